@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+
+// Read-only run of elements owned by someone else: a vector, or an array inside a mapped file.
+// Stages that only read geometry take one of these, so that they run on cached data in place.
+template<class T>
+class ArrayView
+{
+private:
+	const T* first = nullptr;
+	size_t count = 0;
+
+public:
+	ArrayView() = default;
+	ArrayView(const T* data, size_t size) : first(data), count(size) {}
+	ArrayView(const std::vector<T>& data) : first(data.data()), count(data.size()) {}
+
+	const T* data() const { return first; }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	const T& operator[](size_t i) const { return first[i]; }
+	const T* begin() const { return first; }
+	const T* end() const { return first + count; }
+};
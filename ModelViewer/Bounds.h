@@ -0,0 +1,148 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include <vector>
+
+struct Bounds
+{
+	XMFLOAT3 boxMin;
+	XMFLOAT3 boxMax;
+	XMFLOAT3 center;
+	float radius;
+
+	Bounds()
+	{
+		boxMin = {1e30f, 1e30f, 1e30f};
+		boxMax = {-1e30f, -1e30f, -1e30f};
+		center = {0, 0, 0};
+		radius = 0;
+	}
+
+	bool Empty() const { return boxMin.x > boxMax.x; }
+
+	XMFLOAT3 Extent() const
+	{
+		if(Empty()) return {0, 0, 0};
+		return {boxMax.x - boxMin.x, boxMax.y - boxMin.y, boxMax.z - boxMin.z};
+	}
+
+	// Fills meshBounds with the box and sphere of every mesh range and returns the bounds of the whole
+	// model. Work is split into chunks that never cross a mesh, each chunk reduces into its own slot and
+	// the slots are merged serially, so the result does not depend on thread timing.
+	static Bounds Compute(const std::vector<Vertex>& vertices, const std::vector<MeshRange>& meshRanges, std::vector<Bounds>& meshBounds)
+	{
+		struct Chunk
+		{
+			int mesh;
+			UINT begin, end;
+			XMFLOAT3 boxMin, boxMax;
+			float radiusSq;
+		};
+
+		std::vector<Chunk> chunks;
+		for(int i = 0; i < (int)meshRanges.size(); ++i)
+		{
+			const MeshRange& range = meshRanges[i];
+			for(UINT begin = 0; begin < range.vertexCount; begin += chunkSize)
+				chunks.push_back({i, range.baseVertex + begin, range.baseVertex + min(begin + chunkSize, range.vertexCount)});
+		}
+		int chunkCount = chunks.size();
+
+#pragma omp parallel for schedule(dynamic)
+		for(int c = 0; c < chunkCount; ++c)
+		{
+			XMVECTOR lo[4], hi[4];
+			for(int k = 0; k < 4; ++k) lo[k] = XMVectorReplicate(1e30f), hi[k] = XMVectorReplicate(-1e30f);
+
+			UINT i = chunks[c].begin;
+			for(; i + 4 <= chunks[c].end; i += 4)
+				for(int k = 0; k < 4; ++k)
+				{
+					XMVECTOR p = XMLoadFloat3(&vertices[i + k].position);
+					lo[k] = XMVectorMin(lo[k], p);
+					hi[k] = XMVectorMax(hi[k], p);
+				}
+			for(; i < chunks[c].end; ++i)
+			{
+				XMVECTOR p = XMLoadFloat3(&vertices[i].position);
+				lo[0] = XMVectorMin(lo[0], p);
+				hi[0] = XMVectorMax(hi[0], p);
+			}
+
+			XMStoreFloat3(&chunks[c].boxMin, XMVectorMin(XMVectorMin(lo[0], lo[1]), XMVectorMin(lo[2], lo[3])));
+			XMStoreFloat3(&chunks[c].boxMax, XMVectorMax(XMVectorMax(hi[0], hi[1]), XMVectorMax(hi[2], hi[3])));
+		}
+
+		meshBounds.assign(meshRanges.size(), Bounds());
+		for(auto& chunk : chunks) meshBounds[chunk.mesh].Merge(chunk.boxMin, chunk.boxMax);
+		for(auto& bounds : meshBounds)
+			if(!bounds.Empty())
+				XMStoreFloat3(&bounds.center, (XMLoadFloat3(&bounds.boxMin) + XMLoadFloat3(&bounds.boxMax)) * 0.5f);
+
+		// The sphere is centered on the box; its radius is the farthest vertex from that center.
+#pragma omp parallel for schedule(dynamic)
+		for(int c = 0; c < chunkCount; ++c)
+		{
+			XMVECTOR center = XMLoadFloat3(&meshBounds[chunks[c].mesh].center);
+			XMVECTOR farthest = XMVectorZero();
+			for(UINT i = chunks[c].begin; i < chunks[c].end; ++i)
+				farthest = XMVectorMax(farthest, XMVector3LengthSq(XMLoadFloat3(&vertices[i].position) - center));
+			chunks[c].radiusSq = XMVectorGetX(farthest);
+		}
+
+		for(auto& chunk : chunks)
+			meshBounds[chunk.mesh].radius = max(meshBounds[chunk.mesh].radius, chunk.radiusSq);
+		for(auto& bounds : meshBounds) bounds.radius = sqrtf(bounds.radius);
+
+		return Union(meshBounds);
+	}
+
+	// Box around all parts; the sphere is centered on the box and encloses the spheres of the parts.
+	static Bounds Union(const std::vector<Bounds>& parts)
+	{
+		Bounds whole;
+		for(auto& bounds : parts)
+			if(!bounds.Empty()) whole.Merge(bounds.boxMin, bounds.boxMax);
+		if(whole.Empty()) return whole;
+
+		XMVECTOR center = (XMLoadFloat3(&whole.boxMin) + XMLoadFloat3(&whole.boxMax)) * 0.5f;
+		XMStoreFloat3(&whole.center, center);
+		for(auto& bounds : parts)
+			if(!bounds.Empty())
+				whole.radius = max(whole.radius, XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.center) - center)) + bounds.radius);
+		return whole;
+	}
+
+	// Bounds of the transformed box: the center moves with the matrix, the half extent grows by the
+	// absolute values of its linear part. The sphere keeps its center and scales by the largest stretch.
+	Bounds Transformed(const InstanceTransform& transform, float maxScale) const
+	{
+		if(Empty()) return *this;
+
+		XMVECTOR halfExtent = (XMLoadFloat3(&boxMax) - XMLoadFloat3(&boxMin)) * 0.5f;
+		XMVECTOR localCenter = XMVectorSetW(XMLoadFloat3(&center), 1);
+		float c[3], h[3];
+		for(int r = 0; r < 3; ++r)
+		{
+			XMVECTOR row = XMLoadFloat4(&transform.rows[r]);
+			c[r] = XMVectorGetX(XMVector4Dot(row, localCenter));
+			h[r] = XMVectorGetX(XMVector3Dot(XMVectorAbs(row), halfExtent));
+		}
+
+		Bounds result;
+		result.boxMin = {c[0] - h[0], c[1] - h[1], c[2] - h[2]};
+		result.boxMax = {c[0] + h[0], c[1] + h[1], c[2] + h[2]};
+		result.center = {c[0], c[1], c[2]};
+		result.radius = radius * maxScale;
+		return result;
+	}
+
+private:
+	static constexpr UINT chunkSize = 1 << 16;
+
+	void Merge(const XMFLOAT3& otherMin, const XMFLOAT3& otherMax)
+	{
+		XMStoreFloat3(&boxMin, XMVectorMin(XMLoadFloat3(&boxMin), XMLoadFloat3(&otherMin)));
+		XMStoreFloat3(&boxMax, XMVectorMax(XMLoadFloat3(&boxMax), XMLoadFloat3(&otherMax)));
+	}
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "DirectX-std.h"
+#include "MathHelper.h"
 
 class Renderer;
 
@@ -17,6 +18,9 @@ public:
 	static constexpr double rotateX    = 1.7;
 	static constexpr double rotateY    = 0.7;
 	static constexpr double scale      = -0.5;
+	static constexpr float fovY        = 0.25f * XM_PI;
+	static constexpr float nearZ       = 1.0f;
+	static constexpr float farZ        = 1000000.0f;
 
 
 public:
@@ -29,16 +33,16 @@ public:
 		up = XMVectorSet(0, 1, 0, 0);
 	}
 
-	XMMATRIX getViewMatrix()
+	XMMATRIX getViewMatrix() const
 	{
 		XMVECTOR eyePos{radius * cos(phi) * cos(theta), radius * sin(phi), radius * cos(phi) * sin(theta)};
 		eyePos = origin - eyePos;
 		return XMMatrixLookAtLH(eyePos, origin, up);
 	}
 
-	XMMATRIX getProjectMatrix()
+	XMMATRIX getProjectMatrix() const
 	{
-		return XMMatrixPerspectiveFovLH(0.25 * PI, aspectRatio, 1.0f, 1000000.0f);
+		return XMMatrixPerspectiveFovLH(fovY, aspectRatio, nearZ, farZ);
 	}
 
 	void Scale(double offset)
@@ -67,7 +71,7 @@ public:
 		origin += right * xoffset * transformX * transformCommon;
 	}
 
-	XMVECTOR getCameraPos()
+	XMVECTOR getCameraPos() const
 	{
 		XMVECTOR eyePos{radius * cos(phi) * cos(theta), radius * sin(phi), radius * cos(phi) * sin(theta)};
 		eyePos = origin - eyePos;
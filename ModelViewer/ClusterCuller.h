@@ -0,0 +1,103 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include "MeshletBuilder.h"
+#include <vector>
+#include <xmmintrin.h>
+
+// Rejects meshlets whose bounding sphere is outside the view frustum or whose normal cone faces away
+// from the eye. Eye and matrix are in the space the bounds were built in, i.e. model space.
+class ClusterCuller
+{
+public:
+	// Clip planes of a row-vector matrix, normalized so that plane distances are in model units.
+	static void ExtractPlanes(FXMMATRIX matrix, XMFLOAT4 planes[6])
+	{
+		XMMATRIX columns = XMMatrixTranspose(matrix);
+		XMVECTOR clip[6] = {
+			columns.r[3] + columns.r[0], columns.r[3] - columns.r[0],
+			columns.r[3] + columns.r[1], columns.r[3] - columns.r[1],
+			columns.r[2], columns.r[3] - columns.r[2] };
+		for(int p = 0; p < 6; ++p) XMStoreFloat4(&planes[p], XMPlaneNormalize(clip[p]));
+	}
+
+	// SSE path, four clusters per step. Returns the number of visible clusters.
+	static UINT Cull(const ClusterBounds& bounds, FXMVECTOR eye, CXMMATRIX modelViewProjection, std::vector<BYTE>& visible)
+	{
+		XMFLOAT4 planes[6];
+		ExtractPlanes(modelViewProjection, planes);
+		__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+		for(int p = 0; p < 6; ++p)
+		{
+			planeX[p] = _mm_set1_ps(planes[p].x);
+			planeY[p] = _mm_set1_ps(planes[p].y);
+			planeZ[p] = _mm_set1_ps(planes[p].z);
+			planeW[p] = _mm_set1_ps(planes[p].w);
+		}
+		__m128 eyeX = _mm_set1_ps(XMVectorGetX(eye)), eyeY = _mm_set1_ps(XMVectorGetY(eye)), eyeZ = _mm_set1_ps(XMVectorGetZ(eye));
+		__m128 zero = _mm_setzero_ps();
+
+		visible.resize(bounds.count);
+		UINT visibleCount = 0;
+		for(UINT i = 0; i < bounds.count; i += 4)
+		{
+			__m128 cx = _mm_loadu_ps(&bounds.centerX[i]);
+			__m128 cy = _mm_loadu_ps(&bounds.centerY[i]);
+			__m128 cz = _mm_loadu_ps(&bounds.centerZ[i]);
+			__m128 r = _mm_loadu_ps(&bounds.radius[i]);
+
+			__m128 rejected = zero;
+			__m128 negativeRadius = _mm_sub_ps(zero, r);
+			for(int p = 0; p < 6; ++p)
+			{
+				__m128 distance = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(cx, planeX[p]), _mm_mul_ps(cy, planeY[p])),
+					_mm_add_ps(_mm_mul_ps(cz, planeZ[p]), planeW[p]));
+				rejected = _mm_or_ps(rejected, _mm_cmplt_ps(distance, negativeRadius));
+			}
+
+			__m128 dx = _mm_sub_ps(cx, eyeX), dy = _mm_sub_ps(cy, eyeY), dz = _mm_sub_ps(cz, eyeZ);
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+			__m128 facing = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&bounds.axisX[i])), _mm_mul_ps(dy, _mm_loadu_ps(&bounds.axisY[i]))),
+				_mm_mul_ps(dz, _mm_loadu_ps(&bounds.axisZ[i])));
+			__m128 limit = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&bounds.cutoff[i]), length), r);
+			rejected = _mm_or_ps(rejected, _mm_cmpge_ps(facing, limit));
+
+			int mask = ~_mm_movemask_ps(rejected);
+			for(UINT k = 0; k < 4 && i + k < bounds.count; ++k)
+			{
+				visible[i + k] = (mask >> k) & 1;
+				visibleCount += visible[i + k];
+			}
+		}
+		return visibleCount;
+	}
+
+	// Reference path with the same tests, one cluster at a time.
+	static UINT CullScalar(const ClusterBounds& bounds, FXMVECTOR eye, CXMMATRIX modelViewProjection, std::vector<BYTE>& visible)
+	{
+		XMFLOAT4 planes[6];
+		ExtractPlanes(modelViewProjection, planes);
+		XMFLOAT3 e;
+		XMStoreFloat3(&e, eye);
+
+		visible.resize(bounds.count);
+		UINT visibleCount = 0;
+		for(UINT i = 0; i < bounds.count; ++i)
+		{
+			float cx = bounds.centerX[i], cy = bounds.centerY[i], cz = bounds.centerZ[i], r = bounds.radius[i];
+			bool rejected = false;
+			for(int p = 0; p < 6; ++p)
+				rejected |= cx * planes[p].x + cy * planes[p].y + cz * planes[p].z + planes[p].w < -r;
+
+			float dx = cx - e.x, dy = cy - e.y, dz = cz - e.z;
+			float length = sqrtf(dx * dx + dy * dy + dz * dz);
+			rejected |= dx * bounds.axisX[i] + dy * bounds.axisY[i] + dz * bounds.axisZ[i] >= bounds.cutoff[i] * length + r;
+
+			visible[i] = !rejected;
+			visibleCount += visible[i];
+		}
+		return visibleCount;
+	}
+};
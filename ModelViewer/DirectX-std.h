@@ -40,4 +40,23 @@ struct Vertex
 	XMFLOAT3 position;
 	XMFLOAT3 normal;
 	XMFLOAT3 color;
-};
\ No newline at end of file
+};
+
+struct MeshRange
+{
+	UINT baseVertex;
+	UINT vertexCount;
+	UINT firstIndex;
+	UINT indexCount;
+	UINT firstLineIndex;
+	UINT lineIndexCount;
+	UINT faceSize;
+	UINT hasColors;
+	// Set when no vertex is shared by two source polygons, as Assimp gives them without welding.
+	UINT cornerVertices;
+};
+// Rows of an affine world matrix in column-vector form: p' = (dot(rows[0], p), dot(rows[1], p), dot(rows[2], p)).
+struct InstanceTransform
+{
+	XMFLOAT4 rows[3];
+};
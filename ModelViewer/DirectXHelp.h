@@ -1,6 +1,7 @@
 #pragma once
 
 #include "DirectX-std.h"
+#include <functional>
 
 class DirectXHelp
 {
@@ -10,6 +11,17 @@ public:
     ComPtr<ID3D12GraphicsCommandList> cmdList,
     const void* initData,
     UINT64 byteSize,
+    Microsoft::WRL::ComPtr<ID3D12Resource>& uploadBuffer)
+	{
+		return CreateDefaultBuffer(device, cmdList, byteSize, [&](void* mapped) { memcpy(mapped, initData, byteSize); }, uploadBuffer);
+	}
+
+	// For data that is not in one array: fill writes all byteSize bytes into the mapped upload heap.
+	static ComPtr<ID3D12Resource> CreateDefaultBuffer(
+    ComPtr<ID3D12Device4> device,
+    ComPtr<ID3D12GraphicsCommandList> cmdList,
+    UINT64 byteSize,
+    const std::function<void(void*)>& fill,
     Microsoft::WRL::ComPtr<ID3D12Resource>& uploadBuffer)
 	{
 		ComPtr<ID3D12Resource> defaultBuffer;
@@ -30,14 +42,14 @@ public:
         nullptr,
         IID_PPV_ARGS(uploadBuffer.GetAddressOf())));
 
-		D3D12_SUBRESOURCE_DATA subResourceData = {};
-		subResourceData.pData = initData;
-		subResourceData.RowPitch = byteSize;
-		subResourceData.SlicePitch = subResourceData.RowPitch;
+		void* mapped = nullptr;
+		THROW_IF_FAILED(uploadBuffer->Map(0, &CD3DX12_RANGE(0, 0), &mapped));
+		fill(mapped);
+		uploadBuffer->Unmap(0, nullptr);
 
 		cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
         D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST));
-		UpdateSubresources<1>(cmdList.Get(), defaultBuffer.Get(), uploadBuffer.Get(), 0, 0, 1, &subResourceData);
+		cmdList->CopyBufferRegion(defaultBuffer.Get(), 0, uploadBuffer.Get(), 0, byteSize);
 		cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
         D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ));
 
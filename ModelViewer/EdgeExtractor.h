@@ -0,0 +1,342 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include "ArrayView.h"
+#include <vector>
+#include <algorithm>
+#include <cstring>
+
+struct EdgeStats
+{
+	// Face edges before deduplication, and the triangulation diagonals left out of the rest.
+	UINT faceEdges = 0;
+	UINT diagonals = 0;
+};
+
+class EdgeExtractor
+{
+private:
+	static constexpr UINT chunkSize = 1 << 16;
+	static constexpr int partitionBits = 8;
+	static constexpr int partitionCount = 1 << partitionBits;
+	static constexpr UINT32 empty = 0xffffffff;
+
+	struct Chunk
+	{
+		int mesh;
+		UINT begin, end;
+	};
+
+	struct Entry
+	{
+		UINT64 key;
+		UINT first, second;
+		UINT count;
+	};
+
+public:
+	// Rebuilds lineIndices so that every undirected edge of every mesh appears once, in first-use order.
+	// Assimp gives every polygon corner its own vertex, so vertices are first welded by position within
+	// their mesh and edges are hashed by welded id; meshes never share an edge and the whole model is one
+	// pass. With dropDiagonals, an edge of a mesh with cornerVertices whose only two faces also share its
+	// two vertices lies inside one source polygon, so it is a triangulation diagonal and skipped. This
+	// does not depend on the order of the faces, which the optimizer and the meshlet builder change.
+	static EdgeStats Extract(
+		ArrayView<Vertex> vertices,
+		const std::vector<UINT32>& indices,
+		std::vector<MeshRange>& meshRanges,
+		std::vector<UINT32>& lineIndices,
+		bool dropDiagonals = false)
+	{
+		std::vector<Chunk> chunks;
+		for(int i = 0; i < (int)meshRanges.size(); ++i)
+		{
+			const MeshRange& range = meshRanges[i];
+			for(UINT begin = 0; begin < range.indexCount; begin += chunkSize)
+				chunks.push_back({i, range.firstIndex + begin, range.firstIndex + min(begin + chunkSize, range.indexCount)});
+		}
+		int chunkCount = chunks.size();
+
+		// Welded ids in place of the indices, so that the passes below read them in order.
+		std::vector<UINT32> welded;
+		{
+			std::vector<UINT32> weld;
+			Weld(vertices, meshRanges, weld);
+			welded.resize(indices.size());
+#pragma omp parallel for schedule(dynamic)
+			for(int c = 0; c < chunkCount; ++c)
+			{
+				UINT base = meshRanges[chunks[c].mesh].baseVertex;
+				for(UINT p = chunks[c].begin; p < chunks[c].end; ++p) welded[p] = weld[base + indices[p]];
+			}
+		}
+
+		std::vector<UINT> partitionStart;
+		std::vector<UINT32> buckets;
+		Partition(chunks, partitionStart, buckets, [&](const Chunk& chunk, UINT p, UINT64& hash) {
+			UINT64 key;
+			if(!EdgeKey(welded, meshRanges[chunk.mesh], p, key)) return false;
+			hash = Hash(key);
+			return true;
+		});
+
+		// Every partition is deduplicated by one thread; its bucket is in index order, so the first
+		// occurrence wins exactly as in a serial scan.
+		std::vector<BYTE> keep(indices.size(), 0);
+		UINT diagonals = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+ : diagonals)
+		for(int k = 0; k < partitionCount; ++k)
+		{
+			UINT begin = partitionStart[k], end = partitionStart[k + 1];
+			if(begin == end) continue;
+
+			UINT tableSize = 1;
+			while(tableSize < (end - begin) * 2) tableSize <<= 1;
+			std::vector<Entry> table(tableSize, Entry{0, 0, 0, 0});
+
+			for(UINT i = begin; i < end; ++i)
+			{
+				UINT p = buckets[i];
+				UINT64 key = 0;
+				EdgeKey(welded, FindRange(meshRanges, p), p, key);
+
+				UINT slot = Hash(key) & (tableSize - 1);
+				while(table[slot].count != 0 && table[slot].key != key) slot = (slot + 1) & (tableSize - 1);
+
+				Entry& entry = table[slot];
+				if(entry.count == 0)
+				{
+					entry = {key, p, 0, 1};
+					keep[p] = 1;
+				}
+				else
+				{
+					if(entry.count == 1) entry.second = p;
+					++entry.count;
+				}
+			}
+
+			if(!dropDiagonals) continue;
+			for(auto& entry : table)
+				if(entry.count == 2 && IsDiagonal(indices, FindRange(meshRanges, entry.first), entry.first, entry.second))
+				{
+					keep[entry.first] = 0;
+					++diagonals;
+				}
+		}
+		EdgeStats stats;
+		stats.faceEdges = buckets.size();
+		stats.diagonals = diagonals;
+		std::vector<UINT32>().swap(buckets);
+		std::vector<UINT32>().swap(welded);
+
+		// Compact the surviving edges back into per-mesh slices.
+		std::vector<UINT> chunkStart(chunkCount + 1, 0);
+#pragma omp parallel for schedule(dynamic)
+		for(int c = 0; c < chunkCount; ++c)
+		{
+			UINT count = 0;
+			for(UINT p = chunks[c].begin; p < chunks[c].end; ++p) count += keep[p];
+			chunkStart[c + 1] = count;
+		}
+		for(int c = 0; c < chunkCount; ++c) chunkStart[c + 1] += chunkStart[c];
+
+		for(int i = 0, c = 0; i < (int)meshRanges.size(); ++i)
+		{
+			UINT first = chunkStart[c];
+			while(c < chunkCount && chunks[c].mesh == i) ++c;
+			meshRanges[i].firstLineIndex = first * 2;
+			meshRanges[i].lineIndexCount = (chunkStart[c] - first) * 2;
+		}
+
+		lineIndices.resize((size_t)chunkStart[chunkCount] * 2);
+		lineIndices.shrink_to_fit();
+#pragma omp parallel for schedule(dynamic)
+		for(int c = 0; c < chunkCount; ++c)
+		{
+			const MeshRange& range = meshRanges[chunks[c].mesh];
+			UINT32* out = lineIndices.data() + (size_t)chunkStart[c] * 2;
+			for(UINT p = chunks[c].begin; p < chunks[c].end; ++p)
+			{
+				if(!keep[p]) continue;
+				GetEdge(indices, range, p, out[0], out[1]);
+				out += 2;
+			}
+		}
+
+		return stats;
+	}
+
+private:
+	// Splits the items of every chunk into partitions by the top bits of their hash, in parallel: each
+	// chunk counts its items per partition, then every (partition, chunk) pair fills its own slice. Items
+	// hashOf rejects are left out, and every partition lists its items in ascending order.
+	template<class HashOf>
+	static void Partition(const std::vector<Chunk>& chunks, std::vector<UINT>& partitionStart, std::vector<UINT32>& buckets, HashOf hashOf)
+	{
+		int chunkCount = chunks.size();
+		std::vector<UINT> offsets((size_t)chunkCount * partitionCount, 0);
+#pragma omp parallel for schedule(dynamic)
+		for(int c = 0; c < chunkCount; ++c)
+		{
+			UINT* counts = offsets.data() + (size_t)c * partitionCount;
+			UINT64 hash;
+			for(UINT p = chunks[c].begin; p < chunks[c].end; ++p)
+				if(hashOf(chunks[c], p, hash)) ++counts[hash >> (64 - partitionBits)];
+		}
+
+		partitionStart.resize(partitionCount + 1);
+		UINT total = 0;
+		for(int k = 0; k < partitionCount; ++k)
+		{
+			partitionStart[k] = total;
+			for(int c = 0; c < chunkCount; ++c)
+			{
+				UINT count = offsets[(size_t)c * partitionCount + k];
+				offsets[(size_t)c * partitionCount + k] = total;
+				total += count;
+			}
+		}
+		partitionStart[partitionCount] = total;
+
+		buckets.resize(total);
+#pragma omp parallel for schedule(dynamic)
+		for(int c = 0; c < chunkCount; ++c)
+		{
+			UINT* cursor = offsets.data() + (size_t)c * partitionCount;
+			UINT64 hash;
+			for(UINT p = chunks[c].begin; p < chunks[c].end; ++p)
+				if(hashOf(chunks[c], p, hash)) buckets[cursor[hash >> (64 - partitionBits)]++] = p;
+		}
+	}
+
+	// weld[v] is the first vertex of v's mesh at exactly v's position; ids stay global, so they never
+	// match across meshes.
+	static void Weld(ArrayView<Vertex> vertices, const std::vector<MeshRange>& meshRanges, std::vector<UINT32>& weld)
+	{
+		std::vector<Chunk> chunks;
+		for(int i = 0; i < (int)meshRanges.size(); ++i)
+		{
+			const MeshRange& range = meshRanges[i];
+			for(UINT begin = 0; begin < range.vertexCount; begin += chunkSize)
+				chunks.push_back({i, range.baseVertex + begin, range.baseVertex + min(begin + chunkSize, range.vertexCount)});
+		}
+
+		// Every position is hashed once, with its mesh; probes compare hashes before positions.
+		std::vector<UINT64> hashes(vertices.size());
+		int chunkCount = chunks.size();
+#pragma omp parallel for schedule(dynamic)
+		for(int c = 0; c < chunkCount; ++c)
+			for(UINT v = chunks[c].begin; v < chunks[c].end; ++v) hashes[v] = PositionHash(vertices[v].position, chunks[c].mesh);
+
+		std::vector<UINT> partitionStart;
+		std::vector<UINT32> buckets;
+		Partition(chunks, partitionStart, buckets, [&](const Chunk&, UINT v, UINT64& hash) {
+			hash = hashes[v];
+			return true;
+		});
+
+		struct Slot
+		{
+			UINT64 hash;
+			UINT32 vertex;
+		};
+		weld.resize(vertices.size());
+		for(UINT v = 0; v < weld.size(); ++v) weld[v] = v;
+#pragma omp parallel for schedule(dynamic)
+		for(int k = 0; k < partitionCount; ++k)
+		{
+			UINT begin = partitionStart[k], end = partitionStart[k + 1];
+			if(begin == end) continue;
+
+			UINT tableSize = 1;
+			while(tableSize < (end - begin) * 2) tableSize <<= 1;
+			std::vector<Slot> table(tableSize, Slot{0, empty});
+			for(UINT i = begin; i < end; ++i)
+			{
+				UINT32 v = buckets[i];
+				UINT64 hash = hashes[v];
+				UINT slot = hash & (tableSize - 1);
+				while(table[slot].vertex != empty && (table[slot].hash != hash || !SameMeshPosition(vertices, meshRanges, table[slot].vertex, v)))
+					slot = (slot + 1) & (tableSize - 1);
+				if(table[slot].vertex == empty) table[slot] = {hash, v};
+				weld[v] = table[slot].vertex;
+			}
+		}
+	}
+
+	static bool SameMeshPosition(ArrayView<Vertex> vertices, const std::vector<MeshRange>& meshRanges, UINT32 u, UINT32 v)
+	{
+		return memcmp(&vertices[u].position, &vertices[v].position, sizeof(XMFLOAT3)) == 0 && &FindMesh(meshRanges, u) == &FindMesh(meshRanges, v);
+	}
+
+	// The edge that starts at index position p, if any: triangles own three edges, lines one.
+	static bool GetEdge(const std::vector<UINT32>& indices, const MeshRange& range, UINT p, UINT32& a, UINT32& b)
+	{
+		UINT local = p - range.firstIndex;
+		if(range.faceSize == 3)
+		{
+			UINT corner = local % 3;
+			a = indices[p];
+			b = indices[p - corner + (corner + 1) % 3];
+		}
+		else if(range.faceSize == 2 && local % 2 == 0)
+		{
+			a = indices[p];
+			b = indices[p + 1];
+		}
+		else return false;
+		return a != b;
+	}
+
+	// The undirected edge at p by welded ids; edges whose ends weld together have none.
+	static bool EdgeKey(const std::vector<UINT32>& welded, const MeshRange& range, UINT p, UINT64& key)
+	{
+		UINT32 a, b;
+		if(!GetEdge(welded, range, p, a, b)) return false;
+		UINT64 u = a, v = b;
+		key = u < v ? (u << 32) | v : (v << 32) | u;
+		return true;
+	}
+
+	static UINT64 Hash(UINT64 key)
+	{
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdULL;
+		key ^= key >> 33;
+		key *= 0xc4ceb9fe1a85ec53ULL;
+		key ^= key >> 33;
+		return key;
+	}
+
+	static UINT64 PositionHash(const XMFLOAT3& position, size_t mesh)
+	{
+		UINT32 bits[3];
+		memcpy(bits, &position, sizeof(bits));
+		return Hash(((UINT64)bits[0] << 32 | bits[1]) ^ Hash((UINT64)bits[2] << 32 | (UINT32)mesh));
+	}
+
+	static const MeshRange& FindRange(const std::vector<MeshRange>& meshRanges, UINT p)
+	{
+		auto it = std::upper_bound(meshRanges.begin(), meshRanges.end(), p,
+			[](UINT p, const MeshRange& range) { return p < range.firstIndex; });
+		return *(it - 1);
+	}
+
+	static const MeshRange& FindMesh(const std::vector<MeshRange>& meshRanges, UINT v)
+	{
+		auto it = std::upper_bound(meshRanges.begin(), meshRanges.end(), v,
+			[](UINT v, const MeshRange& range) { return v < range.baseVertex; });
+		return *(it - 1);
+	}
+
+	// Two faces of a mesh with cornerVertices that use the same two vertices belong to one source polygon.
+	static bool IsDiagonal(const std::vector<UINT32>& indices, const MeshRange& range, UINT p, UINT q)
+	{
+		if(range.faceSize != 3 || !range.cornerVertices) return false;
+		UINT32 a, b, c, d;
+		GetEdge(indices, range, p, a, b);
+		GetEdge(indices, range, q, c, d);
+		return (a == c && b == d) || (a == d && b == c);
+	}
+};
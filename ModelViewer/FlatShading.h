@@ -0,0 +1,192 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include "ArrayView.h"
+#include <vector>
+
+// Flat shading without tripling vertices: the pixel shader reads the normal with nointerpolation, so
+// only the leading vertex of each triangle has to carry the face normal. Triangles are rotated so that
+// the leading vertex is one whose normal already matches, or one that is still free; a vertex is only
+// duplicated when all three corners are taken by a different normal.
+class FlatShading
+{
+private:
+	static constexpr UINT chunkSize = 1 << 16;
+	static constexpr UINT unassigned = 0xffffffff;
+	static constexpr float sameNormal = 0.99999f;
+
+	struct Chunk
+	{
+		int mesh;
+		UINT begin, end;
+	};
+
+	struct Split
+	{
+		UINT32 vertex;
+		UINT32 face;
+	};
+
+public:
+	static void Build(
+		ArrayView<Vertex> vertices,
+		const std::vector<UINT32>& indices,
+		const std::vector<MeshRange>& meshRanges,
+		std::vector<Vertex>& flatVertices,
+		std::vector<UINT32>& flatIndices,
+		std::vector<MeshRange>& flatRanges)
+	{
+		int meshCount = meshRanges.size();
+		std::vector<UINT> faceOffset(meshCount + 1, 0);
+		std::vector<Chunk> chunks;
+		for(int i = 0; i < meshCount; ++i)
+		{
+			UINT faceCount = meshRanges[i].faceSize == 3 ? meshRanges[i].indexCount / 3 : 0;
+			faceOffset[i + 1] = faceOffset[i] + faceCount;
+			for(UINT begin = 0; begin < faceCount; begin += chunkSize)
+				chunks.push_back({i, begin, min(begin + chunkSize, faceCount)});
+		}
+
+		std::vector<XMFLOAT3> faceNormals(faceOffset[meshCount]);
+#pragma omp parallel for schedule(dynamic)
+		for(int c = 0; c < (int)chunks.size(); ++c)
+		{
+			const MeshRange& range = meshRanges[chunks[c].mesh];
+			ComputeFaceNormals(
+				vertices.data() + range.baseVertex,
+				indices.data() + range.firstIndex + chunks[c].begin * 3,
+				chunks[c].end - chunks[c].begin,
+				faceNormals.data() + faceOffset[chunks[c].mesh] + chunks[c].begin);
+		}
+
+		// Pick the leading vertex of every triangle; the claim order is per mesh, so meshes run in parallel.
+		flatIndices.resize(indices.size());
+		std::vector<std::vector<UINT32>> owners(meshCount);
+		std::vector<std::vector<Split>> splits(meshCount);
+#pragma omp parallel for schedule(dynamic)
+		for(int i = 0; i < meshCount; ++i)
+		{
+			const MeshRange& range = meshRanges[i];
+			if(range.faceSize != 3) continue;
+
+			const XMFLOAT3* normals = faceNormals.data() + faceOffset[i];
+			std::vector<UINT32>& owner = owners[i];
+			owner.assign(range.vertexCount, unassigned);
+
+			for(UINT face = 0, faceCount = faceOffset[i + 1] - faceOffset[i]; face < faceCount; ++face)
+			{
+				const UINT32* corners = indices.data() + range.firstIndex + face * 3;
+				UINT32* out = flatIndices.data() + range.firstIndex + face * 3;
+				XMVECTOR normal = XMLoadFloat3(&normals[face]);
+				bool degenerate = XMVectorGetX(XMVector3LengthSq(normal)) == 0;
+
+				int lead = -1;
+				for(int k = 0; k < 3 && lead < 0; ++k)
+				{
+					UINT32 other = owner[corners[k]];
+					if(degenerate || (other != unassigned &&
+						XMVectorGetX(XMVector3Dot(normal, XMLoadFloat3(&normals[other]))) > sameNormal)) lead = k;
+				}
+				for(int k = 0; k < 3 && lead < 0; ++k)
+					if(owner[corners[k]] == unassigned)
+					{
+						owner[corners[k]] = face;
+						lead = k;
+					}
+
+				if(lead < 0)
+				{
+					out[0] = range.vertexCount + splits[i].size();
+					splits[i].push_back({corners[0], face});
+					out[1] = corners[1];
+					out[2] = corners[2];
+				}
+				else
+				{
+					out[0] = corners[lead];
+					out[1] = corners[(lead + 1) % 3];
+					out[2] = corners[(lead + 2) % 3];
+				}
+			}
+		}
+
+		flatRanges = meshRanges;
+		UINT flatVertexCount = 0;
+		for(int i = 0; i < meshCount; ++i)
+		{
+			MeshRange& range = flatRanges[i];
+			if(range.faceSize != 3) range.indexCount = 0;
+			range.baseVertex = flatVertexCount;
+			range.vertexCount += splits[i].size();
+			flatVertexCount += range.vertexCount;
+		}
+
+		flatVertices.resize(flatVertexCount);
+#pragma omp parallel for schedule(dynamic)
+		for(int i = 0; i < meshCount; ++i)
+		{
+			const MeshRange& range = meshRanges[i];
+			const XMFLOAT3* normals = faceNormals.data() + faceOffset[i];
+			Vertex* out = flatVertices.data() + flatRanges[i].baseVertex;
+
+			for(UINT v = 0; v < range.vertexCount; ++v)
+			{
+				out[v] = vertices[range.baseVertex + v];
+				if(!owners[i].empty() && owners[i][v] != unassigned) out[v].normal = normals[owners[i][v]];
+			}
+			for(UINT s = 0; s < splits[i].size(); ++s)
+			{
+				out[range.vertexCount + s] = vertices[range.baseVertex + splits[i][s].vertex];
+				out[range.vertexCount + s].normal = normals[splits[i][s].face];
+			}
+		}
+	}
+
+	// Unit face normals (p2 - p1) x (p3 - p1), four triangles per step in SoA form.
+	static void ComputeFaceNormals(const Vertex* vertices, const UINT32* indices, UINT faceCount, XMFLOAT3* normals)
+	{
+		UINT face = 0;
+		for(; face + 4 <= faceCount; face += 4)
+		{
+			XMVECTOR x[3], y[3], z[3];
+			for(int k = 0; k < 3; ++k)
+			{
+				const XMFLOAT3& a = vertices[indices[(face + 0) * 3 + k]].position;
+				const XMFLOAT3& b = vertices[indices[(face + 1) * 3 + k]].position;
+				const XMFLOAT3& c = vertices[indices[(face + 2) * 3 + k]].position;
+				const XMFLOAT3& d = vertices[indices[(face + 3) * 3 + k]].position;
+				x[k] = XMVectorSet(a.x, b.x, c.x, d.x);
+				y[k] = XMVectorSet(a.y, b.y, c.y, d.y);
+				z[k] = XMVectorSet(a.z, b.z, c.z, d.z);
+			}
+
+			XMVECTOR ux = x[1] - x[0], uy = y[1] - y[0], uz = z[1] - z[0];
+			XMVECTOR vx = x[2] - x[0], vy = y[2] - y[0], vz = z[2] - z[0];
+			XMVECTOR nx = XMVectorNegativeMultiplySubtract(uz, vy, uy * vz);
+			XMVECTOR ny = XMVectorNegativeMultiplySubtract(ux, vz, uz * vx);
+			XMVECTOR nz = XMVectorNegativeMultiplySubtract(uy, vx, ux * vy);
+
+			XMVECTOR length = XMVectorSqrt(XMVectorMultiplyAdd(nx, nx, XMVectorMultiplyAdd(ny, ny, nz * nz)));
+			XMVECTOR scale = XMVectorSelect(XMVectorZero(), XMVectorReciprocal(length), XMVectorGreater(length, XMVectorZero()));
+
+			XMFLOAT4 rx, ry, rz;
+			XMStoreFloat4(&rx, nx * scale);
+			XMStoreFloat4(&ry, ny * scale);
+			XMStoreFloat4(&rz, nz * scale);
+			normals[face + 0] = {rx.x, ry.x, rz.x};
+			normals[face + 1] = {rx.y, ry.y, rz.y};
+			normals[face + 2] = {rx.z, ry.z, rz.z};
+			normals[face + 3] = {rx.w, ry.w, rz.w};
+		}
+
+		for(; face < faceCount; ++face)
+		{
+			XMVECTOR p1 = XMLoadFloat3(&vertices[indices[face * 3 + 0]].position);
+			XMVECTOR p2 = XMLoadFloat3(&vertices[indices[face * 3 + 1]].position);
+			XMVECTOR p3 = XMLoadFloat3(&vertices[indices[face * 3 + 2]].position);
+			XMVECTOR normal = XMVector3Cross(p2 - p1, p3 - p1);
+			if(XMVectorGetX(XMVector3LengthSq(normal)) > 0) normal = XMVector3Normalize(normal);
+			XMStoreFloat3(&normals[face], normal);
+		}
+	}
+};
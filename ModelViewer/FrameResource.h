@@ -4,6 +4,8 @@
 #include "UploadBuffer.h"
 #include "MathHelper.h"
 #include "DirectXHelp.h"
+#include "GridBuilder.h"
+#include "LightClusterBuilder.h"
 
 using namespace DirectX;
 
@@ -21,17 +23,25 @@ struct PassConstants
     int lightCount;
 	float unused;
 
-    XMFLOAT4 lightPos[8];
-
-    XMFLOAT4 lightColor[8];
+    // tileScale takes pixels to cluster columns and rows; see LightClusterBuilder for the slices.
+    XMFLOAT2 tileScale;
+    float sliceScale;
+    float sliceBias;
 
     XMFLOAT3 camearaPos;
+    UINT clustersX;
+    UINT clustersY;
+    UINT clustersZ;
 };
 
 class FrameResource
 {
 private:
 	std::shared_ptr<UploadBuffer<PassConstants>> passCB = nullptr;
+	std::shared_ptr<UploadBuffer<Vertex>> gridVertices = nullptr;
+	std::shared_ptr<UploadBuffer<PointLight>> lights = nullptr;
+	std::shared_ptr<UploadBuffer<LightCluster>> lightClusters = nullptr;
+	std::shared_ptr<UploadBuffer<UINT>> lightIndices = nullptr;
 	ComPtr<ID3D12CommandAllocator> cmdAlloc;
 
 public:
@@ -44,8 +54,16 @@ public:
 			IID_PPV_ARGS(&cmdAlloc)
 		));
 		passCB = std::make_shared<UploadBuffer<PassConstants>>(device, 1, true);
+		gridVertices = std::make_shared<UploadBuffer<Vertex>>(device, GridBuilder::maxVertices, false);
+		lights = std::make_shared<UploadBuffer<PointLight>>(device, LightClusterBuilder::maxLights, false);
+		lightClusters = std::make_shared<UploadBuffer<LightCluster>>(device, LightClusterBuilder::clusterCount, false);
+		lightIndices = std::make_shared<UploadBuffer<UINT>>(device, LightClusterBuilder::maxLightIndices, false);
 	}
 
 	inline ComPtr<ID3D12CommandAllocator> GetCmdAlloc() { return cmdAlloc; }
 	inline std::shared_ptr<UploadBuffer<PassConstants>> GetPassConstants() { return passCB; }
+	inline std::shared_ptr<UploadBuffer<Vertex>> GetGridVertices() { return gridVertices; }
+	inline std::shared_ptr<UploadBuffer<PointLight>> GetLights() { return lights; }
+	inline std::shared_ptr<UploadBuffer<LightCluster>> GetLightClusters() { return lightClusters; }
+	inline std::shared_ptr<UploadBuffer<UINT>> GetLightIndices() { return lightIndices; }
 };
\ No newline at end of file
@@ -0,0 +1,180 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include "Bounds.h"
+#include "ClusterCuller.h"
+#include <vector>
+#include <intrin.h>
+#include <immintrin.h>
+
+// Axis-aligned boxes as center and half extent in SoA form, padded to a multiple of eight so the culler
+// never needs a tail. Empty boxes get a negative extent, which no frustum accepts.
+struct BoxBounds
+{
+	std::vector<float> centerX, centerY, centerZ, extentX, extentY, extentZ;
+	UINT count = 0;
+
+	void Resize(UINT n)
+	{
+		count = n;
+		UINT padded = (n + 7) & ~7u;
+		for(auto* lane : {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ}) lane->assign(padded, 0);
+	}
+
+	void Set(UINT i, const Bounds& bounds)
+	{
+		if(bounds.Empty())
+		{
+			centerX[i] = centerY[i] = centerZ[i] = 0;
+			extentX[i] = extentY[i] = extentZ[i] = -1e30f;
+			return;
+		}
+		centerX[i] = (bounds.boxMin.x + bounds.boxMax.x) * 0.5f;
+		centerY[i] = (bounds.boxMin.y + bounds.boxMax.y) * 0.5f;
+		centerZ[i] = (bounds.boxMin.z + bounds.boxMax.z) * 0.5f;
+		extentX[i] = (bounds.boxMax.x - bounds.boxMin.x) * 0.5f;
+		extentY[i] = (bounds.boxMax.y - bounds.boxMin.y) * 0.5f;
+		extentZ[i] = (bounds.boxMax.z - bounds.boxMin.z) * 0.5f;
+	}
+
+	size_t Bytes() const
+	{
+		return centerX.capacity() * sizeof(float) * 6;
+	}
+};
+
+// Rejects boxes that lie entirely outside one of the six clip planes: a box is outside a plane when its
+// center's distance plus the box's projected radius, |n.x| ex + |n.y| ey + |n.z| ez, is negative. The
+// test is conservative, so boxes crossing a frustum corner are kept. Eight boxes per step, as one AVX
+// vector when the CPU and OS support it and as two SSE vectors otherwise.
+class FrustumCuller
+{
+public:
+	// Returns the number of visible boxes; matrix takes the boxes' space to clip space.
+	static UINT Cull(const BoxBounds& boxes, CXMMATRIX matrix, std::vector<BYTE>& visible)
+	{
+		static const bool avx = HasAvx();
+		XMFLOAT4 planes[6];
+		ClusterCuller::ExtractPlanes(matrix, planes);
+		visible.resize(boxes.count);
+		return avx ? CullAvx(boxes, planes, visible) : CullSse(boxes, planes, visible);
+	}
+
+	static UINT CullAvx(const BoxBounds& boxes, const XMFLOAT4 planes[6], std::vector<BYTE>& visible)
+	{
+		__m256 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+		for(int p = 0; p < 6; ++p)
+		{
+			planeX[p] = _mm256_set1_ps(planes[p].x);
+			planeY[p] = _mm256_set1_ps(planes[p].y);
+			planeZ[p] = _mm256_set1_ps(planes[p].z);
+			planeW[p] = _mm256_set1_ps(planes[p].w);
+			absX[p] = _mm256_set1_ps(fabsf(planes[p].x));
+			absY[p] = _mm256_set1_ps(fabsf(planes[p].y));
+			absZ[p] = _mm256_set1_ps(fabsf(planes[p].z));
+		}
+		__m256 zero = _mm256_setzero_ps();
+
+		UINT visibleCount = 0;
+		for(UINT i = 0; i < boxes.count; i += 8)
+		{
+			__m256 cx = _mm256_loadu_ps(&boxes.centerX[i]), cy = _mm256_loadu_ps(&boxes.centerY[i]), cz = _mm256_loadu_ps(&boxes.centerZ[i]);
+			__m256 ex = _mm256_loadu_ps(&boxes.extentX[i]), ey = _mm256_loadu_ps(&boxes.extentY[i]), ez = _mm256_loadu_ps(&boxes.extentZ[i]);
+
+			__m256 rejected = zero;
+			for(int p = 0; p < 6; ++p)
+			{
+				__m256 distance = _mm256_add_ps(
+					_mm256_add_ps(_mm256_mul_ps(cx, planeX[p]), _mm256_mul_ps(cy, planeY[p])),
+					_mm256_add_ps(_mm256_mul_ps(cz, planeZ[p]), planeW[p]));
+				__m256 radius = _mm256_add_ps(
+					_mm256_add_ps(_mm256_mul_ps(ex, absX[p]), _mm256_mul_ps(ey, absY[p])), _mm256_mul_ps(ez, absZ[p]));
+				rejected = _mm256_or_ps(rejected, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_LT_OQ));
+			}
+			visibleCount += Store(~_mm256_movemask_ps(rejected), i, boxes.count, visible);
+		}
+		_mm256_zeroupper();
+		return visibleCount;
+	}
+
+	static UINT CullSse(const BoxBounds& boxes, const XMFLOAT4 planes[6], std::vector<BYTE>& visible)
+	{
+		__m128 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+		for(int p = 0; p < 6; ++p)
+		{
+			planeX[p] = _mm_set1_ps(planes[p].x);
+			planeY[p] = _mm_set1_ps(planes[p].y);
+			planeZ[p] = _mm_set1_ps(planes[p].z);
+			planeW[p] = _mm_set1_ps(planes[p].w);
+			absX[p] = _mm_set1_ps(fabsf(planes[p].x));
+			absY[p] = _mm_set1_ps(fabsf(planes[p].y));
+			absZ[p] = _mm_set1_ps(fabsf(planes[p].z));
+		}
+		__m128 zero = _mm_setzero_ps();
+
+		UINT visibleCount = 0;
+		for(UINT i = 0; i < boxes.count; i += 8)
+		{
+			int mask = 0;
+			for(UINT half = 0; half < 8; half += 4)
+			{
+				UINT j = i + half;
+				__m128 cx = _mm_loadu_ps(&boxes.centerX[j]), cy = _mm_loadu_ps(&boxes.centerY[j]), cz = _mm_loadu_ps(&boxes.centerZ[j]);
+				__m128 ex = _mm_loadu_ps(&boxes.extentX[j]), ey = _mm_loadu_ps(&boxes.extentY[j]), ez = _mm_loadu_ps(&boxes.extentZ[j]);
+
+				__m128 rejected = zero;
+				for(int p = 0; p < 6; ++p)
+				{
+					__m128 distance = _mm_add_ps(
+						_mm_add_ps(_mm_mul_ps(cx, planeX[p]), _mm_mul_ps(cy, planeY[p])),
+						_mm_add_ps(_mm_mul_ps(cz, planeZ[p]), planeW[p]));
+					__m128 radius = _mm_add_ps(
+						_mm_add_ps(_mm_mul_ps(ex, absX[p]), _mm_mul_ps(ey, absY[p])), _mm_mul_ps(ez, absZ[p]));
+					rejected = _mm_or_ps(rejected, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+				}
+				mask |= _mm_movemask_ps(rejected) << half;
+			}
+			visibleCount += Store(~mask, i, boxes.count, visible);
+		}
+		return visibleCount;
+	}
+
+	// Reference path with the same test, one box at a time.
+	static UINT CullScalar(const BoxBounds& boxes, const XMFLOAT4 planes[6], std::vector<BYTE>& visible)
+	{
+		UINT visibleCount = 0;
+		for(UINT i = 0; i < boxes.count; ++i)
+		{
+			bool rejected = false;
+			for(int p = 0; p < 6; ++p)
+			{
+				float distance = boxes.centerX[i] * planes[p].x + boxes.centerY[i] * planes[p].y + boxes.centerZ[i] * planes[p].z + planes[p].w;
+				float radius = boxes.extentX[i] * fabsf(planes[p].x) + boxes.extentY[i] * fabsf(planes[p].y) + boxes.extentZ[i] * fabsf(planes[p].z);
+				rejected |= distance + radius < 0;
+			}
+			visible[i] = !rejected;
+			visibleCount += visible[i];
+		}
+		return visibleCount;
+	}
+
+	static bool HasAvx()
+	{
+		int info[4];
+		__cpuid(info, 1);
+		bool osSaves = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+		return osSaves && avx && (_xgetbv(0) & 6) == 6;
+	}
+
+private:
+	static UINT Store(int mask, UINT first, UINT count, std::vector<BYTE>& visible)
+	{
+		UINT visibleCount = 0;
+		for(UINT k = 0; k < 8 && first + k < count; ++k)
+		{
+			visible[first + k] = (mask >> k) & 1;
+			visibleCount += visible[first + k];
+		}
+		return visibleCount;
+	}
+};
@@ -99,5 +99,10 @@ void GDXWidget::ChangeLight(int intensity)
 	renderer->ChangeLightIntensity(intensity);
 }
 
+void GDXWidget::ChangeLightCount(int count)
+{
+	renderer->ChangeLightCount(count);
+}
+
 
 
@@ -32,6 +32,7 @@ public slots:
 	void SwitchFront();
 	void SwitchBack();
 	void ChangeLight(int);
+	void ChangeLightCount(int);
 
 protected:
 	virtual void paintEvent(QPaintEvent* event);
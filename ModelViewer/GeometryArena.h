@@ -0,0 +1,235 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include "IndexStore.h"
+#include <vector>
+#include <map>
+
+struct DrawRange
+{
+	UINT firstIndex;
+	UINT indexCount;
+	UINT baseVertex;
+	DXGI_FORMAT format;
+};
+
+// First-fit allocator over [0, capacity) that only does bookkeeping. Freed blocks are coalesced with
+// their neighbours; when nothing fits, the capacity grows at the end.
+class RangeAllocator
+{
+private:
+	std::map<UINT, UINT> freeBlocks;
+	UINT capacity = 0;
+
+public:
+	UINT Allocate(UINT size, UINT alignment = 1)
+	{
+		for(auto it = freeBlocks.begin(); it != freeBlocks.end(); ++it)
+		{
+			UINT offset = (it->first + alignment - 1) / alignment * alignment;
+			UINT end = it->first + it->second;
+			if(offset + size > end) continue;
+
+			UINT blockStart = it->first;
+			freeBlocks.erase(it);
+			if(offset > blockStart) freeBlocks[blockStart] = offset - blockStart;
+			if(offset + size < end) freeBlocks[offset + size] = end - offset - size;
+			return offset;
+		}
+
+		// Grow, reusing a free block that touches the end.
+		UINT offset = (capacity + alignment - 1) / alignment * alignment;
+		if(!freeBlocks.empty())
+		{
+			auto last = std::prev(freeBlocks.end());
+			if(last->first + last->second == capacity)
+			{
+				offset = (last->first + alignment - 1) / alignment * alignment;
+				UINT lastStart = last->first;
+				freeBlocks.erase(last);
+				if(offset > lastStart) freeBlocks[lastStart] = offset - lastStart;
+			}
+		}
+		if(offset > capacity) freeBlocks[capacity] = offset - capacity;
+		capacity = offset + size;
+		return offset;
+	}
+
+	void Free(UINT offset, UINT size)
+	{
+		if(size == 0) return;
+		auto next = freeBlocks.lower_bound(offset);
+		if(next != freeBlocks.end() && offset + size == next->first)
+		{
+			size += next->second;
+			next = freeBlocks.erase(next);
+		}
+		if(next != freeBlocks.begin())
+		{
+			auto previous = std::prev(next);
+			if(previous->first + previous->second == offset)
+			{
+				previous->second += size;
+				return;
+			}
+		}
+		freeBlocks[offset] = size;
+	}
+
+	UINT Capacity() const { return capacity; }
+
+	UINT FreeSize() const
+	{
+		UINT size = 0;
+		for(auto& block : freeBlocks) size += block.second;
+		return size;
+	}
+};
+
+// CPU side of a model's geometry: all vertices in one buffer and all indices, 16 and 32-bit mixed, in
+// one byte store that the GPU sees as a single buffer with a view per width. Draw ranges are handed out
+// by the allocators, so nothing here needs a device. Vertices are not copied: the arena only remembers
+// where every array goes, and CopyVertices writes them straight into the upload heap.
+class GeometryArena
+{
+public:
+	struct VertexSpan
+	{
+		const Vertex* data;
+		UINT count;
+		UINT offset;
+	};
+
+	std::vector<VertexSpan> vertexSpans;
+	std::vector<BYTE> indexData;
+	RangeAllocator vertexAllocator;
+	RangeAllocator indexAllocator;
+
+	// data has to stay valid until CopyVertices has run.
+	UINT AddVertices(const Vertex* data, UINT count)
+	{
+		UINT offset = vertexAllocator.Allocate(count);
+		if(count > 0) vertexSpans.push_back({data, count, offset});
+		return offset;
+	}
+
+	UINT VertexCount() const { return vertexAllocator.Capacity(); }
+
+	// Fills out, VertexCount() vertices, in blocks of up to 64K vertices in parallel. Free ranges are left
+	// as they are.
+	void CopyVertices(Vertex* out) const
+	{
+		const UINT block = 1 << 16;
+		std::vector<std::pair<int, UINT>> blocks;
+		for(int s = 0; s < (int)vertexSpans.size(); ++s)
+			for(UINT first = 0; first < vertexSpans[s].count; first += block) blocks.push_back({s, first});
+
+#pragma omp parallel for schedule(dynamic)
+		for(int b = 0; b < (int)blocks.size(); ++b)
+		{
+			const VertexSpan& span = vertexSpans[blocks[b].first];
+			UINT first = blocks[b].second;
+			memcpy(out + span.offset + first, span.data + first, min(block, span.count - first) * sizeof(Vertex));
+		}
+	}
+
+	// Adds the indices of every mesh, whose vertices start at vertexBase + meshRanges[i].baseVertex.
+	// Consecutive meshes share one 16-bit range as long as their vertices span at most 65536; meshes too
+	// large for that share 32-bit ranges. Indices are rebased onto the first vertex of their range.
+	// meshDraws, if given, receives the range of every single mesh, so that a subset can be merged later.
+	std::vector<DrawRange> AddMeshes(
+		const IndexStore& store,
+		const std::vector<MeshRange>& meshRanges,
+		UINT vertexBase,
+		std::vector<DrawRange>* meshDraws = nullptr)
+	{
+		struct Placement
+		{
+			UINT offset;
+			UINT width;
+			UINT delta;
+		};
+
+		// Group the meshes and allocate every group serially, then copy all meshes in parallel.
+		int meshCount = meshRanges.size();
+		std::vector<DrawRange> draws;
+		std::vector<Placement> placements(meshCount);
+		if(meshDraws) meshDraws->clear();
+		for(int first = 0; first < meshCount;)
+		{
+			UINT groupBase = meshRanges[first].baseVertex;
+			bool wide = meshRanges[first].vertexCount > 65536;
+			UINT indexCount = 0;
+			int last = first;
+			for(; last < meshCount; ++last)
+			{
+				const MeshRange& range = meshRanges[last];
+				if(wide ? range.vertexCount <= 65536 : range.baseVertex + range.vertexCount - groupBase > 65536) break;
+				indexCount += store.ranges[last].count;
+			}
+
+			UINT width = wide ? 4 : 2;
+			UINT offset = indexCount > 0 ? indexAllocator.Allocate(indexCount * width, 4) : 0;
+			if(indexCount > 0)
+				draws.push_back({offset / width, indexCount, vertexBase + groupBase, wide ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT});
+			for(int i = first; i < last; ++i)
+			{
+				placements[i] = {offset, width, meshRanges[i].baseVertex - groupBase};
+				if(meshDraws)
+					meshDraws->push_back({offset / width, store.ranges[i].count, vertexBase + groupBase, wide ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT});
+				offset += store.ranges[i].count * width;
+			}
+			first = last;
+		}
+		if(indexData.size() < indexAllocator.Capacity()) indexData.resize(indexAllocator.Capacity());
+
+#pragma omp parallel for schedule(dynamic)
+		for(int i = 0; i < meshCount; ++i)
+		{
+			const Placement& placement = placements[i];
+			BYTE* out = indexData.data() + placement.offset;
+			for(UINT k = 0, count = store.ranges[i].count; k < count; ++k)
+			{
+				UINT32 index = store.Get(i, k) + placement.delta;
+				if(placement.width == 4) reinterpret_cast<UINT32*>(out)[k] = index;
+				else reinterpret_cast<UINT16*>(out)[k] = (UINT16)index;
+			}
+		}
+		return Merge(draws);
+	}
+
+	void Free(const DrawRange& draw)
+	{
+		indexAllocator.Free(draw.firstIndex * Width(draw.format), draw.indexCount * Width(draw.format));
+	}
+
+	// Joins draws that continue each other in the index store with the same base vertex and width.
+	static std::vector<DrawRange> Merge(const std::vector<DrawRange>& draws)
+	{
+		std::vector<DrawRange> merged;
+		for(auto& draw : draws)
+		{
+			if(draw.indexCount == 0) continue;
+			if(!merged.empty())
+			{
+				DrawRange& back = merged.back();
+				if(back.format == draw.format && back.baseVertex == draw.baseVertex && back.firstIndex + back.indexCount == draw.firstIndex)
+				{
+					back.indexCount += draw.indexCount;
+					continue;
+				}
+			}
+			merged.push_back(draw);
+		}
+		return merged;
+	}
+
+	static UINT Width(DXGI_FORMAT format) { return format == DXGI_FORMAT_R16_UINT ? 2 : 4; }
+
+	// The spans and the staged indices are only needed until the buffers are uploaded; the allocators stay.
+	void ReleaseStaging()
+	{
+		std::vector<VertexSpan>().swap(vertexSpans);
+		std::vector<BYTE>().swap(indexData);
+	}
+};
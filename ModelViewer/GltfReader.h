@@ -0,0 +1,459 @@
+#pragma once
+
+#include "SceneGraph.h"
+#include "DirectX-std.h"
+#include "MappedFile.h"
+#include "ImportProgress.h"
+#include "MeshReader.h"
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <vector>
+#include <string>
+#include <memory>
+#include <climits>
+
+// Native reader for glTF 2.0 and GLB. Buffers stay mapped and accessors are read straight out of their
+// buffer views into the vertex and index arrays, so the only copy is the one into the viewer's layout:
+// 32-bit indices are copied as they are, everything else is converted element by element.
+//
+// Every primitive becomes a mesh. Meshes used by one node are baked with its transform, meshes used by
+// several nodes are instanced, in the same order the Assimp path uses. Embedded base64 buffers, sparse or
+// quantized accessors, strips, fans and required extensions are left to Assimp.
+class GltfReader
+{
+private:
+	static constexpr UINT chunkSize = 1 << 16;
+	static constexpr UINT32 glbMagic = 0x46546C67;
+	static constexpr UINT32 jsonChunk = 0x4E4F534A;
+	static constexpr UINT32 binChunk = 0x004E4942;
+
+	enum ComponentType { Byte = 5120, UnsignedByte = 5121, Short = 5122, UnsignedShort = 5123, UnsignedInt = 5125, Float = 5126 };
+
+	struct Buffer
+	{
+		const BYTE* data;
+		UINT64 size;
+	};
+
+	// The first element of an accessor inside its mapped buffer and the distance between elements.
+	struct Accessor
+	{
+		const BYTE* data = nullptr;
+		UINT count = 0;
+		UINT stride = 0;
+		int componentType = 0;
+		int components = 0;
+		bool normalized = false;
+	};
+
+	struct Primitive
+	{
+		Accessor position, normal, color, index;
+		UINT faceSize;
+		InstanceTransform transform;
+	};
+
+	struct Chunk
+	{
+		int primitive;
+		UINT begin, end;
+	};
+
+	struct Document
+	{
+		QJsonObject root;
+		std::vector<std::unique_ptr<MappedFile>> files;
+		std::vector<Buffer> buffers;
+	};
+
+public:
+	static bool Handles(const std::string& fileName)
+	{
+		return MeshReader::HasExtension(fileName, "gltf") || MeshReader::HasExtension(fileName, "glb");
+	}
+
+	static bool Read(
+		const std::string& fileName,
+		std::vector<Vertex>& vertices,
+		std::vector<UINT32>& indices,
+		std::vector<MeshRange>& meshRanges,
+		std::vector<InstanceTransform>& instanceTransforms,
+		std::vector<UINT>& meshInstances,
+		UINT64& bytes,
+		ImportProgress* progress)
+	{
+		Document document;
+		if(!Open(fileName, document, bytes)) return false;
+		const QJsonObject& root = document.root;
+		if(!root.value("extensionsRequired").toArray().isEmpty()) return false;
+
+		std::vector<std::vector<InstanceTransform>> meshNodes;
+		if(!Traverse(root, meshNodes)) return false;
+
+		// Baked meshes first, then instanced ones, each primitive with its own instance range.
+		std::vector<Primitive> primitives;
+		instanceTransforms.assign(1, SceneGraph::Identity());
+		meshInstances.assign(1, 1);
+		QJsonArray meshes = root.value("meshes").toArray();
+		for(int pass = 0; pass < 2; ++pass)
+			for(int m = 0; m < (int)meshNodes.size(); ++m)
+			{
+				bool instanced = meshNodes[m].size() > 1;
+				if(meshNodes[m].empty() || instanced != (pass == 1)) continue;
+				for(const auto& value : meshes[m].toObject().value("primitives").toArray())
+				{
+					Primitive primitive;
+					if(!ReadPrimitive(document, value.toObject(), primitive)) return false;
+					primitive.transform = instanced ? SceneGraph::Identity() : meshNodes[m][0];
+					primitives.push_back(primitive);
+					if(instanced) instanceTransforms.insert(instanceTransforms.end(), meshNodes[m].begin(), meshNodes[m].end());
+					meshInstances.push_back(instanceTransforms.size());
+				}
+			}
+		if(primitives.empty()) return false;
+
+		UINT64 vertexCount = 0, indexCount = 0;
+		std::vector<Chunk> vertexChunks, indexChunks;
+		meshRanges.assign(primitives.size(), {});
+		for(int i = 0; i < (int)primitives.size(); ++i)
+		{
+			const Primitive& primitive = primitives[i];
+			MeshRange& range = meshRanges[i];
+			range.baseVertex = vertexCount;
+			range.vertexCount = primitive.position.count;
+			range.firstIndex = indexCount;
+			range.indexCount = primitive.index.data ? primitive.index.count : primitive.position.count;
+			range.faceSize = primitive.faceSize;
+			range.hasColors = primitive.color.data != nullptr;
+			if(range.indexCount % range.faceSize != 0) return false;
+			vertexCount += range.vertexCount;
+			indexCount += range.indexCount;
+
+			for(UINT begin = 0; begin < range.vertexCount; begin += chunkSize)
+				vertexChunks.push_back({i, begin, min(begin + chunkSize, range.vertexCount)});
+			// A multiple of every face size, so that no face straddles two chunks.
+			for(UINT begin = 0; begin < range.indexCount; begin += chunkSize * 6)
+				indexChunks.push_back({i, begin, min(begin + chunkSize * 6, range.indexCount)});
+		}
+		if(vertexCount > UINT_MAX || indexCount > UINT_MAX) return false;
+
+		vertices.resize(vertexCount);
+		indices.resize(indexCount);
+#pragma omp parallel for schedule(dynamic)
+		for(int c = 0; c < (int)vertexChunks.size(); ++c)
+			ReadVertices(primitives[vertexChunks[c].primitive], vertexChunks[c], vertices.data() + meshRanges[vertexChunks[c].primitive].baseVertex);
+
+		std::vector<BYTE> inRange(indexChunks.size(), 1);
+#pragma omp parallel for schedule(dynamic)
+		for(int c = 0; c < (int)indexChunks.size(); ++c)
+		{
+			const MeshRange& range = meshRanges[indexChunks[c].primitive];
+			inRange[c] = ReadIndices(primitives[indexChunks[c].primitive], indexChunks[c], range.vertexCount, indices.data() + range.firstIndex);
+		}
+		for(BYTE chunkInRange : inRange) if(!chunkInRange) return false;
+		if(progress) progress->Check();
+
+		for(int i = 0; i < (int)primitives.size(); ++i)
+		{
+			const MeshRange& range = meshRanges[i];
+			if(primitives[i].normal.data || range.faceSize != 3) continue;
+			MeshReader::ComputeNormals(vertices.data() + range.baseVertex, range.vertexCount, indices.data() + range.firstIndex, range.indexCount);
+		}
+		return true;
+	}
+
+private:
+	static bool Open(const std::string& fileName, Document& document, UINT64& bytes)
+	{
+		document.files.push_back(std::make_unique<MappedFile>(fileName));
+		const MappedFile& file = *document.files.back();
+		if(!file.IsOpen()) return false;
+		bytes = file.Size();
+
+		const BYTE* jsonBytes = file.Data();
+		UINT64 jsonLength = file.Size();
+		Buffer binary = {nullptr, 0};
+		if(MeshReader::HasExtension(fileName, "glb"))
+		{
+			UINT32 header[5];
+			if(file.Size() < sizeof(header)) return false;
+			memcpy(header, file.Data(), sizeof(header));
+			if(header[0] != glbMagic || header[1] != 2 || header[4] != jsonChunk || 20ull + header[3] > file.Size()) return false;
+			jsonBytes = file.Data() + 20;
+			jsonLength = header[3];
+
+			UINT64 next = (20ull + header[3] + 3) & ~3ull;
+			UINT32 chunk[2];
+			if(next + sizeof(chunk) <= file.Size())
+			{
+				memcpy(chunk, file.Data() + next, sizeof(chunk));
+				if(chunk[1] == binChunk && next + sizeof(chunk) + chunk[0] <= file.Size()) binary = {file.Data() + next + sizeof(chunk), chunk[0]};
+			}
+		}
+
+		// The JSON is parsed in place; the byte array only wraps the mapping.
+		QJsonParseError error;
+		QJsonDocument json = QJsonDocument::fromJson(QByteArray::fromRawData(reinterpret_cast<const char*>(jsonBytes), (int)jsonLength), &error);
+		if(error.error != QJsonParseError::NoError || !json.isObject()) return false;
+		document.root = json.object();
+
+		std::string directory = fileName.substr(0, fileName.find_last_of("/\\") + 1);
+		for(const auto& value : document.root.value("buffers").toArray())
+		{
+			QJsonObject buffer = value.toObject();
+			UINT64 length = (UINT64)buffer.value("byteLength").toDouble(0);
+			if(!buffer.contains("uri"))
+			{
+				if(!binary.data || length > binary.size) return false;
+				document.buffers.push_back({binary.data, length});
+				continue;
+			}
+
+			std::string uri = buffer.value("uri").toString().toStdString();
+			if(uri.compare(0, 5, "data:") == 0) return false;
+			document.files.push_back(std::make_unique<MappedFile>(directory + uri));
+			const MappedFile& external = *document.files.back();
+			if(!external.IsOpen() || length > external.Size()) return false;
+			document.buffers.push_back({external.Data(), length});
+			bytes += external.Size();
+		}
+		return true;
+	}
+
+	// World transforms of every node that references each mesh, depth first from the roots of the scene.
+	static bool Traverse(const QJsonObject& root, std::vector<std::vector<InstanceTransform>>& meshNodes)
+	{
+		QJsonArray nodes = root.value("nodes").toArray();
+		QJsonArray scenes = root.value("scenes").toArray();
+		int scene = root.value("scene").toInt(0);
+		if(scene < 0 || scene >= scenes.size()) return false;
+		meshNodes.assign(root.value("meshes").toArray().size(), {});
+
+		std::vector<std::pair<int, InstanceTransform>> stack;
+		for(const auto& value : scenes[scene].toObject().value("nodes").toArray())
+			stack.push_back({value.toInt(-1), SceneGraph::Identity()});
+		for(int visited = 0; !stack.empty(); ++visited)
+		{
+			// A valid hierarchy visits every node once.
+			int node = stack.back().first;
+			if(node < 0 || node >= nodes.size() || visited >= nodes.size()) return false;
+			QJsonObject object = nodes[node].toObject();
+			InstanceTransform world = Multiply(stack.back().second, Local(object));
+			stack.pop_back();
+
+			if(object.contains("mesh"))
+			{
+				int mesh = object.value("mesh").toInt(-1);
+				if(mesh < 0 || mesh >= (int)meshNodes.size()) return false;
+				meshNodes[mesh].push_back(LeftHanded(world));
+			}
+			for(const auto& child : object.value("children").toArray()) stack.push_back({child.toInt(-1), world});
+		}
+		return true;
+	}
+
+	static InstanceTransform Local(const QJsonObject& node)
+	{
+		InstanceTransform local = SceneGraph::Identity();
+		QJsonArray matrix = node.value("matrix").toArray();
+		if(matrix.size() == 16)
+		{
+			// Column major.
+			for(int r = 0; r < 3; ++r)
+				local.rows[r] = {(float)matrix[r].toDouble(), (float)matrix[4 + r].toDouble(), (float)matrix[8 + r].toDouble(), (float)matrix[12 + r].toDouble()};
+			return local;
+		}
+
+		float t[3] = {0, 0, 0}, q[4] = {0, 0, 0, 1}, s[3] = {1, 1, 1};
+		QJsonArray translation = node.value("translation").toArray(), rotation = node.value("rotation").toArray(), scale = node.value("scale").toArray();
+		if(translation.size() == 3) for(int k = 0; k < 3; ++k) t[k] = (float)translation[k].toDouble();
+		if(rotation.size() == 4) for(int k = 0; k < 4; ++k) q[k] = (float)rotation[k].toDouble();
+		if(scale.size() == 3) for(int k = 0; k < 3; ++k) s[k] = (float)scale[k].toDouble();
+
+		float x = q[0], y = q[1], z = q[2], w = q[3];
+		float rotationMatrix[3][3] = {
+			{1 - 2 * (y * y + z * z), 2 * (x * y - z * w), 2 * (x * z + y * w)},
+			{2 * (x * y + z * w), 1 - 2 * (x * x + z * z), 2 * (y * z - x * w)},
+			{2 * (x * z - y * w), 2 * (y * z + x * w), 1 - 2 * (x * x + y * y)} };
+		for(int r = 0; r < 3; ++r)
+			local.rows[r] = {rotationMatrix[r][0] * s[0], rotationMatrix[r][1] * s[1], rotationMatrix[r][2] * s[2], t[r]};
+		return local;
+	}
+
+	static InstanceTransform Multiply(const InstanceTransform& a, const InstanceTransform& b)
+	{
+		InstanceTransform result;
+		for(int r = 0; r < 3; ++r)
+		{
+			const float* row = &a.rows[r].x;
+			float out[4];
+			for(int c = 0; c < 4; ++c)
+				out[c] = row[0] * (&b.rows[0].x)[c] + row[1] * (&b.rows[1].x)[c] + row[2] * (&b.rows[2].x)[c] + (c == 3 ? row[3] : 0);
+			result.rows[r] = {out[0], out[1], out[2], out[3]};
+		}
+		return result;
+	}
+
+	// Conjugates a right-handed transform with the z mirror, so that it applies to mirrored vertices.
+	static InstanceTransform LeftHanded(InstanceTransform transform)
+	{
+		transform.rows[0].z = -transform.rows[0].z;
+		transform.rows[1].z = -transform.rows[1].z;
+		transform.rows[2].x = -transform.rows[2].x;
+		transform.rows[2].y = -transform.rows[2].y;
+		transform.rows[2].w = -transform.rows[2].w;
+		return transform;
+	}
+
+	static bool ReadPrimitive(const Document& document, const QJsonObject& object, Primitive& primitive)
+	{
+		static const UINT faceSizes[] = {1, 2, 0, 0, 3, 0, 0};
+		int mode = object.value("mode").toInt(4);
+		if(mode < 0 || mode > 6 || faceSizes[mode] == 0) return false;
+		primitive.faceSize = faceSizes[mode];
+
+		QJsonObject attributes = object.value("attributes").toObject();
+		if(!ReadAccessor(document, attributes.value("POSITION").toInt(-1), primitive.position)) return false;
+		if(primitive.position.componentType != Float || primitive.position.components != 3) return false;
+
+		if(attributes.contains("NORMAL"))
+		{
+			if(!ReadAccessor(document, attributes.value("NORMAL").toInt(-1), primitive.normal)) return false;
+			if(primitive.normal.componentType != Float || primitive.normal.components != 3 || primitive.normal.count != primitive.position.count) return false;
+		}
+		if(attributes.contains("COLOR_0"))
+		{
+			if(!ReadAccessor(document, attributes.value("COLOR_0").toInt(-1), primitive.color)) return false;
+			if(primitive.color.components < 3 || primitive.color.count != primitive.position.count) return false;
+			if(primitive.color.componentType != Float && !primitive.color.normalized) return false;
+		}
+		if(object.contains("indices"))
+		{
+			if(!ReadAccessor(document, object.value("indices").toInt(-1), primitive.index)) return false;
+			int type = primitive.index.componentType;
+			if(primitive.index.components != 1 || (type != UnsignedByte && type != UnsignedShort && type != UnsignedInt)) return false;
+		}
+		return true;
+	}
+
+	static bool ReadAccessor(const Document& document, int index, Accessor& accessor)
+	{
+		QJsonArray accessors = document.root.value("accessors").toArray();
+		QJsonArray views = document.root.value("bufferViews").toArray();
+		if(index < 0 || index >= accessors.size()) return false;
+		QJsonObject object = accessors[index].toObject();
+		if(object.contains("sparse") || !object.contains("bufferView")) return false;
+
+		static const char* types[] = {"SCALAR", "VEC2", "VEC3", "VEC4"};
+		QString type = object.value("type").toString();
+		for(int k = 0; k < 4; ++k) if(type == types[k]) accessor.components = k + 1;
+		accessor.componentType = object.value("componentType").toInt();
+		accessor.normalized = object.value("normalized").toBool(false);
+		accessor.count = (UINT)object.value("count").toDouble(0);
+		UINT componentSize = ComponentSize(accessor.componentType);
+		if(accessor.components == 0 || componentSize == 0) return false;
+
+		int viewIndex = object.value("bufferView").toInt(-1);
+		if(viewIndex < 0 || viewIndex >= views.size()) return false;
+		QJsonObject view = views[viewIndex].toObject();
+		int buffer = view.value("buffer").toInt(-1);
+		if(buffer < 0 || buffer >= (int)document.buffers.size()) return false;
+
+		UINT64 viewOffset = (UINT64)view.value("byteOffset").toDouble(0);
+		UINT64 viewLength = (UINT64)view.value("byteLength").toDouble(0);
+		UINT64 offset = (UINT64)object.value("byteOffset").toDouble(0);
+		UINT elementSize = componentSize * accessor.components;
+		accessor.stride = view.value("byteStride").toInt(0);
+		if(accessor.stride == 0) accessor.stride = elementSize;
+		if(viewOffset + viewLength > document.buffers[buffer].size) return false;
+		if(accessor.count > 0 && offset + (UINT64)(accessor.count - 1) * accessor.stride + elementSize > viewLength) return false;
+
+		accessor.data = document.buffers[buffer].data + viewOffset + offset;
+		return true;
+	}
+
+	static UINT ComponentSize(int componentType)
+	{
+		switch(componentType)
+		{
+		case Byte: case UnsignedByte: return 1;
+		case Short: case UnsignedShort: return 2;
+		case UnsignedInt: case Float: return 4;
+		default: return 0;
+		}
+	}
+
+	static float Component(const BYTE* p, int componentType, bool normalized)
+	{
+		switch(componentType)
+		{
+		case Float: { float v; memcpy(&v, p, sizeof(v)); return v; }
+		case UnsignedByte: return normalized ? *p / 255.0f : *p;
+		case UnsignedShort: { UINT16 v; memcpy(&v, p, sizeof(v)); return normalized ? v / 65535.0f : v; }
+		case Byte: { signed char v = *reinterpret_cast<const signed char*>(p); return normalized ? max(v / 127.0f, -1.0f) : v; }
+		case Short: { INT16 v; memcpy(&v, p, sizeof(v)); return normalized ? max(v / 32767.0f, -1.0f) : v; }
+		default: return 0;
+		}
+	}
+
+	static UINT32 IndexAt(const BYTE* p, int componentType)
+	{
+		if(componentType == UnsignedByte) return *p;
+		if(componentType == UnsignedShort)
+		{
+			UINT16 v;
+			memcpy(&v, p, sizeof(v));
+			return v;
+		}
+		UINT32 v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	static void ReadVertices(const Primitive& primitive, const Chunk& chunk, Vertex* vertices)
+	{
+		bool baked = !SceneGraph::IsIdentity(primitive.transform);
+		UINT componentSize = primitive.color.data ? ComponentSize(primitive.color.componentType) : 0;
+		for(UINT i = chunk.begin; i < chunk.end; ++i)
+		{
+			Vertex& vertex = vertices[i];
+			XMFLOAT3 value;
+			memcpy(&value, primitive.position.data + (UINT64)i * primitive.position.stride, sizeof(value));
+			vertex.position = MeshReader::Flip(value);
+			if(primitive.normal.data)
+			{
+				memcpy(&value, primitive.normal.data + (UINT64)i * primitive.normal.stride, sizeof(value));
+				vertex.normal = MeshReader::Flip(value);
+			}
+			else vertex.normal = {0, 0, 0};
+			if(primitive.color.data)
+			{
+				const BYTE* color = primitive.color.data + (UINT64)i * primitive.color.stride;
+				vertex.color.x = Component(color, primitive.color.componentType, true);
+				vertex.color.y = Component(color + componentSize, primitive.color.componentType, true);
+				vertex.color.z = Component(color + componentSize * 2, primitive.color.componentType, true);
+			}
+			else vertex.color = {0, 0, 0};
+			if(baked) SceneGraph::Apply(primitive.transform, vertex);
+		}
+	}
+
+	// Indices are checked against the primitive and written in the flipped winding; without an index
+	// accessor a primitive draws its vertices in order.
+	static bool ReadIndices(const Primitive& primitive, const Chunk& chunk, UINT vertexCount, UINT32* indices)
+	{
+		const Accessor& index = primitive.index;
+		if(index.data && index.componentType == UnsignedInt && index.stride == sizeof(UINT32))
+			memcpy(indices + chunk.begin, index.data + (UINT64)chunk.begin * sizeof(UINT32), (chunk.end - chunk.begin) * sizeof(UINT32));
+		else
+			for(UINT i = chunk.begin; i < chunk.end; ++i)
+				indices[i] = index.data ? IndexAt(index.data + (UINT64)i * index.stride, index.componentType) : i;
+
+		bool inRange = true;
+		for(UINT i = chunk.begin; i < chunk.end; ++i) inRange &= indices[i] < vertexCount;
+		if(primitive.faceSize == 3)
+			for(UINT i = chunk.begin; i + 2 < chunk.end; i += 3) std::swap(indices[i + 1], indices[i + 2]);
+		return inRange;
+	}
+};
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include "Camera.h"
+#include <vector>
+#include <cmath>
+
+// Ground grid on the y = 0 plane, rebuilt every frame from the camera alone. The minor spacing is the
+// power of ten closest to a tenth of the eye height, and every tenth line is a major line. Each level
+// reaches a hundred of its own spacings around the point below the eye, fading into the background
+// towards that reach, and lines are clipped against the view frustum, so the output stays a few thousand
+// vertices at any distance.
+//
+// grid.hlsl reads the line color from the normal slot.
+class GridBuilder
+{
+public:
+	static constexpr XMFLOAT3 minorColor{62.0 / 255, 63.0 / 255, 66.0 / 255};
+	static constexpr XMFLOAT3 majorColor{0.4, 0.4, 0.4};
+	static constexpr XMFLOAT3 xaxisColor{232.0 / 255, 95.0 / 255, 55.0 / 255};
+	static constexpr XMFLOAT3 yaxisColor{118.0 / 255, 248.0 / 255, 39.0 / 255};
+	static constexpr XMFLOAT3 zaxisColor{37.0 / 255, 191.0 / 255, 250.0 / 255};
+
+	static constexpr float minSpacing = 1;
+	static constexpr float maxSpacing = 1000;
+	static constexpr int reach = 100;
+	// grid.hlsl fades lines to the background 20000 units from the origin; nothing beyond is visible.
+	static constexpr float extent = 20000;
+	static constexpr float axisLength = 70000;
+
+	// Two levels, two directions, 2 * reach + 1 lines each plus one for rounding, every line in two
+	// segments, and the three axes.
+	static constexpr UINT maxVertices = 2 * 2 * (2 * reach + 2) * 4 + 6;
+
+	// Fills lines with a line list and returns its vertex count. Axes hidden by axisFlag are left out
+	// and replaced by ordinary grid lines.
+	static UINT Build(const Camera& camera, XMFLOAT3 axisFlag, XMFLOAT3 background, std::vector<Vertex>& lines)
+	{
+		lines.clear();
+		XMFLOAT3 eye;
+		XMStoreFloat3(&eye, camera.getCameraPos());
+		XMFLOAT4X4 viewProjection;
+		XMStoreFloat4x4(&viewProjection, camera.getViewMatrix() * camera.getProjectMatrix());
+
+		// Every frustum plane restricted to y = 0 is a half-plane a * x + c * z + d >= 0.
+		XMFLOAT3 planes[6];
+		const int combine[6][2] = {{0, 1}, {0, -1}, {1, 1}, {1, -1}, {2, 0}, {2, -1}};
+		for(int p = 0; p < 6; ++p)
+		{
+			int column = combine[p][0];
+			float sign = (float)combine[p][1];
+			auto coefficient = [&](int row) {
+				return p == 4 ? viewProjection.m[row][2] : viewProjection.m[row][3] + sign * viewProjection.m[row][column];
+			};
+			planes[p] = {coefficient(0), coefficient(2), coefficient(3)};
+		}
+
+		float height = max(fabsf(eye.y), minSpacing);
+		float spacing = powf(10, floorf(log10f(height / 10)));
+		spacing = min(max(spacing, minSpacing), maxSpacing);
+
+		AddLevel(eye, planes, spacing, 10, minorColor, background, axisFlag, lines);
+		AddLevel(eye, planes, spacing * 10, 0, majorColor, background, axisFlag, lines);
+
+		if(axisFlag.x > 0.5)
+		{
+			lines.push_back({{-axisLength, 0, 0}, xaxisColor});
+			lines.push_back({{ axisLength, 0, 0}, xaxisColor});
+		}
+		if(axisFlag.y > 0.5)
+		{
+			lines.push_back({{0, -axisLength, 0}, yaxisColor});
+			lines.push_back({{0,  axisLength, 0}, yaxisColor});
+		}
+		if(axisFlag.z > 0.5)
+		{
+			lines.push_back({{0, 0, -axisLength}, zaxisColor});
+			lines.push_back({{0, 0,  axisLength}, zaxisColor});
+		}
+		return lines.size();
+	}
+
+private:
+	// Lines at multiples of spacing in both directions; with skipEvery set, every skipEvery-th line is
+	// left to the coarser level.
+	static void AddLevel(
+		const XMFLOAT3& eye,
+		const XMFLOAT3 (&planes)[6],
+		float spacing,
+		int skipEvery,
+		XMFLOAT3 color,
+		XMFLOAT3 background,
+		XMFLOAT3 axisFlag,
+		std::vector<Vertex>& lines)
+	{
+		float range = spacing * reach;
+		float center[2] = {eye.x, eye.z};
+		for(int direction = 0; direction < 2; ++direction)
+		{
+			// direction 0 runs along z at fixed x, direction 1 along x at fixed z.
+			int across = direction == 0 ? 0 : 1;
+			bool axisShown = direction == 0 ? axisFlag.z > 0.5 : axisFlag.x > 0.5;
+			float low = max(center[across] - range, -extent), high = min(center[across] + range, extent);
+			for(float k = ceilf(low / spacing); k * spacing <= high; ++k)
+			{
+				long long index = (long long)k;
+				if(skipEvery > 0 && index % skipEvery == 0) continue;
+				if(index == 0 && axisShown) continue;
+
+				float fixed = (float)index * spacing;
+				float begin = max(center[1 - across] - range, -extent), end = min(center[1 - across] + range, extent);
+				if(!Clip(planes, direction, fixed, begin, end)) continue;
+
+				float nearest = min(max(center[1 - across], begin), end);
+				AddSegment(direction, fixed, begin, nearest, eye, range, color, background, lines);
+				AddSegment(direction, fixed, nearest, end, eye, range, color, background, lines);
+			}
+		}
+	}
+
+	// Narrows [begin, end] along the line to the part on the positive side of every plane.
+	static bool Clip(const XMFLOAT3 (&planes)[6], int direction, float fixed, float& begin, float& end)
+	{
+		for(auto& plane : planes)
+		{
+			float slope = direction == 0 ? plane.y : plane.x;
+			float offset = (direction == 0 ? plane.x : plane.y) * fixed + plane.z;
+			if(slope == 0)
+			{
+				if(offset < 0) return false;
+				continue;
+			}
+			float bound = -offset / slope;
+			if(slope > 0) begin = max(begin, bound);
+			else end = min(end, bound);
+		}
+		return begin < end;
+	}
+
+	static void AddSegment(
+		int direction, float fixed, float begin, float end,
+		const XMFLOAT3& eye, float range, XMFLOAT3 color, XMFLOAT3 background, std::vector<Vertex>& lines)
+	{
+		if(begin >= end) return;
+		for(float along : {begin, end})
+		{
+			XMFLOAT3 position = direction == 0 ? XMFLOAT3{fixed, 0, along} : XMFLOAT3{along, 0, fixed};
+			float dx = position.x - eye.x, dz = position.z - eye.z;
+			float fade = min(sqrtf(dx * dx + dz * dz) / range, 1.0f);
+			XMVECTOR faded = XMVectorLerp(XMLoadFloat3(&color), XMLoadFloat3(&background), fade);
+			Vertex vertex{position};
+			XMStoreFloat3(&vertex.normal, faded);
+			lines.push_back(vertex);
+		}
+	}
+};
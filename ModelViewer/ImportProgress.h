@@ -0,0 +1,69 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include "assimp/ProgressHandler.hpp"
+#include <atomic>
+
+enum class ImportStage
+{
+	Hash,
+	Read,
+	Extract,
+	Optimize,
+	Lods,
+	Meshlets,
+	Occluders,
+	Edges,
+	FlatShading,
+	Upload,
+	Count
+};
+
+class ImportCancelled {};
+
+// Progress and cancel flag shared between a loading thread and the renderer. Every stage owns a fixed
+// share of the bar; Assimp's own reading dominates, so it gets most of it.
+class ImportProgress
+{
+private:
+	static constexpr float stageShare[(int)ImportStage::Count] = {0.02f, 0.5f, 0.1f, 0.08f, 0.1f, 0.03f, 0.02f, 0.07f, 0.05f, 0.03f};
+
+	std::atomic<bool> cancelled{false};
+	std::atomic<int> percent{0};
+
+public:
+	void Cancel() { cancelled = true; }
+	bool Cancelled() const { return cancelled; }
+	int Percent() const { return percent; }
+
+	void Report(ImportStage stage, float fraction)
+	{
+		float done = 0;
+		for(int i = 0; i < (int)stage; ++i) done += stageShare[i];
+		done += stageShare[(int)stage] * max(0.0f, min(fraction, 1.0f));
+		percent = (int)(done * 100);
+	}
+
+	// Called between stages and after the parallel loops inside them, which skip their remaining work
+	// once cancelled; unwinding frees whatever the aborted load had allocated.
+	void Check() const
+	{
+		if(cancelled) throw ImportCancelled();
+	}
+};
+
+class ImportProgressHandler : public Assimp::ProgressHandler
+{
+private:
+	ImportProgress& progress;
+
+public:
+	ImportProgressHandler(ImportProgress& progress) : progress(progress) {}
+
+	// Returning false makes Assimp abandon the import and hand back a null scene.
+	bool Update(float percentage) override
+	{
+		if(percentage >= 0) progress.Report(ImportStage::Read, percentage);
+		return !progress.Cancelled();
+	}
+};
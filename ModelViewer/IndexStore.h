@@ -0,0 +1,92 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include <vector>
+#include <emmintrin.h>
+
+// One index array split by mesh, every mesh in the narrowest width that can address its vertices:
+// meshes of up to 65536 vertices are kept as R16_UINT, larger ones as R32_UINT.
+class IndexStore
+{
+public:
+	struct Range
+	{
+		DXGI_FORMAT format;
+		UINT offset;
+		UINT count;
+	};
+
+	std::vector<UINT16> indices16;
+	std::vector<UINT32> indices32;
+	std::vector<Range> ranges;
+
+	void Build(
+		const std::vector<UINT32>& indices,
+		const std::vector<MeshRange>& meshRanges,
+		UINT MeshRange::*first,
+		UINT MeshRange::*count)
+	{
+		ranges.resize(meshRanges.size());
+		UINT size16 = 0, size32 = 0;
+		for(int i = 0; i < (int)meshRanges.size(); ++i)
+		{
+			const MeshRange& range = meshRanges[i];
+			bool narrow = range.vertexCount <= 65536;
+			ranges[i].format = narrow ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+			ranges[i].offset = narrow ? size16 : size32;
+			ranges[i].count = range.*count;
+			(narrow ? size16 : size32) += range.*count;
+		}
+
+		indices16.resize(size16);
+		indices32.resize(size32);
+#pragma omp parallel for schedule(dynamic)
+		for(int i = 0; i < (int)meshRanges.size(); ++i)
+		{
+			const UINT32* in = indices.data() + meshRanges[i].*first;
+			if(ranges[i].format == DXGI_FORMAT_R16_UINT) Narrow(in, ranges[i].count, indices16.data() + ranges[i].offset);
+			else memcpy(indices32.data() + ranges[i].offset, in, ranges[i].count * sizeof(UINT32));
+		}
+	}
+
+	void* Data(int mesh)
+	{
+		const Range& range = ranges[mesh];
+		if(range.format == DXGI_FORMAT_R16_UINT) return indices16.data() + range.offset;
+		return indices32.data() + range.offset;
+	}
+
+	UINT32 Get(int mesh, UINT i) const
+	{
+		const Range& range = ranges[mesh];
+		if(range.format == DXGI_FORMAT_R16_UINT) return indices16[range.offset + i];
+		return indices32[range.offset + i];
+	}
+
+	size_t Bytes() const
+	{
+		return indices16.size() * sizeof(UINT16) + indices32.size() * sizeof(UINT32);
+	}
+
+	size_t Count() const
+	{
+		return indices16.size() + indices32.size();
+	}
+
+	// SSE2 has no unsigned 32 to 16 bit pack, so values are biased into the signed range, packed with
+	// signed saturation and biased back; eight indices per step.
+	static void Narrow(const UINT32* in, UINT count, UINT16* out)
+	{
+		const __m128i bias32 = _mm_set1_epi32(0x8000);
+		const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+
+		UINT i = 0;
+		for(; i + 8 <= count; i += 8)
+		{
+			__m128i a = _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), bias32);
+			__m128i b = _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 4)), bias32);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_add_epi16(_mm_packs_epi32(a, b), bias16));
+		}
+		for(; i < count; ++i) out[i] = (UINT16)in[i];
+	}
+};
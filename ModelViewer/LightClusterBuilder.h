@@ -0,0 +1,290 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <emmintrin.h>
+
+// Layouts shared with the StructuredBuffers in pbr.hlsl.
+struct PointLight
+{
+	XMFLOAT3 position;
+	float radius;
+	XMFLOAT3 color;
+	float unused;
+};
+
+struct LightCluster
+{
+	UINT offset;
+	UINT count;
+};
+
+// Assigns point lights to a froxel grid: clustersX by clustersY screen tiles, cut along the view depth
+// into clustersZ slices spaced evenly in log depth between a near and a far distance of interest; the
+// first and last slices reach on to the camera's near and far planes. Every cluster gets the range of
+// lightIndices that lists the lights whose sphere touches the cluster's view space box.
+//
+// Slices are built in parallel, each on its own lists. A slice first keeps the lights that touch it,
+// every row of tiles keeps those of the slice's lights that touch the row, and every cluster tests the
+// row's lights, four spheres against one box per SSE step.
+class LightClusterBuilder
+{
+public:
+	static constexpr UINT clustersX = 16, clustersY = 8, clustersZ = 24;
+	static constexpr UINT clusterCount = clustersX * clustersY * clustersZ;
+	static constexpr UINT maxLights = 1 << 14;
+	static constexpr UINT maxLightIndices = 1 << 20;
+	// Radiance below which a light no longer counts; pbr.hlsl fades every light to zero at its radius.
+	static constexpr float cutoff = 1.0f / 256;
+
+	std::vector<LightCluster> clusters;
+	std::vector<UINT> lightIndices;
+	// The slice of view depth z is floor(log(z) * sliceScale + sliceBias), clamped to the grid.
+	float sliceScale = 0, sliceBias = 0;
+	// Cluster entries left out because lightIndices was full.
+	UINT dropped = 0;
+	double buildMs = 0;
+
+	static float Radius(const XMFLOAT3& color)
+	{
+		return sqrtf(max(color.x, max(color.y, color.z)) / cutoff);
+	}
+
+	LightClusterBuilder() : clusters(clusterCount), slices(clustersZ) {}
+
+	// view and fovY, aspect, nearZ and farZ describe the camera; lights are in world space. Lights past
+	// maxLights are ignored.
+	void Build(
+		const std::vector<PointLight>& lights,
+		FXMMATRIX view,
+		float fovY, float aspect, float nearZ, float farZ,
+		float clusterNear, float clusterFar)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		int lightCount = min((UINT)lights.size(), maxLights);
+		UINT padded = (lightCount + 3) & ~3u;
+		viewLights.Resize(padded);
+#pragma omp parallel for
+		for(int i = 0; i < lightCount; ++i)
+		{
+			XMFLOAT3 center;
+			XMStoreFloat3(&center, XMVector3TransformCoord(XMLoadFloat3(&lights[i].position), view));
+			viewLights.Set(i, center, lights[i].radius, i);
+		}
+		for(UINT i = lightCount; i < padded; ++i) viewLights.Set(i, {1e30f, 1e30f, 1e30f}, 0, 0);
+
+		clusterNear = max(clusterNear, nearZ);
+		clusterFar = max(clusterFar, clusterNear * 1.001f);
+		sliceScale = clustersZ / logf(clusterFar / clusterNear);
+		sliceBias = -logf(clusterNear) * sliceScale;
+		tanY = tanf(fovY / 2);
+		tanX = tanY * aspect;
+
+#pragma omp parallel for schedule(dynamic)
+		for(int z = 0; z < (int)clustersZ; ++z)
+		{
+			float zn = z == 0 ? nearZ : expf((z - sliceBias) / sliceScale);
+			float zf = z == clustersZ - 1 ? farZ : expf((z + 1 - sliceBias) / sliceScale);
+			buildSlice(slices[z], z, zn, zf);
+		}
+
+		// Concatenate the slices; once lightIndices is full the remaining clusters are cut short.
+		UINT total = 0;
+		dropped = 0;
+		for(UINT z = 0; z < clustersZ; ++z)
+		{
+			Slice& slice = slices[z];
+			for(UINT c = 0; c < clustersX * clustersY; ++c)
+			{
+				LightCluster& cluster = clusters[z * clustersX * clustersY + c];
+				UINT count = min(slice.clusters[c].count, maxLightIndices - min(total, maxLightIndices));
+				dropped += slice.clusters[c].count - count;
+				cluster = {total, count};
+				total += count;
+			}
+		}
+		lightIndices.resize(total);
+#pragma omp parallel for schedule(dynamic)
+		for(int c = 0; c < (int)clusterCount; ++c)
+		{
+			const Slice& slice = slices[c / (clustersX * clustersY)];
+			const LightCluster& source = slice.clusters[c % (clustersX * clustersY)];
+			std::copy(slice.indices.begin() + source.offset, slice.indices.begin() + source.offset + clusters[c].count,
+				lightIndices.begin() + clusters[c].offset);
+		}
+		buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// Brute force over every light and every cluster box, for checking Build.
+	void BuildScalar(
+		const std::vector<PointLight>& lights, FXMMATRIX view,
+		float fovY, float aspect, float nearZ, float farZ, float clusterNear, float clusterFar,
+		std::vector<LightCluster>& outClusters, std::vector<UINT>& outIndices) const
+	{
+		outClusters.assign(clusterCount, {0, 0});
+		outIndices.clear();
+		UINT lightCount = min((UINT)lights.size(), maxLights);
+		std::vector<XMFLOAT3> centers(lightCount);
+		for(UINT i = 0; i < lightCount; ++i)
+			XMStoreFloat3(&centers[i], XMVector3TransformCoord(XMLoadFloat3(&lights[i].position), view));
+
+		clusterNear = max(clusterNear, nearZ);
+		clusterFar = max(clusterFar, clusterNear * 1.001f);
+		float scale = clustersZ / logf(clusterFar / clusterNear), bias = -logf(clusterNear) * scale;
+		float ty = tanf(fovY / 2), tx = ty * aspect;
+		for(UINT z = 0; z < clustersZ; ++z)
+		{
+			float zn = z == 0 ? nearZ : expf((z - bias) / scale);
+			float zf = z == clustersZ - 1 ? farZ : expf((z + 1 - bias) / scale);
+			for(UINT y = 0; y < clustersY; ++y)
+				for(UINT x = 0; x < clustersX; ++x)
+				{
+					Box box = ClusterBox(tx, ty, x, x + 1, y, y + 1, zn, zf);
+					LightCluster& cluster = outClusters[(z * clustersY + y) * clustersX + x];
+					cluster.offset = outIndices.size();
+					for(UINT i = 0; i < lightCount; ++i)
+					{
+						float dx = max(max(box.min.x - centers[i].x, centers[i].x - box.max.x), 0.0f);
+						float dy = max(max(box.min.y - centers[i].y, centers[i].y - box.max.y), 0.0f);
+						float dz = max(max(box.min.z - centers[i].z, centers[i].z - box.max.z), 0.0f);
+						if(dx * dx + dy * dy + dz * dz <= lights[i].radius * lights[i].radius) outIndices.push_back(i);
+					}
+					cluster.count = outIndices.size() - cluster.offset;
+				}
+		}
+	}
+
+private:
+	struct Box
+	{
+		XMFLOAT3 min, max;
+	};
+
+	// View space lights in SoA form, padded to a multiple of four with lights that touch nothing.
+	struct LightSet
+	{
+		std::vector<float> x, y, z, radius;
+		std::vector<UINT> index;
+		UINT count = 0;
+
+		void Resize(UINT n)
+		{
+			count = n;
+			for(auto* lane : {&x, &y, &z, &radius}) lane->resize(n);
+			index.resize(n);
+		}
+
+		void Set(UINT i, const XMFLOAT3& center, float r, UINT light)
+		{
+			x[i] = center.x;
+			y[i] = center.y;
+			z[i] = center.z;
+			radius[i] = r;
+			index[i] = light;
+		}
+
+		void Add(const LightSet& from, UINT i)
+		{
+			x.push_back(from.x[i]);
+			y.push_back(from.y[i]);
+			z.push_back(from.z[i]);
+			radius.push_back(from.radius[i]);
+			index.push_back(from.index[i]);
+			++count;
+		}
+
+		void Clear()
+		{
+			for(auto* lane : {&x, &y, &z, &radius}) lane->clear();
+			index.clear();
+			count = 0;
+		}
+
+		void Pad()
+		{
+			while(count & 3)
+			{
+				x.push_back(1e30f);
+				y.push_back(1e30f);
+				z.push_back(1e30f);
+				radius.push_back(0);
+				index.push_back(0);
+				++count;
+			}
+		}
+	};
+
+	// Lists of one slice, with offsets into its own indices; kept between frames to reuse their storage.
+	struct Slice
+	{
+		LightSet lights, rowLights;
+		std::vector<LightCluster> clusters;
+		std::vector<UINT> indices;
+	};
+
+	LightSet viewLights;
+	std::vector<Slice> slices;
+	float tanX = 1, tanY = 1;
+
+	// View space box around the tiles [x0, x1) by [y0, y1) between depths zn and zf; row 0 is the top.
+	static Box ClusterBox(float tanX, float tanY, UINT x0, UINT x1, UINT y0, UINT y1, float zn, float zf)
+	{
+		float left = (-1 + 2.0f * x0 / clustersX) * tanX, right = (-1 + 2.0f * x1 / clustersX) * tanX;
+		float bottom = (1 - 2.0f * y1 / clustersY) * tanY, top = (1 - 2.0f * y0 / clustersY) * tanY;
+		Box box;
+		box.min = {min(left * zn, left * zf), min(bottom * zn, bottom * zf), zn};
+		box.max = {max(right * zn, right * zf), max(top * zn, top * zf), zf};
+		return box;
+	}
+
+	// Bit k is set when sphere first + k touches the box: the squared distance from the center to the box
+	// is at most the squared radius.
+	static int Touches(const LightSet& set, UINT first, const Box& box)
+	{
+		__m128 x = _mm_loadu_ps(&set.x[first]), y = _mm_loadu_ps(&set.y[first]), z = _mm_loadu_ps(&set.z[first]);
+		__m128 r = _mm_loadu_ps(&set.radius[first]), zero = _mm_setzero_ps();
+		__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(box.min.x), x), _mm_sub_ps(x, _mm_set1_ps(box.max.x))), zero);
+		__m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(box.min.y), y), _mm_sub_ps(y, _mm_set1_ps(box.max.y))), zero);
+		__m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_set1_ps(box.min.z), z), _mm_sub_ps(z, _mm_set1_ps(box.max.z))), zero);
+		__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		return _mm_movemask_ps(_mm_cmple_ps(distance, _mm_mul_ps(r, r)));
+	}
+
+	static void Select(const LightSet& from, const Box& box, LightSet& to)
+	{
+		to.Clear();
+		for(UINT i = 0; i < from.count; i += 4)
+		{
+			int mask = Touches(from, i, box);
+			for(UINT k = 0; k < 4; ++k)
+				if(mask >> k & 1) to.Add(from, i + k);
+		}
+		to.Pad();
+	}
+
+	void buildSlice(Slice& slice, UINT z, float zn, float zf) const
+	{
+		slice.clusters.resize(clustersX * clustersY);
+		slice.indices.clear();
+		Select(viewLights, ClusterBox(tanX, tanY, 0, clustersX, 0, clustersY, zn, zf), slice.lights);
+		for(UINT y = 0; y < clustersY; ++y)
+		{
+			Select(slice.lights, ClusterBox(tanX, tanY, 0, clustersX, y, y + 1, zn, zf), slice.rowLights);
+			for(UINT x = 0; x < clustersX; ++x)
+			{
+				LightCluster& cluster = slice.clusters[y * clustersX + x];
+				cluster.offset = slice.indices.size();
+				Box box = ClusterBox(tanX, tanY, x, x + 1, y, y + 1, zn, zf);
+				for(UINT i = 0; i < slice.rowLights.count; i += 4)
+				{
+					int mask = Touches(slice.rowLights, i, box);
+					for(UINT k = 0; k < 4; ++k)
+						if(mask >> k & 1) slice.indices.push_back(slice.rowLights.index[i + k]);
+				}
+				cluster.count = slice.indices.size() - cluster.offset;
+			}
+		}
+	}
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include <string>
+
+// Read-only view of a whole file through a Win32 file mapping.
+class MappedFile
+{
+private:
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = nullptr;
+	const BYTE* data = nullptr;
+	UINT64 size = 0;
+
+public:
+	MappedFile(const std::string& fileName)
+	{
+		file = CreateFileA(
+			fileName.c_str(),
+			GENERIC_READ,
+			FILE_SHARE_READ,
+			nullptr,
+			OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+			nullptr );
+		if(file == INVALID_HANDLE_VALUE) return;
+
+		LARGE_INTEGER fileSize;
+		if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) return;
+		size = fileSize.QuadPart;
+
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if(mapping == nullptr) return;
+		data = static_cast<const BYTE*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+	MappedFile(const MappedFile& rhs) = delete;
+	MappedFile& operator=(const MappedFile& rhs) = delete;
+	~MappedFile()
+	{
+		if(data != nullptr) UnmapViewOfFile(data);
+		if(mapping != nullptr) CloseHandle(mapping);
+		if(file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	}
+
+	bool IsOpen() const { return data != nullptr; }
+	const BYTE* Data() const { return data; }
+	UINT64 Size() const { return size; }
+};
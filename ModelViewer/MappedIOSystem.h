@@ -0,0 +1,73 @@
+#pragma once
+
+#include "assimp/IOSystem.hpp"
+#include "assimp/IOStream.hpp"
+#include "MappedFile.h"
+#include <memory>
+
+// Assimp stream over a mapped file: Read is a copy out of the mapping and Seek only moves the cursor.
+class MappedIOStream : public Assimp::IOStream
+{
+private:
+	std::unique_ptr<MappedFile> file;
+	size_t position = 0;
+
+public:
+	MappedIOStream(std::unique_ptr<MappedFile> file) : file(std::move(file)) {}
+
+	size_t Read(void* pvBuffer, size_t pSize, size_t pCount) override
+	{
+		if(pSize == 0) return 0;
+		size_t count = min(pCount, (size_t)(file->Size() - position) / pSize);
+		memcpy(pvBuffer, file->Data() + position, count * pSize);
+		position += count * pSize;
+		return count;
+	}
+
+	size_t Write(const void* pvBuffer, size_t pSize, size_t pCount) override
+	{
+		return 0;
+	}
+
+	aiReturn Seek(size_t pOffset, aiOrigin pOrigin) override
+	{
+		size_t target;
+		if(pOrigin == aiOrigin_SET) target = pOffset;
+		else if(pOrigin == aiOrigin_CUR) target = position + pOffset;
+		else target = file->Size() - pOffset;
+
+		if(target > file->Size()) return aiReturn_FAILURE;
+		position = target;
+		return aiReturn_SUCCESS;
+	}
+
+	size_t Tell() const override { return position; }
+	size_t FileSize() const override { return file->Size(); }
+	void Flush() override {}
+};
+
+// Read-only IO system handing out mapped streams; Assimp only ever reads while importing.
+class MappedIOSystem : public Assimp::IOSystem
+{
+public:
+	bool Exists(const char* pFile) const override
+	{
+		return GetFileAttributesA(pFile) != INVALID_FILE_ATTRIBUTES;
+	}
+
+	char getOsSeparator() const override { return '\\'; }
+
+	Assimp::IOStream* Open(const char* pFile, const char* pMode = "rb") override
+	{
+		if(strchr(pMode, 'w') || strchr(pMode, 'a') || strchr(pMode, '+')) return nullptr;
+
+		auto file = std::make_unique<MappedFile>(pFile);
+		if(!file->IsOpen()) return nullptr;
+		return new MappedIOStream(std::move(file));
+	}
+
+	void Close(Assimp::IOStream* pFile) override
+	{
+		delete pFile;
+	}
+};
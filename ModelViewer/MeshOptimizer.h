@@ -0,0 +1,378 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include "ImportProgress.h"
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+
+struct CacheStats
+{
+	UINT triangles = 0;
+	UINT vertices = 0;
+	UINT misses = 0;
+
+	float Acmr() const { return triangles ? (float)misses / triangles : 0; }
+	float Atvr() const { return vertices ? (float)misses / vertices : 0; }
+	void Add(const CacheStats& other)
+	{
+		triangles += other.triangles;
+		vertices += other.vertices;
+		misses += other.misses;
+	}
+};
+
+// Reorders the index and vertex data of every mesh for the GPU: Tipsify for the post-transform cache,
+// optionally a cluster sort against overdraw, then vertices renumbered by first use for fetch locality.
+// Meshes are independent, so they are optimized in parallel; meshes above blockTriangles are put in spatial
+// order and cut into blocks of consecutive triangles that are reordered on their own, so that a single huge
+// mesh is spread over the threads as well. A block starts with a cold cache, which costs at most cacheSize
+// misses, and the cluster sort only moves clusters within their block.
+class MeshOptimizer
+{
+private:
+	static constexpr UINT cacheSize = 16;
+	static constexpr UINT gridBits = 4;
+
+public:
+	static constexpr UINT blockTriangles = 1 << 16;
+
+public:
+	static void Optimize(
+		std::vector<Vertex>& vertices,
+		std::vector<UINT32>& indices,
+		const std::vector<MeshRange>& meshRanges,
+		bool reduceOverdraw,
+		std::vector<CacheStats>& before,
+		std::vector<CacheStats>& after,
+		ImportProgress* progress = nullptr)
+	{
+		int meshCount = meshRanges.size();
+		before.assign(meshCount, CacheStats());
+		after.assign(meshCount, CacheStats());
+
+		// A mesh that is cut into blocks is measured as a whole before, and as the sum of its blocks after.
+		std::vector<Block> blocks;
+		for(int i = 0; i < meshCount; ++i)
+		{
+			const MeshRange& range = meshRanges[i];
+			if(range.faceSize != 3) continue;
+			if(range.indexCount > blockTriangles * 3)
+			{
+				before[i] = Analyze(indices.data() + range.firstIndex, range.indexCount, range.vertexCount);
+				SpatialOrder(vertices.data() + range.baseVertex, range.vertexCount, indices.data() + range.firstIndex, range.indexCount);
+			}
+			for(UINT first = 0; first < range.indexCount; first += blockTriangles * 3)
+				blocks.push_back({i, first, min(range.indexCount - first, blockTriangles * 3)});
+		}
+
+		int blockCount = blocks.size();
+		std::vector<CacheStats> blockBefore(blockCount), blockAfter(blockCount);
+		std::atomic<int> optimized{0};
+#pragma omp parallel for schedule(dynamic)
+		for(int b = 0; b < blockCount; ++b)
+		{
+			if(progress && progress->Cancelled()) continue;
+			const Block& block = blocks[b];
+			const MeshRange& range = meshRanges[block.mesh];
+			const Vertex* meshVertices = vertices.data() + range.baseVertex;
+			UINT32* blockIndices = indices.data() + range.firstIndex + block.firstIndex;
+			if(block.indexCount == range.indexCount)
+				OptimizeTriangles(meshVertices, blockIndices, block.indexCount, range.vertexCount, reduceOverdraw, blockBefore[b], blockAfter[b]);
+			else
+				OptimizeBlock(meshVertices, blockIndices, block.indexCount, reduceOverdraw, blockBefore[b], blockAfter[b]);
+			if(progress) progress->Report(ImportStage::Optimize, (float)++optimized / blockCount);
+		}
+		if(progress) progress->Check();
+
+		for(int b = 0; b < blockCount; ++b)
+		{
+			int mesh = blocks[b].mesh;
+			if(blocks[b].indexCount == meshRanges[mesh].indexCount) before[mesh] = blockBefore[b];
+			after[mesh].Add(blockAfter[b]);
+			after[mesh].vertices = before[mesh].vertices;
+		}
+
+#pragma omp parallel for schedule(dynamic)
+		for(int i = 0; i < meshCount; ++i)
+		{
+			const MeshRange& range = meshRanges[i];
+			RemapVertices(vertices.data() + range.baseVertex, range.vertexCount, indices.data() + range.firstIndex, range.indexCount);
+		}
+	}
+
+	// Misses of a FIFO cache of cacheSize entries, the model the ACMR/ATVR figures are usually quoted in.
+	static CacheStats Analyze(const UINT32* indices, UINT indexCount, UINT vertexCount)
+	{
+		CacheStats stats;
+		stats.triangles = indexCount / 3;
+
+		std::vector<UINT> stamp(vertexCount, 0);
+		UINT time = cacheSize + 1;
+		for(UINT i = 0; i < indexCount; ++i)
+		{
+			UINT32 v = indices[i];
+			if(stamp[v] == 0) ++stats.vertices;
+			if(time - stamp[v] > cacheSize)
+			{
+				stamp[v] = time++;
+				++stats.misses;
+			}
+		}
+		return stats;
+	}
+
+	// Tipsify and the optional cluster sort in place, with the cache statistics before and after. Renumbering
+	// the vertices afterwards does not change them.
+	static void OptimizeTriangles(
+		const Vertex* vertices, UINT32* indices, UINT indexCount, UINT vertexCount, bool reduceOverdraw, CacheStats& before, CacheStats& after)
+	{
+		before = Analyze(indices, indexCount, vertexCount);
+		std::vector<UINT32> clusters;
+		std::vector<UINT32> ordered(indexCount);
+		Tipsify(indices, indexCount, vertexCount, ordered.data(), clusters);
+		if(reduceOverdraw) SortClusters(vertices, ordered.data(), indexCount, clusters, indices);
+		else memcpy(indices, ordered.data(), indexCount * sizeof(UINT32));
+		after = Analyze(indices, indexCount, vertexCount);
+	}
+
+	// Distribution of a per-mesh figure such as &CacheStats::Acmr over the meshes that have triangles.
+	struct Spread
+	{
+		float lowest = 0;
+		float median = 0;
+		float p90 = 0;
+		float highest = 0;
+	};
+
+	static Spread MeshSpread(const std::vector<CacheStats>& stats, float (CacheStats::*figure)() const)
+	{
+		std::vector<float> values;
+		for(auto& mesh : stats)
+			if(mesh.triangles > 0) values.push_back((mesh.*figure)());
+		Spread spread;
+		if(values.empty()) return spread;
+		std::sort(values.begin(), values.end());
+		spread.lowest = values.front();
+		spread.median = values[values.size() / 2];
+		spread.p90 = values[values.size() * 9 / 10];
+		spread.highest = values.back();
+		return spread;
+	}
+
+	// Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw".
+	// Fans around the vertex that stays longest in the cache; every restart from a dead end begins a new
+	// cluster, whose first triangle is written to clusters.
+	static void Tipsify(const UINT32* indices, UINT indexCount, UINT vertexCount, UINT32* out, std::vector<UINT32>& clusters)
+	{
+		UINT faceCount = indexCount / 3;
+
+		std::vector<UINT> live(vertexCount, 0);
+		for(UINT i = 0; i < indexCount; ++i) ++live[indices[i]];
+
+		std::vector<UINT> adjacencyStart(vertexCount + 1, 0);
+		for(UINT v = 0; v < vertexCount; ++v) adjacencyStart[v + 1] = adjacencyStart[v] + live[v];
+		std::vector<UINT> adjacency(indexCount);
+		std::vector<UINT> cursor(adjacencyStart.begin(), adjacencyStart.end() - 1);
+		for(UINT i = 0; i < indexCount; ++i) adjacency[cursor[indices[i]]++] = i / 3;
+
+		std::vector<UINT> stamp(vertexCount, 0);
+		std::vector<BYTE> emitted(faceCount, 0);
+		std::vector<UINT32> deadEnd;
+		std::vector<UINT32> candidates;
+		UINT time = cacheSize + 1, scan = 0, written = 0;
+
+		clusters.clear();
+		int fan = NextLive(live, deadEnd, scan);
+		while(fan >= 0)
+		{
+			candidates.clear();
+			for(UINT a = adjacencyStart[fan]; a < adjacencyStart[fan + 1]; ++a)
+			{
+				UINT face = adjacency[a];
+				if(emitted[face]) continue;
+				emitted[face] = 1;
+
+				for(int k = 0; k < 3; ++k)
+				{
+					UINT32 v = indices[face * 3 + k];
+					out[written++] = v;
+					deadEnd.push_back(v);
+					candidates.push_back(v);
+					--live[v];
+					if(time - stamp[v] > cacheSize) stamp[v] = time++;
+				}
+			}
+
+			int next = -1, best = -1;
+			for(UINT32 v : candidates)
+			{
+				if(live[v] == 0) continue;
+				int priority = 0;
+				if(time - stamp[v] + 2 * live[v] <= cacheSize) priority = time - stamp[v];
+				if(priority > best)
+				{
+					best = priority;
+					next = v;
+				}
+			}
+
+			if(next < 0)
+			{
+				next = NextLive(live, deadEnd, scan);
+				if(next >= 0) clusters.push_back(written / 3);
+			}
+			fan = next;
+		}
+
+		if(clusters.empty() || clusters[0] != 0) clusters.insert(clusters.begin(), 0);
+	}
+
+private:
+	struct Block
+	{
+		int mesh;
+		UINT firstIndex;
+		UINT indexCount;
+	};
+
+	// A block is renumbered to the vertices it uses first, so that the per-vertex arrays of the passes scale
+	// with the block and not with its mesh. Numbering keeps the mesh's vertex order, which Tipsify's restart
+	// scan follows.
+	static void OptimizeBlock(const Vertex* vertices, UINT32* indices, UINT indexCount, bool reduceOverdraw, CacheStats& before, CacheStats& after)
+	{
+		std::vector<UINT32> used(indices, indices + indexCount);
+		std::sort(used.begin(), used.end());
+		used.erase(std::unique(used.begin(), used.end()), used.end());
+
+		std::vector<UINT32> local(indexCount);
+		for(UINT i = 0; i < indexCount; ++i) local[i] = std::lower_bound(used.begin(), used.end(), indices[i]) - used.begin();
+		std::vector<Vertex> blockVertices(used.size());
+		for(UINT v = 0; v < used.size(); ++v) blockVertices[v] = vertices[used[v]];
+
+		OptimizeTriangles(blockVertices.data(), local.data(), indexCount, used.size(), reduceOverdraw, before, after);
+		for(UINT i = 0; i < indexCount; ++i) indices[i] = used[local[i]];
+	}
+
+	// Sorts the triangles by the cell of a 16x16x16 grid over the mesh their centroid falls in, cells in
+	// Morton order, so that consecutive triangles form compact patches whatever order the file had them in.
+	// Triangles keep their order within a cell.
+	static void SpatialOrder(const Vertex* vertices, UINT vertexCount, UINT32* indices, UINT indexCount)
+	{
+		XMVECTOR low = XMVectorReplicate(FLT_MAX), high = XMVectorReplicate(-FLT_MAX);
+		for(UINT v = 0; v < vertexCount; ++v)
+		{
+			XMVECTOR p = XMLoadFloat3(&vertices[v].position);
+			low = XMVectorMin(low, p);
+			high = XMVectorMax(high, p);
+		}
+		const float cells = 1 << gridBits;
+		XMVECTOR toCell = XMVectorReplicate(cells / 3) / XMVectorMax(high - low, XMVectorReplicate(1e-20f));
+
+		int faceCount = indexCount / 3;
+		std::vector<UINT> cellOf(faceCount);
+#pragma omp parallel for
+		for(int f = 0; f < faceCount; ++f)
+		{
+			XMVECTOR sum = XMLoadFloat3(&vertices[indices[f * 3]].position) + XMLoadFloat3(&vertices[indices[f * 3 + 1]].position) +
+				XMLoadFloat3(&vertices[indices[f * 3 + 2]].position);
+			XMFLOAT3 cell;
+			XMStoreFloat3(&cell, XMVectorClamp((sum - low * 3) * toCell, XMVectorZero(), XMVectorReplicate(cells - 1)));
+			UINT morton = 0;
+			for(UINT bit = 0; bit < gridBits; ++bit)
+				morton |= ((UINT)cell.x >> bit & 1) << (bit * 3) | ((UINT)cell.y >> bit & 1) << (bit * 3 + 1) | ((UINT)cell.z >> bit & 1) << (bit * 3 + 2);
+			cellOf[f] = morton;
+		}
+
+		std::vector<UINT> cellStart((1 << gridBits * 3) + 1, 0);
+		for(int f = 0; f < faceCount; ++f) ++cellStart[cellOf[f] + 1];
+		for(size_t c = 1; c < cellStart.size(); ++c) cellStart[c] += cellStart[c - 1];
+		std::vector<UINT32> sorted(indexCount);
+		for(int f = 0; f < faceCount; ++f)
+			memcpy(&sorted[cellStart[cellOf[f]]++ * 3], indices + f * 3, 3 * sizeof(UINT32));
+		memcpy(indices, sorted.data(), indexCount * sizeof(UINT32));
+	}
+
+	static int NextLive(const std::vector<UINT>& live, std::vector<UINT32>& deadEnd, UINT& scan)
+	{
+		while(!deadEnd.empty())
+		{
+			UINT32 v = deadEnd.back();
+			deadEnd.pop_back();
+			if(live[v] > 0) return v;
+		}
+		for(; scan < live.size(); ++scan)
+			if(live[scan] > 0) return scan;
+		return -1;
+	}
+
+	// Clusters facing away from the mesh center are drawn first, since they tend to occlude the rest.
+	static void SortClusters(const Vertex* vertices, const UINT32* indices, UINT indexCount, const std::vector<UINT32>& clusters, UINT32* out)
+	{
+		UINT faceCount = indexCount / 3;
+		int clusterCount = clusters.size();
+
+		std::vector<XMFLOAT3> centroids(clusterCount), normals(clusterCount);
+		XMVECTOR meshCentroid = XMVectorZero();
+		float meshArea = 0;
+		for(int c = 0; c < clusterCount; ++c)
+		{
+			UINT end = c + 1 < clusterCount ? clusters[c + 1] : faceCount;
+			XMVECTOR centroid = XMVectorZero(), normal = XMVectorZero();
+			float area = 0;
+			for(UINT face = clusters[c]; face < end; ++face)
+			{
+				XMVECTOR p1 = XMLoadFloat3(&vertices[indices[face * 3 + 0]].position);
+				XMVECTOR p2 = XMLoadFloat3(&vertices[indices[face * 3 + 1]].position);
+				XMVECTOR p3 = XMLoadFloat3(&vertices[indices[face * 3 + 2]].position);
+				XMVECTOR cross = XMVector3Cross(p2 - p1, p3 - p1);
+				float faceArea = XMVectorGetX(XMVector3Length(cross));
+				centroid += (p1 + p2 + p3) * (faceArea / 3);
+				normal += cross;
+				area += faceArea;
+			}
+
+			meshCentroid += centroid;
+			meshArea += area;
+			XMStoreFloat3(&centroids[c], area > 0 ? centroid / area : centroid);
+			XMStoreFloat3(&normals[c], XMVector3Normalize(normal));
+		}
+		if(meshArea > 0) meshCentroid = meshCentroid / meshArea;
+
+		std::vector<float> keys(clusterCount);
+		std::vector<int> order(clusterCount);
+		for(int c = 0; c < clusterCount; ++c)
+		{
+			keys[c] = XMVectorGetX(XMVector3Dot(XMLoadFloat3(&centroids[c]) - meshCentroid, XMLoadFloat3(&normals[c])));
+			order[c] = c;
+		}
+		std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return keys[a] > keys[b]; });
+
+		for(int c : order)
+		{
+			UINT end = c + 1 < clusterCount ? clusters[c + 1] : faceCount;
+			UINT count = (end - clusters[c]) * 3;
+			memcpy(out, indices + clusters[c] * 3, count * sizeof(UINT32));
+			out += count;
+		}
+	}
+
+	// Vertices are renumbered in the order the index buffer first touches them; unused ones go last.
+	static void RemapVertices(Vertex* vertices, UINT vertexCount, UINT32* indices, UINT indexCount)
+	{
+		const UINT32 unused = 0xffffffff;
+		std::vector<UINT32> remap(vertexCount, unused);
+		UINT32 next = 0;
+		for(UINT i = 0; i < indexCount; ++i)
+		{
+			if(remap[indices[i]] == unused) remap[indices[i]] = next++;
+			indices[i] = remap[indices[i]];
+		}
+		for(UINT v = 0; v < vertexCount; ++v)
+			if(remap[v] == unused) remap[v] = next++;
+
+		std::vector<Vertex> reordered(vertexCount);
+		for(UINT v = 0; v < vertexCount; ++v) reordered[remap[v]] = vertices[v];
+		memcpy(vertices, reordered.data(), vertexCount * sizeof(Vertex));
+	}
+};
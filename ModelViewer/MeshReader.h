@@ -0,0 +1,70 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include <vector>
+#include <string>
+#include <cctype>
+
+// Helpers shared by the native OBJ, STL and PLY readers, which all produce what an Assimp import with
+// ConvertToLeftHanded would: z negated and the winding flipped.
+class MeshReader
+{
+public:
+	static bool HasExtension(const std::string& fileName, const char* extension)
+	{
+		size_t dot = fileName.find_last_of('.');
+		if(dot == std::string::npos) return false;
+		std::string fileExtension = fileName.substr(dot + 1);
+		for(auto& c : fileExtension) c = tolower(c);
+		return fileExtension == extension;
+	}
+
+	static XMFLOAT3 Flip(const XMFLOAT3& value)
+	{
+		return {value.x, value.y, -value.z};
+	}
+
+	// Area-weighted vertex normals over shared vertices.
+	static void ComputeNormals(std::vector<Vertex>& vertices, const std::vector<UINT32>& indices)
+	{
+		ComputeNormals(vertices.data(), vertices.size(), indices.data(), indices.size());
+	}
+
+	static void ComputeNormals(Vertex* vertices, UINT vertexCount, const UINT32* indices, UINT indexCount)
+	{
+		int faceCount = indexCount / 3;
+		std::vector<XMFLOAT3> faceNormals(faceCount);
+#pragma omp parallel for
+		for(int f = 0; f < faceCount; ++f)
+		{
+			XMVECTOR a = XMLoadFloat3(&vertices[indices[f * 3]].position);
+			XMVECTOR b = XMLoadFloat3(&vertices[indices[f * 3 + 1]].position);
+			XMVECTOR c = XMLoadFloat3(&vertices[indices[f * 3 + 2]].position);
+			XMStoreFloat3(&faceNormals[f], XMVector3Cross(b - a, c - a));
+		}
+
+		for(UINT v = 0; v < vertexCount; ++v) vertices[v].normal = {0, 0, 0};
+		for(int f = 0; f < faceCount; ++f)
+			for(int k = 0; k < 3; ++k)
+			{
+				XMFLOAT3& normal = vertices[indices[f * 3 + k]].normal;
+				normal.x += faceNormals[f].x;
+				normal.y += faceNormals[f].y;
+				normal.z += faceNormals[f].z;
+			}
+
+#pragma omp parallel for
+		for(int v = 0; v < (int)vertexCount; ++v)
+			XMStoreFloat3(&vertices[v].normal, XMVector3Normalize(XMLoadFloat3(&vertices[v].normal)));
+	}
+
+	static MeshRange SingleMesh(UINT vertexCount, UINT indexCount, UINT faceSize, bool hasColors)
+	{
+		MeshRange range = {};
+		range.vertexCount = vertexCount;
+		range.indexCount = indexCount;
+		range.faceSize = faceSize;
+		range.hasColors = hasColors;
+		return range;
+	}
+};
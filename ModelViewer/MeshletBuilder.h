@@ -0,0 +1,271 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include "ArrayView.h"
+#include "ImportProgress.h"
+#include <vector>
+#include <algorithm>
+
+// A run of triangles inside one mesh's index range; firstIndex is relative to the mesh's first index.
+struct Meshlet
+{
+	UINT firstIndex;
+	UINT indexCount;
+};
+
+// Bounding sphere and normal cone of every meshlet in SoA form, padded to a multiple of four so the
+// culler never needs a tail. A cutoff of 1 marks a cone that can never be back-facing.
+struct ClusterBounds
+{
+	std::vector<float> centerX, centerY, centerZ, radius;
+	std::vector<float> axisX, axisY, axisZ, cutoff;
+	UINT count = 0;
+
+	void Resize(UINT n)
+	{
+		count = n;
+		UINT padded = (n + 3) & ~3u;
+		for(auto* lane : {&centerX, &centerY, &centerZ, &radius, &axisX, &axisY, &axisZ}) lane->assign(padded, 0);
+		cutoff.assign(padded, 1);
+	}
+};
+
+// Splits every triangle mesh into meshlets of at most maxVertices vertices and maxTriangles triangles
+// and rewrites its indices meshlet by meshlet, so that every meshlet is a contiguous draw range.
+class MeshletBuilder
+{
+public:
+	static constexpr UINT maxVertices = 64;
+	static constexpr UINT maxTriangles = 124;
+
+	static void Build(
+		ArrayView<Vertex> vertices,
+		std::vector<UINT32>& indices,
+		const std::vector<MeshRange>& meshRanges,
+		std::vector<Meshlet>& meshlets,
+		std::vector<UINT>& meshMeshlets,
+		ClusterBounds& bounds,
+		ImportProgress* progress = nullptr)
+	{
+		int meshCount = meshRanges.size();
+		std::vector<std::vector<Meshlet>> split(meshCount);
+		std::vector<BYTE> closed(meshCount, 0);
+
+		std::atomic<int> done{0};
+#pragma omp parallel for schedule(dynamic)
+		for(int i = 0; i < meshCount; ++i)
+		{
+			if(progress && progress->Cancelled()) continue;
+			const MeshRange& range = meshRanges[i];
+			if(range.faceSize == 3 && range.indexCount >= 3)
+			{
+				UINT32* meshIndices = indices.data() + range.firstIndex;
+				split[i] = Split(meshIndices, range.indexCount, range.vertexCount);
+				closed[i] = Closed(vertices.data() + range.baseVertex, meshIndices, range.indexCount, range.vertexCount);
+			}
+			if(progress) progress->Report(ImportStage::Meshlets, (float)++done / meshCount);
+		}
+		if(progress) progress->Check();
+
+		meshMeshlets.assign(meshCount + 1, 0);
+		for(int i = 0; i < meshCount; ++i) meshMeshlets[i + 1] = meshMeshlets[i] + split[i].size();
+		meshlets.resize(meshMeshlets[meshCount]);
+		bounds.Resize(meshlets.size());
+
+#pragma omp parallel for schedule(dynamic)
+		for(int i = 0; i < meshCount; ++i)
+		{
+			const MeshRange& range = meshRanges[i];
+			for(UINT m = 0; m < split[i].size(); ++m)
+			{
+				UINT cluster = meshMeshlets[i] + m;
+				meshlets[cluster] = split[i][m];
+				ComputeBounds(
+					vertices.data() + range.baseVertex,
+					indices.data() + range.firstIndex + split[i][m].firstIndex,
+					split[i][m].indexCount,
+					closed[i] != 0,
+					bounds,
+					cluster);
+			}
+		}
+	}
+
+private:
+	// Grows every meshlet from the first triangle left in index order, which keeps the Tipsify order
+	// between meshlets, by always adding the adjacent triangle that brings the fewest new vertices.
+	static std::vector<Meshlet> Split(UINT32* indices, UINT indexCount, UINT vertexCount)
+	{
+		UINT faceCount = indexCount / 3;
+
+		std::vector<UINT> adjacencyStart(vertexCount + 1, 0);
+		for(UINT i = 0; i < faceCount * 3; ++i) ++adjacencyStart[indices[i] + 1];
+		for(UINT v = 0; v < vertexCount; ++v) adjacencyStart[v + 1] += adjacencyStart[v];
+		std::vector<UINT> adjacency(faceCount * 3);
+		std::vector<UINT> cursor(adjacencyStart.begin(), adjacencyStart.end() - 1);
+		for(UINT i = 0; i < faceCount * 3; ++i) adjacency[cursor[indices[i]]++] = i / 3;
+
+		std::vector<BYTE> emitted(faceCount, 0);
+		std::vector<UINT> owner(vertexCount, 0);
+		std::vector<UINT> candidates;
+		std::vector<UINT32> ordered;
+		ordered.reserve(faceCount * 3);
+		std::vector<Meshlet> meshlets;
+
+		for(UINT seed = 0;; ++seed)
+		{
+			while(seed < faceCount && emitted[seed]) ++seed;
+			if(seed == faceCount) break;
+
+			UINT id = meshlets.size() + 1;
+			Meshlet meshlet = {(UINT)ordered.size(), 0};
+			UINT meshletVertices = 0;
+			candidates.assign(1, seed);
+			while(meshlet.indexCount < maxTriangles * 3)
+			{
+				int best = -1;
+				UINT bestAdded = 4;
+				for(size_t c = 0; c < candidates.size();)
+				{
+					UINT face = candidates[c];
+					if(emitted[face])
+					{
+						candidates[c] = candidates.back();
+						candidates.pop_back();
+						continue;
+					}
+					UINT added = 0;
+					for(int k = 0; k < 3; ++k) added += owner[indices[face * 3 + k]] != id;
+					if(added < bestAdded)
+					{
+						bestAdded = added;
+						best = c;
+						if(added == 0) break;
+					}
+					++c;
+				}
+				if(best < 0 || meshletVertices + bestAdded > maxVertices) break;
+
+				UINT face = candidates[best];
+				emitted[face] = 1;
+				for(int k = 0; k < 3; ++k)
+				{
+					UINT32 v = indices[face * 3 + k];
+					ordered.push_back(v);
+					if(owner[v] == id) continue;
+					owner[v] = id;
+					++meshletVertices;
+					for(UINT a = adjacencyStart[v]; a < adjacencyStart[v + 1]; ++a)
+						if(!emitted[adjacency[a]]) candidates.push_back(adjacency[a]);
+				}
+				meshlet.indexCount += 3;
+			}
+			meshlets.push_back(meshlet);
+		}
+
+		memcpy(indices, ordered.data(), ordered.size() * sizeof(UINT32));
+		return meshlets;
+	}
+
+	// The viewer draws both sides, so only meshes without open edges may lose their back-facing meshlets.
+	// Assimp output is not welded, so vertices are matched by position: every edge must be used twice.
+	static bool Closed(const Vertex* vertices, const UINT32* indices, UINT indexCount, UINT vertexCount)
+	{
+		std::vector<UINT32> order(vertexCount);
+		for(UINT v = 0; v < vertexCount; ++v) order[v] = v;
+		auto less = [&](UINT32 a, UINT32 b)
+		{
+			const XMFLOAT3& p = vertices[a].position;
+			const XMFLOAT3& q = vertices[b].position;
+			if(p.x != q.x) return p.x < q.x;
+			if(p.y != q.y) return p.y < q.y;
+			return p.z < q.z;
+		};
+		std::sort(order.begin(), order.end(), less);
+
+		std::vector<UINT32> weld(vertexCount);
+		UINT32 id = 0;
+		for(UINT k = 0; k < vertexCount; ++k)
+		{
+			if(k > 0 && less(order[k - 1], order[k])) ++id;
+			weld[order[k]] = id;
+		}
+
+		// Directed edges of a closed, consistently wound surface pair up with their reverses.
+		UINT faceCount = indexCount / 3;
+		std::vector<UINT64> edges, reversed;
+		edges.reserve(faceCount * 3);
+		reversed.reserve(faceCount * 3);
+		for(UINT f = 0; f < faceCount; ++f)
+		{
+			for(int k = 0; k < 3; ++k)
+			{
+				UINT64 a = weld[indices[f * 3 + k]], b = weld[indices[f * 3 + (k + 1) % 3]];
+				if(a == b) continue;
+				edges.push_back(a << 32 | b);
+				reversed.push_back(b << 32 | a);
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		std::sort(reversed.begin(), reversed.end());
+		return edges == reversed;
+	}
+
+	static void ComputeBounds(
+		const Vertex* vertices,
+		const UINT32* indices,
+		UINT indexCount,
+		bool closed,
+		ClusterBounds& bounds,
+		UINT cluster)
+	{
+		XMVECTOR center = XMVectorZero();
+		for(UINT i = 0; i < indexCount; ++i) center += XMLoadFloat3(&vertices[indices[i]].position);
+		center = center / (float)indexCount;
+
+		float radius = 0;
+		for(UINT i = 0; i < indexCount; ++i)
+			radius = max(radius, XMVectorGetX(XMVector3Length(XMLoadFloat3(&vertices[indices[i]].position) - center)));
+
+		// Face normals are oriented by the vertex normals, which follow the winding Assimp produced.
+		std::vector<XMFLOAT3> normals;
+		normals.reserve(indexCount / 3);
+		XMVECTOR axis = XMVectorZero();
+		for(UINT i = 0; i + 2 < indexCount; i += 3)
+		{
+			const Vertex& a = vertices[indices[i]];
+			const Vertex& b = vertices[indices[i + 1]];
+			const Vertex& c = vertices[indices[i + 2]];
+			XMVECTOR p1 = XMLoadFloat3(&a.position);
+			XMVECTOR normal = XMVector3Cross(XMLoadFloat3(&b.position) - p1, XMLoadFloat3(&c.position) - p1);
+			if(XMVectorGetX(XMVector3LengthSq(normal)) == 0) continue;
+			XMVECTOR shading = XMLoadFloat3(&a.normal) + XMLoadFloat3(&b.normal) + XMLoadFloat3(&c.normal);
+			if(XMVectorGetX(XMVector3Dot(normal, shading)) < 0) normal = -normal;
+			normal = XMVector3Normalize(normal);
+			normals.push_back({});
+			XMStoreFloat3(&normals.back(), normal);
+			axis += normal;
+		}
+
+		float minDot = 1;
+		if(XMVectorGetX(XMVector3LengthSq(axis)) > 0)
+		{
+			axis = XMVector3Normalize(axis);
+			for(auto& normal : normals) minDot = min(minDot, XMVectorGetX(XMVector3Dot(axis, XMLoadFloat3(&normal))));
+		}
+		else minDot = -1;
+
+		XMFLOAT3 c, n;
+		XMStoreFloat3(&c, center);
+		XMStoreFloat3(&n, axis);
+		bounds.centerX[cluster] = c.x;
+		bounds.centerY[cluster] = c.y;
+		bounds.centerZ[cluster] = c.z;
+		bounds.radius[cluster] = radius;
+		bounds.axisX[cluster] = n.x;
+		bounds.axisY[cluster] = n.y;
+		bounds.axisZ[cluster] = n.z;
+		// The cone of view directions that see only back faces has the sine of the normal spread as cosine.
+		bounds.cutoff[cluster] = closed && minDot > 0 ? sqrtf(1 - minDot * minDot) : 1;
+	}
+};
@@ -9,32 +9,101 @@
 #include <string>
 #include <iostream>
 #include <algorithm>
+#include <chrono>
+#include <thread>
 #include "IndexBuffer.h"
+#include "EdgeExtractor.h"
+#include "FlatShading.h"
+#include "Bounds.h"
+#include "ModelCache.h"
+#include "MappedIOSystem.h"
+#include "ImportProgress.h"
+#include "MeshOptimizer.h"
+#include "PackedVertex.h"
+#include "IndexStore.h"
+#include "GeometryArena.h"
+#include "Simplifier.h"
+#include "MeshletBuilder.h"
+#include "ClusterCuller.h"
+#include "FrustumCuller.h"
+#include "OcclusionCuller.h"
+#include "RenderQueue.h"
+#include "Camera.h"
+#include "SceneGraph.h"
+#include "ModelWriter.h"
+#include "ObjReader.h"
+#include "StlReader.h"
+#include "PlyReader.h"
+#include "GltfReader.h"
+#include <psapi.h>
 
 #pragma comment(lib, "assimp-vc140-mt.lib")
+#pragma comment(lib, "psapi.lib")
 
-struct Point
+// What a model keeps of its CPU geometry once it is on the GPU. Drawing never reads it; export does, and
+// rebuilds whatever was released first.
+enum class Retention
 {
-	float min, max;
-	Point() { min = 1e30; max = -1e30; }
-	Point(float x, float y)
-	{
-		this->min = x;
-		this->max = y;
-	}
-	inline float Middle()
-	{
-		return (min + max) * 0.5;
-	}
+	Keep,		// vertices and every index store
+	Compress,	// packed vertices and the triangle indices; export decodes them within the packing error
+	Drop		// nothing; export reloads the import cache, or imports the file again
+};
+
+struct ImportOptions
+{
+	bool dropDiagonals = false;
+	bool mappedIO = true;
+	bool optimizeIndices = true;
+	bool reduceOverdraw = false;
+	bool packVertices = false;
+	bool buildLods = true;
+	bool buildMeshlets = true;
+	bool occlusionCulling = true;
+	bool nativeReaders = true;
+	// Off reads and writes no import cache, so every load runs the whole import.
+	bool useCache = true;
+	Retention retention = Retention::Drop;
+
+	// Options that change the cached geometry and therefore belong in the cache key.
+	UINT32 ProcessFlags() const { return (optimizeIndices ? 1 : 0) | (reduceOverdraw ? 2 : 0) | (nativeReaders ? 4 : 0); }
+};
+
+// A mesh range drawn once per node that references the mesh.
+struct InstancedDraw
+{
+	DrawRange draw;
+	UINT firstInstance;
+	UINT instanceCount;
+	// Nearest view distance of the draw's meshes, for front-to-back ordering.
+	float depth = 0;
+};
+
+// Bytes a model holds by category. GPU buffers are counted at their requested size; upload heaps are
+// the staging copies kept until ReleaseUploadBuffers.
+struct ModelMemory
+{
+	size_t vertices = 0;
+	size_t indices = 0;
+	size_t lods = 0;
+	size_t culling = 0;
+	size_t draws = 0;
+	size_t gpuBuffers = 0;
+	size_t uploadBuffers = 0;
+
+	size_t Cpu() const { return vertices + indices + lods + culling + draws; }
+	size_t Gpu() const { return gpuBuffers + uploadBuffers; }
 };
 
 const std::string modelTypeList[] = {
 	"*.obj",
+	"*.stl",
+	"*.ply",
 	"*.fbx",
 	"*.3d",
 	"*.blend",
 	"*.dae",
 	"*.glTF",
+	"*.glb",
 	"*.dxf",
 	"*.m3d",
 	"*.ogex",
@@ -48,222 +117,1165 @@ class Model
 {
 public:
 	std::shared_ptr<VertexBuffer> vertexBuffer;
-	std::shared_ptr<VertexBuffer> solidVertexBuffer;
-	std::vector<std::shared_ptr<IndexBuffer>> indexBuffers;
-	std::vector<std::shared_ptr<IndexBuffer>> lineIndexBuffers;
+	std::shared_ptr<IndexBuffer> arenaIndexBuffer;
 
+	// Imported vertices. A cache hit leaves this empty and reads them in place from the cache file;
+	// Vertices() is the model's vertices either way.
 	std::vector<Vertex> vertices;
-	std::vector<Vertex> solidVertices;
+	std::vector<Vertex> flatVertices;
 	std::vector<UINT32> indices;
 	std::vector<UINT32> lineIndices;
+	std::vector<UINT32> flatIndices;
+
+	IndexStore triangleStore;
+	IndexStore lineStore;
+	IndexStore flatStore;
+
+	GeometryArena arena;
+	std::vector<DrawRange> triangleDraws;
+	std::vector<DrawRange> lineDraws;
+	std::vector<DrawRange> flatDraws;
+	// Line and flat shading ranges of every single mesh; lineDraws and flatDraws are this frame's visible ones.
+	std::vector<DrawRange> lineMeshDraws;
+	std::vector<DrawRange> flatMeshDraws;
+
+	// levelDraws[level][mesh] is the range of every mesh at every LOD; selectedDraws is this frame's pick.
+	std::vector<UINT32> lodIndices;
+	std::vector<MeshLod> lods;
+	std::vector<UINT> meshLods;
+	std::vector<std::vector<DrawRange>> levelDraws;
+	std::vector<DrawRange> selectedDraws;
+	// View distance of the nearest mesh in each of this frame's merged draws.
+	std::vector<float> selectedDepths;
+	std::vector<float> lineDepths;
+	std::vector<float> flatDepths;
+
+	// Draws handed to the last Submit, replayed one by one through DrawQueued.
+	std::vector<InstancedDraw> queuedDraws;
+	D3D12_PRIMITIVE_TOPOLOGY queuedTopology = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	DXGI_FORMAT boundFormat = DXGI_FORMAT_UNKNOWN;
+
+	// Meshlets of the level 0 triangles; meshMeshlets[mesh] is the first meshlet of every mesh.
+	std::vector<Meshlet> meshlets;
+	std::vector<UINT> meshMeshlets;
+	ClusterBounds clusterBounds;
+	std::vector<BYTE> visibleClusters;
+
+	// Box of every baked mesh, then of every instance of the instanced meshes, after the instance transform;
+	// meshVisible is this frame's frustum test of each and meshUnoccluded that test with the boxes hidden
+	// behind the occluders cleared. Lines are seen through surfaces, so they only use the frustum test.
+	BoxBounds meshBoxes;
+	std::vector<BYTE> meshVisible;
+	std::vector<BYTE> meshUnoccluded;
+	UINT visibleBoxes = 0;
+
+	// Coarse triangles of the largest baked meshes, rasterized every frame to hide the boxes behind them.
+	OccluderMesh occluders;
+	OcclusionCuller occlusion;
+
+	// Meshes referenced by a single node have the node transform baked into their vertices and are drawn
+	// with instance 0, the identity. Meshes referenced by several nodes come last, from
+	// firstInstancedMesh on, and keep one transform per node: instances [meshInstances[i], meshInstances[i + 1]).
+	std::vector<InstanceTransform> instanceTransforms;
+	std::vector<UINT> meshInstances;
+	int firstInstancedMesh = 0;
+	std::shared_ptr<VertexBuffer> instanceBuffer;
+	std::vector<InstancedDraw> lineInstances;
+	std::vector<InstancedDraw> flatInstances;
+	std::vector<InstancedDraw> selectedInstances;
+
+	std::vector<PackedVertex> packedVertices;
+	std::vector<UINT32> packedColors;
+	std::vector<PackedMesh> packedMeshes;
 
 	ComPtr<ID3D12Device4> device;
 	ComPtr<ID3D12GraphicsCommandList> cmdList;
 
-	int faceCount;
+	std::vector<MeshRange> meshRanges;
+	std::vector<MeshRange> flatRanges;
+
+	int faceCount = 0;
+	int vertexCount = 0;
 
 public:
-	Point lr[3];
+	Bounds bounds;
+	std::vector<Bounds> meshBounds;
 	static constexpr double maxLength = 800;
 	double scale = 1;
 	std::string modelFileName;
 
+	static constexpr UINT importFlags = 
+		aiProcess_Triangulate | aiProcess_SortByPType | aiProcess_GenNormals | aiProcess_ConvertToLeftHanded;
+
 	Model(
-		std::shared_ptr<VertexBuffer> vb, 
-		std::shared_ptr<IndexBuffer> ib, 
+		std::string fileName, 
 		ComPtr<ID3D12Device4> device, 
-		ComPtr<ID3D12GraphicsCommandList> cmdList)
+		ComPtr<ID3D12GraphicsCommandList> cmdList, 
+		ImportOptions options = ImportOptions())
+	{
+		if(Load(fileName, options, nullptr)) Upload(device, cmdList);
+	}
+
+	// CPU half of a load, safe to run on a worker thread. Throws ImportCancelled once progress is
+	// cancelled; the members are then released with the half-built model.
+	Model(std::string fileName, ImportProgress& progress, ImportOptions options = ImportOptions())
+	{
+		Load(fileName, options, &progress);
+	}
+
+	bool Loaded() const { return !meshRanges.empty(); }
+
+	ArrayView<Vertex> Vertices() const
+	{
+		return cacheFile ? cachedVertices : ArrayView<Vertex>(vertices);
+	}
+
+	// GPU half of a load: creates the buffers on the render thread's command list.
+	void Upload(ComPtr<ID3D12Device4> device, ComPtr<ID3D12GraphicsCommandList> cmdList)
 	{
 		this->device = device;
 		this->cmdList = cmdList;
 
-		vertexBuffer = vb;
-		lineIndexBuffers.push_back(ib);
+		vertexBuffer = std::make_shared<VertexBuffer>(
+			device, cmdList, [this](void* out) { arena.CopyVertices(static_cast<Vertex*>(out)); }, sizeof(Vertex), arena.VertexCount() );
+		// Both index widths are views of one buffer, so it is created with a whole number of 32-bit indices.
+		arena.indexData.resize((arena.indexData.size() + 3) & ~3);
+		if(!arena.indexData.empty())
+			arenaIndexBuffer = std::make_shared<IndexBuffer>(
+				device, cmdList, arena.indexData.data(), arena.indexData.size() / 4, DXGI_FORMAT_R32_UINT );
+		arena.ReleaseStaging();
+		instanceBuffer = std::make_shared<VertexBuffer>(
+			device, cmdList, instanceTransforms.data(), sizeof(InstanceTransform), instanceTransforms.size() );
+
+		vertexCount = Vertices().size();
+		faceCount = 0;
+		for(auto& draw : triangleDraws) faceCount += draw.indexCount / 3;
+		for(int i = firstInstancedMesh; i < (int)meshRanges.size(); ++i)
+			faceCount += levelDraws[0][i].indexCount / 3 * (meshInstances[i + 1] - meshInstances[i]);
+		printf("Model:  %d vertices\n", vertexCount);
+
+		applyRetention();
+		ModelMemory memory = Memory();
+		printf("Model:  CPU %.1f MB (vertices %.1f, indices %.1f, LODs %.1f, culling %.1f, draws %.1f), GPU %.1f MB and %.1f MB of upload heaps\n",
+			memory.Cpu() / 1048576.0, memory.vertices / 1048576.0, memory.indices / 1048576.0, memory.lods / 1048576.0,
+			memory.culling / 1048576.0, memory.draws / 1048576.0, memory.gpuBuffers / 1048576.0, memory.uploadBuffers / 1048576.0);
+	}
+
+	// The upload heaps are only read by the copies recorded with the buffers; call once those have executed.
+	void ReleaseUploadBuffers()
+	{
+		for(VertexBuffer* buffer : {vertexBuffer.get(), instanceBuffer.get()})
+			if(buffer) buffer->uploadBuffer.Reset();
+		if(arenaIndexBuffer) arenaIndexBuffer->uploadBuffer.Reset();
+	}
+
+	ModelMemory Memory() const
+	{
+		ModelMemory memory;
+		memory.vertices = Bytes(vertices) + cachedVertices.size() * sizeof(Vertex) + Bytes(flatVertices) + Bytes(packedVertices) +
+			Bytes(packedColors);
+		memory.indices = triangleStore.Bytes() + lineStore.Bytes() + flatStore.Bytes() + Bytes(arena.indexData) +
+			Bytes(indices) + Bytes(lineIndices) + Bytes(flatIndices);
+		memory.lods = Bytes(lodIndices) + Bytes(lods) + Bytes(meshLods);
+		for(auto& level : levelDraws) memory.lods += Bytes(level);
+		memory.culling = Bytes(meshlets) + Bytes(meshMeshlets) + Bytes(visibleClusters) + Bytes(meshBounds) + meshBoxes.Bytes() + Bytes(meshVisible) +
+			Bytes(meshUnoccluded) + occluders.Bytes() + occlusion.Bytes();
+		for(auto* lane : {&clusterBounds.centerX, &clusterBounds.centerY, &clusterBounds.centerZ, &clusterBounds.radius,
+			&clusterBounds.axisX, &clusterBounds.axisY, &clusterBounds.axisZ, &clusterBounds.cutoff}) memory.culling += Bytes(*lane);
+		memory.draws = Bytes(triangleDraws) + Bytes(lineDraws) + Bytes(flatDraws) + Bytes(selectedDraws) + Bytes(lineMeshDraws) + Bytes(flatMeshDraws) +
+			Bytes(selectedDepths) + Bytes(lineDepths) + Bytes(flatDepths) + Bytes(queuedDraws) +
+			Bytes(instanceTransforms) + Bytes(meshInstances) + Bytes(lineInstances) + Bytes(flatInstances) + Bytes(selectedInstances) +
+			Bytes(meshRanges) + Bytes(flatRanges) + Bytes(packedMeshes);
+
+		CountBuffer(vertexBuffer, memory);
+		CountBuffer(instanceBuffer, memory);
+		CountBuffer(arenaIndexBuffer, memory);
+		return memory;
+	}
+
+	XMMATRIX getModel()
+	{
+		return XMMatrixScaling(scale, scale, scale);
+	}
+
+	// Queues this frame's draws of the topology; command commandBase + k replays draw k through DrawQueued.
+	// The material is the index width, so draws that share an index buffer view end up next to each other.
+	// Points are drawn without indices, as one command.
+	void Submit(RenderQueue& queue, D3D12_PRIMITIVE_TOPOLOGY primitiveType, UINT pass, UINT pso, UINT commandBase)
+	{
+		queuedDraws.clear();
+		queuedTopology = primitiveType;
+		if(primitiveType == D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST)
+		{
+			if(levelDraws.empty()) queueDraws(triangleDraws, {}, selectedInstances);
+			else queueDraws(selectedDraws, selectedDepths, selectedInstances);
+		}
+		else if(primitiveType == D3D_PRIMITIVE_TOPOLOGY_LINELIST) queueDraws(lineDraws, lineDepths, lineInstances);
+		else if(primitiveType == D3D_PRIMITIVE_TOPOLOGY_LINESTRIP) queueDraws(flatDraws, flatDepths, flatInstances);
+		else queuedDraws.push_back({});
+
+		for(UINT k = 0; k < queuedDraws.size(); ++k)
+		{
+			UINT material = queuedDraws[k].draw.format == DXGI_FORMAT_R16_UINT ? 0 : 1;
+			queue.Add(RenderQueue::MakeKey(pass, pso, material, queuedDraws[k].depth), commandBase + k);
+		}
+	}
+
+	// Sets the topology and buffers the queued draws expect; needed again after anything else was drawn.
+	void Bind()
+	{
+		bool flat = queuedTopology == D3D_PRIMITIVE_TOPOLOGY_LINESTRIP;
+		cmdList->IASetPrimitiveTopology(flat ? D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST : queuedTopology);
+		vertexBuffer->Bind(cmdList);
+		instanceBuffer->Bind(cmdList, 1);
+		boundFormat = DXGI_FORMAT_UNKNOWN;
+	}
+
+	void DrawQueued(UINT k)
+	{
+		const InstancedDraw& queued = queuedDraws[k];
+		if(queuedTopology != D3D_PRIMITIVE_TOPOLOGY_POINTLIST)
+		{
+			drawRange(queued.draw, queued.firstInstance, queued.instanceCount, boundFormat);
+			return;
+		}
+		UINT bakedVertices = firstInstancedMesh < (int)meshRanges.size() ? meshRanges[firstInstancedMesh].baseVertex : vertexCount;
+		cmdList->DrawInstanced(bakedVertices, 1, 0, 0);
+		for(int i = firstInstancedMesh; i < (int)meshRanges.size(); ++i)
+			cmdList->DrawInstanced(meshRanges[i].vertexCount, meshInstances[i + 1] - meshInstances[i], meshRanges[i].baseVertex, meshInstances[i]);
+	}
+
+	// Picks for every mesh the coarsest LOD whose error, projected at the near side of the mesh's
+	// bounding sphere, stays under maxPixelError, and draws meshes at level 0 as their visible meshlets.
+	// Meshes and instances whose box is outside the frustum are left out of every topology, and those whose
+	// box is hidden behind the occluders out of the triangles and flat shading. Every merged draw keeps the
+	// depth of its nearest mesh for Submit.
+	// pixelsPerUnit is the screen height in pixels over the view height at distance one; eye and
+	// viewProjection are in world space.
+	void SelectDraws(XMVECTOR eye, FXMMATRIX viewProjection, float pixelsPerUnit)
+	{
+		if(levelDraws.empty()) return;
+		XMMATRIX modelViewProjection = getModel() * viewProjection;
+		if(!meshlets.empty())
+			ClusterCuller::Cull(clusterBounds, eye / (float)scale, modelViewProjection, visibleClusters);
+		visibleBoxes = FrustumCuller::Cull(meshBoxes, modelViewProjection, meshVisible);
+		meshUnoccluded = meshVisible;
+		if(occluders.TriangleCount() > 0)
+		{
+			occlusion.Render(occluders, modelViewProjection);
+			visibleBoxes = occlusion.Test(meshBoxes, modelViewProjection, meshUnoccluded);
+		}
+
+		std::vector<DrawRange> draws, lines, flats;
+		std::vector<float> drawDepths, lineMeshDepths, flatMeshDepths;
+		draws.reserve(meshRanges.size());
+		selectedInstances.clear();
+		lineInstances.clear();
+		flatInstances.clear();
+		for(int i = 0; i < (int)meshRanges.size(); ++i)
+		{
+			if(i >= firstInstancedMesh)
+			{
+				// Meshlet bounds are in mesh space, so instanced meshes are only culled instance by instance.
+				UINT level = meshLods.empty() ? 0 : selectLevel(i, meshDistance(i, eye), pixelsPerUnit);
+				addVisibleInstances(i, levelDraws[level][i], meshUnoccluded, eye, selectedInstances);
+				addVisibleInstances(i, lineMeshDraws[i], meshVisible, eye, lineInstances);
+				addVisibleInstances(i, flatMeshDraws[i], meshUnoccluded, eye, flatInstances);
+				continue;
+			}
+			if(!meshVisible[i]) continue;
+			float depth = boxDepth(i, eye);
+			lines.push_back(lineMeshDraws[i]);
+			lineMeshDepths.push_back(depth);
+			if(!meshUnoccluded[i]) continue;
+			flats.push_back(flatMeshDraws[i]);
+			flatMeshDepths.push_back(depth);
+
+			UINT level = meshLods.empty() ? 0 : selectLevel(i, meshDistance(i, eye), pixelsPerUnit);
+			const DrawRange& draw = levelDraws[level][i];
+			if(level == 0 && !meshlets.empty() && meshMeshlets[i] < meshMeshlets[i + 1])
+			{
+				for(UINT m = meshMeshlets[i]; m < meshMeshlets[i + 1]; ++m)
+					if(visibleClusters[m])
+					{
+						draws.push_back({draw.firstIndex + meshlets[m].firstIndex, meshlets[m].indexCount, draw.baseVertex, draw.format});
+						drawDepths.push_back(depth);
+					}
+			}
+			else if(draw.indexCount > 0)
+			{
+				draws.push_back(draw);
+				drawDepths.push_back(depth);
+			}
+		}
+		selectedDraws = MergeDraws(draws, drawDepths, selectedDepths);
+		lineDraws = MergeDraws(lines, lineMeshDepths, lineDepths);
+		flatDraws = MergeDraws(flats, flatMeshDepths, flatDepths);
+	}
+
+	static std::string GetReadFileTypeList()
+	{
+		std::string res = "3D Model(" + modelTypeList[0];
+		for(int i = 1; i < _countof(modelTypeList); ++i)
+			res += " " + modelTypeList[i];
+		res += ")";
+		return res;
+	}
+
+	// OBJ, PLY and STL are written natively from the geometry in memory; other formats still go
+	// through an Assimp round trip of the source file. Restoring released geometry may read the whole
+	// file again, so this runs on a worker thread; drawing does not touch the CPU geometry it swaps.
+	void saveModel(std::string fileName)
+	{
+		if(fileName.empty()) return;
+		ExportFormat format = ModelWriter::FormatOf(fileName);
+		if(format == ExportFormat::Unknown)
+		{
+			saveWithAssimp(fileName);
+			return;
+		}
+		if(!restoreGeometry())
+		{
+			printf("Model:  could not restore the geometry of %s\n", modelFileName.c_str());
+			return;
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+		UINT64 bytes = 0;
+		bool written = ModelWriter::Write(fileName, format, exportParts(), bytes);
+		applyRetention();
+		if(!written)
+		{
+			printf("Model:  could not write %s\n", fileName.c_str());
+			return;
+		}
+		double ms = ElapsedMs(start);
+		printf("Model:  exported %.1f MB in %.1f ms, %.1f MB/s\n", bytes / 1048576.0, ms, bytes / 1048576.0 / max(ms, 0.001) * 1000);
+	}
+
+private:
+	struct ExtractChunk
+	{
+		int mesh;
+		UINT begin, end;
+		UINT indexOffset;
+	};
+
+	// Scratch model for reimportGeometry.
+	Model() = default;
+
+	static constexpr UINT extractChunkSize = 1 << 16;
+	static constexpr UINT extractBatchVertices = 1 << 22;
+	// aiScene and aiMesh have inline destructors, so deleting them here frees Assimp's allocations from
+	// this module. That is safe only because the release build and assimp-vc140-mt both link the dynamic
+	// release UCRT (/MD) and so share one heap; the debug build links ucrtbased and leaves the scene to the
+	// importer.
+#if defined(_DLL) && !defined(_DEBUG)
+	static constexpr bool sharesAssimpHeap = true;
+#else
+	static constexpr bool sharesAssimpHeap = false;
+#endif
+	static constexpr float maxPixelError = 1.0f;
+
+	// How the model was imported, so that released geometry can be rebuilt the same way.
+	ImportOptions importOptions;
+	CacheKey cacheKey;
+	bool cached = false;
+	std::unique_ptr<MappedFile> cacheFile;
+	ArrayView<Vertex> cachedVertices;
+
+	template<class T>
+	static size_t Bytes(const std::vector<T>& data)
+	{
+		return data.capacity() * sizeof(T);
+	}
+
+	template<class Buffer>
+	static void CountBuffer(const std::shared_ptr<Buffer>& buffer, ModelMemory& memory)
+	{
+		if(!buffer) return;
+		memory.gpuBuffers += buffer->descriptor.SizeInBytes;
+		if(buffer->uploadBuffer) memory.uploadBuffers += buffer->descriptor.SizeInBytes;
+	}
+
+	static double ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	static double PeakWorkingSetMB()
+	{
+		PROCESS_MEMORY_COUNTERS counters;
+		if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+		return counters.PeakWorkingSetSize / 1048576.0;
+	}
+
+	static double WorkingSetMB()
+	{
+		PROCESS_MEMORY_COUNTERS counters;
+		if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+		return counters.WorkingSetSize / 1048576.0;
 	}
 
-	Model(std::string fileName, ComPtr<ID3D12Device4> device, ComPtr<ID3D12GraphicsCommandList> cmdList)
-		: device(device), cmdList(cmdList)
+	bool Load(const std::string& fileName, const ImportOptions& options, ImportProgress* progress)
 	{
 		std::cout << "Model input:" << fileName << std::endl;
-		Assimp::Importer importer;
-		const aiScene* scene = importer.ReadFile(fileName, aiProcess_Triangulate | aiProcess_GenNormals | aiProcess_ConvertToLeftHanded);
 		modelFileName = fileName;
+		importOptions = options;
+
+		auto loadStart = std::chrono::high_resolution_clock::now();
+		cached = options.useCache && ModelCache::MakeKey(fileName, importFlags, options.ProcessFlags(), cacheKey, progress);
+		if(cached && ModelCache::Load(cacheKey, cacheFile, cachedVertices, indices, meshRanges, bounds, meshBounds, instanceTransforms, meshInstances))
+		{
+			printf("Model:  loaded from cache in %.1f ms\n", ElapsedMs(loadStart));
+		}
+		else
+		{
+			if(!importScene(fileName, options, progress)) return false;
+			printf("Model:  imported in %.1f ms with %s IO, peak working set %.1f MB\n",
+				ElapsedMs(loadStart), options.mappedIO ? "mapped" : "default", PeakWorkingSetMB());
+			if(cached && !ModelCache::Save(cacheKey, vertices, indices, meshRanges, bounds, meshBounds, instanceTransforms, meshInstances))
+			{
+				printf("Model:  could not write the import cache\n");
+				cached = false;
+			}
+		}
+
+		findInstancedMeshes();
+
+		XMFLOAT3 extent = bounds.Extent();
+		float longest = max(extent.x, max(extent.y, extent.z));
+		if(longest > 0) scale = maxLength / longest;
+		buildMeshBoxes();
+
+		if(options.packVertices) packMeshes();
+		if(options.buildLods) buildLods(progress);
+		if(options.buildMeshlets) buildMeshlets(progress);
+		if(options.occlusionCulling) buildOccluders(progress);
+
+		ReportProgress(progress, ImportStage::Edges);
+		EdgeStats edges = EdgeExtractor::Extract(Vertices(), indices, meshRanges, lineIndices, options.dropDiagonals);
+		printf("Model:  %u edges, %u before deduplication, %u diagonals left out\n",
+			(UINT)(lineIndices.size() / 2), edges.faceEdges, edges.diagonals);
+
+		ReportProgress(progress, ImportStage::FlatShading);
+		auto flatStart = std::chrono::high_resolution_clock::now();
+		FlatShading::Build(Vertices(), indices, meshRanges, flatVertices, flatIndices, flatRanges);
+		printf("Model:  flat shading %u vertices, %.1f MB in %.1f ms (%.1f MB with one vertex per corner)\n",
+			(UINT)flatVertices.size(),
+			(flatVertices.size() * sizeof(Vertex) + flatIndices.size() * sizeof(UINT32)) / 1048576.0,
+			ElapsedMs(flatStart),
+			indices.size() * sizeof(Vertex) / 1048576.0 );
+
+		storeIndices();
+		buildArena();
+
+		ReportProgress(progress, ImportStage::Upload);
+		return true;
+	}
+
+	static void ReportProgress(ImportProgress* progress, ImportStage stage)
+	{
+		if(!progress) return;
+		progress->Check();
+		progress->Report(stage, 0);
+	}
+
+	bool importScene(const std::string& fileName, const ImportOptions& options, ImportProgress* progress)
+	{
+		bool native = options.nativeReaders && importNative(fileName, progress);
+		if(!native && !importWithAssimp(fileName, options, progress)) return false;
+
+		if(options.optimizeIndices) optimizeMeshes(options, progress);
+		Bounds::Compute(vertices, meshRanges, meshBounds);
+		bounds = instanceBounds();
+		return true;
+	}
+
+	// OBJ, binary STL and PLY files the native readers cover become one baked mesh, glTF keeps its meshes and
+	// instances; anything else, including files whose contents do not match their extension, is left to Assimp.
+	bool importNative(const std::string& fileName, ImportProgress* progress)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		UINT64 bytes = 0;
+		const char* format = nullptr;
+		bool read = false;
+		if(ObjReader::Handles(fileName))
+		{
+			format = "OBJ";
+			read = ObjReader::Read(fileName, vertices, indices, meshRanges, bytes, progress);
+		}
+		else if(StlReader::Handles(fileName))
+		{
+			format = "STL";
+			read = StlReader::Read(fileName, vertices, indices, meshRanges, bytes, progress);
+		}
+		else if(PlyReader::Handles(fileName))
+		{
+			format = "PLY";
+			read = PlyReader::Read(fileName, vertices, indices, meshRanges, bytes, progress);
+		}
+		else if(GltfReader::Handles(fileName))
+		{
+			format = "glTF";
+			read = GltfReader::Read(fileName, vertices, indices, meshRanges, instanceTransforms, meshInstances, bytes, progress);
+		}
+		if(!format) return false;
+		if(!read)
+		{
+			printf("Model:  %s needs features of the Assimp reader\n", format);
+			return false;
+		}
+		double ms = ElapsedMs(start);
+		printf("Model:  native %s reader, %.1f MB in %.1f ms, %.1f MB/s, peak working set %.1f MB\n",
+			format, bytes / 1048576.0, ms, bytes / 1048576.0 / max(ms, 0.001) * 1000, PeakWorkingSetMB());
+
+		if(!GltfReader::Handles(fileName))
+		{
+			instanceTransforms.assign(1, SceneGraph::Identity());
+			meshInstances.assign(meshRanges.size() + 1, 1);
+		}
+		findInstancedMeshes();
+		ReportProgress(progress, ImportStage::Extract);
+		return true;
+	}
+
+	// Where the heap is shared, the scene is taken over from the importer, so that extraction can free
+	// every mesh as soon as it is copied and the scene shrinks while the model grows.
+	bool importWithAssimp(const std::string& fileName, const ImportOptions& options, ImportProgress* progress)
+	{
+		Assimp::Importer importer;
+		if(options.mappedIO) importer.SetIOHandler(new MappedIOSystem());
+		if(progress) importer.SetProgressHandler(new ImportProgressHandler(*progress));
+		const aiScene* scene = importer.ReadFile(fileName, importFlags);
 
+		if(progress) progress->Check();
 		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 		{
 			std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
-			return;
+			return false;
 		}
+		std::unique_ptr<aiScene> owned;
+		if(sharesAssimpHeap) owned.reset(importer.GetOrphanedScene());
+		double sceneWorkingSet = WorkingSetMB();
 
-		processNode(scene->mRootNode, scene);
+		ReportProgress(progress, ImportStage::Extract);
+		auto start = std::chrono::high_resolution_clock::now();
+		std::vector<UINT> meshList;
+		std::vector<InstanceTransform> bakedTransforms;
+		processScene(scene, meshList, bakedTransforms);
+		processMeshes(scene, meshList, bakedTransforms, owned != nullptr);
+		printf("Model:  extracted %.1f MB in %.1f ms; working set %.1f MB with the scene read, peak %.1f MB\n",
+			(vertices.size() * sizeof(Vertex) + indices.size() * sizeof(UINT32)) / 1048576.0, ElapsedMs(start), sceneWorkingSet, PeakWorkingSetMB());
+		return true;
+	}
 
-		vertexBuffer = std::make_shared<VertexBuffer>(
-			device, cmdList, vertices.data(), sizeof(Vertex), vertices.size() );
+	// Meshes used by one node are baked and listed first, meshes used by several nodes are instanced.
+	void processScene(const aiScene* scene, std::vector<UINT>& meshList, std::vector<InstanceTransform>& bakedTransforms)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		SceneGraph graph;
+		graph.Flatten(scene->mRootNode);
+		std::vector<std::vector<UINT>> meshNodes = graph.MeshNodes(scene->mNumMeshes);
 
-#pragma omp parallel for
-		for(int i = 0; i < vertices.size(); ++i)
+		instanceTransforms.assign(1, SceneGraph::Identity());
+		meshInstances.assign(1, 1);
+		UINT references = 0;
+		for(UINT m = 0; m < scene->mNumMeshes; ++m)
 		{
-			lr[0].min = min(lr[0].min, vertices[i].position.x);
-			lr[0].max = max(lr[0].max, vertices[i].position.x);
+			references += meshNodes[m].size();
+			if(meshNodes[m].size() != 1) continue;
+			meshList.push_back(m);
+			meshInstances.push_back(1);
+			bakedTransforms.push_back(graph.World(meshNodes[m][0]));
+		}
+		firstInstancedMesh = meshList.size();
+
+		double savedBytes = 0;
+		for(UINT m = 0; m < scene->mNumMeshes; ++m)
+		{
+			if(meshNodes[m].size() < 2) continue;
+			meshList.push_back(m);
+			bakedTransforms.push_back(SceneGraph::Identity());
+			for(UINT node : meshNodes[m]) instanceTransforms.push_back(graph.World(node));
+			meshInstances.push_back(instanceTransforms.size());
+
+			const aiMesh* mesh = scene->mMeshes[m];
+			double meshBytes = mesh->mNumVertices * sizeof(Vertex) + mesh->mNumFaces * 3 * sizeof(UINT32);
+			savedBytes += (meshNodes[m].size() - 1) * meshBytes - meshNodes[m].size() * sizeof(InstanceTransform);
+		}
+		printf("Model:  %u nodes in %u levels flattened in %.1f ms, %u meshes referenced %u times, %u instances saved %.1f MB\n",
+			(UINT)graph.nodes.size(), (UINT)graph.levels.size() - 1, ElapsedMs(start), (UINT)meshList.size(), references,
+			(UINT)instanceTransforms.size() - 1, savedBytes / 1048576.0);
+	}
+
+	// Instanced meshes come last; they are the ones with a non-empty instance range.
+	void findInstancedMeshes()
+	{
+		firstInstancedMesh = meshRanges.size();
+		while(firstInstancedMesh > 0 && meshInstances[firstInstancedMesh] > meshInstances[firstInstancedMesh - 1]) --firstInstancedMesh;
+	}
+
+	// Bounds of the whole scene: baked meshes as they are, instanced meshes once per instance.
+	Bounds instanceBounds() const
+	{
+		std::vector<Bounds> parts(meshBounds.begin(), meshBounds.begin() + firstInstancedMesh);
+		for(int i = firstInstancedMesh; i < (int)meshRanges.size(); ++i)
+			for(UINT k = meshInstances[i]; k < meshInstances[i + 1]; ++k)
+				parts.push_back(meshBounds[i].Transformed(instanceTransforms[k], SceneGraph::MaxScale(instanceTransforms[k])));
+		return Bounds::Union(parts);
+	}
 
-			lr[1].min = min(lr[1].min, vertices[i].position.y);
-			lr[1].max = max(lr[1].max, vertices[i].position.y);
+	void packMeshes()
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		ArrayView<Vertex> vertices = Vertices();
+		VertexPacker::Encode(vertices, meshRanges, meshBounds, packedVertices, packedColors, packedMeshes);
+		double ms = ElapsedMs(start);
+
+		float maxError = 0;
+		for(auto& mesh : packedMeshes) maxError = max(maxError, mesh.MaxPositionError());
+		double bytes = packedVertices.size() * sizeof(PackedVertex) + packedColors.size() * sizeof(UINT32);
+		printf("Model:  packed %.1f bytes per vertex (was %u), %.1f M vertices/s, position error at most %g\n",
+			vertices.empty() ? 0.0 : bytes / vertices.size(), (UINT)sizeof(Vertex), vertices.size() / max(ms, 0.001) / 1000, maxError);
+	}
 
-			lr[2].min = min(lr[2].min, vertices[i].position.z);
-			lr[2].max = max(lr[2].max, vertices[i].position.z);
+	void optimizeMeshes(const ImportOptions& options, ImportProgress* progress)
+	{
+		ReportProgress(progress, ImportStage::Optimize);
+		auto start = std::chrono::high_resolution_clock::now();
+		std::vector<CacheStats> before, after;
+		MeshOptimizer::Optimize(vertices, indices, meshRanges, options.reduceOverdraw, before, after, progress);
+
+		CacheStats totalBefore, totalAfter;
+		for(int i = 0; i < (int)meshRanges.size(); ++i)
+		{
+			totalBefore.Add(before[i]);
+			totalAfter.Add(after[i]);
 		}
+		printf("Model:  vertex cache ACMR %.3f -> %.3f, ATVR %.3f -> %.3f in %.1f ms\n",
+			totalBefore.Acmr(), totalAfter.Acmr(), totalBefore.Atvr(), totalAfter.Atvr(), ElapsedMs(start));
+		for(auto figure : {&CacheStats::Acmr, &CacheStats::Atvr})
+		{
+			MeshOptimizer::Spread from = MeshOptimizer::MeshSpread(before, figure), to = MeshOptimizer::MeshSpread(after, figure);
+			printf("Model:  per mesh %s min %.3f -> %.3f, median %.3f -> %.3f, p90 %.3f -> %.3f, max %.3f -> %.3f\n",
+				figure == &CacheStats::Acmr ? "ACMR" : "ATVR", from.lowest, to.lowest, from.median, to.median, from.p90, to.p90, from.highest, to.highest);
+		}
+	}
 
-		scale = -1e30;
-		for(int i = 0; i < 3; ++i) scale = max(scale, lr[i].max - lr[i].min);
-		scale = maxLength / scale;
+	// meshList holds the scene slot of every mesh in model order. With freeMeshes the scene is owned here
+	// and every batch of meshes is deleted once copied.
+	void processMeshes(const aiScene* scene, const std::vector<UINT>& meshList, const std::vector<InstanceTransform>& bakedTransforms, bool freeMeshes)
+	{
+		int meshCount = meshList.size();
+		meshRanges.resize(meshCount);
+		std::vector<aiMesh*> meshes(meshCount);
+		for(int i = 0; i < meshCount; ++i) meshes[i] = scene->mMeshes[meshList[i]];
 
-		for(int i = 2; i < solidVertices.size(); i += 3)
+		// First pass: count every mesh so that all arrays are allocated once.
+#pragma omp parallel for schedule(dynamic)
+		for(int i = 0; i < meshCount; ++i)
 		{
-			XMVECTOR p1{solidVertices[i - 2].position.x, solidVertices[i - 2].position.y, solidVertices[i - 2].position.z };
-			XMVECTOR p2{solidVertices[i - 1].position.x, solidVertices[i - 1].position.y, solidVertices[i - 1].position.z };
-			XMVECTOR p3{solidVertices[i - 0].position.x, solidVertices[i - 0].position.y, solidVertices[i - 0].position.z };
+			aiMesh* mesh = meshes[i];
+			UINT indexCount = 0;
+			if(mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE) indexCount = mesh->mNumFaces * 3;
+			else for(int j = 0; j < mesh->mNumFaces; ++j) indexCount += mesh->mFaces[j].mNumIndices;
 
-			XMVECTOR v1 = p3 - p1;
-			XMVECTOR v2 = p2 - p1;
-			XMVECTOR nor = XMVector3Cross(v2, v1);
+			meshRanges[i].vertexCount = mesh->mNumVertices;
+			meshRanges[i].indexCount = indexCount;
+			meshRanges[i].faceSize = 0;
+			meshRanges[i].hasColors = mesh->mColors[0] != nullptr;
+			meshRanges[i].cornerVertices = 1;
+			if(mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE) meshRanges[i].faceSize = 3;
+			else if(mesh->mPrimitiveTypes == aiPrimitiveType_LINE) meshRanges[i].faceSize = 2;
+			else if(mesh->mPrimitiveTypes == aiPrimitiveType_POINT) meshRanges[i].faceSize = 1;
+		}
 
-			XMFLOAT3 normal;
-			XMStoreFloat3(&normal, nor);
-			solidVertices[i - 2].normal = normal;
-			solidVertices[i - 1].normal = normal;
-			solidVertices[i - 0].normal = normal;
+		UINT vertexCount = 0, indexCount = 0;
+		for(auto& range : meshRanges)
+		{
+			range.baseVertex = vertexCount;
+			range.firstIndex = indexCount;
+			vertexCount += range.vertexCount;
+			indexCount += range.indexCount;
 		}
-		solidVertexBuffer = std::make_shared<VertexBuffer>(
-			device, cmdList, solidVertices.data(), sizeof(Vertex), solidVertices.size() );
 
-		printf("Model:  %d vertices\n", vertices.size());
-		faceCount = 0;
-		for(auto& buffer : indexBuffers) faceCount += buffer->indexCount / 3;
+		// Reserving leaves the pages untouched; the arrays only grow by one batch of meshes at a time, and
+		// with freeMeshes every batch's meshes are deleted before the next batch is extracted.
+		vertices.reserve(vertexCount);
+		indices.reserve(indexCount);
+		for(int first = 0; first < meshCount;)
+		{
+			int last = first;
+			UINT batchVertices = 0;
+			while(last < meshCount && (last == first || batchVertices + meshRanges[last].vertexCount <= extractBatchVertices))
+				batchVertices += meshRanges[last++].vertexCount;
+
+			std::vector<ExtractChunk> vertexChunks, faceChunks;
+			for(int i = first; i < last; ++i)
+			{
+				const MeshRange& range = meshRanges[i];
+				for(UINT begin = 0; begin < range.vertexCount; begin += extractChunkSize)
+					vertexChunks.push_back({i, begin, min(begin + extractChunkSize, range.vertexCount), 0});
+
+				// Faces of a pure triangle mesh have a fixed stride, anything else is filled serially.
+				UINT faceCount = meshes[i]->mNumFaces;
+				if(meshes[i]->mPrimitiveTypes == aiPrimitiveType_TRIANGLE)
+					for(UINT begin = 0; begin < faceCount; begin += extractChunkSize)
+						faceChunks.push_back({i, begin, min(begin + extractChunkSize, faceCount), range.firstIndex + begin * 3});
+				else if(faceCount > 0)
+					faceChunks.push_back({i, 0, faceCount, range.firstIndex});
+			}
+
+			vertices.resize(meshRanges[last - 1].baseVertex + meshRanges[last - 1].vertexCount);
+			indices.resize(meshRanges[last - 1].firstIndex + meshRanges[last - 1].indexCount);
+
+			// Every chunk owns a disjoint slice, so the result matches the serial order.
+#pragma omp parallel for schedule(dynamic)
+			for(int i = 0; i < (int)vertexChunks.size(); ++i)
+				processVertices(meshes[vertexChunks[i].mesh], meshRanges[vertexChunks[i].mesh], vertexChunks[i], bakedTransforms[vertexChunks[i].mesh]);
+
+#pragma omp parallel for schedule(dynamic)
+			for(int i = 0; i < (int)faceChunks.size(); ++i)
+				processFaces(meshes[faceChunks[i].mesh], faceChunks[i]);
+
+			// The scene owns its meshes; its destructor skips the emptied slots.
+			for(int i = first; freeMeshes && i < last; ++i)
+			{
+				delete scene->mMeshes[meshList[i]];
+				scene->mMeshes[meshList[i]] = nullptr;
+			}
+			first = last;
+		}
 	}
 
-	XMMATRIX getModel()
+	// Narrows every index array per mesh; the 32-bit working copies are released afterwards.
+	void storeIndices()
 	{
-		return XMMatrixScaling(scale, scale, scale);
+		size_t wideBytes = (indices.size() + lineIndices.size() + flatIndices.size()) * sizeof(UINT32);
+		triangleStore.Build(indices, meshRanges, &MeshRange::firstIndex, &MeshRange::indexCount);
+		lineStore.Build(lineIndices, meshRanges, &MeshRange::firstLineIndex, &MeshRange::lineIndexCount);
+		flatStore.Build(flatIndices, flatRanges, &MeshRange::firstIndex, &MeshRange::indexCount);
+		std::vector<UINT32>().swap(indices);
+		std::vector<UINT32>().swap(lineIndices);
+		std::vector<UINT32>().swap(flatIndices);
+
+		size_t bytes = triangleStore.Bytes() + lineStore.Bytes() + flatStore.Bytes();
+		printf("Model:  index memory %.1f MB, %.1f MB with 32-bit indices\n", bytes / 1048576.0, wideBytes / 1048576.0);
 	}
 
-	void Draw(D3D12_PRIMITIVE_TOPOLOGY primitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST)
+	// Releases the CPU geometry the retention policy does not keep. Flat shading vertices and the line and
+	// flat index stores only ever feed the arena, so every policy but Keep drops them. Geometry is only ever
+	// packed when Compress asks for it; Drop without an import cache imports the file again on export.
+	void applyRetention()
 	{
-		cmdList->IASetPrimitiveTopology(primitiveType);
-		vertexBuffer->Bind(cmdList);
-		if(primitiveType == D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST)
+		if(importOptions.retention == Retention::Keep || Vertices().empty()) return;
+		std::vector<Vertex>().swap(flatVertices);
+		lineStore = IndexStore();
+		flatStore = IndexStore();
+
+		if(importOptions.retention == Retention::Compress)
+		{
+			if(packedMeshes.empty()) VertexPacker::Encode(Vertices(), meshRanges, meshBounds, packedVertices, packedColors, packedMeshes);
+		}
+		else
+		{
+			triangleStore = IndexStore();
+			std::vector<PackedVertex>().swap(packedVertices);
+			std::vector<UINT32>().swap(packedColors);
+			std::vector<PackedMesh>().swap(packedMeshes);
+		}
+		std::vector<Vertex>().swap(vertices);
+		cacheFile.reset();
+		cachedVertices = ArrayView<Vertex>();
+	}
+
+	// Inverse of applyRetention for the vertices and triangle indices that export reads.
+	bool restoreGeometry()
+	{
+		if(!Vertices().empty() || vertexCount == 0) return true;
+		auto start = std::chrono::high_resolution_clock::now();
+		const char* source = "packed vertices";
+		if(!packedMeshes.empty()) VertexPacker::Decode(packedVertices, packedColors, packedMeshes, meshRanges, vertices);
+		else if(reloadGeometry()) source = "the import cache";
+		else if(reimportGeometry()) source = "the model file";
+		else return false;
+		printf("Model:  restored %d vertices from %s in %.1f ms\n", vertexCount, source, ElapsedMs(start));
+		return true;
+	}
+
+	// The cache holds the geometry as imported; meshlets have reordered the triangles of every mesh since,
+	// which export does not care about.
+	bool reloadGeometry()
+	{
+		std::unique_ptr<MappedFile> file;
+		ArrayView<Vertex> fileVertices;
+		std::vector<UINT32> cachedIndices;
+		std::vector<MeshRange> cachedRanges;
+		Bounds cachedBounds;
+		std::vector<Bounds> cachedMeshBounds;
+		std::vector<InstanceTransform> cachedInstances;
+		std::vector<UINT> cachedMeshInstances;
+		if(!cached || !ModelCache::Load(cacheKey, file, fileVertices, cachedIndices, cachedRanges, cachedBounds, cachedMeshBounds, cachedInstances, cachedMeshInstances))
+			return false;
+		if((int)fileVertices.size() != vertexCount || cachedRanges.size() != meshRanges.size()) return false;
+
+		triangleStore.Build(cachedIndices, meshRanges, &MeshRange::firstIndex, &MeshRange::indexCount);
+		cacheFile = std::move(file);
+		cachedVertices = fileVertices;
+		return true;
+	}
+
+	// Without a cache the file is read and extracted again into a scratch model, with the same index
+	// optimization as the first import and none of the stages that only serve drawing.
+	bool reimportGeometry()
+	{
+		Model source;
+		if(!source.importScene(modelFileName, importOptions, nullptr)) return false;
+		if((int)source.vertices.size() != vertexCount || source.meshRanges.size() != meshRanges.size()) return false;
+
+		vertices.swap(source.vertices);
+		triangleStore.Build(source.indices, source.meshRanges, &MeshRange::firstIndex, &MeshRange::indexCount);
+		return true;
+	}
+
+	void buildArena()
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		UINT base = arena.AddVertices(Vertices().data(), Vertices().size());
+		UINT flatBase = arena.AddVertices(flatVertices.data(), flatVertices.size());
+		levelDraws.resize(1);
+		triangleDraws = arena.AddMeshes(triangleStore, meshRanges, base, &levelDraws[0]);
+		if(!meshLods.empty()) addLodLevels(base);
+		lineDraws = arena.AddMeshes(lineStore, meshRanges, base, &lineMeshDraws);
+		flatDraws = arena.AddMeshes(flatStore, flatRanges, flatBase, &flatMeshDraws);
+
+		// Instanced meshes come last, so the baked draws are a prefix of every list.
+		if(firstInstancedMesh < (int)meshRanges.size())
+		{
+			triangleDraws = bakedDraws(levelDraws[0]);
+			lineDraws = bakedDraws(lineMeshDraws);
+			flatDraws = bakedDraws(flatMeshDraws);
+			lineInstances = instancedDraws(lineMeshDraws);
+			flatInstances = instancedDraws(flatMeshDraws);
+		}
+		printf("Model:  %d meshes in %d triangle, %d line and %d flat draws, arena built in %.1f ms\n",
+			(int)meshRanges.size(), (int)triangleDraws.size(), (int)lineDraws.size(), (int)flatDraws.size(), ElapsedMs(start));
+	}
+
+	void buildLods(ImportProgress* progress)
+	{
+		ReportProgress(progress, ImportStage::Lods);
+		auto start = std::chrono::high_resolution_clock::now();
+		if(cached && ModelCache::LoadLods(cacheKey, meshRanges, lodIndices, lods, meshLods))
+		{
+			printf("Model:  LODs loaded from cache in %.1f ms\n", ElapsedMs(start));
+		}
+		else
+		{
+			Simplifier::BuildLods(Vertices(), indices, meshRanges, lodIndices, lods, meshLods, progress);
+			double ms = ElapsedMs(start);
+
+			UINT triangles = 0;
+			for(auto& range : meshRanges) if(range.faceSize == 3) triangles += range.indexCount / 3;
+			UINT cores = max(std::thread::hardware_concurrency(), 1u);
+			printf("Model:  LODs of %u triangles in %.1f ms, %.2f M triangles/s per core\n", triangles, ms, triangles / max(ms, 0.001) / 1000 / cores);
+			if(cached && !ModelCache::SaveLods(cacheKey, lodIndices, lods, meshLods)) printf("Model:  could not write the LOD cache\n");
+		}
+
+		for(UINT level = 1;; ++level)
 		{
-			for(auto& indexBuffer : indexBuffers)
+			UINT before = 0, after = 0, meshes = 0;
+			float error = 0;
+			for(int i = 0; i < (int)meshRanges.size(); ++i)
 			{
-				indexBuffer->Draw(cmdList);
+				if(meshLods[i] + level > meshLods[i + 1]) continue;
+				const MeshLod& lod = lods[meshLods[i] + level - 1];
+				before += level == 1 ? meshRanges[i].indexCount / 3 : lods[meshLods[i] + level - 2].indexCount / 3;
+				after += lod.indexCount / 3;
+				error = max(error, lod.error);
+				++meshes;
 			}
+			if(meshes == 0) break;
+			printf("Model:  LOD %u of %u meshes, ratio %.3f for a target of %.2f, error %g\n",
+				level, meshes, (float)after / before, Simplifier::levelRatio, error);
 		}
-		else if(primitiveType == D3D_PRIMITIVE_TOPOLOGY_LINELIST)
+	}
+
+	// World distance from the eye to the near side of the mesh's sphere, divided by the instance's stretch;
+	// for instanced meshes the nearest instance counts.
+	float meshDistance(int mesh, XMVECTOR eye) const
+	{
+		const Bounds& meshBound = meshBounds[mesh];
+		if(mesh < firstInstancedMesh)
+		{
+			XMVECTOR center = XMLoadFloat3(&meshBound.center) * (float)scale;
+			return max(XMVectorGetX(XMVector3Length(center - eye)) - meshBound.radius * (float)scale, 1.0f);
+		}
+
+		float nearest = FLT_MAX;
+		for(UINT k = meshInstances[mesh]; k < meshInstances[mesh + 1]; ++k)
+		{
+			float stretch = SceneGraph::MaxScale(instanceTransforms[k]);
+			Bounds instance = meshBound.Transformed(instanceTransforms[k], stretch);
+			XMVECTOR center = XMLoadFloat3(&instance.center) * (float)scale;
+			float distance = max(XMVectorGetX(XMVector3Length(center - eye)) - instance.radius * (float)scale, 1.0f);
+			nearest = min(nearest, distance / max(stretch, 1e-6f));
+		}
+		return nearest;
+	}
+
+	UINT selectLevel(int mesh, float distance, float pixelsPerUnit) const
+	{
+		UINT level = 0;
+		for(UINT l = meshLods[mesh]; l < meshLods[mesh + 1]; ++l)
+		{
+			if(lods[l].error * scale / distance * pixelsPerUnit > maxPixelError) break;
+			level = l - meshLods[mesh] + 1;
+		}
+		return level;
+	}
+
+	void buildMeshlets(ImportProgress* progress)
+	{
+		ReportProgress(progress, ImportStage::Meshlets);
+		auto start = std::chrono::high_resolution_clock::now();
+		MeshletBuilder::Build(Vertices(), indices, meshRanges, meshlets, meshMeshlets, clusterBounds, progress);
+		double ms = ElapsedMs(start);
+
+		UINT cones = 0;
+		for(UINT c = 0; c < clusterBounds.count; ++c) cones += clusterBounds.cutoff[c] < 1;
+		printf("Model:  %u meshlets in %.1f ms, %u of them back-face cullable\n", (UINT)meshlets.size(), ms, cones);
+	}
+
+	// Occluders are the largest baked triangle meshes, taken largest first until occluderTriangles is spent.
+	// They keep their full detail: a simplified level may bulge out of the surface and hide what is in front.
+	static constexpr UINT occluderTriangles = 1 << 15;
+	static constexpr float minOccluderRadius = 0.02f;
+
+	void buildOccluders(ImportProgress* progress)
+	{
+		ReportProgress(progress, ImportStage::Occluders);
+		auto start = std::chrono::high_resolution_clock::now();
+		std::vector<int> order;
+		for(int i = 0; i < firstInstancedMesh; ++i)
+			if(meshRanges[i].faceSize == 3 && meshRanges[i].indexCount > 0 && meshBounds[i].radius >= minOccluderRadius * bounds.radius)
+				order.push_back(i);
+		std::sort(order.begin(), order.end(), [&](int a, int b) { return meshBounds[a].radius > meshBounds[b].radius; });
+
+		ArrayView<Vertex> vertices = Vertices();
+		UINT budget = occluderTriangles, meshes = 0;
+		std::vector<UINT> remap;
+		for(int i : order)
 		{
-			for(auto& indexBuffer : lineIndexBuffers)
+			if(progress) progress->Check();
+			const MeshRange& range = meshRanges[i];
+			const UINT32* source = indices.data() + range.firstIndex;
+			UINT count = range.indexCount;
+			if(count / 3 > budget) continue;
+
+			remap.assign(range.vertexCount, UINT_MAX);
+			for(UINT k = 0; k < count; ++k)
 			{
-				indexBuffer->Draw(cmdList);
+				UINT32 index = source[k];
+				if(remap[index] == UINT_MAX)
+				{
+					remap[index] = occluders.positions.size();
+					occluders.positions.push_back(vertices[range.baseVertex + index].position);
+				}
+				occluders.indices.push_back(remap[index]);
 			}
+			budget -= count / 3;
+			++meshes;
+			if(budget == 0) break;
 		}
-		else if(primitiveType == D3D_PRIMITIVE_TOPOLOGY_LINESTRIP)
+		occluders.positions.shrink_to_fit();
+		occluders.indices.shrink_to_fit();
+		printf("Model:  %u occluder triangles from %u meshes in %.1f ms\n", occluders.TriangleCount(), meshes, ElapsedMs(start));
+	}
+
+	// Every LOD level goes into the arena like level 0, laid out mesh after mesh, so that neighbouring
+	// meshes at the same level still merge into one draw.
+	void addLodLevels(UINT base)
+	{
+		for(UINT level = 1;; ++level)
 		{
-			cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-			solidVertexBuffer->Draw(cmdList);
+			std::vector<MeshRange> levelRanges = meshRanges;
+			bool any = false;
+			for(int i = 0; i < (int)meshRanges.size(); ++i)
+			{
+				levelRanges[i].firstIndex = 0;
+				levelRanges[i].indexCount = 0;
+				if(meshLods[i] + level > meshLods[i + 1]) continue;
+				const MeshLod& lod = lods[meshLods[i] + level - 1];
+				levelRanges[i].firstIndex = lod.firstIndex;
+				levelRanges[i].indexCount = lod.indexCount;
+				any = true;
+			}
+			if(!any) break;
+
+			IndexStore levelStore;
+			levelStore.Build(lodIndices, levelRanges, &MeshRange::firstIndex, &MeshRange::indexCount);
+			levelDraws.emplace_back();
+			arena.AddMeshes(levelStore, levelRanges, base, &levelDraws.back());
 		}
-		else
+		std::vector<UINT32>().swap(lodIndices);
+	}
+
+	std::vector<DrawRange> bakedDraws(const std::vector<DrawRange>& meshDraws) const
+	{
+		return GeometryArena::Merge(std::vector<DrawRange>(meshDraws.begin(), meshDraws.begin() + firstInstancedMesh));
+	}
+
+	// Instance k of the instanced meshes has box boxOffset() + k.
+	int boxOffset() const
+	{
+		return firstInstancedMesh - (int)meshInstances[firstInstancedMesh];
+	}
+
+	void buildMeshBoxes()
+	{
+		meshBoxes.Resize(boxOffset() + meshInstances.back());
+		for(int i = 0; i < firstInstancedMesh; ++i) meshBoxes.Set(i, meshBounds[i]);
+		for(int i = firstInstancedMesh; i < (int)meshRanges.size(); ++i)
+			for(UINT k = meshInstances[i]; k < meshInstances[i + 1]; ++k)
+				meshBoxes.Set(boxOffset() + k, meshBounds[i].Transformed(instanceTransforms[k], SceneGraph::MaxScale(instanceTransforms[k])));
+		meshVisible.assign(meshBoxes.count, 1);
+		visibleBoxes = meshBoxes.count;
+	}
+
+	// Runs of consecutive visible instances, so that hidden ones are skipped without touching the instance buffer.
+	void addVisibleInstances(int mesh, const DrawRange& draw, const std::vector<BYTE>& visible, XMVECTOR eye, std::vector<InstancedDraw>& draws) const
+	{
+		if(draw.indexCount == 0) return;
+		int offset = boxOffset();
+		for(UINT k = meshInstances[mesh]; k < meshInstances[mesh + 1];)
 		{
-			vertexBuffer->Draw(cmdList);
+			if(!visible[offset + k])
+			{
+				++k;
+				continue;
+			}
+			UINT first = k;
+			float depth = FLT_MAX;
+			for(; k < meshInstances[mesh + 1] && visible[offset + k]; ++k) depth = min(depth, boxDepth(offset + k, eye));
+			draws.push_back({draw, first, k - first, depth});
 		}
-		
 	}
 
-	void DrawGrid(XMFLOAT3 axisFlag)
+	// World distance from the eye to the sphere around box i.
+	float boxDepth(int box, XMVECTOR eye) const
 	{
-		cmdList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_LINELIST);
-		vertexBuffer->Bind(cmdList);
-		if(axisFlag.x > 0.5) lineIndexBuffers[0]->Draw(cmdList);
-		if(axisFlag.y > 0.5) lineIndexBuffers[1]->Draw(cmdList);
-		if(axisFlag.z > 0.5) lineIndexBuffers[2]->Draw(cmdList);
-		lineIndexBuffers[3]->Draw(cmdList);
+		XMVECTOR center = XMVectorSet(meshBoxes.centerX[box], meshBoxes.centerY[box], meshBoxes.centerZ[box], 0) * (float)scale;
+		XMVECTOR extent = XMVectorSet(meshBoxes.extentX[box], meshBoxes.extentY[box], meshBoxes.extentZ[box], 0) * (float)scale;
+		return max(XMVectorGetX(XMVector3Length(center - eye)) - XMVectorGetX(XMVector3Length(extent)), 0.0f);
 	}
 
-	static std::string GetReadFileTypeList()
+	// GeometryArena::Merge that keeps the nearest depth of every joined draw.
+	static std::vector<DrawRange> MergeDraws(const std::vector<DrawRange>& draws, const std::vector<float>& depths, std::vector<float>& mergedDepths)
 	{
-		std::string res = "3D Model(" + modelTypeList[0];
-		for(int i = 1; i < _countof(modelTypeList); ++i)
-			res += " " + modelTypeList[i];
-		res += ")";
-		return res;
+		std::vector<DrawRange> merged;
+		mergedDepths.clear();
+		for(size_t k = 0; k < draws.size(); ++k)
+		{
+			const DrawRange& draw = draws[k];
+			if(draw.indexCount == 0) continue;
+			if(!merged.empty())
+			{
+				DrawRange& back = merged.back();
+				if(back.format == draw.format && back.baseVertex == draw.baseVertex && back.firstIndex + back.indexCount == draw.firstIndex)
+				{
+					back.indexCount += draw.indexCount;
+					mergedDepths.back() = min(mergedDepths.back(), depths[k]);
+					continue;
+				}
+			}
+			merged.push_back(draw);
+			mergedDepths.push_back(depths[k]);
+		}
+		return merged;
 	}
 
-	void saveModel(std::string fileName)
+	void queueDraws(const std::vector<DrawRange>& draws, const std::vector<float>& depths, const std::vector<InstancedDraw>& instances)
+	{
+		for(size_t k = 0; k < draws.size(); ++k) queuedDraws.push_back({draws[k], 0, 1, k < depths.size() ? depths[k] : 0});
+		queuedDraws.insert(queuedDraws.end(), instances.begin(), instances.end());
+	}
+
+	std::vector<InstancedDraw> instancedDraws(const std::vector<DrawRange>& meshDraws) const
 	{
+		std::vector<InstancedDraw> draws;
+		for(int i = firstInstancedMesh; i < (int)meshRanges.size(); ++i)
+			if(meshDraws[i].indexCount > 0)
+				draws.push_back({meshDraws[i], meshInstances[i], meshInstances[i + 1] - meshInstances[i]});
+		return draws;
+	}
+
+	// Every placement of every mesh: baked meshes once, instanced meshes once per instance.
+	std::vector<ExportPart> exportParts() const
+	{
+		std::vector<ExportPart> parts;
+		for(int i = 0; i < (int)meshRanges.size(); ++i)
+		{
+			const MeshRange& range = meshRanges[i];
+			ExportPart part = {Vertices().data() + range.baseVertex, range.vertexCount, &triangleStore, i, range.indexCount, range.faceSize, SceneGraph::Identity()};
+			if(i < firstInstancedMesh) parts.push_back(part);
+			else for(UINT k = meshInstances[i]; k < meshInstances[i + 1]; ++k)
+			{
+				part.transform = instanceTransforms[k];
+				parts.push_back(part);
+			}
+		}
+		return parts;
+	}
+
+	void saveWithAssimp(const std::string& fileName)
+	{
+		size_t dot = fileName.find_last_of('.');
+		std::string extension = dot == std::string::npos ? "obj" : fileName.substr(dot + 1);
 		Assimp::Importer importer;
 		const aiScene* scene = importer.ReadFile(modelFileName.c_str(), 0);
+		if(!scene) return;
 		Assimp::Exporter exporter;
-		exporter.Export(scene, "obj", fileName);
+		exporter.Export(scene, extension.c_str(), fileName);
 	}
 
-private:
-	void processNode(aiNode* node, const aiScene* scene)
+	// Binds the index view only when the width changes between draws.
+	void drawRange(const DrawRange& draw, UINT firstInstance, UINT instanceCount, DXGI_FORMAT& bound)
 	{
-		for(int i = 0; i < node->mNumMeshes; ++i) processMesh(scene->mMeshes[node->mMeshes[i]], scene);
-		for(int i = 0; i < node->mNumChildren; ++i) processNode(node->mChildren[i], scene);
+		if(draw.format != bound)
+		{
+			D3D12_INDEX_BUFFER_VIEW view = arenaIndexBuffer->descriptor;
+			view.Format = draw.format;
+			cmdList->IASetIndexBuffer(&view);
+			bound = draw.format;
+		}
+		cmdList->DrawIndexedInstanced(draw.indexCount, instanceCount, draw.firstIndex, draw.baseVertex, firstInstance);
 	}
 
-	void processMesh(aiMesh* mesh, const aiScene* scene)
+	void processVertices(aiMesh* mesh, const MeshRange& range, const ExtractChunk& chunk, const InstanceTransform& transform)
 	{
-		UINT startLocation = vertices.size();
-		UINT indexOffset = indices.size();
-		UINT lineIndexOffset = lineIndices.size();
-		for(int i = 0; i < mesh->mNumVertices; ++i)
+		bool baked = !SceneGraph::IsIdentity(transform);
+		for(UINT i = chunk.begin; i < chunk.end; ++i)
 		{
-			Vertex vertex{
-				{
-					mesh->mVertices[i].x,
-					mesh->mVertices[i].y,
-					mesh->mVertices[i].z
-				},
-				{
-					mesh->mNormals[i].x,
-					mesh->mNormals[i].y,
-					mesh->mNormals[i].z
-				}
-			};
-			if(mesh->mColors[0]) vertex.color = {mesh->mColors[i][0].r,mesh->mColors[i][0].g,mesh->mColors[i][0].b};
-			vertices.push_back(vertex);
+			Vertex& vertex = vertices[range.baseVertex + i];
+			vertex.position = {mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z};
+			if(mesh->mNormals) vertex.normal = {mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z};
+			else vertex.normal = {0, 0, 0};
+			if(mesh->mColors[0]) vertex.color = {mesh->mColors[0][i].r, mesh->mColors[0][i].g, mesh->mColors[0][i].b};
+			else vertex.color = {0, 0, 0};
+			if(baked) SceneGraph::Apply(transform, vertex);
 		}
+	}
 
-		for(int i = 0; i < mesh->mNumFaces; ++i)
+	void processFaces(const aiMesh* mesh, const ExtractChunk& chunk)
+	{
+		UINT index = chunk.indexOffset;
+		for(UINT i = chunk.begin; i < chunk.end; ++i)
 		{
-			aiFace face = mesh->mFaces[i];
-			for(int j = 0; j < face.mNumIndices; ++j) {
-				indices.push_back(face.mIndices[j]);
-				solidVertices.push_back(vertices[face.mIndices[j] + startLocation]);
-			}
-
-			for(int j = 0; j < face.mNumIndices; ++j)
-				lineIndices.push_back(face.mIndices[j]),
-				lineIndices.push_back(face.mIndices[(j + 1) % face.mNumIndices]);
-		}
-
-		indexBuffers.push_back(
-			std::make_shared<IndexBuffer>(
-				device, 
-				cmdList, 
-				indices.data() + indexOffset, 
-				indices.size() - indexOffset, 
-				DXGI_FORMAT_R32_UINT, 
-				startLocation )
-		);
-
-		lineIndexBuffers.push_back(
-			std::make_shared<IndexBuffer>(
-				device,
-				cmdList,
-				lineIndices.data() + lineIndexOffset,
-				lineIndices.size() - lineIndexOffset,
-				DXGI_FORMAT_R32_UINT,
-				startLocation )
-		);
+			const aiFace& face = mesh->mFaces[i];
+			for(int j = 0; j < face.mNumIndices; ++j) indices[index + j] = face.mIndices[j];
+			index += face.mNumIndices;
+		}
 	}
 };
\ No newline at end of file
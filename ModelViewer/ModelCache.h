@@ -0,0 +1,469 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include "MappedFile.h"
+#include "Bounds.h"
+#include "ArrayView.h"
+#include "ImportProgress.h"
+#include "Simplifier.h"
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <string>
+#include <fstream>
+#include <filesystem>
+
+struct CacheKey
+{
+	UINT64 contentHash;
+	UINT64 fileSize;
+	UINT32 importFlags;
+	UINT32 processFlags;
+};
+
+// On-disk copy of the extracted geometry. The file is a fixed header followed by 16-byte aligned raw
+// arrays, so a hit is a mapping plus a few block copies and never touches Assimp. Files live in a per-user
+// folder that is trimmed to maxCacheBytes, least recently used first. LODs go to a second file under
+// the same key, since they are optional and built after the geometry file is written.
+class ModelCache
+{
+private:
+	static constexpr UINT32 magic = 0x3143564d;
+	static constexpr UINT32 version = 5;
+	static constexpr UINT32 lodMagic = 0x4c43564d;
+	static constexpr UINT32 lodVersion = 1;
+	static constexpr UINT64 blockSize = 1 << 20;
+	static constexpr UINT indexChunk = 1 << 16;
+
+	struct Header
+	{
+		UINT32 magic;
+		UINT32 version;
+		CacheKey key;
+		UINT64 cacheSize;
+		UINT64 meshCount;
+		UINT64 vertexCount;
+		UINT64 indexCount;
+		UINT64 instanceCount;
+		UINT64 meshRangeOffset;
+		UINT64 meshBoundsOffset;
+		UINT64 vertexOffset;
+		UINT64 indexOffset;
+		UINT64 instanceOffset;
+		UINT64 meshInstanceOffset;
+		Bounds bounds;
+	};
+
+	struct LodHeader
+	{
+		UINT32 magic;
+		UINT32 version;
+		CacheKey key;
+		UINT64 cacheSize;
+		UINT64 meshCount;
+		UINT64 lodCount;
+		UINT64 lodIndexCount;
+		UINT64 meshLodOffset;
+		UINT64 lodOffset;
+		UINT64 lodIndexOffset;
+	};
+
+public:
+	static constexpr UINT64 maxCacheBytes = 8ULL << 30;
+
+	// %LOCALAPPDATA%\ModelViewer\cache, or a folder in the temp directory without it. Tests point it elsewhere.
+	static std::filesystem::path& Directory()
+	{
+		static std::filesystem::path directory = DefaultDirectory();
+		return directory;
+	}
+
+	static bool MakeKey(const std::string& fileName, UINT32 importFlags, UINT32 processFlags, CacheKey& key, ImportProgress* progress = nullptr)
+	{
+		MappedFile file(fileName);
+		if(!file.IsOpen()) return false;
+
+		memset(&key, 0, sizeof(key));
+		key.contentHash = Hash(file.Data(), file.Size(), progress);
+		key.fileSize = file.Size();
+		key.importFlags = importFlags;
+		key.processFlags = processFlags;
+		return true;
+	}
+
+	// Vertices are not copied: they point into file, which has to stay open while they are used. Everything
+	// else is copied out, the indices because later stages rewrite them. A file that does not pass Valid is
+	// deleted.
+	static bool Load(
+		const CacheKey& key,
+		std::unique_ptr<MappedFile>& file,
+		ArrayView<Vertex>& vertices,
+		std::vector<UINT32>& indices,
+		std::vector<MeshRange>& meshRanges,
+		Bounds& bounds,
+		std::vector<Bounds>& meshBounds,
+		std::vector<InstanceTransform>& instances,
+		std::vector<UINT>& meshInstances)
+	{
+		std::filesystem::path path = CachePath(key);
+		auto mapped = std::make_unique<MappedFile>(path.string());
+		if(!mapped->IsOpen()) return false;
+
+		Header header;
+		if(!Valid(*mapped, key, header))
+		{
+			mapped.reset();
+			std::error_code error;
+			std::filesystem::remove(path, error);
+			return false;
+		}
+
+		const BYTE* data = mapped->Data();
+		auto ranges = reinterpret_cast<const MeshRange*>(data + header.meshRangeOffset);
+		auto rangeBounds = reinterpret_cast<const Bounds*>(data + header.meshBoundsOffset);
+		auto vertexData = reinterpret_cast<const Vertex*>(data + header.vertexOffset);
+		auto indexData = reinterpret_cast<const UINT32*>(data + header.indexOffset);
+		auto instanceData = reinterpret_cast<const InstanceTransform*>(data + header.instanceOffset);
+		auto meshInstanceData = reinterpret_cast<const UINT*>(data + header.meshInstanceOffset);
+
+		meshRanges.assign(ranges, ranges + header.meshCount);
+		meshBounds.assign(rangeBounds, rangeBounds + header.meshCount);
+		vertices = ArrayView<Vertex>(vertexData, header.vertexCount);
+		indices.assign(indexData, indexData + header.indexCount);
+		instances.assign(instanceData, instanceData + header.instanceCount);
+		meshInstances.assign(meshInstanceData, meshInstanceData + header.meshCount + 1);
+		bounds = header.bounds;
+		file = std::move(mapped);
+
+		std::error_code error;
+		std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+		return true;
+	}
+
+	static bool Save(
+		const CacheKey& key,
+		ArrayView<Vertex> vertices,
+		const std::vector<UINT32>& indices,
+		const std::vector<MeshRange>& meshRanges,
+		const Bounds& bounds,
+		const std::vector<Bounds>& meshBounds,
+		const std::vector<InstanceTransform>& instances,
+		const std::vector<UINT>& meshInstances)
+	{
+		Header header;
+		memset(&header, 0, sizeof(header));
+		header.magic = magic;
+		header.version = version;
+		header.key = key;
+		header.meshCount = meshRanges.size();
+		header.vertexCount = vertices.size();
+		header.indexCount = indices.size();
+		header.instanceCount = instances.size();
+		header.meshRangeOffset = Align(sizeof(Header));
+		header.meshBoundsOffset = Align(header.meshRangeOffset + meshRanges.size() * sizeof(MeshRange));
+		header.vertexOffset = Align(header.meshBoundsOffset + meshBounds.size() * sizeof(Bounds));
+		header.indexOffset = Align(header.vertexOffset + vertices.size() * sizeof(Vertex));
+		header.instanceOffset = Align(header.indexOffset + indices.size() * sizeof(UINT32));
+		header.meshInstanceOffset = Align(header.instanceOffset + instances.size() * sizeof(InstanceTransform));
+		header.cacheSize = header.meshInstanceOffset + meshInstances.size() * sizeof(UINT);
+		header.bounds = bounds;
+
+		return WriteFile(CachePath(key), [&](std::ofstream& out)
+		{
+			UINT64 position = 0;
+			Write(out, position, 0, &header, sizeof(header));
+			Write(out, position, header.meshRangeOffset, meshRanges.data(), meshRanges.size() * sizeof(MeshRange));
+			Write(out, position, header.meshBoundsOffset, meshBounds.data(), meshBounds.size() * sizeof(Bounds));
+			Write(out, position, header.vertexOffset, vertices.data(), vertices.size() * sizeof(Vertex));
+			Write(out, position, header.indexOffset, indices.data(), indices.size() * sizeof(UINT32));
+			Write(out, position, header.instanceOffset, instances.data(), instances.size() * sizeof(InstanceTransform));
+			Write(out, position, header.meshInstanceOffset, meshInstances.data(), meshInstances.size() * sizeof(UINT));
+		});
+	}
+
+	// The LODs of the geometry stored under key, as Simplifier::BuildLods returns them. meshRanges are the
+	// loaded ones, against which every level is checked; a file that does not match them is deleted.
+	static bool LoadLods(
+		const CacheKey& key,
+		const std::vector<MeshRange>& meshRanges,
+		std::vector<UINT32>& lodIndices,
+		std::vector<MeshLod>& lods,
+		std::vector<UINT>& meshLods)
+	{
+		std::filesystem::path path = CachePath(key, "-lods");
+		LodHeader header;
+		bool valid = false;
+		{
+			MappedFile file(path.string());
+			if(!file.IsOpen()) return false;
+			valid = ValidLods(file, key, meshRanges, header);
+			if(valid)
+			{
+				const BYTE* data = file.Data();
+				auto meshLodData = reinterpret_cast<const UINT*>(data + header.meshLodOffset);
+				auto lodData = reinterpret_cast<const MeshLod*>(data + header.lodOffset);
+				auto lodIndexData = reinterpret_cast<const UINT32*>(data + header.lodIndexOffset);
+				meshLods.assign(meshLodData, meshLodData + header.meshCount + 1);
+				lods.assign(lodData, lodData + header.lodCount);
+				lodIndices.assign(lodIndexData, lodIndexData + header.lodIndexCount);
+			}
+		}
+
+		std::error_code error;
+		if(!valid) std::filesystem::remove(path, error);
+		else std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+		return valid;
+	}
+
+	static bool SaveLods(
+		const CacheKey& key,
+		const std::vector<UINT32>& lodIndices,
+		const std::vector<MeshLod>& lods,
+		const std::vector<UINT>& meshLods)
+	{
+		LodHeader header;
+		memset(&header, 0, sizeof(header));
+		header.magic = lodMagic;
+		header.version = lodVersion;
+		header.key = key;
+		header.meshCount = meshLods.size() - 1;
+		header.lodCount = lods.size();
+		header.lodIndexCount = lodIndices.size();
+		header.meshLodOffset = Align(sizeof(LodHeader));
+		header.lodOffset = Align(header.meshLodOffset + meshLods.size() * sizeof(UINT));
+		header.lodIndexOffset = Align(header.lodOffset + lods.size() * sizeof(MeshLod));
+		header.cacheSize = header.lodIndexOffset + lodIndices.size() * sizeof(UINT32);
+
+		return WriteFile(CachePath(key, "-lods"), [&](std::ofstream& out)
+		{
+			UINT64 position = 0;
+			Write(out, position, 0, &header, sizeof(header));
+			Write(out, position, header.meshLodOffset, meshLods.data(), meshLods.size() * sizeof(UINT));
+			Write(out, position, header.lodOffset, lods.data(), lods.size() * sizeof(MeshLod));
+			Write(out, position, header.lodIndexOffset, lodIndices.data(), lodIndices.size() * sizeof(UINT32));
+		});
+	}
+
+	// Deletes the least recently used cache files until the rest fit in maxBytes; keep always stays.
+	static void Trim(const std::filesystem::path& directory, UINT64 maxBytes, const std::filesystem::path& keep)
+	{
+		struct Entry
+		{
+			std::filesystem::path path;
+			std::filesystem::file_time_type time;
+			UINT64 size;
+		};
+		std::vector<Entry> entries;
+		UINT64 total = 0;
+		std::error_code error;
+		for(std::filesystem::directory_iterator it(directory, error), end; !error && it != end; it.increment(error))
+		{
+			if(it->path().extension() != ".mvc") continue;
+			Entry entry = {it->path(), it->last_write_time(error), it->file_size(error)};
+			if(error) break;
+			total += entry.size;
+			entries.push_back(entry);
+		}
+		std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+		for(auto& entry : entries)
+		{
+			if(total <= maxBytes) break;
+			if(entry.path == keep) continue;
+			if(std::filesystem::remove(entry.path, error)) total -= entry.size;
+		}
+	}
+
+	// 64-bit content hash; 1 MB blocks are hashed in parallel and folded in order.
+	static UINT64 Hash(const BYTE* data, UINT64 size, ImportProgress* progress = nullptr)
+	{
+		int blockCount = (size + blockSize - 1) / blockSize;
+		std::vector<UINT64> blockHashes(blockCount);
+		std::atomic<int> hashed{0};
+#pragma omp parallel for
+		for(int i = 0; i < blockCount; ++i)
+		{
+			if(progress && progress->Cancelled()) continue;
+			blockHashes[i] = HashBlock(data + i * blockSize, min(blockSize, size - i * blockSize), i);
+			if(progress) progress->Report(ImportStage::Hash, (float)++hashed / blockCount);
+		}
+		if(progress) progress->Check();
+
+		UINT64 hash = size;
+		for(auto blockHash : blockHashes) hash = Mix(hash ^ blockHash);
+		return hash;
+	}
+
+private:
+	static std::filesystem::path DefaultDirectory()
+	{
+		std::filesystem::path root;
+		wchar_t* localAppData = nullptr;
+		size_t length = 0;
+		if(_wdupenv_s(&localAppData, &length, L"LOCALAPPDATA") == 0 && localAppData) root = localAppData;
+		free(localAppData);
+		std::error_code error;
+		if(root.empty()) root = std::filesystem::temp_directory_path(error);
+		return root / "ModelViewer" / "cache";
+	}
+
+	static std::filesystem::path CachePath(const CacheKey& key, const char* suffix = "")
+	{
+		char name[80];
+		snprintf(name, sizeof(name), "%016llx-%08x-%x%s.mvc", (unsigned long long)key.contentHash, key.importFlags, key.processFlags, suffix);
+		return Directory() / name;
+	}
+
+	// Writes a temporary file and renames it over path once complete, so that a reader never maps half a file.
+	template<class WriteArrays>
+	static bool WriteFile(const std::filesystem::path& path, WriteArrays writeArrays)
+	{
+		std::error_code error;
+		std::filesystem::create_directories(Directory(), error);
+		std::filesystem::path tempPath = path.string() + ".tmp";
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			if(!out) return false;
+			writeArrays(out);
+			if(!out) return false;
+		}
+
+		std::filesystem::remove(path, error);
+		std::filesystem::rename(tempPath, path, error);
+		if(error) return false;
+		Trim(Directory(), maxCacheBytes, path);
+		return true;
+	}
+
+	static UINT64 Align(UINT64 offset) { return (offset + 15) & ~15ULL; }
+
+	static bool Fits(UINT64 offset, UINT64 count, UINT64 elementSize, UINT64 fileSize)
+	{
+		return offset <= fileSize && count <= (fileSize - offset) / elementSize;
+	}
+
+	// A file is only used once every array fits in it, every mesh range lies within the arrays and every
+	// index within its mesh, so that a truncated or damaged file is refused here instead of read out of
+	// bounds by a later stage.
+	static bool Valid(const MappedFile& file, const CacheKey& key, Header& header)
+	{
+		UINT64 size = file.Size();
+		if(size < sizeof(Header)) return false;
+		memcpy(&header, file.Data(), sizeof(Header));
+		if(header.magic != magic || header.version != version || header.cacheSize != size) return false;
+		if(header.key.contentHash != key.contentHash || header.key.fileSize != key.fileSize || header.key.importFlags != key.importFlags ||
+			header.key.processFlags != key.processFlags) return false;
+		if(header.meshCount >= size || header.instanceCount == 0 ||
+			!Fits(header.meshRangeOffset, header.meshCount, sizeof(MeshRange), size) ||
+			!Fits(header.meshBoundsOffset, header.meshCount, sizeof(Bounds), size) ||
+			!Fits(header.vertexOffset, header.vertexCount, sizeof(Vertex), size) ||
+			!Fits(header.indexOffset, header.indexCount, sizeof(UINT32), size) ||
+			!Fits(header.instanceOffset, header.instanceCount, sizeof(InstanceTransform), size) ||
+			!Fits(header.meshInstanceOffset, header.meshCount + 1, sizeof(UINT), size)) return false;
+
+		const BYTE* data = file.Data();
+		auto ranges = reinterpret_cast<const MeshRange*>(data + header.meshRangeOffset);
+		auto indices = reinterpret_cast<const UINT32*>(data + header.indexOffset);
+		auto meshInstances = reinterpret_cast<const UINT*>(data + header.meshInstanceOffset);
+		for(UINT64 i = 0; i < header.meshCount; ++i)
+		{
+			const MeshRange& range = ranges[i];
+			if((UINT64)range.baseVertex + range.vertexCount > header.vertexCount ||
+				(UINT64)range.firstIndex + range.indexCount > header.indexCount ||
+				range.faceSize > 3 || (range.faceSize > 0 && range.indexCount % range.faceSize != 0) ||
+				meshInstances[i] > meshInstances[i + 1]) return false;
+		}
+		if(meshInstances[header.meshCount] > header.instanceCount) return false;
+
+		// Index checks run over fixed chunks, so that one huge mesh is spread over the threads as well.
+		std::vector<std::pair<UINT, UINT>> chunks;
+		for(UINT i = 0; i < header.meshCount; ++i)
+			for(UINT k = 0; k < ranges[i].indexCount; k += indexChunk) chunks.push_back({i, k});
+		int chunkCount = chunks.size();
+		int outOfRange = 0;
+#pragma omp parallel for reduction(+ : outOfRange)
+		for(int c = 0; c < chunkCount; ++c)
+		{
+			const MeshRange& range = ranges[chunks[c].first];
+			const UINT32* index = indices + range.firstIndex;
+			UINT end = min(range.indexCount, chunks[c].second + indexChunk);
+			for(UINT k = chunks[c].second; k < end; ++k) outOfRange += index[k] >= range.vertexCount;
+		}
+		return outOfRange == 0;
+	}
+
+	// Every level has to lie in the index array and index its own mesh's vertices.
+	static bool ValidLods(const MappedFile& file, const CacheKey& key, const std::vector<MeshRange>& meshRanges, LodHeader& header)
+	{
+		UINT64 size = file.Size();
+		if(size < sizeof(LodHeader)) return false;
+		memcpy(&header, file.Data(), sizeof(LodHeader));
+		if(header.magic != lodMagic || header.version != lodVersion || header.cacheSize != size) return false;
+		if(memcmp(&header.key, &key, sizeof(CacheKey)) != 0 || header.meshCount != meshRanges.size()) return false;
+		if(!Fits(header.meshLodOffset, header.meshCount + 1, sizeof(UINT), size) ||
+			!Fits(header.lodOffset, header.lodCount, sizeof(MeshLod), size) ||
+			!Fits(header.lodIndexOffset, header.lodIndexCount, sizeof(UINT32), size)) return false;
+
+		const BYTE* data = file.Data();
+		auto meshLods = reinterpret_cast<const UINT*>(data + header.meshLodOffset);
+		auto lods = reinterpret_cast<const MeshLod*>(data + header.lodOffset);
+		auto lodIndices = reinterpret_cast<const UINT32*>(data + header.lodIndexOffset);
+		if(meshLods[0] != 0 || meshLods[header.meshCount] != header.lodCount) return false;
+		for(UINT64 i = 0; i < header.meshCount; ++i)
+			if(meshLods[i] > meshLods[i + 1]) return false;
+
+		int meshCount = header.meshCount;
+		int outOfRange = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+ : outOfRange)
+		for(int i = 0; i < meshCount; ++i)
+			for(UINT l = meshLods[i]; l < meshLods[i + 1]; ++l)
+			{
+				const MeshLod& lod = lods[l];
+				if((UINT64)lod.firstIndex + lod.indexCount > header.lodIndexCount || lod.indexCount % 3 != 0)
+				{
+					++outOfRange;
+					continue;
+				}
+				for(UINT k = 0; k < lod.indexCount; ++k) outOfRange += lodIndices[lod.firstIndex + k] >= meshRanges[i].vertexCount;
+			}
+		return outOfRange == 0;
+	}
+
+	static void Write(std::ofstream& out, UINT64& position, UINT64 offset, const void* data, UINT64 byteSize)
+	{
+		static const char zeros[16] = {};
+		out.write(zeros, offset - position);
+		out.write(static_cast<const char*>(data), byteSize);
+		position = offset + byteSize;
+	}
+
+	static UINT64 Mix(UINT64 key)
+	{
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdULL;
+		key ^= key >> 33;
+		key *= 0xc4ceb9fe1a85ec53ULL;
+		key ^= key >> 33;
+		return key;
+	}
+
+	static UINT64 HashBlock(const BYTE* data, UINT64 size, UINT64 seed)
+	{
+		const UINT64 k1 = 0x9e3779b97f4a7c15ULL, k2 = 0xbf58476d1ce4e5b9ULL;
+		UINT64 lanes[4] = {seed, seed + k1, seed + k2, seed - k1};
+
+		UINT64 i = 0;
+		for(; i + 32 <= size; i += 32)
+			for(int k = 0; k < 4; ++k)
+			{
+				UINT64 word;
+				memcpy(&word, data + i + k * 8, 8);
+				lanes[k] += word * k2;
+				lanes[k] = ((lanes[k] << 31) | (lanes[k] >> 33)) * k1;
+			}
+
+		UINT64 hash = seed ^ size;
+		for(int k = 0; k < 4; ++k) hash = Mix(hash ^ lanes[k]);
+		for(; i < size; ++i) hash = (hash ^ data[i]) * k1;
+		return Mix(hash);
+	}
+};
@@ -0,0 +1,280 @@
+#pragma once
+
+#include "SceneGraph.h"
+#include "DirectX-std.h"
+#include "IndexStore.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <charconv>
+#include <cctype>
+#include <thread>
+
+// One placement of a mesh: a baked mesh with the identity, or an instanced mesh with one of its
+// transforms. Indices are read from the store, relative to the mesh's first vertex.
+struct ExportPart
+{
+	const Vertex* vertices;
+	UINT vertexCount;
+	const IndexStore* store;
+	int mesh;
+	UINT indexCount;
+	UINT faceSize;
+	InstanceTransform transform;
+};
+
+enum class ExportFormat { Obj, Ply, Stl, Unknown };
+
+// Streaming writers for the in-memory geometry. Work is cut into chunks that never cross a part;
+// a batch of chunks is encoded in parallel and then written in order, so the output does not depend on
+// thread timing and only one batch is held in memory. Geometry is converted back from the left-handed
+// import convention: z is negated and the winding flipped.
+class ModelWriter
+{
+private:
+	static constexpr UINT chunkSize = 1 << 14;
+
+	enum class ChunkKind { Positions, Normals, Faces };
+
+	struct Chunk
+	{
+		ChunkKind kind;
+		int part;
+		UINT begin, end;
+		UINT base;
+	};
+
+public:
+	static ExportFormat FormatOf(const std::string& fileName)
+	{
+		size_t dot = fileName.find_last_of('.');
+		if(dot == std::string::npos) return ExportFormat::Unknown;
+		std::string extension = fileName.substr(dot + 1);
+		for(auto& c : extension) c = tolower(c);
+		if(extension == "obj") return ExportFormat::Obj;
+		if(extension == "ply") return ExportFormat::Ply;
+		if(extension == "stl") return ExportFormat::Stl;
+		return ExportFormat::Unknown;
+	}
+
+	static bool Write(const std::string& fileName, ExportFormat format, const std::vector<ExportPart>& parts, UINT64& bytes)
+	{
+		std::ofstream out(fileName, std::ios::binary | std::ios::trunc);
+		if(!out) return false;
+
+		bool written = false;
+		if(format == ExportFormat::Obj) written = WriteObj(out, parts);
+		else if(format == ExportFormat::Ply) written = WritePly(out, parts);
+		else if(format == ExportFormat::Stl) written = WriteStl(out, parts);
+		bytes = written ? (UINT64)out.tellp() : 0;
+		return written && (bool)out;
+	}
+
+private:
+	static bool WriteObj(std::ofstream& out, const std::vector<ExportPart>& parts)
+	{
+		out << "# ModelViewer export\n";
+
+		std::vector<Chunk> chunks;
+		UINT base = 1;
+		for(int p = 0; p < (int)parts.size(); ++p)
+		{
+			const ExportPart& part = parts[p];
+			AddChunks(chunks, ChunkKind::Positions, p, part.vertexCount, base);
+			AddChunks(chunks, ChunkKind::Normals, p, part.vertexCount, base);
+			AddChunks(chunks, ChunkKind::Faces, p, part.faceSize ? part.indexCount / part.faceSize : 0, base);
+			base += part.vertexCount;
+		}
+
+		return WriteChunks(out, chunks, [&](const Chunk& chunk, std::string& buffer)
+		{
+			const ExportPart& part = parts[chunk.part];
+			buffer.resize((chunk.end - chunk.begin) * 96 + 32);
+			char* first = &buffer[0];
+			char* last = first + buffer.size();
+			char* p = first;
+			if(chunk.kind == ChunkKind::Positions && chunk.begin == 0) p += snprintf(p, last - p, "o part%d\n", chunk.part);
+
+			if(chunk.kind == ChunkKind::Faces)
+			{
+				static const char* keywords[] = {"", "p", "l", "f"};
+				for(UINT f = chunk.begin; f < chunk.end; ++f)
+				{
+					UINT32 corners[3];
+					FaceCorners(part, f, corners);
+					*p++ = keywords[part.faceSize][0];
+					for(UINT k = 0; k < part.faceSize; ++k)
+					{
+						*p++ = ' ';
+						p = std::to_chars(p, last, chunk.base + corners[k]).ptr;
+						if(part.faceSize != 3) continue;
+						*p++ = '/';
+						*p++ = '/';
+						p = std::to_chars(p, last, chunk.base + corners[k]).ptr;
+					}
+					*p++ = '\n';
+				}
+			}
+			else
+			{
+				for(UINT v = chunk.begin; v < chunk.end; ++v)
+				{
+					Vertex vertex = Place(part, v);
+					const XMFLOAT3& value = chunk.kind == ChunkKind::Positions ? vertex.position : vertex.normal;
+					*p++ = 'v';
+					if(chunk.kind == ChunkKind::Normals) *p++ = 'n';
+					for(float component : {value.x, value.y, value.z})
+					{
+						*p++ = ' ';
+						p = std::to_chars(p, last, component).ptr;
+					}
+					*p++ = '\n';
+				}
+			}
+			buffer.resize(p - first);
+		});
+	}
+
+	static bool WritePly(std::ofstream& out, const std::vector<ExportPart>& parts)
+	{
+		std::vector<Chunk> chunks;
+		UINT64 vertexCount = 0, faceCount = 0;
+		for(int p = 0; p < (int)parts.size(); ++p)
+		{
+			if(parts[p].faceSize != 3) continue;
+			AddChunks(chunks, ChunkKind::Positions, p, parts[p].vertexCount, vertexCount);
+			vertexCount += parts[p].vertexCount;
+		}
+		for(UINT p = 0, base = 0; p < parts.size(); ++p)
+		{
+			if(parts[p].faceSize != 3) continue;
+			AddChunks(chunks, ChunkKind::Faces, p, parts[p].indexCount / 3, base);
+			faceCount += parts[p].indexCount / 3;
+			base += parts[p].vertexCount;
+		}
+
+		out << "ply\nformat binary_little_endian 1.0\ncomment ModelViewer export\n"
+			<< "element vertex " << vertexCount << "\n"
+			<< "property float x\nproperty float y\nproperty float z\n"
+			<< "property float nx\nproperty float ny\nproperty float nz\n"
+			<< "property uchar red\nproperty uchar green\nproperty uchar blue\n"
+			<< "element face " << faceCount << "\n"
+			<< "property list uchar uint vertex_indices\nend_header\n";
+
+		return WriteChunks(out, chunks, [&](const Chunk& chunk, std::string& buffer)
+		{
+			const ExportPart& part = parts[chunk.part];
+			UINT recordSize = chunk.kind == ChunkKind::Faces ? 13 : 27;
+			buffer.resize((chunk.end - chunk.begin) * recordSize);
+			char* p = &buffer[0];
+			for(UINT i = chunk.begin; i < chunk.end; ++i)
+			{
+				if(chunk.kind == ChunkKind::Faces)
+				{
+					UINT32 corners[3];
+					FaceCorners(part, i, corners);
+					*p++ = 3;
+					for(UINT32 corner : corners) p = Put(p, (UINT32)(chunk.base + corner));
+				}
+				else
+				{
+					Vertex vertex = Place(part, i);
+					p = Put(p, vertex.position);
+					p = Put(p, vertex.normal);
+					for(float c : {vertex.color.x, vertex.color.y, vertex.color.z})
+						*p++ = (char)(BYTE)(min(max(c, 0.0f), 1.0f) * 255 + 0.5f);
+				}
+			}
+		});
+	}
+
+	// Binary STL has no shared vertices: every triangle carries its face normal and three corners.
+	static bool WriteStl(std::ofstream& out, const std::vector<ExportPart>& parts)
+	{
+		std::vector<Chunk> chunks;
+		UINT32 faceCount = 0;
+		for(int p = 0; p < (int)parts.size(); ++p)
+		{
+			if(parts[p].faceSize != 3) continue;
+			AddChunks(chunks, ChunkKind::Faces, p, parts[p].indexCount / 3, 0);
+			faceCount += parts[p].indexCount / 3;
+		}
+
+		char header[80] = "ModelViewer export";
+		out.write(header, sizeof(header));
+		out.write(reinterpret_cast<const char*>(&faceCount), sizeof(faceCount));
+
+		return WriteChunks(out, chunks, [&](const Chunk& chunk, std::string& buffer)
+		{
+			const ExportPart& part = parts[chunk.part];
+			buffer.resize((chunk.end - chunk.begin) * 50);
+			char* p = &buffer[0];
+			for(UINT f = chunk.begin; f < chunk.end; ++f)
+			{
+				UINT32 corners[3];
+				FaceCorners(part, f, corners);
+				Vertex a = Place(part, corners[0]), b = Place(part, corners[1]), c = Place(part, corners[2]);
+				XMVECTOR p1 = XMLoadFloat3(&a.position);
+				XMFLOAT3 normal;
+				XMStoreFloat3(&normal, XMVector3Normalize(XMVector3Cross(XMLoadFloat3(&b.position) - p1, XMLoadFloat3(&c.position) - p1)));
+				p = Put(p, normal);
+				p = Put(p, a.position);
+				p = Put(p, b.position);
+				p = Put(p, c.position);
+				*p++ = 0;
+				*p++ = 0;
+			}
+		});
+	}
+
+	static void AddChunks(std::vector<Chunk>& chunks, ChunkKind kind, int part, UINT count, UINT64 base)
+	{
+		for(UINT begin = 0; begin < count; begin += chunkSize)
+			chunks.push_back({kind, part, begin, min(begin + chunkSize, count), (UINT)base});
+	}
+
+	template<typename Encode>
+	static bool WriteChunks(std::ofstream& out, const std::vector<Chunk>& chunks, Encode encode)
+	{
+		int batchSize = max(std::thread::hardware_concurrency(), 1u) * 4;
+		std::vector<std::string> buffers(batchSize);
+		for(size_t first = 0; first < chunks.size(); first += batchSize)
+		{
+			int count = (int)min(chunks.size() - first, (size_t)batchSize);
+#pragma omp parallel for schedule(dynamic)
+			for(int c = 0; c < count; ++c) encode(chunks[first + c], buffers[c]);
+			for(int c = 0; c < count; ++c) out.write(buffers[c].data(), buffers[c].size());
+			if(!out) return false;
+		}
+		return true;
+	}
+
+	// Corners of face f with the winding flipped back to counter-clockwise.
+	static void FaceCorners(const ExportPart& part, UINT f, UINT32* corners)
+	{
+		UINT first = f * part.faceSize;
+		for(UINT k = 0; k < part.faceSize; ++k) corners[k] = part.store->Get(part.mesh, first + k);
+		if(part.faceSize == 3) std::swap(corners[1], corners[2]);
+	}
+
+	static Vertex Place(const ExportPart& part, UINT v)
+	{
+		Vertex vertex = part.vertices[v];
+		if(!SceneGraph::IsIdentity(part.transform)) SceneGraph::Apply(part.transform, vertex);
+		vertex.position.z = -vertex.position.z;
+		vertex.normal.z = -vertex.normal.z;
+		return vertex;
+	}
+
+	static char* Put(char* p, UINT32 value)
+	{
+		memcpy(p, &value, sizeof(value));
+		return p + sizeof(value);
+	}
+
+	static char* Put(char* p, const XMFLOAT3& value)
+	{
+		memcpy(p, &value, sizeof(value));
+		return p + sizeof(value);
+	}
+};
@@ -0,0 +1,338 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include "MappedFile.h"
+#include "ImportProgress.h"
+#include "MeshReader.h"
+#include <vector>
+#include <string>
+#include <charconv>
+#include <thread>
+#include <climits>
+
+// Native reader for the subset of OBJ that scans are written in: v with optional colors, vn, and f in any of
+// the v, v/t, v//n and v/t/n forms, including negative indices. Texture coordinates, groups and materials
+// are skipped. Lines, points, free-form geometry and continued lines make Read fail, so the caller falls
+// back to Assimp.
+//
+// The mapped file is cut at line boundaries and every chunk is parsed on its own; the chunks are then merged
+// in file order, so indices can be resolved once the number of v and vn records before each chunk is known.
+// The result is one triangle mesh, converted to the left-handed convention Assimp's import produces.
+class ObjReader
+{
+private:
+	static constexpr UINT64 minChunkBytes = 1 << 20;
+	// Negative OBJ indices count back from the record they appear in; until the chunk's offset is known they
+	// are kept relative to the chunk and biased below every absolute index.
+	static constexpr INT64 relativeBias = 1ll << 62;
+	static constexpr INT64 noNormal = -1;
+
+	struct Chunk
+	{
+		const char* begin;
+		const char* end;
+		std::vector<XMFLOAT3> positions, colors, normals;
+		std::vector<INT64> corners, normalCorners;
+		UINT64 positionBase = 0, normalBase = 0, cornerBase = 0;
+		bool failed = false;
+		bool sharedNormals = true;
+		bool relativeCorners = false;
+	};
+
+	enum class NormalSource { Shared, Computed, PerCorner };
+
+public:
+	static bool Handles(const std::string& fileName)
+	{
+		return MeshReader::HasExtension(fileName, "obj");
+	}
+
+	static bool Read(
+		const std::string& fileName,
+		std::vector<Vertex>& vertices,
+		std::vector<UINT32>& indices,
+		std::vector<MeshRange>& meshRanges,
+		UINT64& bytes,
+		ImportProgress* progress)
+	{
+		MappedFile file(fileName);
+		if(!file.IsOpen()) return false;
+		const char* data = reinterpret_cast<const char*>(file.Data());
+		bytes = file.Size();
+
+		std::vector<Chunk> chunks;
+		UINT64 chunkBytes = max(bytes / (max(std::thread::hardware_concurrency(), 1u) * 4) + 1, minChunkBytes);
+		for(const char* begin = data, *end = data + bytes; begin < end;)
+		{
+			const char* cut = begin + min(chunkBytes, (UINT64)(end - begin));
+			if(cut < end)
+			{
+				cut = static_cast<const char*>(memchr(cut, '\n', end - cut));
+				cut = cut ? cut + 1 : end;
+			}
+			chunks.push_back({begin, cut});
+			begin = cut;
+		}
+
+		int chunkCount = chunks.size();
+		std::atomic<int> parsed{0};
+#pragma omp parallel for schedule(dynamic)
+		for(int c = 0; c < chunkCount; ++c)
+		{
+			if(progress && progress->Cancelled()) continue;
+			Parse(chunks[c]);
+			if(progress) progress->Report(ImportStage::Read, (float)++parsed / chunkCount);
+		}
+		if(progress) progress->Check();
+
+		UINT64 positionCount = 0, normalCount = 0, cornerCount = 0;
+		bool hasColors = false;
+		for(auto& chunk : chunks)
+		{
+			if(chunk.failed) return false;
+			chunk.positionBase = positionCount;
+			chunk.normalBase = normalCount;
+			chunk.cornerBase = cornerCount;
+			positionCount += chunk.positions.size();
+			normalCount += chunk.normals.size();
+			cornerCount += chunk.corners.size();
+			hasColors |= !chunk.colors.empty();
+		}
+		if(cornerCount == 0 || positionCount > UINT_MAX || cornerCount > UINT_MAX) return false;
+
+		// Positions of every chunk land in their own slice; the winding is flipped along with z below.
+		std::vector<BYTE> inRange(chunkCount, 1);
+		indices.resize(cornerCount);
+#pragma omp parallel for schedule(dynamic)
+		for(int c = 0; c < chunkCount; ++c)
+		{
+			const Chunk& chunk = chunks[c];
+			UINT32* out = indices.data() + chunk.cornerBase;
+			for(size_t i = 0; i < chunk.corners.size(); ++i)
+			{
+				INT64 index = Resolve(chunk.corners[i], chunk.positionBase);
+				if(index < 0 || index >= (INT64)positionCount) inRange[c] = 0;
+				out[i - i % 3 + (3 - i % 3) % 3] = (UINT32)index;
+			}
+		}
+
+		NormalSource source = NormalSource::Shared;
+		for(int c = 0; c < chunkCount; ++c)
+		{
+			if(!inRange[c])
+			{
+				std::vector<UINT32>().swap(indices);
+				return false;
+			}
+			// Equal relative indices only name the same record when both counts before the chunk agree.
+			const Chunk& chunk = chunks[c];
+			if(!chunk.sharedNormals || (chunk.relativeCorners && chunk.positionBase != chunk.normalBase)) source = NormalSource::PerCorner;
+		}
+		if(normalCount == 0) source = NormalSource::Computed;
+		else if(normalCount != positionCount) source = NormalSource::PerCorner;
+
+		vertices.resize(positionCount);
+		std::vector<XMFLOAT3> normals(source == NormalSource::PerCorner ? normalCount : 0);
+#pragma omp parallel for schedule(dynamic)
+		for(int c = 0; c < chunkCount; ++c)
+		{
+			const Chunk& chunk = chunks[c];
+			for(size_t i = 0; i < chunk.positions.size(); ++i)
+			{
+				Vertex& vertex = vertices[chunk.positionBase + i];
+				vertex.position = MeshReader::Flip(chunk.positions[i]);
+				vertex.color = i < chunk.colors.size() ? chunk.colors[i] : XMFLOAT3{0, 0, 0};
+			}
+			for(size_t i = 0; i < chunk.normals.size(); ++i)
+			{
+				if(source == NormalSource::Shared) vertices[chunk.normalBase + i].normal = MeshReader::Flip(chunk.normals[i]);
+				else if(source == NormalSource::PerCorner) normals[chunk.normalBase + i] = MeshReader::Flip(chunk.normals[i]);
+			}
+		}
+
+		if(source == NormalSource::Computed) MeshReader::ComputeNormals(vertices, indices);
+		if(source == NormalSource::PerCorner && !ExpandCorners(chunks, normals, vertices, indices)) return false;
+
+		meshRanges.assign(1, MeshReader::SingleMesh(vertices.size(), indices.size(), 3, hasColors));
+		return true;
+	}
+
+private:
+	static void Parse(Chunk& chunk)
+	{
+		for(const char* line = chunk.begin; line < chunk.end && !chunk.failed;)
+		{
+			const char* end = static_cast<const char*>(memchr(line, '\n', chunk.end - line));
+			if(!end) end = chunk.end;
+			ParseLine(chunk, Skip(line, end), end);
+			line = end + 1;
+		}
+		if(!chunk.colors.empty()) chunk.colors.resize(chunk.positions.size(), {0, 0, 0});
+	}
+
+	static void ParseLine(Chunk& chunk, const char* p, const char* end)
+	{
+		if(p == end || *p == '#') return;
+		while(end > p && isspace((unsigned char)end[-1])) --end;
+		if(end > p && end[-1] == '\\')
+		{
+			chunk.failed = true;
+			return;
+		}
+
+		const char* keyword = p;
+		while(p < end && !isspace((unsigned char)*p)) ++p;
+		size_t length = p - keyword;
+		auto is = [&](const char* name) { return length == strlen(name) && memcmp(keyword, name, length) == 0; };
+
+		if(is("v"))
+		{
+			float values[6];
+			int count = 0;
+			while(count < 6 && Number(p, end, values[count])) ++count;
+			if(count < 3)
+			{
+				chunk.failed = true;
+				return;
+			}
+			chunk.positions.push_back({values[0], values[1], values[2]});
+			if(count == 6)
+			{
+				chunk.colors.resize(chunk.positions.size() - 1, {0, 0, 0});
+				chunk.colors.push_back({values[3], values[4], values[5]});
+			}
+		}
+		else if(is("vn"))
+		{
+			XMFLOAT3 normal;
+			if(!Number(p, end, normal.x) || !Number(p, end, normal.y) || !Number(p, end, normal.z)) chunk.failed = true;
+			else chunk.normals.push_back(normal);
+		}
+		else if(is("f")) ParseFace(chunk, p, end);
+		else if(is("l") || is("p") || is("curv") || is("curv2") || is("surf") || is("cstype")) chunk.failed = true;
+	}
+
+	// Polygons are split into a fan around their first corner.
+	static void ParseFace(Chunk& chunk, const char* p, const char* end)
+	{
+		INT64 position[2], normal[2];
+		int count = 0;
+		for(p = Skip(p, end); p < end; p = Skip(p, end), ++count)
+		{
+			INT64 v, n = noNormal, unused;
+			if(!Index(p, end, chunk.positions.size(), v))
+			{
+				chunk.failed = true;
+				return;
+			}
+			if(p < end && *p == '/')
+			{
+				++p;
+				if(p < end && *p != '/' && !Index(p, end, 0, unused)) chunk.failed = true;
+				if(p < end && *p == '/')
+				{
+					++p;
+					if(!Index(p, end, chunk.normals.size(), n)) chunk.failed = true;
+				}
+			}
+			if(chunk.failed || (p < end && !isspace((unsigned char)*p)))
+			{
+				chunk.failed = true;
+				return;
+			}
+			chunk.sharedNormals &= n == noNormal || n == v;
+			chunk.relativeCorners |= v < 0;
+
+			if(count >= 2)
+			{
+				chunk.corners.insert(chunk.corners.end(), {position[0], position[1], v});
+				chunk.normalCorners.insert(chunk.normalCorners.end(), {normal[0], normal[1], n});
+			}
+			if(count == 0)
+			{
+				position[0] = v;
+				normal[0] = n;
+			}
+			position[1] = v;
+			normal[1] = n;
+		}
+		if(count < 3) chunk.failed = true;
+	}
+
+	static const char* Skip(const char* p, const char* end)
+	{
+		while(p < end && isspace((unsigned char)*p)) ++p;
+		return p;
+	}
+
+	static bool Number(const char*& p, const char* end, float& value)
+	{
+		p = Skip(p, end);
+		if(p < end && *p == '+') ++p;
+		auto result = std::from_chars(p, end, value);
+		if(result.ec != std::errc()) return false;
+		p = result.ptr;
+		return true;
+	}
+
+	// Positive indices become zero-based absolute ones, negative indices stay relative to the chunk.
+	static bool Index(const char*& p, const char* end, size_t localCount, INT64& index)
+	{
+		INT64 raw;
+		auto result = std::from_chars(p, end, raw);
+		if(result.ec != std::errc() || raw == 0) return false;
+		p = result.ptr;
+		index = raw > 0 ? raw - 1 : (INT64)localCount + raw - relativeBias;
+		return true;
+	}
+
+	static INT64 Resolve(INT64 index, UINT64 base)
+	{
+		return index >= 0 ? index : index + relativeBias + (INT64)base;
+	}
+
+	// Faces whose normal indices differ from their position indices get one vertex per corner, like Assimp
+	// produces for every OBJ; corners without a normal take their face's.
+	static bool ExpandCorners(
+		const std::vector<Chunk>& chunks,
+		const std::vector<XMFLOAT3>& normals,
+		std::vector<Vertex>& vertices,
+		std::vector<UINT32>& indices)
+	{
+		std::vector<Vertex> corners(indices.size());
+		std::vector<BYTE> inRange(chunks.size(), 1);
+#pragma omp parallel for schedule(dynamic)
+		for(int c = 0; c < (int)chunks.size(); ++c)
+		{
+			const Chunk& chunk = chunks[c];
+			for(size_t i = 0; i < chunk.normalCorners.size(); i += 3)
+			{
+				UINT64 first = chunk.cornerBase + i;
+				Vertex* face = &corners[first];
+				for(int k = 0; k < 3; ++k) face[k] = vertices[indices[first + k]];
+				XMVECTOR p1 = XMLoadFloat3(&face[0].position);
+				XMFLOAT3 faceNormal;
+				XMStoreFloat3(&faceNormal, XMVector3Normalize(XMVector3Cross(XMLoadFloat3(&face[1].position) - p1, XMLoadFloat3(&face[2].position) - p1)));
+
+				for(int k = 0; k < 3; ++k)
+				{
+					// Corner k of the flipped face is corner (3 - k) % 3 of the record.
+					INT64 n = chunk.normalCorners[i + (3 - k) % 3];
+					if(n == noNormal)
+					{
+						face[k].normal = faceNormal;
+						continue;
+					}
+					n = Resolve(n, chunk.normalBase);
+					if(n < 0 || n >= (INT64)normals.size()) inRange[c] = 0;
+					else face[k].normal = normals[n];
+				}
+			}
+		}
+		for(BYTE chunkInRange : inRange) if(!chunkInRange) return false;
+
+		vertices.swap(corners);
+		for(UINT i = 0; i < indices.size(); ++i) indices[i] = i;
+		return true;
+	}
+};
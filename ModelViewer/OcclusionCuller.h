@@ -0,0 +1,335 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include "FrustumCuller.h"
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <emmintrin.h>
+
+// Triangles of the largest meshes in model space, kept for occlusion culling after the rest of the CPU
+// geometry is released.
+struct OccluderMesh
+{
+	std::vector<XMFLOAT3> positions;
+	std::vector<UINT32> indices;
+
+	UINT TriangleCount() const { return indices.size() / 3; }
+
+	size_t Bytes() const
+	{
+		return positions.capacity() * sizeof(XMFLOAT3) + indices.capacity() * sizeof(UINT32);
+	}
+};
+
+// Software occlusion culling against a small depth buffer. Occluder triangles are transformed, clipped
+// against the near plane and binned into screen tiles; every tile then rasterizes its own bin on its own
+// thread, four pixel corners at a time, and resolves the corners into a depth per pixel and the depth
+// range of the tile. A box
+// is hidden when its nearest depth lies behind the buffer everywhere under its screen rectangle; a tile
+// whose nearest depth is behind the box shows it at once, and one whose farthest depth is in front of
+// the box is passed, both without reading pixels.
+//
+// Depth is z / w of the D3D projection. Occluders are sampled at pixel corners, keeping the nearest depth
+// at each, and a pixel is only written when all four of its corners are covered, with the farthest of
+// them. For one triangle that is exactly the pixels it covers entirely, so nothing seen past an occluder's
+// edge is hidden; triangles sharing an edge cover the corners on it between them and leave no crack.
+// A hole or notch in an occluder narrower than a pixel is not seen.
+class OcclusionCuller
+{
+public:
+	static constexpr int width = 256, height = 128;
+	static constexpr int tileWidth = 32, tileHeight = 16;
+	static constexpr int tilesX = width / tileWidth, tilesY = height / tileHeight;
+	// Corners of one tile row, tileWidth + 1 of them, rounded up to whole groups of four.
+	static constexpr int cornerStride = (tileWidth + 4) & ~3;
+
+	// Time of the last Render and Test, stage by stage.
+	struct Stats
+	{
+		double setupMs = 0, rasterMs = 0, testMs = 0;
+		UINT triangles = 0, binned = 0, tested = 0, occluded = 0;
+	};
+	Stats stats;
+
+	OcclusionCuller() : depth(width * height, 1.0f), tileMin(tilesX * tilesY, 1.0f), tileMax(tilesX * tilesY, 1.0f), bins(tilesX * tilesY) {}
+
+	// Fills the depth buffer with occluders; matrix takes their space to clip space.
+	void Render(const OccluderMesh& occluders, CXMMATRIX matrix)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		int vertexCount = occluders.positions.size();
+		clip.resize(vertexCount);
+#pragma omp parallel for
+		for(int v = 0; v < vertexCount; ++v)
+			XMStoreFloat4(&clip[v], XMVector3Transform(XMLoadFloat3(&occluders.positions[v]), matrix));
+
+		triangles.clear();
+		for(auto& bin : bins) bin.clear();
+		for(UINT t = 0; t < occluders.TriangleCount(); ++t)
+		{
+			XMFLOAT4 corners[3] = {
+				clip[occluders.indices[t * 3]], clip[occluders.indices[t * 3 + 1]], clip[occluders.indices[t * 3 + 2]]};
+			if(Outside(corners)) continue;
+			addClipped(corners);
+		}
+		stats.triangles = triangles.size();
+		stats.binned = 0;
+		for(int t = 0; t < (int)triangles.size(); ++t)
+		{
+			const ScreenTriangle& triangle = triangles[t];
+			// Tiles share their edge corners with the next tile.
+			for(int ty = max(triangle.minY - 1, 0) / tileHeight; ty <= min(triangle.maxY / tileHeight, tilesY - 1); ++ty)
+				for(int tx = max(triangle.minX - 1, 0) / tileWidth; tx <= min(triangle.maxX / tileWidth, tilesX - 1); ++tx)
+					bins[ty * tilesX + tx].push_back(t);
+		}
+		for(auto& bin : bins) stats.binned += bin.size();
+		stats.setupMs = ElapsedMs(start);
+
+		start = std::chrono::high_resolution_clock::now();
+#pragma omp parallel for schedule(dynamic)
+		for(int tile = 0; tile < tilesX * tilesY; ++tile) rasterizeTile(tile);
+		stats.rasterMs = ElapsedMs(start);
+	}
+
+	// Clears visible[i] for the boxes hidden behind the last Render and returns how many stay visible.
+	// Boxes already marked invisible are not tested.
+	UINT Test(const BoxBounds& boxes, CXMMATRIX matrix, std::vector<BYTE>& visible)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		int count = boxes.count, tested = 0, occluded = 0;
+#pragma omp parallel for schedule(dynamic, 256) reduction(+ : tested, occluded)
+		for(int i = 0; i < count; ++i)
+		{
+			if(!visible[i]) continue;
+			++tested;
+			if(boxVisible(boxes, i, matrix)) continue;
+			visible[i] = 0;
+			++occluded;
+		}
+		stats.tested = tested;
+		stats.occluded = occluded;
+		stats.testMs = ElapsedMs(start);
+
+		UINT visibleCount = 0;
+		for(int i = 0; i < count; ++i) visibleCount += visible[i];
+		return visibleCount;
+	}
+
+	float Depth(int x, int y) const
+	{
+		return depth[y * width + x];
+	}
+
+	size_t Bytes() const
+	{
+		size_t bytes = (depth.capacity() + tileMin.capacity() + tileMax.capacity()) * sizeof(float) + clip.capacity() * sizeof(XMFLOAT4) +
+			triangles.capacity() * sizeof(ScreenTriangle);
+		for(auto& bin : bins) bytes += bin.capacity() * sizeof(UINT);
+		return bytes;
+	}
+
+private:
+	// Screen position in pixels and depth of each corner, and the pixel corners the bounding box covers.
+	struct ScreenTriangle
+	{
+		float x[3], y[3], z[3];
+		int minX, minY, maxX, maxY;
+	};
+
+	std::vector<float> depth;
+	std::vector<float> tileMin, tileMax;
+	std::vector<XMFLOAT4> clip;
+	std::vector<ScreenTriangle> triangles;
+	std::vector<std::vector<UINT>> bins;
+
+	static double ElapsedMs(std::chrono::high_resolution_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	// True when all three corners are outside the same side or far plane.
+	static bool Outside(const XMFLOAT4 (&corners)[3])
+	{
+		bool left = true, right = true, bottom = true, top = true, behind = true;
+		for(auto& c : corners)
+		{
+			left &= c.x < -c.w;
+			right &= c.x > c.w;
+			bottom &= c.y < -c.w;
+			top &= c.y > c.w;
+			behind &= c.z > c.w;
+		}
+		return left || right || bottom || top || behind;
+	}
+
+	// Keeps the part with z >= 0, at most a quad, and adds it as one or two screen triangles.
+	void addClipped(const XMFLOAT4 (&corners)[3])
+	{
+		XMFLOAT4 polygon[4];
+		int n = 0;
+		for(int k = 0; k < 3; ++k)
+		{
+			const XMFLOAT4& a = corners[k];
+			const XMFLOAT4& b = corners[(k + 1) % 3];
+			if(a.z >= 0) polygon[n++] = a;
+			if((a.z >= 0) != (b.z >= 0))
+			{
+				float t = a.z / (a.z - b.z);
+				polygon[n++] = {a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, 0, a.w + (b.w - a.w) * t};
+			}
+		}
+		for(int k = 2; k < n; ++k) addTriangle(polygon[0], polygon[k - 1], polygon[k]);
+	}
+
+	void addTriangle(const XMFLOAT4& a, const XMFLOAT4& b, const XMFLOAT4& c)
+	{
+		ScreenTriangle triangle;
+		const XMFLOAT4* corners[3] = {&a, &b, &c};
+		float lowX = 1e30f, lowY = 1e30f, highX = -1e30f, highY = -1e30f;
+		for(int k = 0; k < 3; ++k)
+		{
+			if(corners[k]->w <= 0) return;
+			float invW = 1 / corners[k]->w;
+			triangle.x[k] = (corners[k]->x * invW * 0.5f + 0.5f) * width;
+			triangle.y[k] = (0.5f - corners[k]->y * invW * 0.5f) * height;
+			triangle.z[k] = corners[k]->z * invW;
+			lowX = min(lowX, triangle.x[k]);
+			lowY = min(lowY, triangle.y[k]);
+			highX = max(highX, triangle.x[k]);
+			highY = max(highY, triangle.y[k]);
+		}
+		float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) -
+			(triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+		if(fabsf(area) < 1e-6f) return;
+
+		// Pixel corners sit at whole coordinates, from 0 to width and height; clamping before the conversion
+		// keeps huge coordinates in range.
+		triangle.minX = max((int)ceilf(min(max(lowX, -1.0f), width + 1.0f)), 0);
+		triangle.minY = max((int)ceilf(min(max(lowY, -1.0f), height + 1.0f)), 0);
+		triangle.maxX = min((int)floorf(min(max(highX, -1.0f), width + 1.0f)), width);
+		triangle.maxY = min((int)floorf(min(max(highY, -1.0f), height + 1.0f)), height);
+		if(triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) return;
+		triangles.push_back(triangle);
+	}
+
+	// Edge functions and barycentric depth for four neighbouring corners at once; both windings are drawn.
+	void rasterizeTile(int tile)
+	{
+		int tileX = tile % tilesX * tileWidth, tileY = tile / tilesX * tileHeight;
+		float corners[(tileHeight + 1) * cornerStride];
+		for(float& corner : corners) corner = 1.0f;
+
+		const __m128 lane = _mm_setr_ps(0, 1, 2, 3), zero = _mm_setzero_ps();
+		for(UINT t : bins[tile])
+		{
+			const ScreenTriangle& triangle = triangles[t];
+			float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) -
+				(triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+			float sign = area > 0 ? 1.0f : -1.0f;
+			float invArea = 1 / fabsf(area);
+
+			// Edge k faces corner k, so its value weighs that corner's depth.
+			float stepX[3], stepY[3], originX[3], originY[3];
+			for(int k = 0; k < 3; ++k)
+			{
+				int a = (k + 1) % 3, b = (k + 2) % 3;
+				stepX[k] = -(triangle.y[b] - triangle.y[a]) * sign;
+				stepY[k] = (triangle.x[b] - triangle.x[a]) * sign;
+				originX[k] = triangle.x[a];
+				originY[k] = triangle.y[a];
+			}
+			__m128 z0 = _mm_set1_ps(triangle.z[0] * invArea), z1 = _mm_set1_ps(triangle.z[1] * invArea), z2 = _mm_set1_ps(triangle.z[2] * invArea);
+
+			int x0 = (max(triangle.minX, tileX) - tileX) & ~3, x1 = min(triangle.maxX, tileX + tileWidth) - tileX;
+			int y0 = max(triangle.minY, tileY) - tileY, y1 = min(triangle.maxY, tileY + tileHeight) - tileY;
+			for(int y = y0; y <= y1; ++y)
+			{
+				__m128 e[3], step[3];
+				for(int k = 0; k < 3; ++k)
+				{
+					float row = stepX[k] * (tileX + x0 - originX[k]) + stepY[k] * (tileY + y - originY[k]);
+					e[k] = _mm_add_ps(_mm_set1_ps(row), _mm_mul_ps(lane, _mm_set1_ps(stepX[k])));
+					step[k] = _mm_set1_ps(stepX[k] * 4);
+				}
+				for(int x = x0; x <= x1; x += 4)
+				{
+					__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e[0], zero), _mm_cmpge_ps(e[1], zero)), _mm_cmpge_ps(e[2], zero));
+					if(_mm_movemask_ps(inside))
+					{
+						__m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[0], z0), _mm_mul_ps(e[1], z1)), _mm_mul_ps(e[2], z2));
+						float* samples = &corners[y * cornerStride + x];
+						__m128 old = _mm_loadu_ps(samples);
+						_mm_storeu_ps(samples, _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(old, z)), _mm_andnot_ps(inside, old)));
+					}
+					for(int k = 0; k < 3; ++k) e[k] = _mm_add_ps(e[k], step[k]);
+				}
+			}
+		}
+
+		// An uncovered corner keeps 1, the far plane, and so does every pixel touching it.
+		__m128 nearest = _mm_set1_ps(1.0f), farthest = _mm_setzero_ps();
+		for(int y = 0; y < tileHeight; ++y)
+			for(int x = 0; x < tileWidth; x += 4)
+			{
+				const float* top = &corners[y * cornerStride + x];
+				const float* bottom = top + cornerStride;
+				__m128 pixels = _mm_max_ps(
+					_mm_max_ps(_mm_loadu_ps(top), _mm_loadu_ps(top + 1)), _mm_max_ps(_mm_loadu_ps(bottom), _mm_loadu_ps(bottom + 1)));
+				_mm_storeu_ps(&depth[(tileY + y) * width + tileX + x], pixels);
+				nearest = _mm_min_ps(nearest, pixels);
+				farthest = _mm_max_ps(farthest, pixels);
+			}
+		float lanes[4];
+		_mm_storeu_ps(lanes, nearest);
+		tileMin[tile] = min(min(lanes[0], lanes[1]), min(lanes[2], lanes[3]));
+		_mm_storeu_ps(lanes, farthest);
+		tileMax[tile] = max(max(lanes[0], lanes[1]), max(lanes[2], lanes[3]));
+	}
+
+	// The box's corners are its clip space center plus or minus its three transformed half axes. A box
+	// reaching in front of the near plane is always visible.
+	bool boxVisible(const BoxBounds& boxes, int i, CXMMATRIX matrix) const
+	{
+		XMVECTOR center = XMVector3Transform(XMVectorSet(boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i], 1), matrix);
+		XMVECTOR axes[3] = {matrix.r[0] * boxes.extentX[i], matrix.r[1] * boxes.extentY[i], matrix.r[2] * boxes.extentZ[i]};
+		XMVECTOR lowClip = XMVectorReplicate(1e30f), low = lowClip, high = -lowClip;
+		for(int corner = 0; corner < 8; ++corner)
+		{
+			XMVECTOR p = center + (corner & 1 ? axes[0] : -axes[0]) + (corner & 2 ? axes[1] : -axes[1]) + (corner & 4 ? axes[2] : -axes[2]);
+			lowClip = XMVectorMin(lowClip, p);
+			XMVECTOR projected = p / XMVectorSplatW(p);
+			low = XMVectorMin(low, projected);
+			high = XMVectorMax(high, projected);
+		}
+		if(XMVectorGetZ(lowClip) < 0 || XMVectorGetW(lowClip) <= 0) return true;
+
+		float lowX = (XMVectorGetX(low) * 0.5f + 0.5f) * width, highX = (XMVectorGetX(high) * 0.5f + 0.5f) * width;
+		float lowY = (0.5f - XMVectorGetY(high) * 0.5f) * height, highY = (0.5f - XMVectorGetY(low) * 0.5f) * height;
+		float nearest = XMVectorGetZ(low);
+
+		// Every pixel the rectangle touches, not only those whose centers it covers.
+		int x0 = max((int)floorf(max(lowX, -1.0f)), 0), x1 = min((int)ceilf(min(highX, (float)width + 1)) - 1, width - 1);
+		int y0 = max((int)floorf(max(lowY, -1.0f)), 0), y1 = min((int)ceilf(min(highY, (float)height + 1)) - 1, height - 1);
+		if(x0 > x1 || y0 > y1) return false;
+
+		__m128 boxDepth = _mm_set1_ps(nearest), lane = _mm_setr_ps(0, 1, 2, 3);
+		for(int ty = y0 / tileHeight; ty <= y1 / tileHeight; ++ty)
+			for(int tx = x0 / tileWidth; tx <= x1 / tileWidth; ++tx)
+			{
+				if(nearest <= tileMin[ty * tilesX + tx]) return true;
+				if(nearest > tileMax[ty * tilesX + tx]) continue;
+				int left = max(x0, tx * tileWidth), right = min(x1, tx * tileWidth + tileWidth - 1);
+				int top = max(y0, ty * tileHeight), bottom = min(y1, ty * tileHeight + tileHeight - 1);
+				for(int y = top; y <= bottom; ++y)
+					for(int x = left & ~3; x <= right; x += 4)
+					{
+						__m128 xs = _mm_add_ps(_mm_set1_ps((float)x), lane);
+						__m128 inRange = _mm_and_ps(_mm_cmpge_ps(xs, _mm_set1_ps((float)left)), _mm_cmple_ps(xs, _mm_set1_ps((float)right)));
+						__m128 behind = _mm_cmple_ps(boxDepth, _mm_loadu_ps(&depth[y * width + x]));
+						if(_mm_movemask_ps(_mm_and_ps(inRange, behind))) return true;
+					}
+			}
+		return false;
+	}
+};
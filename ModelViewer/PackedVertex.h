@@ -0,0 +1,240 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include "Bounds.h"
+#include "ArrayView.h"
+#include <vector>
+#include <cfloat>
+
+// 12-byte vertex: position as R16G16B16A16_UNORM inside the mesh box, normal as R16G16_SNORM in
+// octahedral form. Colors live in a separate R8G8B8A8_UNORM stream that only colored meshes have.
+struct PackedVertex
+{
+	UINT16 position[4];
+	INT16 normal[2];
+};
+
+// Decoding constants of one mesh: position = offset + quantized * step.
+struct PackedMesh
+{
+	XMFLOAT3 offset;
+	XMFLOAT3 step;
+	UINT firstColor;
+	UINT colorCount;
+
+	// Rounding to the nearest step is off by at most half a step on every axis. The step count it rounds is
+	// itself computed in floats: the difference to the offset, the reciprocal of the step and their product
+	// each add a relative FLT_EPSILON / 2 of up to 65535 steps, which the bound rounds up to
+	// 2 * 65536 * FLT_EPSILON steps. The decoder's multiply and add then round once each, relative to the
+	// largest coordinate.
+	float MaxPositionError() const
+	{
+		const float steps = 0.5f + 2 * 65536 * FLT_EPSILON;
+		float largest = max(fabsf(offset.x), max(fabsf(offset.y), fabsf(offset.z))) + 65535 * max(step.x, max(step.y, step.z));
+		float decoding = 2 * FLT_EPSILON * largest;
+		float x = step.x * steps + decoding, y = step.y * steps + decoding, z = step.z * steps + decoding;
+		return sqrtf(x * x + y * y + z * z) * (1 + 4 * FLT_EPSILON);
+	}
+};
+
+class VertexPacker
+{
+private:
+	static constexpr UINT chunkSize = 1 << 16;
+
+	struct Chunk
+	{
+		int mesh;
+		UINT begin, end;
+	};
+
+public:
+	static void Encode(
+		ArrayView<Vertex> vertices,
+		const std::vector<MeshRange>& meshRanges,
+		const std::vector<Bounds>& meshBounds,
+		std::vector<PackedVertex>& packed,
+		std::vector<UINT32>& colors,
+		std::vector<PackedMesh>& meshes)
+	{
+		meshes.resize(meshRanges.size());
+		UINT colorCount = 0;
+		std::vector<Chunk> chunks;
+		for(int i = 0; i < (int)meshRanges.size(); ++i)
+		{
+			const MeshRange& range = meshRanges[i];
+			const Bounds& bounds = meshBounds[i];
+			PackedMesh& mesh = meshes[i];
+			mesh.offset = bounds.Empty() ? XMFLOAT3{0, 0, 0} : bounds.boxMin;
+			XMFLOAT3 extent = bounds.Extent();
+			mesh.step = {extent.x / 65535, extent.y / 65535, extent.z / 65535};
+			mesh.firstColor = colorCount;
+			mesh.colorCount = range.hasColors ? range.vertexCount : 0;
+			colorCount += mesh.colorCount;
+
+			for(UINT begin = 0; begin < range.vertexCount; begin += chunkSize)
+				chunks.push_back({i, begin, min(begin + chunkSize, range.vertexCount)});
+		}
+
+		packed.resize(vertices.size());
+		colors.resize(colorCount);
+#pragma omp parallel for schedule(dynamic)
+		for(int c = 0; c < (int)chunks.size(); ++c)
+		{
+			const MeshRange& range = meshRanges[chunks[c].mesh];
+			const PackedMesh& mesh = meshes[chunks[c].mesh];
+			const Vertex* in = vertices.data() + range.baseVertex + chunks[c].begin;
+			UINT count = chunks[c].end - chunks[c].begin;
+			EncodeVertices(in, count, mesh, packed.data() + range.baseVertex + chunks[c].begin);
+			if(mesh.colorCount > 0) EncodeColors(in, count, colors.data() + mesh.firstColor + chunks[c].begin);
+		}
+	}
+
+	// Inverse of Encode, within MaxPositionError of every mesh; meshes without colors decode to black.
+	static void Decode(
+		const std::vector<PackedVertex>& packed,
+		const std::vector<UINT32>& colors,
+		const std::vector<PackedMesh>& meshes,
+		const std::vector<MeshRange>& meshRanges,
+		std::vector<Vertex>& vertices)
+	{
+		std::vector<Chunk> chunks;
+		for(int i = 0; i < (int)meshRanges.size(); ++i)
+			for(UINT begin = 0; begin < meshRanges[i].vertexCount; begin += chunkSize)
+				chunks.push_back({i, begin, min(begin + chunkSize, meshRanges[i].vertexCount)});
+
+		vertices.resize(packed.size());
+#pragma omp parallel for schedule(dynamic)
+		for(int c = 0; c < (int)chunks.size(); ++c)
+		{
+			const MeshRange& range = meshRanges[chunks[c].mesh];
+			const PackedMesh& mesh = meshes[chunks[c].mesh];
+			Vertex* out = vertices.data() + range.baseVertex + chunks[c].begin;
+			UINT count = chunks[c].end - chunks[c].begin;
+			DecodeVertices(packed.data() + range.baseVertex + chunks[c].begin, count, mesh, out);
+			if(mesh.colorCount > 0) DecodeColors(colors.data() + mesh.firstColor + chunks[c].begin, count, out);
+			else for(UINT v = 0; v < count; ++v) out[v].color = {0, 0, 0};
+		}
+	}
+
+	// Four vertices per step in SoA form; the tail is padded by repeating the last vertex.
+	static void EncodeVertices(const Vertex* vertices, UINT count, const PackedMesh& mesh, PackedVertex* out)
+	{
+		XMVECTOR offsetX = XMVectorReplicate(mesh.offset.x), offsetY = XMVectorReplicate(mesh.offset.y), offsetZ = XMVectorReplicate(mesh.offset.z);
+		XMVECTOR scaleX = XMVectorReplicate(mesh.step.x > 0 ? 1 / mesh.step.x : 0);
+		XMVECTOR scaleY = XMVectorReplicate(mesh.step.y > 0 ? 1 / mesh.step.y : 0);
+		XMVECTOR scaleZ = XMVectorReplicate(mesh.step.z > 0 ? 1 / mesh.step.z : 0);
+		XMVECTOR zero = XMVectorZero(), one = XMVectorSplatOne(), unorm = XMVectorReplicate(65535), snorm = XMVectorReplicate(32767);
+
+		for(UINT v = 0; v < count; v += 4)
+		{
+			const Vertex& a = vertices[v];
+			const Vertex& b = vertices[min(v + 1, count - 1)];
+			const Vertex& c = vertices[min(v + 2, count - 1)];
+			const Vertex& d = vertices[min(v + 3, count - 1)];
+
+			XMVECTOR px = XMVectorSet(a.position.x, b.position.x, c.position.x, d.position.x);
+			XMVECTOR py = XMVectorSet(a.position.y, b.position.y, c.position.y, d.position.y);
+			XMVECTOR pz = XMVectorSet(a.position.z, b.position.z, c.position.z, d.position.z);
+			XMVECTOR qx = XMVectorRound(XMVectorClamp((px - offsetX) * scaleX, zero, unorm));
+			XMVECTOR qy = XMVectorRound(XMVectorClamp((py - offsetY) * scaleY, zero, unorm));
+			XMVECTOR qz = XMVectorRound(XMVectorClamp((pz - offsetZ) * scaleZ, zero, unorm));
+
+			// Project onto the octahedron |x| + |y| + |z| = 1 and fold the lower half over the diagonals.
+			XMVECTOR nx = XMVectorSet(a.normal.x, b.normal.x, c.normal.x, d.normal.x);
+			XMVECTOR ny = XMVectorSet(a.normal.y, b.normal.y, c.normal.y, d.normal.y);
+			XMVECTOR nz = XMVectorSet(a.normal.z, b.normal.z, c.normal.z, d.normal.z);
+			XMVECTOR l1 = XMVectorAbs(nx) + XMVectorAbs(ny) + XMVectorAbs(nz);
+			XMVECTOR inverse = XMVectorSelect(zero, XMVectorReciprocal(l1), XMVectorGreater(l1, zero));
+			XMVECTOR ox = nx * inverse, oy = ny * inverse;
+			XMVECTOR signX = XMVectorSelect(-one, one, XMVectorGreaterOrEqual(ox, zero));
+			XMVECTOR signY = XMVectorSelect(-one, one, XMVectorGreaterOrEqual(oy, zero));
+			XMVECTOR lower = XMVectorLess(nz, zero);
+			XMVECTOR fx = XMVectorSelect(ox, (one - XMVectorAbs(oy)) * signX, lower);
+			XMVECTOR fy = XMVectorSelect(oy, (one - XMVectorAbs(ox)) * signY, lower);
+			fx = XMVectorRound(XMVectorClamp(fx, -one, one) * snorm);
+			fy = XMVectorRound(XMVectorClamp(fy, -one, one) * snorm);
+
+			XMFLOAT4 sx, sy, sz, tx, ty;
+			XMStoreFloat4(&sx, qx);
+			XMStoreFloat4(&sy, qy);
+			XMStoreFloat4(&sz, qz);
+			XMStoreFloat4(&tx, fx);
+			XMStoreFloat4(&ty, fy);
+			const float* lanes[5] = {&sx.x, &sy.x, &sz.x, &tx.x, &ty.x};
+			for(UINT k = 0; k < 4 && v + k < count; ++k)
+			{
+				PackedVertex& p = out[v + k];
+				p.position[0] = (UINT16)lanes[0][k];
+				p.position[1] = (UINT16)lanes[1][k];
+				p.position[2] = (UINT16)lanes[2][k];
+				p.position[3] = 0;
+				p.normal[0] = (INT16)lanes[3][k];
+				p.normal[1] = (INT16)lanes[4][k];
+			}
+		}
+	}
+
+	static void EncodeColors(const Vertex* vertices, UINT count, UINT32* out)
+	{
+		XMVECTOR byteScale = XMVectorReplicate(255);
+		for(UINT v = 0; v < count; ++v)
+		{
+			XMFLOAT4 c;
+			XMStoreFloat4(&c, XMVectorRound(XMVectorSaturate(XMLoadFloat3(&vertices[v].color)) * byteScale));
+			out[v] = (UINT32)c.x | (UINT32)c.y << 8 | (UINT32)c.z << 16 | 0xff000000u;
+		}
+	}
+
+	static void DecodeColors(const UINT32* colors, UINT count, Vertex* out)
+	{
+		for(UINT v = 0; v < count; ++v)
+			out[v].color = {(colors[v] & 0xff) / 255.0f, (colors[v] >> 8 & 0xff) / 255.0f, (colors[v] >> 16 & 0xff) / 255.0f};
+	}
+
+	// Inverse of EncodeVertices, four vertices per step; colors are left untouched.
+	static void DecodeVertices(const PackedVertex* packed, UINT count, const PackedMesh& mesh, Vertex* out)
+	{
+		XMVECTOR offsetX = XMVectorReplicate(mesh.offset.x), offsetY = XMVectorReplicate(mesh.offset.y), offsetZ = XMVectorReplicate(mesh.offset.z);
+		XMVECTOR stepX = XMVectorReplicate(mesh.step.x), stepY = XMVectorReplicate(mesh.step.y), stepZ = XMVectorReplicate(mesh.step.z);
+		XMVECTOR zero = XMVectorZero(), one = XMVectorSplatOne(), snorm = XMVectorReplicate(1.0f / 32767);
+
+		for(UINT v = 0; v < count; v += 4)
+		{
+			const PackedVertex& a = packed[v];
+			const PackedVertex& b = packed[min(v + 1, count - 1)];
+			const PackedVertex& c = packed[min(v + 2, count - 1)];
+			const PackedVertex& d = packed[min(v + 3, count - 1)];
+
+			XMVECTOR px = XMVectorMultiplyAdd(XMVectorSet(a.position[0], b.position[0], c.position[0], d.position[0]), stepX, offsetX);
+			XMVECTOR py = XMVectorMultiplyAdd(XMVectorSet(a.position[1], b.position[1], c.position[1], d.position[1]), stepY, offsetY);
+			XMVECTOR pz = XMVectorMultiplyAdd(XMVectorSet(a.position[2], b.position[2], c.position[2], d.position[2]), stepZ, offsetZ);
+
+			XMVECTOR nx = XMVectorSet(a.normal[0], b.normal[0], c.normal[0], d.normal[0]) * snorm;
+			XMVECTOR ny = XMVectorSet(a.normal[1], b.normal[1], c.normal[1], d.normal[1]) * snorm;
+			XMVECTOR nz = one - XMVectorAbs(nx) - XMVectorAbs(ny);
+			XMVECTOR fold = XMVectorMax(-nz, zero);
+			nx -= XMVectorSelect(-fold, fold, XMVectorGreaterOrEqual(nx, zero));
+			ny -= XMVectorSelect(-fold, fold, XMVectorGreaterOrEqual(ny, zero));
+			XMVECTOR length = XMVectorSqrt(XMVectorMultiplyAdd(nx, nx, XMVectorMultiplyAdd(ny, ny, nz * nz)));
+			XMVECTOR inverse = XMVectorReciprocal(length);
+			nx *= inverse;
+			ny *= inverse;
+			nz *= inverse;
+
+			XMFLOAT4 sx, sy, sz, tx, ty, tz;
+			XMStoreFloat4(&sx, px);
+			XMStoreFloat4(&sy, py);
+			XMStoreFloat4(&sz, pz);
+			XMStoreFloat4(&tx, nx);
+			XMStoreFloat4(&ty, ny);
+			XMStoreFloat4(&tz, nz);
+			const float* lanes[6] = {&sx.x, &sy.x, &sz.x, &tx.x, &ty.x, &tz.x};
+			for(UINT k = 0; k < 4 && v + k < count; ++k)
+			{
+				out[v + k].position = {lanes[0][k], lanes[1][k], lanes[2][k]};
+				out[v + k].normal = {lanes[3][k], lanes[4][k], lanes[5][k]};
+			}
+		}
+	}
+};
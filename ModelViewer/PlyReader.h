@@ -0,0 +1,543 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include "MappedFile.h"
+#include "ImportProgress.h"
+#include "MeshReader.h"
+#include <vector>
+#include <string>
+#include <charconv>
+#include <climits>
+
+// Native reader for ASCII and little-endian binary PLY. Binary vertex properties are read as typed
+// columns at their offset in the fixed-size vertex record; faces are cut into chunks that are decoded in
+// parallel and merged in order. A file without faces becomes a point cloud. Big-endian files and vertex records with list
+// properties are left to Assimp.
+class PlyReader
+{
+private:
+	static constexpr UINT chunkSize = 1 << 16;
+	static constexpr UINT floatsPerVertex = sizeof(Vertex) / sizeof(float);
+
+	enum class Type { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, None };
+	enum class Encoding { Ascii, Binary, BigEndian };
+
+	struct Property
+	{
+		std::string name;
+		Type type;
+		Type countType = Type::None;
+		UINT offset = 0;
+	};
+
+	struct Element
+	{
+		std::string name;
+		UINT64 count;
+		std::vector<Property> properties;
+		UINT stride = 0;
+		bool fixed = true;
+	};
+
+	// A run of records of one element starting at a known place in the file.
+	struct Chunk
+	{
+		const char* begin;
+		UINT first, count;
+		std::vector<UINT32> triangles;
+		bool failed = false;
+	};
+
+	struct VertexLayout
+	{
+		int position[3] = {-1, -1, -1};
+		int normal[3] = {-1, -1, -1};
+		int color[3] = {-1, -1, -1};
+	};
+
+public:
+	static bool Handles(const std::string& fileName)
+	{
+		return MeshReader::HasExtension(fileName, "ply");
+	}
+
+	static bool Read(
+		const std::string& fileName,
+		std::vector<Vertex>& vertices,
+		std::vector<UINT32>& indices,
+		std::vector<MeshRange>& meshRanges,
+		UINT64& bytes,
+		ImportProgress* progress)
+	{
+		MappedFile file(fileName);
+		if(!file.IsOpen()) return false;
+		const char* data = reinterpret_cast<const char*>(file.Data());
+		const char* end = data + file.Size();
+		bytes = file.Size();
+
+		Encoding encoding;
+		std::vector<Element> elements;
+		const char* body = ParseHeader(data, end, encoding, elements);
+		if(!body || encoding == Encoding::BigEndian) return false;
+
+		int vertexElement = -1, faceElement = -1;
+		for(int e = 0; e < (int)elements.size(); ++e)
+		{
+			if(elements[e].name == "vertex" && vertexElement < 0) vertexElement = e;
+			if(elements[e].name == "face" && faceElement < 0) faceElement = e;
+		}
+		if(vertexElement < 0 || elements[vertexElement].count == 0 || elements[vertexElement].count > UINT_MAX) return false;
+		const Element& vertexRecord = elements[vertexElement];
+		if(!vertexRecord.fixed) return false;
+
+		VertexLayout layout;
+		static const char* names[3][3] = {{"x", "y", "z"}, {"nx", "ny", "nz"}, {"red", "green", "blue"}};
+		for(int p = 0; p < (int)vertexRecord.properties.size(); ++p)
+			for(int k = 0; k < 3; ++k)
+			{
+				if(vertexRecord.properties[p].name == names[0][k]) layout.position[k] = p;
+				if(vertexRecord.properties[p].name == names[1][k]) layout.normal[k] = p;
+				if(vertexRecord.properties[p].name == names[2][k]) layout.color[k] = p;
+			}
+		if(layout.position[0] < 0 || layout.position[1] < 0 || layout.position[2] < 0) return false;
+		bool hasNormals = layout.normal[0] >= 0 && layout.normal[1] >= 0 && layout.normal[2] >= 0;
+		bool hasColors = layout.color[0] >= 0 && layout.color[1] >= 0 && layout.color[2] >= 0;
+
+		// Locate the start of every chunk of the vertex and face elements.
+		std::vector<Chunk> vertexChunks, faceChunks;
+		const char* p = body;
+		for(int e = 0; e <= max(vertexElement, faceElement) && p; ++e)
+		{
+			const Element& element = elements[e];
+			if(e == faceElement && !FaceList(element)) return false;
+			std::vector<Chunk>* chunks = e == vertexElement ? &vertexChunks : e == faceElement ? &faceChunks : nullptr;
+			p = encoding == Encoding::Ascii ? SkipLines(p, end, element.count, chunks) : SkipRecords(p, end, element, chunks);
+		}
+		if(!p) return false;
+
+		vertices.resize(vertexRecord.count);
+#pragma omp parallel for schedule(dynamic)
+		for(int c = 0; c < (int)vertexChunks.size(); ++c)
+		{
+			Chunk& chunk = vertexChunks[c];
+			if(encoding == Encoding::Ascii) ReadAsciiVertices(chunk, vertexRecord, end, layout, hasNormals, hasColors, vertices);
+			else ReadBinaryVertices(chunk, vertexRecord, layout, hasNormals, hasColors, vertices);
+		}
+
+		UINT vertexCount = vertices.size();
+#pragma omp parallel for schedule(dynamic)
+		for(int c = 0; c < (int)faceChunks.size(); ++c)
+		{
+			Chunk& chunk = faceChunks[c];
+			if(encoding == Encoding::Ascii) ReadAsciiFaces(chunk, elements[faceElement], end, vertexCount);
+			else ReadBinaryFaces(chunk, elements[faceElement], vertexCount);
+		}
+		if(progress) progress->Check();
+
+		for(auto& chunk : vertexChunks) if(chunk.failed) return false;
+		std::vector<UINT64> cornerBase(faceChunks.size() + 1, 0);
+		for(size_t c = 0; c < faceChunks.size(); ++c)
+		{
+			if(faceChunks[c].failed) return false;
+			cornerBase[c + 1] = cornerBase[c] + faceChunks[c].triangles.size();
+		}
+		if(cornerBase.back() > UINT_MAX) return false;
+
+		// Point clouds draw every vertex once.
+		if(cornerBase.back() == 0)
+		{
+			indices.resize(vertexCount);
+			for(UINT v = 0; v < vertexCount; ++v) indices[v] = v;
+			meshRanges.assign(1, MeshReader::SingleMesh(vertexCount, vertexCount, 1, hasColors));
+			return true;
+		}
+
+		indices.resize(cornerBase.back());
+#pragma omp parallel for
+		for(int c = 0; c < (int)faceChunks.size(); ++c)
+		{
+			std::vector<UINT32>& triangles = faceChunks[c].triangles;
+			if(!triangles.empty()) memcpy(&indices[cornerBase[c]], triangles.data(), triangles.size() * sizeof(UINT32));
+			std::vector<UINT32>().swap(triangles);
+		}
+
+		if(!hasNormals) MeshReader::ComputeNormals(vertices, indices);
+		meshRanges.assign(1, MeshReader::SingleMesh(vertexCount, indices.size(), 3, hasColors));
+		return true;
+	}
+
+private:
+	static const char* ParseHeader(const char* p, const char* end, Encoding& encoding, std::vector<Element>& elements)
+	{
+		if(end - p < 4 || memcmp(p, "ply", 3) != 0 || (p[3] != '\n' && p[3] != '\r')) return nullptr;
+
+		bool hasFormat = false;
+		while(p < end)
+		{
+			const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+			if(!lineEnd) return nullptr;
+			std::vector<std::string> tokens = Tokens(p, lineEnd);
+			p = lineEnd + 1;
+			if(tokens.empty()) continue;
+
+			if(tokens[0] == "end_header")
+			{
+				if(!hasFormat) return nullptr;
+				for(auto& element : elements) Layout(element);
+				return p;
+			}
+			if(tokens[0] == "format" && tokens.size() >= 2)
+			{
+				hasFormat = true;
+				if(tokens[1] == "ascii") encoding = Encoding::Ascii;
+				else if(tokens[1] == "binary_little_endian") encoding = Encoding::Binary;
+				else if(tokens[1] == "binary_big_endian") encoding = Encoding::BigEndian;
+				else return nullptr;
+			}
+			else if(tokens[0] == "element" && tokens.size() == 3)
+			{
+				UINT64 count = 0;
+				if(std::from_chars(tokens[2].data(), tokens[2].data() + tokens[2].size(), count).ec != std::errc()) return nullptr;
+				elements.push_back({tokens[1], count});
+			}
+			else if(tokens[0] == "property" && !elements.empty())
+			{
+				Property property;
+				if(tokens.size() == 5 && tokens[1] == "list")
+				{
+					property.countType = TypeOf(tokens[2]);
+					property.type = TypeOf(tokens[3]);
+					property.name = tokens[4];
+					if(property.countType == Type::None || property.countType == Type::Float32 || property.countType == Type::Float64) return nullptr;
+				}
+				else if(tokens.size() == 3)
+				{
+					property.type = TypeOf(tokens[1]);
+					property.name = tokens[2];
+				}
+				else return nullptr;
+				if(property.type == Type::None) return nullptr;
+				elements.back().properties.push_back(property);
+			}
+		}
+		return nullptr;
+	}
+
+	static std::vector<std::string> Tokens(const char* p, const char* end)
+	{
+		std::vector<std::string> tokens;
+		while(p < end)
+		{
+			while(p < end && isspace((unsigned char)*p)) ++p;
+			const char* token = p;
+			while(p < end && !isspace((unsigned char)*p)) ++p;
+			if(p > token) tokens.emplace_back(token, p);
+		}
+		return tokens;
+	}
+
+	static Type TypeOf(const std::string& name)
+	{
+		static const char* names[][2] = {
+			{"char", "int8"}, {"uchar", "uint8"}, {"short", "int16"}, {"ushort", "uint16"},
+			{"int", "int32"}, {"uint", "uint32"}, {"float", "float32"}, {"double", "float64"} };
+		for(int t = 0; t < (int)Type::None; ++t)
+			if(name == names[t][0] || name == names[t][1]) return (Type)t;
+		return Type::None;
+	}
+
+	static UINT SizeOf(Type type)
+	{
+		static const UINT sizes[] = {1, 1, 2, 2, 4, 4, 4, 8, 0};
+		return sizes[(int)type];
+	}
+
+	static void Layout(Element& element)
+	{
+		for(auto& property : element.properties)
+		{
+			property.offset = element.stride;
+			if(property.countType != Type::None) element.fixed = false;
+			element.stride += SizeOf(property.type);
+		}
+	}
+
+	// The face element carries exactly one list of vertex indices; any other property must be fixed-size.
+	static bool FaceList(const Element& element)
+	{
+		int lists = 0;
+		for(auto& property : element.properties)
+		{
+			if(property.countType == Type::None) continue;
+			if(property.name != "vertex_indices" && property.name != "vertex_index") return false;
+			if(property.type == Type::Float32 || property.type == Type::Float64) return false;
+			++lists;
+		}
+		return lists == 1;
+	}
+
+	static double Value(const char* p, Type type)
+	{
+		switch(type)
+		{
+		case Type::Int8: return *reinterpret_cast<const signed char*>(p);
+		case Type::UInt8: return *reinterpret_cast<const unsigned char*>(p);
+		case Type::Int16: { INT16 v; memcpy(&v, p, sizeof(v)); return v; }
+		case Type::UInt16: { UINT16 v; memcpy(&v, p, sizeof(v)); return v; }
+		case Type::Int32: { INT v; memcpy(&v, p, sizeof(v)); return v; }
+		case Type::UInt32: { UINT32 v; memcpy(&v, p, sizeof(v)); return v; }
+		case Type::Float32: { float v; memcpy(&v, p, sizeof(v)); return v; }
+		case Type::Float64: { double v; memcpy(&v, p, sizeof(v)); return v; }
+		default: return 0;
+		}
+	}
+
+	// Integer colors are normalized by their type's range.
+	static double ColorRange(Type type)
+	{
+		if(type == Type::UInt8) return 255;
+		if(type == Type::UInt16) return 65535;
+		return 1;
+	}
+
+	static float Color(double value, Type type)
+	{
+		return (float)(value / ColorRange(type));
+	}
+
+	static void Store(Vertex& vertex, const double* values, const Element& element, const VertexLayout& layout, bool hasNormals, bool hasColors)
+	{
+		vertex.position = MeshReader::Flip({(float)values[layout.position[0]], (float)values[layout.position[1]], (float)values[layout.position[2]]});
+		if(hasNormals) vertex.normal = MeshReader::Flip({(float)values[layout.normal[0]], (float)values[layout.normal[1]], (float)values[layout.normal[2]]});
+		else vertex.normal = {0, 0, 0};
+		if(hasColors)
+		{
+			vertex.color.x = Color(values[layout.color[0]], element.properties[layout.color[0]].type);
+			vertex.color.y = Color(values[layout.color[1]], element.properties[layout.color[1]].type);
+			vertex.color.z = Color(values[layout.color[2]], element.properties[layout.color[2]].type);
+		}
+		else vertex.color = {0, 0, 0};
+	}
+
+	// Binary vertex records have a fixed stride, so every property is one strided column, loaded with its
+	// own type into one float of every vertex; properties the vertex does not use are never read.
+	static void ReadBinaryVertices(Chunk& chunk, const Element& element, const VertexLayout& layout, bool hasNormals, bool hasColors, std::vector<Vertex>& vertices)
+	{
+		Vertex* first = vertices.data() + chunk.first;
+		LoadVector(chunk, element, layout.position, &first->position.x);
+		if(hasNormals) LoadVector(chunk, element, layout.normal, &first->normal.x);
+		else for(UINT i = 0; i < chunk.count; ++i) first[i].normal = {0, 0, 0};
+
+		if(hasColors)
+			for(int k = 0; k < 3; ++k)
+			{
+				const Property& property = element.properties[layout.color[k]];
+				LoadColumn(chunk.begin + property.offset, property.type, element.stride, chunk.count, &first->color.x + k, 1, ColorRange(property.type));
+			}
+		else for(UINT i = 0; i < chunk.count; ++i) first[i].color = {0, 0, 0};
+	}
+
+	// Position or normal, flipped to the left-handed convention. Three consecutive floats, the usual layout,
+	// are copied as one block per record.
+	static void LoadVector(const Chunk& chunk, const Element& element, const int columns[3], float* target)
+	{
+		const Property* x = &element.properties[columns[0]];
+		const Property* y = &element.properties[columns[1]];
+		const Property* z = &element.properties[columns[2]];
+		if(x->type == Type::Float32 && y->type == Type::Float32 && z->type == Type::Float32 && y->offset == x->offset + 4 && z->offset == x->offset + 8)
+		{
+			const char* source = chunk.begin + x->offset;
+			for(UINT i = 0; i < chunk.count; ++i, source += element.stride, target += floatsPerVertex)
+			{
+				memcpy(target, source, 3 * sizeof(float));
+				target[2] = -target[2];
+			}
+			return;
+		}
+		for(int k = 0; k < 3; ++k)
+		{
+			const Property& property = element.properties[columns[k]];
+			LoadColumn(chunk.begin + property.offset, property.type, element.stride, chunk.count, target + k, k == 2 ? -1.0f : 1.0f, 1);
+		}
+	}
+
+	static void LoadColumn(const char* source, Type type, UINT stride, UINT count, float* target, float sign, double range)
+	{
+		switch(type)
+		{
+		case Type::Int8: LoadColumn<signed char>(source, stride, count, target, sign, range); break;
+		case Type::UInt8: LoadColumn<unsigned char>(source, stride, count, target, sign, range); break;
+		case Type::Int16: LoadColumn<INT16>(source, stride, count, target, sign, range); break;
+		case Type::UInt16: LoadColumn<UINT16>(source, stride, count, target, sign, range); break;
+		case Type::Int32: LoadColumn<INT>(source, stride, count, target, sign, range); break;
+		case Type::UInt32: LoadColumn<UINT32>(source, stride, count, target, sign, range); break;
+		case Type::Float32: LoadColumn<float>(source, stride, count, target, sign, range); break;
+		case Type::Float64: LoadColumn<double>(source, stride, count, target, sign, range); break;
+		default: break;
+		}
+	}
+
+	// Converts like the ASCII path, through double for normalized colors, so both give the same floats.
+	template<class T>
+	static void LoadColumn(const char* source, UINT stride, UINT count, float* target, float sign, double range)
+	{
+		if(range == 1)
+			for(UINT i = 0; i < count; ++i, source += stride, target += floatsPerVertex)
+			{
+				T value;
+				memcpy(&value, source, sizeof(T));
+				*target = sign * (float)value;
+			}
+		else
+			for(UINT i = 0; i < count; ++i, source += stride, target += floatsPerVertex)
+			{
+				T value;
+				memcpy(&value, source, sizeof(T));
+				*target = sign * (float)(value / range);
+			}
+	}
+
+	static void ReadAsciiVertices(Chunk& chunk, const Element& element, const char* end, const VertexLayout& layout, bool hasNormals, bool hasColors, std::vector<Vertex>& vertices)
+	{
+		std::vector<double> values(element.properties.size());
+		const char* p = chunk.begin;
+		for(UINT i = 0; i < chunk.count; ++i)
+		{
+			const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+			if(!lineEnd) lineEnd = end;
+			for(auto& value : values)
+				if(!Number(p, lineEnd, value))
+				{
+					chunk.failed = true;
+					return;
+				}
+			Store(vertices[chunk.first + i], values.data(), element, layout, hasNormals, hasColors);
+			p = lineEnd + 1;
+		}
+	}
+
+	// Polygons are fanned around their first corner and emitted in the flipped winding.
+	static bool AddPolygon(Chunk& chunk, const UINT32* corners, UINT count, UINT vertexCount)
+	{
+		for(UINT k = 0; k < count; ++k) if(corners[k] >= vertexCount) return false;
+		for(UINT k = 2; k < count; ++k) chunk.triangles.insert(chunk.triangles.end(), {corners[0], corners[k], corners[k - 1]});
+		return true;
+	}
+
+	static void ReadBinaryFaces(Chunk& chunk, const Element& element, UINT vertexCount)
+	{
+		std::vector<UINT32> corners;
+		chunk.triangles.reserve(chunk.count * 3);
+		const char* p = chunk.begin;
+		for(UINT i = 0; i < chunk.count; ++i)
+		{
+			for(auto& property : element.properties)
+			{
+				if(property.countType == Type::None)
+				{
+					p += SizeOf(property.type);
+					continue;
+				}
+				UINT count = (UINT)Value(p, property.countType);
+				p += SizeOf(property.countType);
+				corners.resize(count);
+				for(UINT k = 0; k < count; ++k, p += SizeOf(property.type)) corners[k] = (UINT32)Value(p, property.type);
+				if(!AddPolygon(chunk, corners.data(), count, vertexCount)) chunk.failed = true;
+			}
+			if(chunk.failed) return;
+		}
+	}
+
+	static void ReadAsciiFaces(Chunk& chunk, const Element& element, const char* end, UINT vertexCount)
+	{
+		std::vector<UINT32> corners;
+		chunk.triangles.reserve(chunk.count * 3);
+		const char* p = chunk.begin;
+		for(UINT i = 0; i < chunk.count && !chunk.failed; ++i)
+		{
+			const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+			if(!lineEnd) lineEnd = end;
+			for(auto& property : element.properties)
+			{
+				double value;
+				if(!Number(p, lineEnd, value))
+				{
+					chunk.failed = true;
+					return;
+				}
+				if(property.countType == Type::None) continue;
+				if(value < 0 || value > lineEnd - p)
+				{
+					chunk.failed = true;
+					return;
+				}
+				corners.resize((UINT)value);
+				for(auto& corner : corners)
+				{
+					if(!Number(p, lineEnd, value) || value < 0)
+					{
+						chunk.failed = true;
+						return;
+					}
+					corner = (UINT32)value;
+				}
+				if(!AddPolygon(chunk, corners.data(), corners.size(), vertexCount)) chunk.failed = true;
+			}
+			p = lineEnd + 1;
+		}
+	}
+
+	static bool Number(const char*& p, const char* end, double& value)
+	{
+		while(p < end && isspace((unsigned char)*p)) ++p;
+		if(p < end && *p == '+') ++p;
+		auto result = std::from_chars(p, end, value);
+		if(result.ec != std::errc()) return false;
+		p = result.ptr;
+		return true;
+	}
+
+	// ASCII records are one line each; every chunkSize-th line start is recorded for the parsers.
+	static const char* SkipLines(const char* p, const char* end, UINT64 count, std::vector<Chunk>* chunks)
+	{
+		for(UINT64 i = 0; i < count; ++i)
+		{
+			if(p >= end) return nullptr;
+			if(chunks && i % chunkSize == 0) chunks->push_back({p, (UINT)i, (UINT)min((UINT64)chunkSize, count - i)});
+			const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+			p = lineEnd ? lineEnd + 1 : end;
+		}
+		return p;
+	}
+
+	// Fixed-size records are skipped in one step; records with lists are walked by their counts.
+	static const char* SkipRecords(const char* p, const char* end, const Element& element, std::vector<Chunk>* chunks)
+	{
+		if(element.fixed)
+		{
+			if((UINT64)(end - p) < element.count * element.stride) return nullptr;
+			if(chunks)
+				for(UINT64 i = 0; i < element.count; i += chunkSize)
+					chunks->push_back({p + i * element.stride, (UINT)i, (UINT)min((UINT64)chunkSize, element.count - i)});
+			return p + element.count * element.stride;
+		}
+
+		for(UINT64 i = 0; i < element.count; ++i)
+		{
+			if(chunks && i % chunkSize == 0) chunks->push_back({p, (UINT)i, (UINT)min((UINT64)chunkSize, element.count - i)});
+			for(auto& property : element.properties)
+			{
+				if(property.countType == Type::None)
+				{
+					p += SizeOf(property.type);
+					continue;
+				}
+				if(end - p < (INT64)SizeOf(property.countType)) return nullptr;
+				UINT64 count = (UINT64)Value(p, property.countType);
+				p += SizeOf(property.countType) + count * SizeOf(property.type);
+			}
+			if(p > end) return nullptr;
+		}
+		return p;
+	}
+};
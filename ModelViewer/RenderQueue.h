@@ -0,0 +1,127 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cstring>
+#include <omp.h>
+
+// One draw: a sort key and a command the owner of the queue knows how to replay.
+struct RenderPacket
+{
+	unsigned long long key;
+	unsigned int command;
+};
+
+// Draws of a frame, sorted by a 64-bit key before they are replayed: the pass in the top bits, then the
+// pipeline state, then a material, then the depth, so that state changes are grouped and every group is
+// drawn front to back. Nothing here knows about the graphics API; commands are the owner's indices.
+class RenderQueue
+{
+public:
+	typedef unsigned long long Key;
+
+	static constexpr int passBits = 4, psoBits = 8, materialBits = 20, depthBits = 32;
+	static constexpr int depthShift = 0, materialShift = depthBits, psoShift = materialShift + materialBits, passShift = psoShift + psoBits;
+
+	// depth is a distance from the eye. Non-negative floats order like their bit patterns, so the bits
+	// themselves are the depth bucket.
+	static Key MakeKey(unsigned int pass, unsigned int pso, unsigned int material, float depth)
+	{
+		unsigned int depthKey;
+		depth = depth > 0 ? depth : 0;
+		memcpy(&depthKey, &depth, sizeof(depthKey));
+		return (Key)(pass & Mask(passBits)) << passShift | (Key)(pso & Mask(psoBits)) << psoShift |
+			(Key)(material & Mask(materialBits)) << materialShift | depthKey;
+	}
+
+	static unsigned int Pass(Key key) { return (unsigned int)(key >> passShift) & Mask(passBits); }
+	static unsigned int Pso(Key key) { return (unsigned int)(key >> psoShift) & Mask(psoBits); }
+	static unsigned int Material(Key key) { return (unsigned int)(key >> materialShift) & Mask(materialBits); }
+
+	void Clear() { packets.clear(); }
+	void Add(Key key, unsigned int command) { packets.push_back({key, command}); }
+	const std::vector<RenderPacket>& Packets() const { return packets; }
+	size_t Size() const { return packets.size(); }
+
+	// Least significant digit first radix sort, eleven bits a pass, which keeps packets with equal keys in
+	// the order they were added. Every pass splits the packets into one chunk per thread, each at least
+	// minChunk long, that count their digits and then scatter in parallel; digits that are the same in
+	// every key are skipped.
+	void Sort()
+	{
+		int count = packets.size();
+		if(count < 2) return;
+		int threads = omp_get_max_threads(), chunks = count / minChunk;
+		chunks = chunks < 1 ? 1 : chunks > threads ? threads : chunks;
+		int chunkSize = (count + chunks - 1) / chunks;
+		chunks = (count + chunkSize - 1) / chunkSize;
+
+		std::vector<Key> chunkDiffers(chunks, 0);
+		Key first = packets[0].key;
+#pragma omp parallel for
+		for(int c = 0; c < chunks; ++c)
+		{
+			Key differs = 0;
+			for(int i = c * chunkSize; i < ChunkEnd(c, chunkSize, count); ++i) differs |= packets[i].key ^ first;
+			chunkDiffers[c] = differs;
+		}
+		Key differs = 0;
+		for(Key d : chunkDiffers) differs |= d;
+
+		scratch.resize(count);
+		counts.resize(chunks);
+		for(int shift = 0; shift < 64; shift += digitBits)
+		{
+			if(((differs >> shift) & (radix - 1)) == 0) continue;
+			sortDigit(shift, chunks, chunkSize);
+			packets.swap(scratch);
+		}
+	}
+
+private:
+	static constexpr int digitBits = 11, radix = 1 << digitBits;
+	static constexpr int minChunk = 1 << 14;
+
+	std::vector<RenderPacket> packets;
+	std::vector<RenderPacket> scratch;
+	std::vector<std::array<unsigned int, radix>> counts;
+
+	static int ChunkEnd(int chunk, int chunkSize, int count)
+	{
+		return (chunk + 1) * chunkSize < count ? (chunk + 1) * chunkSize : count;
+	}
+
+	static unsigned int Mask(int bits) { return bits >= 32 ? ~0u : (1u << bits) - 1; }
+
+	// Counts the digit at shift chunk by chunk, turns the counts into every chunk's first slot per digit,
+	// digit major so that chunks keep their order, and scatters packets into scratch.
+	void sortDigit(int shift, int chunks, int chunkSize)
+	{
+		int count = packets.size();
+#pragma omp parallel for
+		for(int c = 0; c < chunks; ++c)
+		{
+			auto& histogram = counts[c];
+			histogram.fill(0);
+			for(int i = c * chunkSize; i < ChunkEnd(c, chunkSize, count); ++i) ++histogram[(packets[i].key >> shift) & (radix - 1)];
+		}
+
+		unsigned int offset = 0;
+		for(int digit = 0; digit < radix; ++digit)
+			for(int c = 0; c < chunks; ++c)
+			{
+				unsigned int n = counts[c][digit];
+				counts[c][digit] = offset;
+				offset += n;
+			}
+
+#pragma omp parallel for
+		for(int c = 0; c < chunks; ++c)
+		{
+			auto& next = counts[c];
+			for(int i = c * chunkSize; i < ChunkEnd(c, chunkSize, count); ++i)
+				scratch[next[(packets[i].key >> shift) & (radix - 1)]++] = packets[i];
+		}
+	}
+};
@@ -21,6 +21,7 @@ Renderer::Renderer(HWND handle, int width, int height) : windowHandle(handle)
 	ID3D12CommandList* cmdLists[] = { commandList.Get() };
 	commandQueue->ExecuteCommandLists(_countof(cmdLists), cmdLists);
 	FlushCommandQueue();
+	model[0]->ReleaseUploadBuffers();
 
 	camera = std::make_shared<Camera>(AspectRatio());
 	lastResize = -1;
@@ -139,21 +140,22 @@ void Renderer::CreateFence() {
 	if (fenceEvent == nullptr) THROW_IF_FAILED(HRESULT_FROM_WIN32(GetLastError()));
 }
 
-void Renderer::CreateShaders() {
+void Renderer::CompileShader(LPCWSTR fileName, LPCSTR entryPoint, LPCSTR target, const D3D_SHADER_MACRO* defines, ComPtr<ID3D10Blob>& shader)
+{
 	UINT compileFlags = 0;
 #ifdef _DEBUG
 	compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
 #endif // _DEBUG
 	ComPtr<ID3D10Blob> error;
 	auto result = D3DCompileFromFile(
-		L"shaders/pbr.hlsl", 
-		nullptr, 
+		fileName, 
+		defines, 
 		nullptr, 
-		"VSMain", 
-		"vs_5_0", 
+		entryPoint, 
+		target, 
 		compileFlags, 
 		0, 
-		&vertexShader, 
+		&shader, 
 		&error );
 	if(!SUCCEEDED(result))
 	{
@@ -162,24 +164,15 @@ void Renderer::CreateShaders() {
 		std::cout << info << std::endl;
 		THROW_IF_FAILED(result);
 	}
+}
 
-	result = D3DCompileFromFile(
-		L"shaders/pbr.hlsl", 
-		nullptr, 
-		nullptr, 
-		"PSMain", 
-		"ps_5_0", 
-		compileFlags, 
-		0, 
-		&fragmentShader, 
-		&error );
-	if(!SUCCEEDED(result))
-	{
-		std::string info;
-		for(int i = 0; i < error->GetBufferSize(); ++i) info.push_back( ((char*)(error->GetBufferPointer()))[i] );
-		std::cout << info << std::endl;
-		THROW_IF_FAILED(result);
-	}
+void Renderer::CreateShaders() {
+	CompileShader(L"shaders/pbr.hlsl", "VSMain", "vs_5_0", nullptr, vertexShader);
+	CompileShader(L"shaders/pbr.hlsl", "PSMain", "ps_5_0", nullptr, fragmentShader);
+
+	const D3D_SHADER_MACRO flatDefines[] = { {"FLAT_SHADING", "1"}, {nullptr, nullptr} };
+	CompileShader(L"shaders/pbr.hlsl", "VSMain", "vs_5_0", flatDefines, flatVertexShader);
+	CompileShader(L"shaders/pbr.hlsl", "PSMain", "ps_5_0", flatDefines, flatFragmentShader);
 }
 
 void Renderer::CreateVertexBuffer() {
@@ -196,72 +189,33 @@ void Renderer::CreateVertexBuffer() {
 			0, offsetof(Vertex, color), D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}
 	);
 
+	// Models also read one world transform per instance from slot 1; the grid has no instances.
+	instanceElementDescs = inputElementDescs;
+	for(UINT row = 0; row < 3; ++row)
+		instanceElementDescs.push_back(
+			{"WORLD", row, DXGI_FORMAT_R32G32B32A32_FLOAT,
+				1, row * sizeof(XMFLOAT4), D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA, 1}
+		);
+
 	model[0] = std::make_shared<Model>(initModel, device, commandList);
 	curModel = 0;
 	switchFrame = -1;
 	task.Clear();
 
-	GenGrid();
+	gridVertices.reserve(GridBuilder::maxVertices);
 }
 
-void Renderer::GenGrid()
-{
-	for(int i = -gridCount / 2 * gridLength, iLimit = gridCount / 2 * gridLength; i <= iLimit; i += gridLength)
-		for(int j = -gridCount / 2 * gridLength, jLimit = gridCount / 2 * gridLength; j <= jLimit; j += gridLength)
-		{
-			Vertex vertex{{i * 1.f, 0, j * 1.f}, gridColor};
-			gridVertices.push_back(vertex);
-		}
-			
-	const float inf = 70000;
-	gridVertices.push_back({{-inf, 0, 0}, xaxisColor});
-	gridVertices.push_back({{ inf, 0, 0}, xaxisColor});
-	gridVertices.push_back({{0, -inf, 0}, yaxisColor});
-	gridVertices.push_back({{0,  inf, 0}, yaxisColor});
-	gridVertices.push_back({{0, 0, -inf}, zaxisColor});
-	gridVertices.push_back({{0, 0,  inf}, zaxisColor});
-
-	for(int i = 0, offset = (gridCount + 1) * (gridCount + 1); i < 6; ++i)
-		gridIndices.push_back(offset + i);
-
-	for(int i = 0; i < gridCount; ++i)
-		for(int j = 0; j < gridCount; ++j)
-		{
-			if(i != gridCount / 2)
-				gridIndices.push_back(i * (gridCount + 1) + j),
-				gridIndices.push_back(i * (gridCount + 1) + j + 1);
-
-			if(j != gridCount / 2) 
-				gridIndices.push_back(i * (gridCount + 1) + j),
-				gridIndices.push_back((i + 1) * (gridCount + 1) + j);
-		}
-
-	grid = std::make_shared<Model>(
-		std::make_shared<VertexBuffer>(device, commandList, gridVertices.data(), sizeof(Vertex), gridVertices.size()),
-		std::make_shared<IndexBuffer>(device, commandList, gridIndices.data(), 2, DXGI_FORMAT_R32_UINT),
-		device,
-		commandList );
-	grid->lineIndexBuffers.push_back(std::make_shared<IndexBuffer>(
-		device, commandList, gridIndices.data() + 2, 2, DXGI_FORMAT_R32_UINT
-		));
-	grid->lineIndexBuffers.push_back(std::make_shared<IndexBuffer>(
-		device, commandList, gridIndices.data() + 4, 2, DXGI_FORMAT_R32_UINT
-		));
-	grid->lineIndexBuffers.push_back(std::make_shared<IndexBuffer>(
-		device, commandList, gridIndices.data() + 6, gridIndices.size() - 6, DXGI_FORMAT_R32_UINT
-		));
-}
-
-
 void Renderer::CreateRootSignature() {
 	CD3DX12_DESCRIPTOR_RANGE table;
 	table.Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0);
 
-	CD3DX12_ROOT_PARAMETER parameter;
-	parameter.InitAsDescriptorTable(1, &table);
+	// The pass constants, then the lights, light clusters and light indices as root SRVs t0 to t2.
+	CD3DX12_ROOT_PARAMETER parameters[4];
+	parameters[0].InitAsDescriptorTable(1, &table);
+	for(UINT i = 0; i < 3; ++i) parameters[i + 1].InitAsShaderResourceView(i);
 
 	CD3DX12_ROOT_SIGNATURE_DESC rootSignatureDesc;
-	rootSignatureDesc.Init(1, &parameter, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+	rootSignatureDesc.Init(_countof(parameters), parameters, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
 
 	ComPtr<ID3D10Blob> signature;
@@ -272,7 +226,7 @@ void Renderer::CreateRootSignature() {
 
 void Renderer::CreatePso() {
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc{};
-	psoDesc.InputLayout = { inputElementDescs.data(), (UINT)inputElementDescs.size() };
+	psoDesc.InputLayout = { instanceElementDescs.data(), (UINT)instanceElementDescs.size() };
 	psoDesc.pRootSignature = rootSignature.Get();
 	psoDesc.VS = CD3DX12_SHADER_BYTECODE(vertexShader.Get());
 	psoDesc.PS = CD3DX12_SHADER_BYTECODE(fragmentShader.Get());
@@ -290,51 +244,17 @@ void Renderer::CreatePso() {
 
 	THROW_IF_FAILED(device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&pso)));
 
+	psoDesc.VS = CD3DX12_SHADER_BYTECODE(flatVertexShader.Get());
+	psoDesc.PS = CD3DX12_SHADER_BYTECODE(flatFragmentShader.Get());
+	THROW_IF_FAILED(device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&flatPso)));
+
 	ComPtr<ID3D10Blob> gridVertexShader;
 	ComPtr<ID3D10Blob> gridFragmentShader;
-
-	UINT compileFlags = 0;
-#ifdef _DEBUG
-	compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
-#endif // _DEBUG
-	ComPtr<ID3D10Blob> error;
-	auto result = D3DCompileFromFile(
-		L"shaders/grid.hlsl", 
-		nullptr, 
-		nullptr, 
-		"VSMain", 
-		"vs_5_0", 
-		compileFlags, 
-		0, 
-		&gridVertexShader, 
-		&error );
-	if(!SUCCEEDED(result))
-	{
-		std::string info;
-		for(int i = 0; i < error->GetBufferSize(); ++i) info.push_back( ((char*)(error->GetBufferPointer()))[i] );
-		std::cout << info << std::endl;
-		THROW_IF_FAILED(result);
-	}
-
-	result = D3DCompileFromFile(
-		L"shaders/grid.hlsl", 
-		nullptr, 
-		nullptr, 
-		"PSMain", 
-		"ps_5_0", 
-		compileFlags, 
-		0, 
-		&gridFragmentShader, 
-		&error );
-	if(!SUCCEEDED(result))
-	{
-		std::string info;
-		for(int i = 0; i < error->GetBufferSize(); ++i) info.push_back( ((char*)(error->GetBufferPointer()))[i] );
-		std::cout << info << std::endl;
-		THROW_IF_FAILED(result);
-	}
+	CompileShader(L"shaders/grid.hlsl", "VSMain", "vs_5_0", nullptr, gridVertexShader);
+	CompileShader(L"shaders/grid.hlsl", "PSMain", "ps_5_0", nullptr, gridFragmentShader);
 
 	psoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_LINE;
+	psoDesc.InputLayout = { inputElementDescs.data(), (UINT)inputElementDescs.size() };
 	psoDesc.VS = CD3DX12_SHADER_BYTECODE(gridVertexShader.Get());
 	psoDesc.PS = CD3DX12_SHADER_BYTECODE(gridFragmentShader.Get());
 	THROW_IF_FAILED(device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&gridPso)));
@@ -389,7 +309,40 @@ void Renderer::SwitchModel()
 	std::string fileName = QfileName.toStdString();
 
 	std::cout << fileName << std::endl << fileName.size() << std::endl;
-	if(fileName.size() > 1) task.SetValue(fileName);
+	if(fileName.size() > 1)
+	{
+		// A load still in flight is abandoned; the new one starts as soon as it has unwound.
+		if(loadProgress) loadProgress->Cancel();
+		task.SetValue(fileName);
+	}
+}
+
+void Renderer::StartLoading(const std::string& fileName)
+{
+	auto progress = std::make_shared<ImportProgress>();
+	loadProgress = progress;
+	loading = std::async(std::launch::async, [fileName, progress]() -> std::shared_ptr<Model> {
+		try
+		{
+			auto loaded = std::make_shared<Model>(fileName, *progress);
+			if(loaded->Loaded()) return loaded;
+		}
+		catch(const ImportCancelled&)
+		{
+			std::cout << "Model:  load of " << fileName << " cancelled" << std::endl;
+		}
+		// Anything else, running out of memory on a huge file included, fails this load and leaves the
+		// current model on screen.
+		catch(const std::exception& e)
+		{
+			std::cout << "Model:  load of " << fileName << " failed: " << e.what() << std::endl;
+		}
+		catch(...)
+		{
+			std::cout << "Model:  load of " << fileName << " failed" << std::endl;
+		}
+		return nullptr;
+	});
 }
 
 void Renderer::SaveModel()
@@ -398,99 +351,97 @@ void Renderer::SaveModel()
 		nullptr,
 		"Save your model",
 		nullptr,
-		"Obj Model(*.obj)"
+		"Obj Model(*.obj);;Binary PLY(*.ply);;Binary STL(*.stl)"
 	);
-	
-	model[curModel]->saveModel(std::string(QfileName.toLocal8Bit()));
+	std::string fileName(QfileName.toLocal8Bit());
+	if(fileName.empty()) return;
+	if(Saving(nullptr))
+	{
+		std::cout << "Model:  still saving, " << fileName << " not written" << std::endl;
+		return;
+	}
+
+	std::shared_ptr<Model> saved = model[curModel];
+	savingModel = saved.get();
+	saving = std::async(std::launch::async, [saved, fileName]() {
+		try
+		{
+			saved->saveModel(fileName);
+		}
+		catch(const std::exception& e)
+		{
+			std::cout << "Model:  save of " << fileName << " failed: " << e.what() << std::endl;
+		}
+	});
+}
+
+// Whether a save is still running, of the given model or of any with nullptr.
+bool Renderer::Saving(const Model* model)
+{
+	if(!saving.valid() || saving.wait_for(std::chrono::seconds(0)) == std::future_status::ready) return false;
+	return !model || model == savingModel;
+}
+
+void Renderer::FocusModel()
+{
+	const Bounds& bounds = model[curModel]->bounds;
+	double scale = model[curModel]->scale;
+	camera->origin = XMVectorSet(bounds.center.x, bounds.center.y, bounds.center.z, 0) * scale;
+	camera->radius = (bounds.boxMax.y - bounds.center.y) * 5 * scale;
 }
 
 void Renderer::SwitchUp()
 {
 	axisFlag = XMFLOAT3{1, 0, 1};
-	camera->origin = XMVECTOR{
-		model[curModel]->lr[0].Middle(),
-		model[curModel]->lr[1].Middle(),
-		model[curModel]->lr[2].Middle()
-	} * model[curModel]->scale;
+	FocusModel();
 
 	camera->phi = -0.5 * PI + 0.0000001;
 	camera->theta = PI * 0.5;
-	camera->radius = (model[curModel]->lr[1].max - model[curModel]->lr[1].Middle()) * 5 * model[curModel]->scale;
 }
 
 void Renderer::SwitchDown()
 {
 	axisFlag = XMFLOAT3{1, 0, 1};
-	camera->origin = XMVECTOR{
-		model[curModel]->lr[0].Middle(),
-		model[curModel]->lr[1].Middle(),
-		model[curModel]->lr[2].Middle()
-	} * model[curModel]->scale;
-	//printf("%f  %f  %f\n", model[curModel]->lr[0].Middle(), model[curModel]->lr[1].Middle(), model[curModel]->lr[2].Middle());
+	FocusModel();
 
 	camera->phi = 0.5 * PI - 0.0000001;
 	camera->theta = PI * 0.5;
-	camera->radius = (model[curModel]->lr[1].max - model[curModel]->lr[1].Middle()) * 5 * model[curModel]->scale;
 }
 
 void Renderer::SwitchLeft()
 {
 	axisFlag = XMFLOAT3{0, 1, 1};
-	camera->origin = XMVECTOR{
-		model[curModel]->lr[0].Middle(),
-		model[curModel]->lr[1].Middle(),
-		model[curModel]->lr[2].Middle()
-	} * model[curModel]->scale;
-	//printf("%f  %f  %f\n", model[curModel]->lr[0].Middle(), model[curModel]->lr[1].Middle(), model[curModel]->lr[2].Middle());
+	FocusModel();
 
 	camera->phi = 0;
 	camera->theta = 0;
-	camera->radius = (model[curModel]->lr[1].max - model[curModel]->lr[1].Middle()) * 5 * model[curModel]->scale;
 }
 
 void Renderer::SwitchRight()
 {
 	axisFlag = XMFLOAT3{0, 1, 1};
-	camera->origin = XMVECTOR{
-		model[curModel]->lr[0].Middle(),
-		model[curModel]->lr[1].Middle(),
-		model[curModel]->lr[2].Middle()
-	} * model[curModel]->scale;
-	//printf("%f  %f  %f\n", model[curModel]->lr[0].Middle(), model[curModel]->lr[1].Middle(), model[curModel]->lr[2].Middle());
+	FocusModel();
 
 	camera->phi = 0;
 	camera->theta = PI;
-	camera->radius = (model[curModel]->lr[1].max - model[curModel]->lr[1].Middle()) * 5 * model[curModel]->scale;
 }
 
 void Renderer::SwitchFront()
 {
 	axisFlag = XMFLOAT3{1, 1, 0};
-	camera->origin = XMVECTOR{
-		model[curModel]->lr[0].Middle(),
-		model[curModel]->lr[1].Middle(),
-		model[curModel]->lr[2].Middle()
-	} * model[curModel]->scale;
-	//printf("%f  %f  %f\n", model[curModel]->lr[0].Middle(), model[curModel]->lr[1].Middle(), model[curModel]->lr[2].Middle());
+	FocusModel();
 
 	camera->phi = 0;
 	camera->theta = 0.5 * PI;
-	camera->radius = (model[curModel]->lr[1].max - model[curModel]->lr[1].Middle()) * 5 * model[curModel]->scale;
 }
 
 void Renderer::SwitchBack()
 {
 	axisFlag = XMFLOAT3{1, 1, 0};
-	camera->origin = XMVECTOR{
-		model[curModel]->lr[0].Middle(),
-		model[curModel]->lr[1].Middle(),
-		model[curModel]->lr[2].Middle()
-	} * model[curModel]->scale;
-	//printf("%f  %f  %f\n", model[curModel]->lr[0].Middle(), model[curModel]->lr[1].Middle(), model[curModel]->lr[2].Middle());
+	FocusModel();
 
 	camera->phi = 0;
 	camera->theta = -0.5 * PI;
-	camera->radius = (model[curModel]->lr[1].max - model[curModel]->lr[1].Middle()) * 5 * model[curModel]->scale;
 }
 
 void Renderer::ResizeSwapChain()
@@ -588,58 +539,37 @@ void Renderer::CreateSizeResource()
 
 void Renderer::Update()
 {
-	if(task.HasValue())
+	bool uploaded = false;
+	if(loading.valid() && loading.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+	{
+		std::shared_ptr<Model> loaded = loading.get();
+		loadProgress.reset();
+		// A load that finished after being superseded is dropped.
+		if(loaded && !task.HasValue())
+		{
+			loaded->Upload(device, commandList);
+			model[curModel ^ 1] = loaded;
+			switchFrame = curFrameIndex;
+			uploaded = true;
+		}
+	}
+
+	if(!loading.valid() && task.HasValue())
 	{
-		model[curModel ^ 1] = std::make_shared<Model>(task.GetValue(), device, commandList);
-		task.Clear();
-		switchFrame =curFrameIndex;
 		std::cout << "Task:  " << task.GetValue() << std::endl;
+		StartLoading(task.GetValue());
+		task.Clear();
 	}
-	else if(switchFrame == curFrameIndex)
+
+	// The frame that recorded the upload has been waited for by now, so its upload heaps can go.
+	if(!uploaded && switchFrame == curFrameIndex)
 	{
 		curModel ^= 1;
 		switchFrame = -1;
+		model[curModel]->ReleaseUploadBuffers();
 		std::cout << "It's time to switch Model!" << std::endl;
 	}
 
-	XMFLOAT4 lightPos[] = {
-		{1, 1, -1, 1},
-		{-1, 1, 1, 1},
-		{-1, 1,-1, 1},
-		{1, 1, 1, 1},
-		{1, -1, -1, 1},
-		{-1, -1, 1, 1},
-		{-1, -1,-1, 1},
-		{1, -1, 1, 1}
-
-	};
-	XMFLOAT4 lightColor[] = {
-		{1.0, 1.0, 1.0, 1},
-		{1.0, 1.0, 1.0, 1},
-		{1.0, 1.0, 1.0, 1},
-		{1.0, 1.0, 1.0, 1},
-		{1.0, 1.0, 1.0, 1},
-		{1.0, 1.0, 1.0, 1},
-		{1.0, 1.0, 1.0, 1},
-		{1.0, 1.0, 1.0, 1}
-	};
-
-	float tmp = 800;
-	float lightInten = lightIntensity;
-
-	for(int i = 0; i < _countof(lightPos); ++i)
-	{
-		lightPos[i].x *= tmp;
-		lightPos[i].y *= tmp;
-		lightPos[i].z *= tmp;
-	}
-	for(int i = 0; i < _countof(lightColor); ++i)
-	{
-		lightColor[i].x *= lightInten;
-		lightColor[i].y *= lightInten;
-		lightColor[i].z *= lightInten;
-	}
-
 	PassConstants passCB;
 	XMStoreFloat4x4(&passCB.model, XMMatrixTranspose(model[curModel]->getModel()));
 	XMStoreFloat4x4(&passCB.view, XMMatrixTranspose(camera->getViewMatrix()));
@@ -649,14 +579,73 @@ void Renderer::Update()
 	passCB.roughness = 0.6;
 	passCB.ao = 1.0;
 
-	passCB.lightCount = _countof(lightPos);
-	for(int i = 0; i < _countof(lightPos); ++i)
-		passCB.lightPos[i] = lightPos[i],
-		passCB.lightColor[i] = lightColor[i];
-
 	XMStoreFloat3(&passCB.camearaPos, camera->getCameraPos());
+	model[curModel]->SelectDraws(
+		camera->getCameraPos(), camera->getViewMatrix() * camera->getProjectMatrix(), height / (2 * tanf(Camera::fovY / 2)));
+
+	// Only the model is lit, so the slices are spent on the depths its bounding sphere covers.
+	float modelScale = (float)model[curModel]->scale;
+	XMVECTOR modelCenter = XMLoadFloat3(&model[curModel]->bounds.center) * modelScale;
+	float modelDistance = XMVectorGetX(XMVector3Length(camera->getCameraPos() - modelCenter));
+	float modelRadius = model[curModel]->bounds.radius * modelScale;
+	BuildLights(modelCenter, modelRadius);
+	passCB.lightCount = min((UINT)lights.size(), LightClusterBuilder::maxLights);
+	lightClusters.Build(lights, camera->getViewMatrix(), Camera::fovY, camera->aspectRatio, Camera::nearZ, Camera::farZ,
+		max(modelDistance - modelRadius, (modelDistance + modelRadius) / 1000), modelDistance + modelRadius);
+	passCB.tileScale = {(float)LightClusterBuilder::clustersX / width, (float)LightClusterBuilder::clustersY / height};
+	passCB.sliceScale = lightClusters.sliceScale;
+	passCB.sliceBias = lightClusters.sliceBias;
+	passCB.clustersX = LightClusterBuilder::clustersX;
+	passCB.clustersY = LightClusterBuilder::clustersY;
+	passCB.clustersZ = LightClusterBuilder::clustersZ;
 
 	CurFrameResource()->GetPassConstants()->CopyData(0, passCB);
+	CurFrameResource()->GetLights()->CopyData(0, lights.data(), min((UINT)lights.size(), LightClusterBuilder::maxLights));
+	CurFrameResource()->GetLightClusters()->CopyData(0, lightClusters.clusters.data(), LightClusterBuilder::clusterCount);
+	CurFrameResource()->GetLightIndices()->CopyData(0, lightClusters.lightIndices.data(), lightClusters.lightIndices.size());
+
+	gridVertexCount = GridBuilder::Build(*camera, axisFlag, screenClearColor, gridVertices);
+	CurFrameResource()->GetGridVertices()->CopyData(0, gridVertices.data(), gridVertexCount);
+}
+
+// Sets the pipeline state only when it changes between packets, and rebinds the model's buffers after the grid.
+void Renderer::ReplayQueue()
+{
+	ID3D12PipelineState* pipelineStates[] = {pso.Get(), flatPso.Get(), gridPso.Get()};
+	ID3D12PipelineState* bound = pso.Get();
+	bool modelBound = false;
+	for(auto& packet : renderQueue.Packets())
+	{
+		ID3D12PipelineState* state = pipelineStates[RenderQueue::Pso(packet.key)];
+		if(state != bound)
+		{
+			commandList->SetPipelineState(state);
+			bound = state;
+		}
+		if(packet.command == gridCommand)
+		{
+			DrawGrid();
+			modelBound = false;
+			continue;
+		}
+		if(!modelBound)
+		{
+			model[curModel]->Bind();
+			modelBound = true;
+		}
+		model[curModel]->DrawQueued(packet.command);
+	}
+}
+
+void Renderer::DrawGrid()
+{
+	D3D12_VERTEX_BUFFER_VIEW view;
+	view.BufferLocation = CurFrameResource()->GetGridVertices()->GetResource()->GetGPUVirtualAddress();
+	view.SizeInBytes = gridVertexCount * sizeof(Vertex);
+	view.StrideInBytes = sizeof(Vertex);
+	commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_LINELIST);
+	commandList->IASetVertexBuffers(0, 1, &view);
+	commandList->DrawInstanced(gridVertexCount, 1, 0, 0);
 }
 
 
@@ -671,8 +660,14 @@ void Renderer::Draw() {
 
 	if(infoLabel)
 	{
-		char buffer[128];
-		sprintf(buffer, " ģ:%s | :%d | :%d  ", model[curModel]->modelFileName.c_str(), model[curModel]->vertexBuffer->vertexCount, model[curModel]->faceCount);
+		char buffer[512];
+		if(!Saving(model[curModel].get())) shownMemory = model[curModel]->Memory();
+		const ModelMemory& memory = shownMemory;
+		sprintf(buffer, " ģ:%s | :%d | :%d | ڴ:%.1f MB | Դ:%.1f MB | ɼ:%u/%u  ",
+			model[curModel]->modelFileName.c_str(), model[curModel]->vertexCount, model[curModel]->faceCount, memory.Cpu() / 1048576.0, memory.Gpu() / 1048576.0,
+			model[curModel]->visibleBoxes, model[curModel]->meshBoxes.count);
+		if(loadProgress)
+			sprintf(buffer + strlen(buffer), "| %s:%d%%  ", "", loadProgress->Percent());
 		infoLabel->setText(QString::fromLocal8Bit(buffer, strlen(buffer)));
 	}
 
@@ -694,6 +689,9 @@ void Renderer::Draw() {
 
 		CD3DX12_GPU_DESCRIPTOR_HANDLE handle(cbvHeap->GetGPUDescriptorHandleForHeapStart(), curFrameIndex, cbvDescriptorSize);
 		commandList->SetGraphicsRootDescriptorTable(0, handle);
+		commandList->SetGraphicsRootShaderResourceView(1, CurFrameResource()->GetLights()->GetResource()->GetGPUVirtualAddress());
+		commandList->SetGraphicsRootShaderResourceView(2, CurFrameResource()->GetLightClusters()->GetResource()->GetGPUVirtualAddress());
+		commandList->SetGraphicsRootShaderResourceView(3, CurFrameResource()->GetLightIndices()->GetResource()->GetGPUVirtualAddress());
 
 		//Transition resource for render
 		commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
@@ -714,9 +712,12 @@ void Renderer::Draw() {
 
 		if(curFrameIndex != 0)
 		{
-			model[curModel]->Draw(primitiveType);
-			commandList->SetPipelineState(gridPso.Get());
-			grid->DrawGrid(axisFlag);
+			renderQueue.Clear();
+			UINT modelPipeline = primitiveType == D3D_PRIMITIVE_TOPOLOGY_LINESTRIP ? FlatPipeline : ScenePipeline;
+			model[curModel]->Submit(renderQueue, primitiveType, ScenePass, modelPipeline, 0);
+			renderQueue.Add(RenderQueue::MakeKey(GridPass, GridPipeline, 0, 0), gridCommand);
+			renderQueue.Sort();
+			ReplayQueue();
 		}
 		
 
@@ -791,4 +792,48 @@ void Renderer::ChangeLightIntensity(int intensity)
 	lightIntensity = intensity;
 }
 
+void Renderer::ChangeLightCount(int count)
+{
+	lightCount = min(max(count, cornerLights), (int)LightClusterBuilder::maxLights);
+}
+
+// The corner rig reaches everywhere, so its lights keep the plain inverse square falloff and are listed in
+// every cluster. The larger rig spreads lightCount colored lights over a shell around the model, a golden
+// angle apart and at depths between 0.75 and 1.5 model radii. Together they light the model's center as
+// brightly as the corner rig, and each fades out at the radius LightClusterBuilder::Radius gives it.
+void Renderer::BuildLights(FXMVECTOR modelCenter, float modelRadius)
+{
+	lights.clear();
+	if(lightCount <= cornerLights)
+	{
+		const float corner = 800;
+		for(int i = 0; i < cornerLights; ++i)
+		{
+			XMFLOAT3 position = {i & 1 ? corner : -corner, i & 2 ? corner : -corner, i & 4 ? corner : -corner};
+			float intensity = (float)lightIntensity;
+			lights.push_back({position, Camera::farZ, {intensity, intensity, intensity}, 0});
+		}
+		return;
+	}
+
+	XMFLOAT3 center;
+	XMStoreFloat3(&center, modelCenter);
+	const float goldenAngle = XM_PI * (3 - sqrtf(5)), goldenFraction = 0.618034f;
+	for(int i = 0; i < lightCount; ++i)
+	{
+		float y = 1 - (2 * i + 1.0f) / lightCount, ring = sqrtf(1 - y * y), angle = goldenAngle * i;
+		float fraction = i * goldenFraction - floorf(i * goldenFraction);
+		float shell = modelRadius * (0.75f + 0.75f * fraction);
+		// Twice the share, since a hue keeps half of white on average.
+		float intensity = 2 * lightIntensity * ((float)cornerLights / lightCount) * (shell * shell) / (3 * 800.0f * 800.0f);
+		float hue = fraction * 6;
+		XMFLOAT3 color = {
+			intensity * min(max(fabsf(hue - 3) - 1, 0.0f), 1.0f),
+			intensity * min(max(2 - fabsf(hue - 2), 0.0f), 1.0f),
+			intensity * min(max(2 - fabsf(hue - 4), 0.0f), 1.0f)};
+		XMFLOAT3 position = {center.x + shell * ring * cosf(angle), center.y + shell * y, center.z + shell * ring * sinf(angle)};
+		lights.push_back({position, LightClusterBuilder::Radius(color), color, 0});
+	}
+}
+
 
@@ -8,6 +8,7 @@
 #include "Nullable.h"
 #include <QFileDialog>
 #include <ctime>
+#include <future>
 #include "QLabel"
 
 #pragma comment(lib, "dxguid.lib")
@@ -23,16 +24,8 @@ private:
 	static const auto DepthStencilFormat = DXGI_FORMAT_D32_FLOAT;
 	static const auto FeatureLevel = D3D_FEATURE_LEVEL_11_0;
 
-	static constexpr int gridLength = 100;
-	static const int gridCount = 1000;
-
 	static constexpr XMFLOAT3 screenClearColor{55.0 / 255, 56.0 / 255, 59.0/ 255};
 
-	static constexpr XMFLOAT3 gridColor {62.0 / 255, 63.0 / 255, 66.0 / 255};
-	static constexpr XMFLOAT3 gridBigColor{0.4, 0.4, 0.4};
-	static constexpr XMFLOAT3 xaxisColor{232.0 / 255, 95.0 / 255, 55.0 / 255};
-	static constexpr XMFLOAT3 yaxisColor{118.0 / 255, 248.0 / 255, 39.0 / 255};
-	static constexpr XMFLOAT3 zaxisColor{37.0 / 255, 191.0 / 255, 250.0 / 255};
 
 	std::string initModel = std::string("models/demo.fbx");
 
@@ -70,6 +63,7 @@ private:
 
 	ComPtr<ID3D12RootSignature> rootSignature;
 	ComPtr<ID3D12PipelineState> pso;
+	ComPtr<ID3D12PipelineState> flatPso;
 
 	ComPtr<ID3D12Fence> fence;
 
@@ -78,20 +72,43 @@ private:
 
 	ComPtr<ID3D10Blob> vertexShader;
 	ComPtr<ID3D10Blob> fragmentShader;
+	ComPtr<ID3D10Blob> flatVertexShader;
+	ComPtr<ID3D10Blob> flatFragmentShader;
 
 	std::vector<D3D12_INPUT_ELEMENT_DESC> inputElementDescs;
+	std::vector<D3D12_INPUT_ELEMENT_DESC> instanceElementDescs;
 
 	ComPtr<ID3D12Resource> offsetScreenRenderTarget;
 
 	std::shared_ptr<Model> model[2];
 	UINT curModel;
 
-	std::shared_ptr<Model> grid;
+	// Rebuilt by GridBuilder every frame into the frame resource's grid buffer.
 	std::vector<Vertex> gridVertices;
-	std::vector<UINT32> gridIndices;
+	UINT gridVertexCount = 0;
 	ComPtr<ID3D12PipelineState> gridPso;
 
+	// Rebuilt every frame and clustered into the frame resource's light buffers.
+	std::vector<PointLight> lights;
+	LightClusterBuilder lightClusters;
+	void BuildLights(FXMVECTOR modelCenter, float modelRadius);
+
+	// Every draw of a frame is a packet in renderQueue, keyed by pass, pipeline state, index width and depth.
+	// The pipeline part of a key indexes the Pipeline list, and the model's commands are its queued draws.
+	enum Pass { ScenePass, GridPass };
+	enum Pipeline { ScenePipeline, FlatPipeline, GridPipeline };
+	static constexpr UINT gridCommand = 1u << 31;
+	RenderQueue renderQueue;
+
 	Nullable<std::string> task;
+	std::future<std::shared_ptr<Model>> loading;
+	std::shared_ptr<ImportProgress> loadProgress;
+	// Export of a model, which may import its file again. While it runs the info label keeps the memory
+	// it showed for that model, since the save swaps the model's CPU geometry meanwhile.
+	std::future<void> saving;
+	const Model* savingModel = nullptr;
+	ModelMemory shownMemory;
+	bool Saving(const Model* model);
 	int switchFrame;
 
 	std::shared_ptr<Camera> camera;
@@ -110,6 +127,10 @@ public:
 	double lastMove = 0;
 	double lastResize = -1;
 	int lightIntensity = 2500000;
+	// Up to cornerLights this is the fixed rig of lights at the corners of a cube around the scene;
+	// above it, lightCount lights spread around the model.
+	static constexpr int cornerLights = 8;
+	int lightCount = cornerLights;
 	XMINT2 newSize;
 	XMFLOAT3 axisFlag{1, 1, 1};
 	D3D12_PRIMITIVE_TOPOLOGY primitiveType = D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
@@ -132,6 +153,7 @@ public:
 	void SwitchBack();
 
 	void ChangeLightIntensity(int intensity);
+	void ChangeLightCount(int count);
 
 private:
 	inline ComPtr<ID3D12Resource> CurRenderTarget();
@@ -148,10 +170,14 @@ private:
 	void CreateCommandObjects();
 	void CreateFence();
 	void CreateVertexBuffer();
+	void CompileShader(LPCWSTR fileName, LPCSTR entryPoint, LPCSTR target, const D3D_SHADER_MACRO* defines, ComPtr<ID3D10Blob>& shader);
 	void CreateShaders();
 	void CreateRootSignature();
 	void CreatePso();
 	void FlushCommandQueue(UINT64 waitValue = 0);
+	void FocusModel();
+	void StartLoading(const std::string& fileName);
 	void Update();
-	void GenGrid();
+	void DrawGrid();
+	void ReplayQueue();
 };
\ No newline at end of file
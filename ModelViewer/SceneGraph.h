@@ -0,0 +1,137 @@
+#pragma once
+
+#include "assimp/scene.h"
+#include "DirectX-std.h"
+#include <vector>
+
+// The node hierarchy flattened breadth first, so that every level only depends on the one above it.
+// Transforms are kept in SoA form: element k of the 3x4 affine matrix of node i is m[k][i].
+class SceneGraph
+{
+public:
+	std::vector<const aiNode*> nodes;
+	std::vector<int> parents;
+	std::vector<UINT> levels;
+	std::vector<float> local[12];
+	std::vector<float> world[12];
+
+	void Flatten(const aiNode* root)
+	{
+		nodes.assign(1, root);
+		parents.assign(1, -1);
+		levels.assign({0, 1});
+		while(levels.back() > levels[levels.size() - 2])
+		{
+			for(UINT i = levels[levels.size() - 2], end = levels.back(); i < end; ++i)
+				for(UINT c = 0; c < nodes[i]->mNumChildren; ++c)
+				{
+					nodes.push_back(nodes[i]->mChildren[c]);
+					parents.push_back(i);
+				}
+			levels.push_back(nodes.size());
+		}
+		levels.pop_back();
+
+		int nodeCount = nodes.size();
+		for(int k = 0; k < 12; ++k)
+		{
+			local[k].resize(nodeCount);
+			world[k].resize(nodeCount);
+		}
+
+#pragma omp parallel for
+		for(int i = 0; i < nodeCount; ++i)
+		{
+			const aiMatrix4x4& m = nodes[i]->mTransformation;
+			const float elements[12] = {m.a1, m.a2, m.a3, m.a4, m.b1, m.b2, m.b3, m.b4, m.c1, m.c2, m.c3, m.c4};
+			for(int k = 0; k < 12; ++k) local[k][i] = elements[k];
+		}
+
+		// Level by level in topological order; nodes of one level are independent.
+		for(int k = 0; k < 12; ++k) world[k][0] = local[k][0];
+		for(size_t level = 1; level + 1 < levels.size(); ++level)
+		{
+#pragma omp parallel for
+			for(int i = levels[level]; i < (int)levels[level + 1]; ++i)
+				Compose(parents[i], i);
+		}
+	}
+
+	InstanceTransform World(UINT node) const
+	{
+		InstanceTransform transform;
+		for(int r = 0; r < 3; ++r)
+			transform.rows[r] = {world[r * 4][node], world[r * 4 + 1][node], world[r * 4 + 2][node], world[r * 4 + 3][node]};
+		return transform;
+	}
+
+	// Nodes referencing every scene mesh, in breadth-first order.
+	std::vector<std::vector<UINT>> MeshNodes(UINT meshCount) const
+	{
+		std::vector<std::vector<UINT>> meshNodes(meshCount);
+		for(UINT i = 0; i < nodes.size(); ++i)
+			for(UINT m = 0; m < nodes[i]->mNumMeshes; ++m) meshNodes[nodes[i]->mMeshes[m]].push_back(i);
+		return meshNodes;
+	}
+
+	static InstanceTransform Identity()
+	{
+		return {{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}}};
+	}
+
+	static bool IsIdentity(const InstanceTransform& transform)
+	{
+		InstanceTransform identity = Identity();
+		return memcmp(&transform, &identity, sizeof(InstanceTransform)) == 0;
+	}
+
+	// Positions take the full matrix; normals take the cofactor matrix, which is the inverse transpose up
+	// to the determinant, flipped for mirroring transforms.
+	static void Apply(const InstanceTransform& transform, Vertex& vertex)
+	{
+		XMVECTOR position = XMVectorSetW(XMLoadFloat3(&vertex.position), 1);
+		XMFLOAT3 p;
+		p.x = XMVectorGetX(XMVector4Dot(XMLoadFloat4(&transform.rows[0]), position));
+		p.y = XMVectorGetX(XMVector4Dot(XMLoadFloat4(&transform.rows[1]), position));
+		p.z = XMVectorGetX(XMVector4Dot(XMLoadFloat4(&transform.rows[2]), position));
+		vertex.position = p;
+
+		const XMFLOAT4* rows = transform.rows;
+		XMVECTOR a = XMVectorSet(rows[0].x, rows[1].x, rows[2].x, 0);
+		XMVECTOR b = XMVectorSet(rows[0].y, rows[1].y, rows[2].y, 0);
+		XMVECTOR c = XMVectorSet(rows[0].z, rows[1].z, rows[2].z, 0);
+		XMVECTOR bc = XMVector3Cross(b, c);
+		float sign = XMVectorGetX(XMVector3Dot(a, bc)) < 0 ? -1.0f : 1.0f;
+		XMVECTOR normal = bc * vertex.normal.x + XMVector3Cross(c, a) * vertex.normal.y + XMVector3Cross(a, b) * vertex.normal.z;
+		XMStoreFloat3(&vertex.normal, XMVector3Normalize(normal) * sign);
+	}
+
+	// Largest factor by which the transform stretches a length.
+	static float MaxScale(const InstanceTransform& transform)
+	{
+		const XMFLOAT4* rows = transform.rows;
+		float a = rows[0].x * rows[0].x + rows[1].x * rows[1].x + rows[2].x * rows[2].x;
+		float b = rows[0].y * rows[0].y + rows[1].y * rows[1].y + rows[2].y * rows[2].y;
+		float c = rows[0].z * rows[0].z + rows[1].z * rows[1].z + rows[2].z * rows[2].z;
+		return sqrtf(max(a, max(b, c)));
+	}
+
+private:
+	// world[node] = world[parent] * local[node] on the 3x4 affine part.
+	void Compose(int parent, int node)
+	{
+		float p[12], l[12];
+		for(int k = 0; k < 12; ++k)
+		{
+			p[k] = world[k][parent];
+			l[k] = local[k][node];
+		}
+		for(int r = 0; r < 3; ++r)
+			for(int c = 0; c < 4; ++c)
+			{
+				float value = p[r * 4] * l[c] + p[r * 4 + 1] * l[4 + c] + p[r * 4 + 2] * l[8 + c];
+				if(c == 3) value += p[r * 4 + 3];
+				world[r * 4 + c][node] = value;
+			}
+	}
+};
@@ -0,0 +1,546 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include "ArrayView.h"
+#include "ImportProgress.h"
+#include "MeshOptimizer.h"
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <omp.h>
+
+struct MeshLod
+{
+	UINT firstIndex;
+	UINT indexCount;
+	float error;
+};
+
+// Quadric error simplification (Garland and Heckbert) by half-edge collapses, so every level keeps
+// using the original vertices and only needs its own indices. Vertices are welded by position first;
+// the split copies along normal or color seams travel with their position and are matched to the
+// closest copy at the target, which is where the attribute part of the error comes from.
+class Simplifier
+{
+public:
+	static constexpr float levelRatio = 0.25f;
+	// From this size a mesh is simplified on its own with every round spread over the threads.
+	static constexpr UINT parallelTriangles = 1 << 16;
+
+private:
+	static constexpr int maxLevels = 4;
+	static constexpr UINT minTriangles = 512;
+	static constexpr float attributeWeight = 0.5f;
+	static constexpr float minFlipCos = 0.25f;
+	static constexpr UINT blockSize = 1 << 15;
+	static constexpr UINT minSortPiece = 1 << 14;
+
+	struct Quadric
+	{
+		double a[10];
+	};
+
+	struct Collapse
+	{
+		float cost;
+		float positionCost;
+		UINT from, to;
+
+		bool operator<(const Collapse& other) const { return cost < other.cost; }
+	};
+
+public:
+	// Appends levels 1.. of every triangle mesh to lodIndices (mesh-local indices) and lods; meshLods[i]
+	// is the first entry of mesh i in lods and meshLods[i + 1] its end. The error of a level is the
+	// square root of the largest quadric error it accepted, in model units.
+	static void BuildLods(
+		ArrayView<Vertex> vertices,
+		const std::vector<UINT32>& indices,
+		const std::vector<MeshRange>& meshRanges,
+		std::vector<UINT32>& lodIndices,
+		std::vector<MeshLod>& lods,
+		std::vector<UINT>& meshLods,
+		ImportProgress* progress = nullptr)
+	{
+		int meshCount = meshRanges.size();
+		std::vector<std::vector<UINT32>> meshIndices(meshCount);
+		std::vector<std::vector<MeshLod>> meshLevels(meshCount);
+
+		// Small meshes take one thread each; large ones run one after another afterwards, since a mesh inside
+		// the loop over meshes would get a single thread for all of its rounds.
+		std::vector<int> large;
+		for(int i = 0; i < meshCount; ++i)
+			if(meshRanges[i].faceSize == 3 && meshRanges[i].indexCount / 3 >= parallelTriangles) large.push_back(i);
+
+		std::atomic<int> simplified{0};
+#pragma omp parallel for schedule(dynamic)
+		for(int i = 0; i < meshCount; ++i)
+		{
+			if(progress && progress->Cancelled()) continue;
+			const MeshRange& range = meshRanges[i];
+			if(range.faceSize == 3 && range.indexCount / 3 >= parallelTriangles) continue;
+			if(range.faceSize == 3 && range.indexCount / 3 >= minTriangles * 2)
+				SimplifyMesh(
+					vertices.data() + range.baseVertex, range.vertexCount,
+					indices.data() + range.firstIndex, range.indexCount,
+					meshIndices[i], meshLevels[i], progress);
+			if(progress) progress->Report(ImportStage::Lods, (float)++simplified / meshCount);
+		}
+		if(progress) progress->Check();
+
+		for(int i : large)
+		{
+			const MeshRange& range = meshRanges[i];
+			SimplifyMesh(
+				vertices.data() + range.baseVertex, range.vertexCount,
+				indices.data() + range.firstIndex, range.indexCount,
+				meshIndices[i], meshLevels[i], progress);
+			if(progress)
+			{
+				progress->Check();
+				progress->Report(ImportStage::Lods, (float)++simplified / meshCount);
+			}
+		}
+
+		lodIndices.clear();
+		lods.clear();
+		meshLods.assign(meshCount + 1, 0);
+		for(int i = 0; i < meshCount; ++i)
+		{
+			UINT offset = lodIndices.size();
+			for(auto lod : meshLevels[i])
+			{
+				lod.firstIndex += offset;
+				lods.push_back(lod);
+			}
+			lodIndices.insert(lodIndices.end(), meshIndices[i].begin(), meshIndices[i].end());
+			meshLods[i + 1] = lods.size();
+		}
+	}
+
+	static void SimplifyMesh(
+		const Vertex* vertices, UINT vertexCount,
+		const UINT32* sourceIndices, UINT indexCount,
+		std::vector<UINT32>& lodIndices, std::vector<MeshLod>& lods,
+		const ImportProgress* progress = nullptr)
+	{
+		std::vector<UINT> positionOf(vertexCount);
+		std::vector<UINT> wedgeStart, wedges;
+		UINT positionCount = Weld(vertices, vertexCount, positionOf, wedgeStart, wedges);
+
+		std::vector<UINT32> indices(sourceIndices, sourceIndices + indexCount);
+		std::vector<UINT> ringStart, ring;
+		std::vector<std::atomic<UINT>> cursor(Serial() ? 0 : positionCount);
+		BuildRings(indices, positionOf, positionCount, ringStart, ring, cursor);
+
+		// Each position sums the planes of its triangles in triangle order, whatever order the ring was built in.
+		std::vector<Quadric> quadrics(positionCount, Quadric{});
+		int positions = positionCount;
+#pragma omp parallel for schedule(static, 4096)
+		for(int p = 0; p < positions; ++p)
+		{
+			std::sort(ring.begin() + ringStart[p], ring.begin() + ringStart[p + 1]);
+			for(UINT r = ringStart[p]; r < ringStart[p + 1]; ++r)
+			{
+				UINT t = ring[r] * 3;
+				Add(quadrics[p], PlaneQuadric(vertices, indices[t], indices[t + 1], indices[t + 2]));
+			}
+		}
+		std::vector<BYTE> border(positionCount, 0);
+		MarkBorders(indices, positionOf, positionCount, border);
+
+		std::vector<UINT> remap(vertexCount);
+		std::vector<Collapse> collapses, scratch;
+		std::vector<BYTE> locked(positionCount);
+		float error = 0;
+		UINT previousCount = indexCount / 3;
+
+		for(int level = 1; level <= maxLevels; ++level)
+		{
+			UINT target = (UINT)(previousCount * levelRatio);
+			if(target < minTriangles) break;
+
+			while(indices.size() / 3 > target)
+			{
+				// A large mesh takes many rounds, so a cancelled load gives up here rather than after the mesh.
+				if(progress && progress->Cancelled()) return;
+				BuildRings(indices, positionOf, positionCount, ringStart, ring, cursor);
+				FindCollapses(vertices, indices, positionOf, wedgeStart, wedges, quadrics, border, collapses);
+				ParallelSort(collapses, scratch);
+
+				// Take an independent set from the cheapest collapses: the ring of every source is locked. This
+				// pick is serial, which keeps the levels the same for any thread count.
+				UINT needed = indices.size() / 3 - target;
+				UINT considered = min((UINT)collapses.size(), max(needed, 64u));
+				UINT removed = 0, accepted = 0;
+				std::fill(locked.begin(), locked.end(), 0);
+				int remapCount = vertexCount;
+#pragma omp parallel for
+				for(int i = 0; i < remapCount; ++i) remap[i] = i;
+
+				for(UINT c = 0; c < considered && removed < needed; ++c)
+				{
+					const Collapse& collapse = collapses[c];
+					if(locked[collapse.from] || locked[collapse.to]) continue;
+					const XMFLOAT3& targetPosition = vertices[wedges[wedgeStart[collapse.to]]].position;
+					if(Flips(vertices, indices, positionOf, ringStart, ring, collapse.from, collapse.to, targetPosition)) continue;
+
+					for(UINT r = ringStart[collapse.from]; r < ringStart[collapse.from + 1]; ++r)
+						for(int k = 0; k < 3; ++k) locked[positionOf[indices[ring[r] * 3 + k]]] = 1;
+
+					Add(quadrics[collapse.to], quadrics[collapse.from]);
+					for(UINT w = wedgeStart[collapse.from]; w < wedgeStart[collapse.from + 1]; ++w)
+						remap[wedges[w]] = ClosestWedge(vertices, wedges[w], wedgeStart, wedges, collapse.to);
+					error = max(error, sqrtf(max(collapse.positionCost, 0.0f)));
+					removed += 2;
+					++accepted;
+				}
+				if(accepted == 0) break;
+
+				// Blocks drop their degenerate triangles in place in parallel, then move down over the gaps.
+				int blockCount = (indices.size() + blockSize * 3 - 1) / (blockSize * 3);
+				std::vector<size_t> kept(blockCount);
+#pragma omp parallel for
+				for(int block = 0; block < blockCount; ++block)
+				{
+					size_t start = (size_t)block * blockSize * 3, end = min(start + blockSize * 3, indices.size()), written = start;
+					for(size_t t = start; t < end; t += 3)
+					{
+						UINT32 a = remap[indices[t]], b = remap[indices[t + 1]], c = remap[indices[t + 2]];
+						UINT pa = positionOf[a], pb = positionOf[b], pc = positionOf[c];
+						if(pa == pb || pb == pc || pa == pc) continue;
+						indices[written++] = a;
+						indices[written++] = b;
+						indices[written++] = c;
+					}
+					kept[block] = written - start;
+				}
+				CloseGaps(indices, kept, blockSize * 3);
+			}
+
+			UINT count = indices.size() / 3;
+			if(count > previousCount * 0.9f) break;
+
+			std::vector<UINT32> clusters;
+			UINT firstIndex = lodIndices.size();
+			lodIndices.resize(firstIndex + indices.size());
+			MeshOptimizer::Tipsify(indices.data(), indices.size(), vertexCount, lodIndices.data() + firstIndex, clusters);
+			lods.push_back({firstIndex, (UINT)indices.size(), error});
+			previousCount = count;
+		}
+	}
+
+private:
+	static UINT Weld(const Vertex* vertices, UINT vertexCount, std::vector<UINT>& positionOf, std::vector<UINT>& wedgeStart, std::vector<UINT>& wedges)
+	{
+		const UINT empty = 0xffffffff;
+		UINT tableSize = 1;
+		while(tableSize < vertexCount * 2) tableSize <<= 1;
+		std::vector<UINT> table(tableSize, empty);
+
+		UINT positionCount = 0;
+		for(UINT v = 0; v < vertexCount; ++v)
+		{
+			const XMFLOAT3& p = vertices[v].position;
+			UINT32 bits[3];
+			memcpy(bits, &p, sizeof(bits));
+			UINT64 hash = (bits[0] * 73856093ULL) ^ (bits[1] * 19349663ULL) ^ (bits[2] * 83492791ULL);
+			UINT slot = (UINT)(hash ^ (hash >> 29)) & (tableSize - 1);
+			while(table[slot] != empty && memcmp(&vertices[table[slot]].position, &p, sizeof(XMFLOAT3)) != 0)
+				slot = (slot + 1) & (tableSize - 1);
+
+			if(table[slot] == empty)
+			{
+				table[slot] = v;
+				positionOf[v] = positionCount++;
+			}
+			else positionOf[v] = positionOf[table[slot]];
+		}
+
+		wedgeStart.assign(positionCount + 1, 0);
+		for(UINT v = 0; v < vertexCount; ++v) ++wedgeStart[positionOf[v] + 1];
+		for(UINT p = 0; p < positionCount; ++p) wedgeStart[p + 1] += wedgeStart[p];
+		wedges.resize(vertexCount);
+		std::vector<UINT> cursor(wedgeStart.begin(), wedgeStart.end() - 1);
+		for(UINT v = 0; v < vertexCount; ++v) wedges[cursor[positionOf[v]]++] = v;
+		return positionCount;
+	}
+
+	static Quadric PlaneQuadric(const Vertex* vertices, UINT32 i0, UINT32 i1, UINT32 i2)
+	{
+		XMVECTOR p0 = XMLoadFloat3(&vertices[i0].position);
+		XMVECTOR n = XMVector3Cross(XMLoadFloat3(&vertices[i1].position) - p0, XMLoadFloat3(&vertices[i2].position) - p0);
+		Quadric q{};
+		if(XMVectorGetX(XMVector3LengthSq(n)) == 0) return q;
+
+		XMFLOAT3 normal;
+		XMStoreFloat3(&normal, XMVector3Normalize(n));
+		double a = normal.x, b = normal.y, c = normal.z;
+		double d = -XMVectorGetX(XMVector3Dot(XMVector3Normalize(n), p0));
+		double values[10] = {a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d};
+		memcpy(q.a, values, sizeof(values));
+		return q;
+	}
+
+	static void Add(Quadric& q, const Quadric& other)
+	{
+		for(int k = 0; k < 10; ++k) q.a[k] += other.a[k];
+	}
+
+	static double Evaluate(const Quadric& q, const Quadric& r, const XMFLOAT3& p)
+	{
+		double a[10];
+		for(int k = 0; k < 10; ++k) a[k] = q.a[k] + r.a[k];
+		double x = p.x, y = p.y, z = p.z;
+		return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+			+ a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+			+ a[7] * z * z + 2 * a[8] * z + a[9];
+	}
+
+	// A position on an edge used by only one triangle is a border; it may be a target but never moves.
+	static void MarkBorders(const std::vector<UINT32>& indices, const std::vector<UINT>& positionOf, UINT positionCount, std::vector<BYTE>& border)
+	{
+		const UINT64 none = ~0ULL;
+		std::vector<UINT64> edges(indices.size()), scratch;
+		int cornerCount = indices.size();
+#pragma omp parallel for schedule(static, 4096)
+		for(int i = 0; i < cornerCount; ++i)
+		{
+			UINT64 a = positionOf[indices[i]], b = positionOf[indices[i - i % 3 + (i + 1) % 3]];
+			edges[i] = a == b ? none : a < b ? (a << 32) | b : (b << 32) | a;
+		}
+		ParallelSort(edges, scratch);
+		edges.resize(std::lower_bound(edges.begin(), edges.end(), none) - edges.begin());
+
+		for(size_t i = 0; i < edges.size();)
+		{
+			size_t j = i;
+			while(j < edges.size() && edges[j] == edges[i]) ++j;
+			if(j - i == 1)
+			{
+				border[edges[i] >> 32] = 1;
+				border[edges[i] & 0xffffffff] = 1;
+			}
+			i = j;
+		}
+	}
+
+	// Small meshes are already one per thread, and the parallel paths only cost them.
+	static bool Serial()
+	{
+		return omp_in_parallel() || omp_get_max_threads() == 1;
+	}
+
+	// Triangles around every position. In parallel, counting and filling go through atomic cursors, so the
+	// order within a ring varies; nothing that reads a ring depends on it.
+	static void BuildRings(
+		const std::vector<UINT32>& indices,
+		const std::vector<UINT>& positionOf,
+		UINT positionCount,
+		std::vector<UINT>& ringStart,
+		std::vector<UINT>& ring,
+		std::vector<std::atomic<UINT>>& cursor)
+	{
+		if(Serial())
+		{
+			ringStart.assign(positionCount + 1, 0);
+			for(UINT i = 0; i < indices.size(); ++i) ++ringStart[positionOf[indices[i]] + 1];
+			for(UINT p = 0; p < positionCount; ++p) ringStart[p + 1] += ringStart[p];
+			ring.resize(indices.size());
+			std::vector<UINT> next(ringStart.begin(), ringStart.end() - 1);
+			for(UINT i = 0; i < indices.size(); ++i) ring[next[positionOf[indices[i]]]++] = i / 3;
+			return;
+		}
+
+		int positions = positionCount, cornerCount = indices.size();
+#pragma omp parallel for
+		for(int p = 0; p < positions; ++p) cursor[p].store(0, std::memory_order_relaxed);
+#pragma omp parallel for schedule(static, 4096)
+		for(int i = 0; i < cornerCount; ++i) cursor[positionOf[indices[i]]].fetch_add(1, std::memory_order_relaxed);
+
+		ringStart.resize(positionCount + 1);
+		ringStart[0] = 0;
+		for(UINT p = 0; p < positionCount; ++p)
+		{
+			UINT size = cursor[p].load(std::memory_order_relaxed);
+			cursor[p].store(ringStart[p], std::memory_order_relaxed);
+			ringStart[p + 1] = ringStart[p] + size;
+		}
+		ring.resize(indices.size());
+#pragma omp parallel for schedule(static, 4096)
+		for(int i = 0; i < cornerCount; ++i) ring[cursor[positionOf[indices[i]]].fetch_add(1, std::memory_order_relaxed)] = i / 3;
+	}
+
+	// Sorts pieces on separate threads and merges them pairwise. Both steps are stable, so equal items keep
+	// the order they were found in and the result does not depend on the thread count.
+	template<class T>
+	static void ParallelSort(std::vector<T>& items, std::vector<T>& scratch)
+	{
+		int pieces = Serial() ? 1 : omp_get_max_threads();
+		pieces = min(pieces, (int)(items.size() / minSortPiece));
+		if(pieces <= 1)
+		{
+			std::stable_sort(items.begin(), items.end());
+			return;
+		}
+
+		std::vector<size_t> bounds(pieces + 1);
+		for(int p = 0; p <= pieces; ++p) bounds[p] = items.size() * p / pieces;
+#pragma omp parallel for
+		for(int p = 0; p < pieces; ++p) std::stable_sort(items.begin() + bounds[p], items.begin() + bounds[p + 1]);
+
+		scratch.resize(items.size());
+		for(int width = 1; width < pieces; width *= 2)
+		{
+			int merges = (pieces + 2 * width - 1) / (2 * width);
+#pragma omp parallel for
+			for(int m = 0; m < merges; ++m)
+			{
+				int first = m * 2 * width, middle = min(first + width, pieces), last = min(first + 2 * width, pieces);
+				std::merge(items.begin() + bounds[first], items.begin() + bounds[middle],
+					items.begin() + bounds[middle], items.begin() + bounds[last], scratch.begin() + bounds[first]);
+			}
+			items.swap(scratch);
+		}
+	}
+
+	// Block b kept kept[b] items at its start; moves them down so that they follow each other.
+	template<class T>
+	static void CloseGaps(std::vector<T>& items, const std::vector<size_t>& kept, size_t blockItems)
+	{
+		size_t written = 0;
+		for(size_t b = 0; b < kept.size(); ++b)
+		{
+			size_t start = b * blockItems;
+			if(written != start) std::copy(items.begin() + start, items.begin() + start + kept[b], items.begin() + written);
+			written += kept[b];
+		}
+		items.resize(written);
+	}
+
+	// One candidate per edge, in the cheaper of its two directions. Corners are filtered per block and
+	// costs evaluated in parallel.
+	static void FindCollapses(
+		const Vertex* vertices,
+		const std::vector<UINT32>& indices,
+		const std::vector<UINT>& positionOf,
+		const std::vector<UINT>& wedgeStart,
+		const std::vector<UINT>& wedges,
+		const std::vector<Quadric>& quadrics,
+		const std::vector<BYTE>& border,
+		std::vector<Collapse>& collapses)
+	{
+		collapses.resize(indices.size());
+		int blockCount = (indices.size() + blockSize - 1) / blockSize;
+		std::vector<size_t> kept(blockCount);
+#pragma omp parallel for
+		for(int block = 0; block < blockCount; ++block)
+		{
+			size_t start = (size_t)block * blockSize, end = min(start + blockSize, indices.size()), written = start;
+			for(size_t i = start; i < end; ++i)
+			{
+				UINT a = positionOf[indices[i]], b = positionOf[indices[i - i % 3 + (i + 1) % 3]];
+				if(a < b && !(border[a] && border[b])) collapses[written++] = {0, 0, a, b};
+			}
+			kept[block] = written - start;
+		}
+		CloseGaps(collapses, kept, blockSize);
+
+		int count = collapses.size();
+#pragma omp parallel for schedule(static, 4096)
+		for(int c = 0; c < count; ++c)
+		{
+			Collapse& collapse = collapses[c];
+			UINT a = collapse.from, b = collapse.to;
+			float costAB = border[a] ? 1e30f : Cost(vertices, wedgeStart, wedges, quadrics, a, b, collapse.positionCost);
+			float positionBA = 0;
+			float costBA = border[b] ? 1e30f : Cost(vertices, wedgeStart, wedges, quadrics, b, a, positionBA);
+			if(costBA < costAB)
+			{
+				collapse = {costBA, positionBA, b, a};
+			}
+			else collapse.cost = costAB;
+		}
+	}
+
+	static float Cost(
+		const Vertex* vertices,
+		const std::vector<UINT>& wedgeStart,
+		const std::vector<UINT>& wedges,
+		const std::vector<Quadric>& quadrics,
+		UINT from, UINT to,
+		float& positionCost)
+	{
+		const XMFLOAT3& target = vertices[wedges[wedgeStart[to]]].position;
+		positionCost = (float)Evaluate(quadrics[from], quadrics[to], target);
+
+		float attribute = 0;
+		for(UINT w = wedgeStart[from]; w < wedgeStart[from + 1]; ++w)
+		{
+			float closest = 1e30f;
+			for(UINT u = wedgeStart[to]; u < wedgeStart[to + 1]; ++u)
+				closest = min(closest, AttributeDistance(vertices[wedges[w]], vertices[wedges[u]]));
+			attribute = max(attribute, closest);
+		}
+
+		XMVECTOR edge = XMLoadFloat3(&target) - XMLoadFloat3(&vertices[wedges[wedgeStart[from]]].position);
+		return positionCost + attributeWeight * attribute * XMVectorGetX(XMVector3LengthSq(edge));
+	}
+
+	static float AttributeDistance(const Vertex& a, const Vertex& b)
+	{
+		XMVECTOR n = XMLoadFloat3(&a.normal) - XMLoadFloat3(&b.normal);
+		XMVECTOR c = XMLoadFloat3(&a.color) - XMLoadFloat3(&b.color);
+		return XMVectorGetX(XMVector3LengthSq(n) + XMVector3LengthSq(c));
+	}
+
+	static UINT ClosestWedge(const Vertex* vertices, UINT wedge, const std::vector<UINT>& wedgeStart, const std::vector<UINT>& wedges, UINT to)
+	{
+		UINT best = wedges[wedgeStart[to]];
+		float bestDistance = 1e30f;
+		for(UINT u = wedgeStart[to]; u < wedgeStart[to + 1]; ++u)
+		{
+			float distance = AttributeDistance(vertices[wedge], vertices[wedges[u]]);
+			if(distance < bestDistance)
+			{
+				bestDistance = distance;
+				best = wedges[u];
+			}
+		}
+		return best;
+	}
+
+	// Rejects a collapse that turns any surviving triangle around the source by more than ~75 degrees.
+	static bool Flips(
+		const Vertex* vertices,
+		const std::vector<UINT32>& indices,
+		const std::vector<UINT>& positionOf,
+		const std::vector<UINT>& ringStart,
+		const std::vector<UINT>& ring,
+		UINT from, UINT to,
+		const XMFLOAT3& targetPosition)
+	{
+		XMVECTOR target = XMLoadFloat3(&targetPosition);
+		for(UINT r = ringStart[from]; r < ringStart[from + 1]; ++r)
+		{
+			const UINT32* corners = indices.data() + ring[r] * 3;
+			XMVECTOR p[3], q[3];
+			bool touchesTarget = false;
+			for(int k = 0; k < 3; ++k)
+			{
+				UINT position = positionOf[corners[k]];
+				touchesTarget |= position == to;
+				p[k] = XMLoadFloat3(&vertices[corners[k]].position);
+				q[k] = position == from ? target : p[k];
+			}
+			if(touchesTarget) continue;
+
+			XMVECTOR before = XMVector3Cross(p[1] - p[0], p[2] - p[0]);
+			XMVECTOR after = XMVector3Cross(q[1] - q[0], q[2] - q[0]);
+			float dot = XMVectorGetX(XMVector3Dot(before, after));
+			float lengths = sqrtf(XMVectorGetX(XMVector3LengthSq(before)) * XMVectorGetX(XMVector3LengthSq(after)));
+			if(lengths == 0 || dot < minFlipCos * lengths) return true;
+		}
+		return false;
+	}
+};
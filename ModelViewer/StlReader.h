@@ -0,0 +1,180 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include "MappedFile.h"
+#include "ImportProgress.h"
+#include "MeshReader.h"
+#include <vector>
+#include <string>
+#include <climits>
+
+// Native reader for binary STL: an 80-byte header, the triangle count and 50 bytes per triangle. A file
+// whose size does not match that layout is ASCII STL and is left to Assimp.
+//
+// STL repeats every corner, so corners are welded by exact position: they are hashed, scattered into
+// buckets by the hash's top bits, and every bucket is welded with its own hash table. Vertices keep the
+// order in which their first corner appears in the file.
+class StlReader
+{
+private:
+	static constexpr UINT headerSize = 84;
+	static constexpr UINT faceBytes = 50;
+	static constexpr UINT chunkSize = 1 << 16;
+	static constexpr UINT bucketBits = 8;
+
+	struct BucketEntry
+	{
+		XMFLOAT3 position;
+		UINT32 corner;
+	};
+
+public:
+	static bool Handles(const std::string& fileName)
+	{
+		return MeshReader::HasExtension(fileName, "stl");
+	}
+
+	static bool Read(
+		const std::string& fileName,
+		std::vector<Vertex>& vertices,
+		std::vector<UINT32>& indices,
+		std::vector<MeshRange>& meshRanges,
+		UINT64& bytes,
+		ImportProgress* progress)
+	{
+		MappedFile file(fileName);
+		if(!file.IsOpen() || file.Size() < headerSize) return false;
+		const BYTE* data = file.Data();
+		bytes = file.Size();
+
+		UINT32 faceCount;
+		memcpy(&faceCount, data + 80, sizeof(faceCount));
+		if(faceCount == 0 || headerSize + (UINT64)faceBytes * faceCount != bytes || 3ull * faceCount > UINT_MAX) return false;
+
+		// Corners in the flipped winding; -0 is folded into +0 so that both weld together.
+		int cornerCount = faceCount * 3;
+		std::vector<XMFLOAT3> corners(cornerCount);
+		std::vector<UINT32> hashes(cornerCount);
+#pragma omp parallel for
+		for(int f = 0; f < (int)faceCount; ++f)
+		{
+			const BYTE* face = data + headerSize + (UINT64)faceBytes * f + 12;
+			for(int k = 0; k < 3; ++k)
+			{
+				XMFLOAT3 position;
+				memcpy(&position, face + 12 * ((3 - k) % 3), sizeof(position));
+				position = MeshReader::Flip({position.x + 0.0f, position.y + 0.0f, position.z + 0.0f});
+				corners[f * 3 + k] = position;
+				hashes[f * 3 + k] = Hash(position);
+			}
+		}
+		if(progress)
+		{
+			progress->Check();
+			progress->Report(ImportStage::Read, 0.5f);
+		}
+
+		std::vector<UINT32> representative(cornerCount);
+		Weld(corners, hashes, representative);
+
+		// Number the first corner of every vertex in file order, then point every corner at its number.
+		int chunkCount = (cornerCount + chunkSize - 1) / chunkSize;
+		std::vector<UINT32> chunkVertices(chunkCount + 1, 0);
+#pragma omp parallel for
+		for(int c = 0; c < chunkCount; ++c)
+			for(int i = c * chunkSize, end = min(i + (int)chunkSize, cornerCount); i < end; ++i)
+				chunkVertices[c + 1] += representative[i] == (UINT32)i;
+		for(int c = 0; c < chunkCount; ++c) chunkVertices[c + 1] += chunkVertices[c];
+
+		std::vector<UINT32>& vertexOf = hashes;
+		vertices.resize(chunkVertices[chunkCount]);
+#pragma omp parallel for
+		for(int c = 0; c < chunkCount; ++c)
+		{
+			UINT32 next = chunkVertices[c];
+			for(int i = c * chunkSize, end = min(i + (int)chunkSize, cornerCount); i < end; ++i)
+			{
+				if(representative[i] != (UINT32)i) continue;
+				vertexOf[i] = next;
+				vertices[next].position = corners[i];
+				vertices[next].color = {0, 0, 0};
+				++next;
+			}
+		}
+
+		indices.resize(cornerCount);
+#pragma omp parallel for
+		for(int i = 0; i < cornerCount; ++i) indices[i] = vertexOf[representative[i]];
+
+		MeshReader::ComputeNormals(vertices, indices);
+		meshRanges.assign(1, MeshReader::SingleMesh(vertices.size(), indices.size(), 3, false));
+		return true;
+	}
+
+private:
+	static UINT32 Hash(const XMFLOAT3& position)
+	{
+		UINT32 bits[3];
+		memcpy(bits, &position, sizeof(bits));
+		UINT32 hash = bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u;
+		return hash * 0x9E3779B1u;
+	}
+
+	// representative[i] is the first corner at the same position as corner i.
+	static void Weld(const std::vector<XMFLOAT3>& corners, const std::vector<UINT32>& hashes, std::vector<UINT32>& representative)
+	{
+		int cornerCount = corners.size();
+		int chunkCount = (cornerCount + chunkSize - 1) / chunkSize;
+		const int bucketCount = 1 << bucketBits;
+		auto bucketOf = [&](int i) { return hashes[i] >> (32 - bucketBits); };
+
+		// Stable scatter: counts per chunk and bucket, bucket-major offsets, then every chunk writes its slots.
+		std::vector<UINT32> offsets((size_t)chunkCount * bucketCount, 0);
+#pragma omp parallel for
+		for(int c = 0; c < chunkCount; ++c)
+			for(int i = c * chunkSize, end = min(i + (int)chunkSize, cornerCount); i < end; ++i)
+				++offsets[(size_t)c * bucketCount + bucketOf(i)];
+
+		std::vector<UINT32> bucketStart(bucketCount + 1, 0);
+		UINT32 total = 0;
+		for(int b = 0; b < bucketCount; ++b)
+		{
+			bucketStart[b] = total;
+			for(int c = 0; c < chunkCount; ++c)
+			{
+				UINT32 count = offsets[(size_t)c * bucketCount + b];
+				offsets[(size_t)c * bucketCount + b] = total;
+				total += count;
+			}
+		}
+		bucketStart[bucketCount] = total;
+
+		// Positions travel with their corner, so that a bucket is welded without leaving its own slice.
+		std::vector<BucketEntry> entries(cornerCount);
+#pragma omp parallel for
+		for(int c = 0; c < chunkCount; ++c)
+			for(int i = c * chunkSize, end = min(i + (int)chunkSize, cornerCount); i < end; ++i)
+				entries[offsets[(size_t)c * bucketCount + bucketOf(i)]++] = {corners[i], (UINT32)i};
+
+		// Every bucket lists its corners in file order, so the first corner a linear-probing table sees at
+		// a position is the earliest one.
+#pragma omp parallel for schedule(dynamic)
+		for(int bucket = 0; bucket < bucketCount; ++bucket)
+		{
+			UINT32 count = bucketStart[bucket + 1] - bucketStart[bucket];
+			UINT32 mask = 1;
+			while(mask < count * 2) mask <<= 1;
+			std::vector<UINT32> table(mask, UINT_MAX);
+			--mask;
+			const BucketEntry* entry = entries.data() + bucketStart[bucket];
+			for(UINT32 k = 0; k < count; ++k)
+			{
+				UINT32 slot = Hash(entry[k].position) & mask;
+				while(table[slot] != UINT_MAX && memcmp(&entry[table[slot]].position, &entry[k].position, sizeof(XMFLOAT3)) != 0)
+					slot = (slot + 1) & mask;
+				if(table[slot] == UINT_MAX) table[slot] = k;
+				representative[entry[k].corner] = entry[table[slot]].corner;
+			}
+		}
+	}
+};
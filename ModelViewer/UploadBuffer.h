@@ -45,6 +45,12 @@ public:
 		memcpy(mappedData + elementByteSize * elementIndex, &data, sizeof(T));
 	}
 
+	// Consecutive elements of a buffer that is not a constant buffer.
+	void CopyData(UINT firstElement, const T* data, UINT count)
+	{
+		memcpy(mappedData + elementByteSize * firstElement, data, count * sizeof(T));
+	}
+
 	inline UINT GetElementSize() { return elementByteSize; }
 
 	static UINT CalcConstantBufferByteSize(UINT size)
@@ -26,9 +26,23 @@ public:
 		descriptor.StrideInBytes = vertexSize;
 	}
 
-	void Bind(ComPtr<ID3D12GraphicsCommandList> cmdList)
+	// For vertices that are not in one array: fill writes all vertexCount of them into the upload heap.
+	VertexBuffer(
+		ComPtr<ID3D12Device4> device,
+		ComPtr<ID3D12GraphicsCommandList> cmdList,
+		const std::function<void(void*)>& fill,
+		UINT vertexSize, UINT vertexCount
+	) : vertexSize(vertexSize), vertexCount(vertexCount)
+	{
+		buffer = DirectXHelp::CreateDefaultBuffer(device, cmdList, (UINT64)vertexCount * vertexSize, fill, uploadBuffer);
+		descriptor.BufferLocation = buffer->GetGPUVirtualAddress();
+		descriptor.SizeInBytes = vertexSize * vertexCount;
+		descriptor.StrideInBytes = vertexSize;
+	}
+
+	void Bind(ComPtr<ID3D12GraphicsCommandList> cmdList, UINT slot = 0)
 	{
-		cmdList->IASetVertexBuffers(0, 1, &descriptor);
+		cmdList->IASetVertexBuffers(slot, 1, &descriptor);
 	}
 
 	void Draw(ComPtr<ID3D12GraphicsCommandList> cmdList)
@@ -119,6 +119,16 @@ QWidget* BuildWindow(GlobalApplication& app)
 
 	QObject::connect(slider, SIGNAL(valueChanged(int)), rendererWindow, SLOT(ChangeLight(int)));
 
+	// 8 keeps the corner lights; more spreads that many lights around the model.
+	QSpinBox* lightCount = new QSpinBox;
+	lightCount->setRange(Renderer::cornerLights, LightClusterBuilder::maxLights);
+	lightCount->setValue(Renderer::cornerLights);
+	lightCount->setFixedSize(80, 20);
+	statusBar->addWidget(new QLabel(chinese("ƹ: ")));
+	statusBar->addWidget(lightCount);
+
+	QObject::connect(lightCount, SIGNAL(valueChanged(int)), rendererWindow, SLOT(ChangeLightCount(int)));
+
 	QLabel* label = new QLabel;
 	statusBar->addPermanentWidget(label);
 	statusBar->setContentsMargins(0, 0, 0, 0);
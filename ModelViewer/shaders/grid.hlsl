@@ -12,11 +12,14 @@ cbuffer cbPass : register(b0)
     int lightCount;
     float unused;
 
-    float4 lightPos[8];
-
-    float4 lightColor[8];
+    float2 tileScale;
+    float sliceScale;
+    float sliceBias;
 
     float3 camearaPos;
+    uint clustersX;
+    uint clustersY;
+    uint clustersZ;
 };
 
 struct PSInput
@@ -12,29 +12,61 @@ cbuffer cbPass : register(b0)
     int lightCount;
     float unused;
 
-    float4 lightPos[8]; 
-
-    float4 lightColor[8]; 
+    float2 tileScale;
+    float sliceScale;
+    float sliceBias;
+
+    float3 camearaPos;
+    uint clustersX;
+    uint clustersY;
+    uint clustersZ;
+};
 
-    float3 camearaPos; 
+struct PointLight
+{
+    float3 position;
+    float radius;
+    float3 color;
+    float unused;
 };
 
+// Lights of cluster c are lightIndices[clusters[c].x] onwards, clusters[c].y of them.
+StructuredBuffer<PointLight> lights : register(t0);
+StructuredBuffer<uint2> clusters : register(t1);
+StructuredBuffer<uint> lightIndices : register(t2);
+
 struct PSInput
 {
     float4 position : SV_POSITION;
     float3 worldPos : TEXCOORD0;
+#ifdef FLAT_SHADING
+    nointerpolation float3 normal : TEXCOORD1;
+#else
     float3 normal : TEXCOORD1;
+#endif
     float3 color : TEXCOORD2;
+    float viewDepth : TEXCOORD3;
 };
 
-PSInput VSMain(float3 position : POSITION, float3 normal : NORMAL, float3 color : COLOR)
+// world0..2 are the rows of the instance transform in column-vector form. Normals take its cofactor
+// matrix, the inverse transpose up to the determinant, so non-uniform scales keep them perpendicular.
+PSInput VSMain(float3 position : POSITION, float3 normal : NORMAL, float3 color : COLOR,
+    float4 world0 : WORLD0, float4 world1 : WORLD1, float4 world2 : WORLD2)
 {
+    float3x4 world = float3x4(world0, world1, world2);
+    float3 a = float3(world0.x, world1.x, world2.x);
+    float3 b = float3(world0.y, world1.y, world2.y);
+    float3 c = float3(world0.z, world1.z, world2.z);
+    float3 instanceNormal = normal.x * cross(b, c) + normal.y * cross(c, a) + normal.z * cross(a, b);
+    instanceNormal *= sign(dot(a, cross(b, c)));
+
     PSInput result;
-	result.position = mul(float4(position, 1.0), model);
+	result.position = mul(float4(mul(world, float4(position, 1.0)), 1.0), model);
     result.worldPos = result.position.xyz;
     result.position = mul(result.position, view);
+    result.viewDepth = result.position.z;
     result.position = mul(result.position, projection);
-    result.normal = mul(float4(normal, 0.0), model).xyz;
+    result.normal = mul(float4(instanceNormal, 0.0), model).xyz;
     result.color = color;
     return result;
 }
@@ -91,15 +123,24 @@ float4 PSMain(PSInput input) : SV_TARGET
     float3 F0 = float3(0.4, 0.4, 0.4);
     F0 = lerp(F0, input.color, metallic);
 
+    uint2 tile = min(uint2(input.position.xy * tileScale), uint2(clustersX, clustersY) - 1);
+    int slice = clamp((int)floor(log(input.viewDepth) * sliceScale + sliceBias), 0, (int)clustersZ - 1);
+    uint2 cluster = clusters[(slice * clustersY + tile.y) * clustersX + tile.x];
+
     float3 Lo = float3(0.0, 0.0, 0.0); 
-    for (int i = 0; i < lightCount; ++i)
+    for (uint k = 0; k < cluster.y; ++k)
     {
-        float3 L = normalize(lightPos[i] - input.worldPos);
+        PointLight light = lights[lightIndices[cluster.x + k]];
+        float3 L = normalize(light.position - input.worldPos);
         float3 H = normalize(V + L);
-        float distance = length(lightPos[i] - input.worldPos);
+        float distance = length(light.position - input.worldPos);
         //return float4(float3(distance, distance, distance) / 1000, 1.0);
-        float attenuation = 1.0 / (distance * distance);
-        float3 radiance = lightColor[i] * attenuation;
+        // Inverse square, faded out towards the radius the light was clustered with so it does not end in
+        // a visible edge at the cluster bounds. This darkens a light's far reach compared to the plain
+        // inverse square; the corner rig gets a radius of Camera::farZ, where the fade stays 1.
+        float fade = saturate(1.0 - pow(distance / light.radius, 4.0));
+        float attenuation = fade * fade / (distance * distance);
+        float3 radiance = light.color * attenuation;
 
         float NDF = DistributionGGX(N, H, roughness);
         float G = GeometrySmith(N, V, L, roughness);
@@ -0,0 +1,196 @@
+#include "Test.h"
+#include "ModelCache.h"
+#include <chrono>
+
+struct CacheGeometry
+{
+	std::vector<Vertex> vertices;
+	std::vector<UINT32> indices;
+	std::vector<MeshRange> meshRanges;
+	Bounds bounds;
+	std::vector<Bounds> meshBounds;
+	std::vector<InstanceTransform> instances;
+	std::vector<UINT> meshInstances;
+};
+
+// Two quads, the second drawn by two instances.
+static CacheGeometry MakeGeometry()
+{
+	CacheGeometry geometry;
+	for(int i = 0; i < 8; ++i)
+	{
+		Vertex vertex = {};
+		vertex.position = {float(i & 1), float((i >> 1) & 1), float(i >> 2)};
+		vertex.normal = {0, 0, 1};
+		vertex.color = {1, 1, 1};
+		geometry.vertices.push_back(vertex);
+	}
+	for(UINT mesh = 0; mesh < 2; ++mesh)
+	{
+		MeshRange range = {};
+		range.baseVertex = mesh * 4;
+		range.vertexCount = 4;
+		range.firstIndex = geometry.indices.size();
+		range.indexCount = 6;
+		range.faceSize = 3;
+		geometry.meshRanges.push_back(range);
+		for(UINT32 index : {0, 1, 2, 2, 1, 3}) geometry.indices.push_back(index);
+	}
+	geometry.meshBounds.resize(2);
+	InstanceTransform identity = {{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}}};
+	geometry.instances.assign(3, identity);
+	geometry.meshInstances = {1, 1, 3};
+	return geometry;
+}
+
+static CacheKey MakeKey()
+{
+	CacheKey key = {};
+	key.contentHash = 0x0123456789abcdefULL;
+	key.fileSize = 1234;
+	key.importFlags = 1;
+	key.processFlags = 2;
+	return key;
+}
+
+static std::filesystem::path UseTestDirectory()
+{
+	std::error_code error;
+	std::filesystem::path directory = std::filesystem::temp_directory_path(error) / "ModelViewerTests" / "cache";
+	std::filesystem::remove_all(directory, error);
+	ModelCache::Directory() = directory;
+	return directory;
+}
+
+static bool Save(const CacheKey& key, const CacheGeometry& geometry)
+{
+	return ModelCache::Save(key, geometry.vertices, geometry.indices, geometry.meshRanges, geometry.bounds, geometry.meshBounds,
+		geometry.instances, geometry.meshInstances);
+}
+
+static bool Load(const CacheKey& key, std::unique_ptr<MappedFile>& file, ArrayView<Vertex>& vertices, CacheGeometry& geometry)
+{
+	return ModelCache::Load(key, file, vertices, geometry.indices, geometry.meshRanges, geometry.bounds, geometry.meshBounds,
+		geometry.instances, geometry.meshInstances);
+}
+
+static std::vector<std::filesystem::path> CacheFiles(const std::filesystem::path& directory)
+{
+	std::vector<std::filesystem::path> files;
+	std::error_code error;
+	for(std::filesystem::directory_iterator it(directory, error), end; !error && it != end; it.increment(error))
+		files.push_back(it->path());
+	return files;
+}
+
+TEST(CacheRoundTripMapsVertices)
+{
+	UseTestDirectory();
+	CacheGeometry saved = MakeGeometry();
+	if(!CHECK(Save(MakeKey(), saved))) return;
+
+	std::unique_ptr<MappedFile> file;
+	ArrayView<Vertex> vertices;
+	CacheGeometry loaded;
+	if(!CHECK(Load(MakeKey(), file, vertices, loaded))) return;
+	CHECK(file && vertices.data() >= (const Vertex*)file->Data() && vertices.end() <= (const Vertex*)(file->Data() + file->Size()));
+	CHECK(vertices.size() == saved.vertices.size() && memcmp(vertices.data(), saved.vertices.data(), vertices.size() * sizeof(Vertex)) == 0);
+	CHECK(loaded.indices == saved.indices);
+	CHECK(loaded.meshInstances == saved.meshInstances);
+	CHECK(loaded.meshRanges.size() == 2 && memcmp(loaded.meshRanges.data(), saved.meshRanges.data(), 2 * sizeof(MeshRange)) == 0);
+
+	CacheKey other = MakeKey();
+	other.processFlags ^= 1;
+	CacheGeometry missed;
+	CHECK(!Load(other, file, vertices, missed));
+}
+
+TEST(CacheRejectsTruncatedFile)
+{
+	std::filesystem::path directory = UseTestDirectory();
+	if(!CHECK(Save(MakeKey(), MakeGeometry()))) return;
+	std::vector<std::filesystem::path> files = CacheFiles(directory);
+	if(!CHECK(files.size() == 1)) return;
+	std::filesystem::resize_file(files[0], std::filesystem::file_size(files[0]) - 4);
+
+	std::unique_ptr<MappedFile> file;
+	ArrayView<Vertex> vertices;
+	CacheGeometry loaded;
+	CHECK(!Load(MakeKey(), file, vertices, loaded));
+	CHECK(!file && vertices.empty());
+	CHECK(CacheFiles(directory).empty());
+}
+
+// Save writes whatever it is given, which stands in for a file damaged on disk.
+TEST(CacheRejectsRangesOutsideTheArrays)
+{
+	std::filesystem::path directory = UseTestDirectory();
+	std::unique_ptr<MappedFile> file;
+	ArrayView<Vertex> vertices;
+	CacheGeometry loaded;
+
+	CacheGeometry geometry = MakeGeometry();
+	geometry.meshRanges[1].vertexCount = 5;
+	CHECK(Save(MakeKey(), geometry) && !Load(MakeKey(), file, vertices, loaded));
+
+	geometry = MakeGeometry();
+	geometry.meshRanges[1].firstIndex = 0xfffffffe;
+	CHECK(Save(MakeKey(), geometry) && !Load(MakeKey(), file, vertices, loaded));
+
+	geometry = MakeGeometry();
+	geometry.indices[7] = 4;
+	CHECK(Save(MakeKey(), geometry) && !Load(MakeKey(), file, vertices, loaded));
+
+	geometry = MakeGeometry();
+	geometry.meshInstances[2] = 4;
+	CHECK(Save(MakeKey(), geometry) && !Load(MakeKey(), file, vertices, loaded));
+
+	CHECK(!file);
+	CHECK(CacheFiles(directory).empty());
+}
+
+TEST(CacheLodsRoundTripAndRejectForeignMeshes)
+{
+	UseTestDirectory();
+	CacheGeometry geometry = MakeGeometry();
+	std::vector<UINT32> lodIndices = {0, 1, 2, 1, 2, 3};
+	std::vector<MeshLod> lods = {{0, 3, 0.5f}, {3, 3, 0.25f}};
+	std::vector<UINT> meshLods = {0, 1, 2};
+	if(!CHECK(ModelCache::SaveLods(MakeKey(), lodIndices, lods, meshLods))) return;
+
+	std::vector<UINT32> loadedIndices;
+	std::vector<MeshLod> loadedLods;
+	std::vector<UINT> loadedMeshLods;
+	if(!CHECK(ModelCache::LoadLods(MakeKey(), geometry.meshRanges, loadedIndices, loadedLods, loadedMeshLods))) return;
+	CHECK(loadedIndices == lodIndices && loadedMeshLods == meshLods);
+	CHECK(loadedLods.size() == 2 && memcmp(loadedLods.data(), lods.data(), sizeof(MeshLod) * 2) == 0);
+
+	// The second mesh shrinks to three vertices, so its level indexes a vertex it no longer has.
+	geometry.meshRanges[1].vertexCount = 3;
+	CHECK(!ModelCache::LoadLods(MakeKey(), geometry.meshRanges, loadedIndices, loadedLods, loadedMeshLods));
+	geometry = MakeGeometry();
+	CHECK(!ModelCache::LoadLods(MakeKey(), geometry.meshRanges, loadedIndices, loadedLods, loadedMeshLods));
+}
+
+TEST(CacheTrimDropsLeastRecentlyUsed)
+{
+	std::filesystem::path directory = UseTestDirectory();
+	std::filesystem::create_directories(directory);
+	auto now = std::filesystem::file_time_type::clock::now();
+	std::vector<std::filesystem::path> files;
+	for(int i = 0; i < 4; ++i)
+	{
+		files.push_back(directory / ("file" + std::to_string(i) + ".mvc"));
+		std::ofstream(files[i], std::ios::binary) << std::string(1000, 'x');
+		std::filesystem::last_write_time(files[i], now - std::chrono::hours(10 - i));
+	}
+	std::ofstream(directory / "other.txt") << std::string(5000, 'x');
+
+	// file0 is the oldest but is the one just written.
+	ModelCache::Trim(directory, 2500, files[0]);
+	CHECK(std::filesystem::exists(files[0]));
+	CHECK(!std::filesystem::exists(files[1]));
+	CHECK(!std::filesystem::exists(files[2]));
+	CHECK(std::filesystem::exists(files[3]));
+	CHECK(std::filesystem::exists(directory / "other.txt"));
+}
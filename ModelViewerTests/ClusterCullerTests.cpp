@@ -0,0 +1,87 @@
+#include "Test.h"
+#include "ClusterCuller.h"
+#include "TestScenes.h"
+#include <chrono>
+
+// Clusters scattered in a cube of side 20 around the origin, with random cones; every fourth one has none.
+static ClusterBounds RandomClusters(UINT count, UINT seed)
+{
+	std::mt19937 random(seed);
+	std::uniform_real_distribution<float> unit(-1, 1), size(0.05f, 1.0f);
+	ClusterBounds bounds;
+	bounds.Resize(count);
+	for(UINT i = 0; i < count; ++i)
+	{
+		XMFLOAT3 center = TestScenes::RandomPoint(random, 10);
+		bounds.centerX[i] = center.x;
+		bounds.centerY[i] = center.y;
+		bounds.centerZ[i] = center.z;
+		bounds.radius[i] = size(random);
+		XMFLOAT3 axis = TestScenes::RandomDirection(random);
+		bounds.axisX[i] = axis.x;
+		bounds.axisY[i] = axis.y;
+		bounds.axisZ[i] = axis.z;
+		bounds.cutoff[i] = i % 4 == 3 ? 1 : unit(random);
+	}
+	return bounds;
+}
+
+static XMMATRIX ViewProjection(FXMVECTOR eye, FXMVECTOR target)
+{
+	return TestScenes::ViewProjection(eye, target, 1.5f, 0.1f, 100);
+}
+
+TEST(ClusterCullingMatchesScalarPath)
+{
+	ClusterBounds bounds = RandomClusters(TestScenes::oddCount, 3);
+	CHECK(TestScenes::CameraMismatches(5, 50, 25, 5, [&](FXMVECTOR eye, FXMVECTOR target) {
+		XMMATRIX viewProjection = ViewProjection(eye, target);
+		std::vector<BYTE> simd, scalar;
+		UINT simdCount = ClusterCuller::Cull(bounds, eye, viewProjection, simd);
+		return simdCount == ClusterCuller::CullScalar(bounds, eye, viewProjection, scalar) && simd == scalar;
+	}) == 0);
+}
+
+TEST(ClusterCullingRejectsOutsideAndBackFacing)
+{
+	ClusterBounds bounds;
+	bounds.Resize(3);
+	float centers[3][3] = {{0, 0, 10}, {0, 0, -10}, {0, 0, 10}};
+	for(UINT i = 0; i < 3; ++i)
+	{
+		bounds.centerX[i] = centers[i][0];
+		bounds.centerY[i] = centers[i][1];
+		bounds.centerZ[i] = centers[i][2];
+		bounds.radius[i] = 1;
+	}
+	// The third cluster faces +z, away from an eye at the origin, within a narrow cone.
+	bounds.axisZ[2] = 1;
+	bounds.cutoff[2] = 0.5f;
+
+	XMVECTOR eye = XMVectorZero();
+	std::vector<BYTE> visible;
+	CHECK(ClusterCuller::Cull(bounds, eye, ViewProjection(eye, XMVectorSet(0, 0, 1, 0)), visible) == 1);
+	CHECK(visible[0] == 1 && visible[1] == 0 && visible[2] == 0);
+}
+
+BENCHMARK(ClusterCullingFourMillionTests)
+{
+	ClusterBounds bounds = RandomClusters(1 << 16, 9);
+	XMVECTOR eye = XMVectorSet(0, 0, -30, 0);
+	XMMATRIX viewProjection = ViewProjection(eye, XMVectorZero());
+	const int repeats = (1 << 22) / bounds.count;
+
+	std::vector<BYTE> simd, scalar;
+	UINT visible = 0, scalarVisible = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	for(int r = 0; r < repeats; ++r) visible = ClusterCuller::Cull(bounds, eye, viewProjection, simd);
+	double simdMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	start = std::chrono::high_resolution_clock::now();
+	for(int r = 0; r < repeats; ++r) scalarVisible = ClusterCuller::CullScalar(bounds, eye, viewProjection, scalar);
+	double scalarMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	double tested = (double)bounds.count * repeats;
+	printf("culling %.0f clusters/ms with SSE, %.0f scalar, %u of %u visible\n",
+		tested / max(simdMs, 0.001), tested / max(scalarMs, 0.001), visible, bounds.count);
+	CHECK(visible == scalarVisible && simd == scalar);
+}
@@ -0,0 +1,127 @@
+#include "Test.h"
+#include "EdgeExtractor.h"
+#include <chrono>
+#include <random>
+
+// A size x size grid of unit quads as Assimp gives it: every quad has its own four corner vertices and
+// is split into two triangles along the diagonal from corner 0 to corner 2.
+static void CornerGrid(UINT size, std::vector<Vertex>& vertices, std::vector<UINT32>& indices, std::vector<MeshRange>& ranges)
+{
+	MeshRange range = {};
+	range.baseVertex = vertices.size();
+	range.firstIndex = indices.size();
+	range.faceSize = 3;
+	range.cornerVertices = 1;
+	for(UINT y = 0; y < size; ++y)
+		for(UINT x = 0; x < size; ++x)
+		{
+			UINT32 first = vertices.size() - range.baseVertex;
+			for(UINT k = 0; k < 4; ++k)
+			{
+				Vertex vertex = {};
+				vertex.position = {(float)(x + (k == 1 || k == 2)), (float)(y + (k >= 2)), 0};
+				vertices.push_back(vertex);
+			}
+			for(UINT32 k : {0, 1, 2, 0, 2, 3}) indices.push_back(first + k);
+		}
+	range.vertexCount = vertices.size() - range.baseVertex;
+	range.indexCount = indices.size() - range.firstIndex;
+	ranges.push_back(range);
+}
+
+// Shuffles the triangles of every mesh, the way the optimizer and the meshlet builder reorder them.
+static void ShuffleTriangles(std::vector<UINT32>& indices, const std::vector<MeshRange>& ranges, UINT seed)
+{
+	std::mt19937 random(seed);
+	for(const MeshRange& range : ranges)
+	{
+		UINT faces = range.indexCount / 3;
+		for(UINT f = faces; f > 1; --f)
+		{
+			UINT other = random() % f;
+			for(UINT k = 0; k < 3; ++k) std::swap(indices[range.firstIndex + (f - 1) * 3 + k], indices[range.firstIndex + other * 3 + k]);
+		}
+	}
+}
+
+TEST(EdgesOfUnweldedQuadsAreCountedOnce)
+{
+	const UINT size = 20, outline = 2 * size * (size + 1), diagonals = size * size;
+	std::vector<Vertex> vertices;
+	std::vector<UINT32> indices, lines;
+	std::vector<MeshRange> ranges;
+	CornerGrid(size, vertices, indices, ranges);
+	ShuffleTriangles(indices, ranges, 1);
+
+	EdgeStats all = EdgeExtractor::Extract(vertices, indices, ranges, lines);
+	CHECK(all.faceEdges == size * size * 6 && all.diagonals == 0);
+	CHECK(lines.size() == (outline + diagonals) * 2 && ranges[0].lineIndexCount == lines.size());
+
+	EdgeStats outlines = EdgeExtractor::Extract(vertices, indices, ranges, lines, true);
+	CHECK(outlines.diagonals == diagonals);
+	CHECK(lines.size() == outline * 2);
+	// Every line still runs between two vertices of its own mesh, along x or y.
+	bool alongAxes = true;
+	for(size_t i = 0; i < lines.size(); i += 2)
+	{
+		const XMFLOAT3& a = vertices[lines[i]].position;
+		const XMFLOAT3& b = vertices[lines[i + 1]].position;
+		alongAxes = alongAxes && lines[i] < vertices.size() && lines[i + 1] < vertices.size() && (a.x == b.x) != (a.y == b.y);
+	}
+	CHECK(alongAxes);
+}
+
+// Meshes at the same place keep their own edges, and a welded mesh keeps its diagonals, since its faces
+// share vertices across polygons too.
+TEST(EdgesStayWithinTheirMesh)
+{
+	const UINT size = 8, outline = 2 * size * (size + 1), diagonals = size * size;
+	std::vector<Vertex> vertices;
+	std::vector<UINT32> indices, lines;
+	std::vector<MeshRange> ranges;
+	CornerGrid(size, vertices, indices, ranges);
+	CornerGrid(size, vertices, indices, ranges);
+
+	MeshRange welded = {};
+	welded.baseVertex = vertices.size();
+	welded.firstIndex = indices.size();
+	welded.faceSize = 3;
+	for(UINT y = 0; y <= size; ++y)
+		for(UINT x = 0; x <= size; ++x)
+		{
+			Vertex vertex = {};
+			vertex.position = {(float)x, (float)y, 0};
+			vertices.push_back(vertex);
+		}
+	for(UINT y = 0; y < size; ++y)
+		for(UINT x = 0; x < size; ++x)
+		{
+			UINT32 a = y * (size + 1) + x, b = a + 1, c = a + size + 2, d = a + size + 1;
+			for(UINT32 index : {a, b, c, a, c, d}) indices.push_back(index);
+		}
+	welded.vertexCount = vertices.size() - welded.baseVertex;
+	welded.indexCount = indices.size() - welded.firstIndex;
+	ranges.push_back(welded);
+	ShuffleTriangles(indices, ranges, 2);
+
+	EdgeStats stats = EdgeExtractor::Extract(vertices, indices, ranges, lines, true);
+	CHECK(stats.diagonals == 2 * diagonals);
+	CHECK(ranges[0].lineIndexCount == outline * 2 && ranges[1].lineIndexCount == outline * 2);
+	CHECK(ranges[2].lineIndexCount == (outline + diagonals) * 2);
+	CHECK(ranges[1].firstLineIndex == outline * 2 && ranges[2].firstLineIndex == outline * 4);
+}
+
+BENCHMARK(EdgeExtractionMillionQuads)
+{
+	std::vector<Vertex> vertices;
+	std::vector<UINT32> indices, lines;
+	std::vector<MeshRange> ranges;
+	CornerGrid(1000, vertices, indices, ranges);
+	ShuffleTriangles(indices, ranges, 1);
+	auto start = std::chrono::high_resolution_clock::now();
+	EdgeStats stats = EdgeExtractor::Extract(vertices, indices, ranges, lines, true);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	CHECK(lines.size() == 2 * 2 * 1000 * 1001);
+	printf("edges of 1M unwelded quads: %u face edges to %u edges, %u diagonals left out, in %.1f ms\n",
+		stats.faceEdges, (UINT)(lines.size() / 2), stats.diagonals, ms);
+}
@@ -0,0 +1,70 @@
+#include "Test.h"
+#include "TestScenes.h"
+#include <chrono>
+
+// Boxes scattered in a cube of side 2000 around the origin; every tenth one is empty.
+static BoxBounds RandomBoxes(UINT count, UINT seed)
+{
+	return TestScenes::Pack(TestScenes::RandomBoxes(count, seed, 1000, 0.5f, 20, 10));
+}
+
+static XMMATRIX ViewProjection(FXMVECTOR eye, FXMVECTOR target)
+{
+	return TestScenes::ViewProjection(eye, target, 16.0f / 9, 1, 2000);
+}
+
+TEST(FrustumCullingPathsAgree)
+{
+	BoxBounds boxes = RandomBoxes(TestScenes::oddCount, 7);
+	CHECK(TestScenes::CameraMismatches(11, 50, 1500, 500, [&](FXMVECTOR eye, FXMVECTOR target) {
+		XMFLOAT4 planes[6];
+		ClusterCuller::ExtractPlanes(ViewProjection(eye, target), planes);
+		std::vector<BYTE> scalar(boxes.count), sse(boxes.count), avx(boxes.count);
+		UINT scalarCount = FrustumCuller::CullScalar(boxes, planes, scalar);
+		bool agree = FrustumCuller::CullSse(boxes, planes, sse) == scalarCount && sse == scalar;
+		if(FrustumCuller::HasAvx()) agree = agree && FrustumCuller::CullAvx(boxes, planes, avx) == scalarCount && avx == scalar;
+		return agree;
+	}) == 0);
+}
+
+TEST(FrustumCullingKeepsBoxesInViewOnly)
+{
+	std::vector<Bounds> placed(4);
+	placed[0].boxMin = {-1, -1, -1};
+	placed[0].boxMax = {1, 1, 1};
+	placed[1].boxMin = {-1, -1, -300};
+	placed[1].boxMax = {1, 1, -200};
+	// Straddles the left plane, so only part of it is in view; the last box stays empty.
+	placed[2].boxMin = {-200, -1, 0};
+	placed[2].boxMax = {-30, 1, 2};
+	BoxBounds boxes = TestScenes::Pack(placed);
+
+	std::vector<BYTE> visible;
+	UINT count = FrustumCuller::Cull(boxes, ViewProjection(XMVectorSet(0, 0, -100, 1), XMVectorZero()), visible);
+	CHECK(count == 2 && visible.size() == 4);
+	CHECK(visible[0] && !visible[1] && visible[2] && !visible[3]);
+}
+
+// Every path over 100000 boxes around a camera looking down +z.
+BENCHMARK(FrustumCullingHundredThousandBoxes)
+{
+	const UINT count = 100000;
+	BoxBounds boxes = RandomBoxes(count, 1);
+	XMFLOAT4 planes[6];
+	ClusterCuller::ExtractPlanes(ViewProjection(XMVectorSet(0, 0, -1500, 1), XMVectorZero()), planes);
+
+	const int repeats = 100;
+	std::vector<BYTE> scalarVisible(count), sseVisible(count), avxVisible(count);
+	UINT visible = 0;
+	auto time = [&](auto cull, std::vector<BYTE>& out) {
+		auto start = std::chrono::high_resolution_clock::now();
+		for(int r = 0; r < repeats; ++r) visible = cull(boxes, planes, out);
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / repeats;
+	};
+	bool avx = FrustumCuller::HasAvx();
+	double scalarMs = time(FrustumCuller::CullScalar, scalarVisible);
+	double sseMs = time(FrustumCuller::CullSse, sseVisible);
+	double avxMs = avx ? time(FrustumCuller::CullAvx, avxVisible) : 0;
+	CHECK(sseVisible == scalarVisible && (!avx || avxVisible == scalarVisible));
+	printf("frustum culling of %u boxes, %u visible: scalar %.3f ms, SSE %.3f ms, AVX %.3f ms\n", count, visible, scalarMs, sseMs, avxMs);
+}
@@ -0,0 +1,123 @@
+#include "Test.h"
+#include "GeometryArena.h"
+#include <chrono>
+
+// One mesh per vertex count, each a fan of triangles over its vertices.
+static void FanMeshes(const std::vector<UINT>& vertexCounts, std::vector<Vertex>& vertices, std::vector<UINT32>& indices, std::vector<MeshRange>& ranges)
+{
+	for(UINT count : vertexCounts)
+	{
+		MeshRange range = {};
+		range.baseVertex = vertices.size();
+		range.vertexCount = count;
+		range.firstIndex = indices.size();
+		range.faceSize = 3;
+		for(UINT v = 0; v < count; ++v)
+		{
+			Vertex vertex = {};
+			vertex.position = {(float)range.baseVertex, (float)v, 0};
+			vertices.push_back(vertex);
+		}
+		for(UINT v = 1; v + 1 < count; ++v)
+			for(UINT32 index : {0u, v, v + 1}) indices.push_back(index);
+		range.indexCount = indices.size() - range.firstIndex;
+		ranges.push_back(range);
+	}
+}
+
+static UINT32 ReadIndex(const GeometryArena& arena, const DrawRange& draw, UINT k)
+{
+	if(draw.format == DXGI_FORMAT_R16_UINT) return reinterpret_cast<const UINT16*>(arena.indexData.data())[draw.firstIndex + k];
+	return reinterpret_cast<const UINT32*>(arena.indexData.data())[draw.firstIndex + k];
+}
+
+TEST(ArenaCopiesVerticesOnlyOnUpload)
+{
+	std::vector<Vertex> first(1000), second(70000);
+	for(UINT v = 0; v < first.size(); ++v) first[v].position = {1, (float)v, 0};
+	for(UINT v = 0; v < second.size(); ++v) second[v].position = {2, (float)v, 0};
+
+	GeometryArena arena;
+	UINT firstBase = arena.AddVertices(first.data(), first.size());
+	UINT secondBase = arena.AddVertices(second.data(), second.size());
+	CHECK(firstBase == 0 && secondBase == first.size());
+	CHECK(arena.VertexCount() == first.size() + second.size());
+
+	// Changes before the upload show up in it: nothing was copied yet.
+	second.back().position.z = 5;
+	std::vector<Vertex> uploaded(arena.VertexCount());
+	arena.CopyVertices(uploaded.data());
+	CHECK(memcmp(uploaded.data() + firstBase, first.data(), first.size() * sizeof(Vertex)) == 0);
+	CHECK(memcmp(uploaded.data() + secondBase, second.data(), second.size() * sizeof(Vertex)) == 0);
+
+	arena.ReleaseStaging();
+	CHECK(arena.vertexSpans.empty() && arena.VertexCount() == first.size() + second.size());
+}
+
+TEST(ArenaPacksMeshesByIndexWidth)
+{
+	std::vector<Vertex> vertices;
+	std::vector<UINT32> indices;
+	std::vector<MeshRange> ranges;
+	FanMeshes({30000, 30000, 10000, 70000, 100}, vertices, indices, ranges);
+	IndexStore store;
+	store.Build(indices, ranges, &MeshRange::firstIndex, &MeshRange::indexCount);
+
+	GeometryArena arena;
+	UINT base = arena.AddVertices(vertices.data(), vertices.size());
+	std::vector<DrawRange> meshDraws;
+	std::vector<DrawRange> draws = arena.AddMeshes(store, ranges, base, &meshDraws);
+	if(!CHECK(meshDraws.size() == ranges.size())) return;
+
+	// The first two meshes share a 16-bit range, the third does not fit in it, the fourth needs 32 bits.
+	CHECK(meshDraws[0].format == DXGI_FORMAT_R16_UINT && meshDraws[1].baseVertex == meshDraws[0].baseVertex);
+	CHECK(meshDraws[2].format == DXGI_FORMAT_R16_UINT && meshDraws[2].baseVertex == ranges[2].baseVertex);
+	CHECK(meshDraws[3].format == DXGI_FORMAT_R32_UINT);
+	CHECK(meshDraws[4].format == DXGI_FORMAT_R16_UINT);
+	CHECK(draws.size() == 4);
+
+	UINT wrong = 0;
+	for(int i = 0; i < (int)ranges.size(); ++i)
+		for(UINT k = 0; k < ranges[i].indexCount; ++k)
+			wrong += meshDraws[i].baseVertex + ReadIndex(arena, meshDraws[i], k) != base + ranges[i].baseVertex + indices[ranges[i].firstIndex + k];
+	CHECK(wrong == 0);
+}
+
+TEST(RangeAllocatorReusesAndCoalescesFreedBlocks)
+{
+	RangeAllocator allocator;
+	UINT a = allocator.Allocate(100), b = allocator.Allocate(50), c = allocator.Allocate(100);
+	CHECK(a == 0 && b == 100 && c == 150 && allocator.Capacity() == 250);
+	allocator.Free(a, 100);
+	allocator.Free(b, 50);
+	CHECK(allocator.FreeSize() == 150);
+	CHECK(allocator.Allocate(120) == 0);
+	CHECK(allocator.Allocate(40, 4) == 252 && allocator.Capacity() == 292);
+}
+
+BENCHMARK(ArenaTenThousandMeshes)
+{
+	std::vector<Vertex> vertices;
+	std::vector<UINT32> indices;
+	std::vector<MeshRange> ranges;
+	FanMeshes(std::vector<UINT>(10000, 500), vertices, indices, ranges);
+	IndexStore store;
+	store.Build(indices, ranges, &MeshRange::firstIndex, &MeshRange::indexCount);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	GeometryArena arena;
+	UINT base = arena.AddVertices(vertices.data(), vertices.size());
+	std::vector<DrawRange> meshDraws;
+	std::vector<DrawRange> draws = arena.AddMeshes(store, ranges, base, &meshDraws);
+	double buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	std::vector<Vertex> uploaded(arena.VertexCount());
+	start = std::chrono::high_resolution_clock::now();
+	arena.CopyVertices(uploaded.data());
+	double copyMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	printf("arena of %d meshes, %.1f MB of vertices: built in %.2f ms into %d draws, vertices copied to upload in %.2f ms (%.1f GB/s)\n",
+		(int)ranges.size(), vertices.size() * sizeof(Vertex) / 1048576.0, buildMs, (int)draws.size(), copyMs,
+		vertices.size() * sizeof(Vertex) / 1e6 / max(copyMs, 0.001));
+	CHECK(memcmp(uploaded.data(), vertices.data(), vertices.size() * sizeof(Vertex)) == 0);
+	CHECK(meshDraws.size() == ranges.size());
+}
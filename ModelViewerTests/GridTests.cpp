@@ -0,0 +1,103 @@
+#include "Test.h"
+#include "GridBuilder.h"
+#include <random>
+#include <chrono>
+
+static const XMFLOAT3 background{55 / 255.0f, 56 / 255.0f, 59 / 255.0f};
+
+// Inside the clip volume of the camera, with a little slack for the clipping done on the y = 0 plane.
+static bool InsideView(const Camera& camera, XMFLOAT3 position)
+{
+	XMFLOAT4 clip;
+	XMStoreFloat4(&clip, XMVector4Transform(XMVectorSet(position.x, position.y, position.z, 1), camera.getViewMatrix() * camera.getProjectMatrix()));
+	float slack = 1e-3f * fabsf(clip.w) + 1e-2f;
+	return clip.w > 0 && fabsf(clip.x) <= clip.w + slack && fabsf(clip.y) <= clip.w + slack && clip.z >= -slack && clip.z <= clip.w + slack;
+}
+
+static Camera RandomCamera(std::mt19937& random)
+{
+	std::uniform_real_distribution<double> unit(0, 1);
+	Camera camera(1.6);
+	camera.theta = unit(random) * 2 * PI;
+	camera.phi = (unit(random) * 2 - 1) * 1.5;
+	camera.radius = 1 + unit(random) * 9999;
+	camera.origin = XMVectorSet((float)(unit(random) * 2 - 1) * 3000, (float)(unit(random) * 2 - 1) * 2000, (float)(unit(random) * 2 - 1) * 3000, 1);
+	return camera;
+}
+
+// Every grid vertex lies in the view and the count stays within maxVertices, from any camera; the six axis
+// vertices at the end run far past the view on purpose.
+TEST(GridStaysInsideTheViewFromRandomCameras)
+{
+	std::mt19937 random(1);
+	std::vector<Vertex> lines;
+	UINT outside = 0, overflows = 0;
+	for(int c = 0; c < 2000; ++c)
+	{
+		Camera camera = RandomCamera(random);
+		UINT count = GridBuilder::Build(camera, {1, 1, 1}, background, lines);
+		if(count > GridBuilder::maxVertices || count != lines.size() || count % 2 != 0) ++overflows;
+		for(UINT i = 0; i + 6 < count; ++i)
+			if(!InsideView(camera, lines[i].position)) ++outside;
+	}
+	CHECK(outside == 0);
+	CHECK(overflows == 0);
+}
+
+// The spacing follows the eye height, and lines fade from their color at the eye to the background at
+// the reach of their level.
+TEST(GridSpacingAndFadeFollowTheEye)
+{
+	Camera camera;
+	camera.phi = -1.5;
+	camera.origin = XMVectorSet(0, 0, 0, 1);
+	std::vector<Vertex> lines;
+	for(double radius : {10.0, 500.0, 9000.0})
+	{
+		camera.radius = radius;
+		XMFLOAT3 eye;
+		XMStoreFloat3(&eye, camera.getCameraPos());
+		UINT count = GridBuilder::Build(camera, {0, 0, 0}, background, lines);
+		if(!CHECK(count > 0)) continue;
+
+		float expected = powf(10, floorf(log10f(fabsf(eye.y) / 10)));
+		expected = min(max(expected, GridBuilder::minSpacing), GridBuilder::maxSpacing);
+		bool onSpacing = true, faded = true;
+		for(UINT i = 0; i < count; i += 2)
+		{
+			const XMFLOAT3& begin = lines[i].position;
+			float fixed = begin.x == lines[i + 1].position.x ? begin.x : begin.z;
+			onSpacing = onSpacing && fabsf(fixed - roundf(fixed / expected) * expected) < 1e-3f * expected;
+			for(UINT k = i; k < i + 2; ++k)
+				faded = faded && lines[k].normal.x >= background.x - 1e-5f && lines[k].normal.x <= GridBuilder::majorColor.x + 1e-5f;
+		}
+		CHECK(onSpacing);
+		CHECK(faded);
+	}
+}
+
+TEST(GridLeavesHiddenAxesToGridLines)
+{
+	Camera camera;
+	std::vector<Vertex> lines;
+	UINT withAxes = GridBuilder::Build(camera, {1, 1, 1}, background, lines);
+	CHECK(lines[withAxes - 1].normal.x == GridBuilder::zaxisColor.x && lines[withAxes - 1].position.z == GridBuilder::axisLength);
+	UINT without = GridBuilder::Build(camera, {0, 0, 0}, background, lines);
+	bool axisColors = false;
+	for(const Vertex& vertex : lines) axisColors = axisColors || vertex.normal.x == GridBuilder::xaxisColor.x || vertex.normal.x == GridBuilder::zaxisColor.x;
+	CHECK(!axisColors);
+	CHECK(without + 6 >= withAxes);
+}
+
+BENCHMARK(GridBuildPerFrame)
+{
+	Camera camera;
+	std::vector<Vertex> lines;
+	const int builds = 10000;
+	size_t vertices = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	for(int i = 0; i < builds; ++i) vertices += GridBuilder::Build(camera, {1, 1, 1}, background, lines);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	CHECK(vertices > 0 && vertices / builds <= GridBuilder::maxVertices);
+	printf("grid: %.2f us per build, %u vertices for the default camera\n", ms * 1000 / builds, (UINT)(vertices / builds));
+}
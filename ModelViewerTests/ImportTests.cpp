@@ -0,0 +1,294 @@
+#include "Test.h"
+#include "Model.h"
+#include "ModelFiles.h"
+
+// Extraction the way it was done before it was split into passes: mesh after mesh, every vertex and
+// index appended in turn. Meshes come in the order Model takes them, the ones referenced by a single node
+// first with that node's transform baked in.
+static void ExtractSerially(const aiScene* scene, std::vector<Vertex>& vertices, std::vector<UINT32>& indices, std::vector<MeshRange>& ranges)
+{
+	SceneGraph graph;
+	graph.Flatten(scene->mRootNode);
+	std::vector<std::vector<UINT>> meshNodes = graph.MeshNodes(scene->mNumMeshes);
+	std::vector<std::pair<UINT, InstanceTransform>> order;
+	for(UINT m = 0; m < scene->mNumMeshes; ++m)
+		if(meshNodes[m].size() == 1) order.push_back({m, graph.World(meshNodes[m][0])});
+	for(UINT m = 0; m < scene->mNumMeshes; ++m)
+		if(meshNodes[m].size() > 1) order.push_back({m, SceneGraph::Identity()});
+
+	for(auto& [m, transform] : order)
+	{
+		const aiMesh* mesh = scene->mMeshes[m];
+		MeshRange range = {};
+		range.baseVertex = vertices.size();
+		range.vertexCount = mesh->mNumVertices;
+		range.firstIndex = indices.size();
+		if(mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE) range.faceSize = 3;
+		else if(mesh->mPrimitiveTypes == aiPrimitiveType_LINE) range.faceSize = 2;
+		else if(mesh->mPrimitiveTypes == aiPrimitiveType_POINT) range.faceSize = 1;
+		for(UINT i = 0; i < mesh->mNumVertices; ++i)
+		{
+			Vertex vertex;
+			vertex.position = {mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z};
+			if(mesh->mNormals) vertex.normal = {mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z};
+			else vertex.normal = {0, 0, 0};
+			if(mesh->mColors[0]) vertex.color = {mesh->mColors[0][i].r, mesh->mColors[0][i].g, mesh->mColors[0][i].b};
+			else vertex.color = {0, 0, 0};
+			if(!SceneGraph::IsIdentity(transform)) SceneGraph::Apply(transform, vertex);
+			vertices.push_back(vertex);
+		}
+		for(UINT f = 0; f < mesh->mNumFaces; ++f)
+			for(UINT j = 0; j < mesh->mFaces[f].mNumIndices; ++j) indices.push_back(mesh->mFaces[f].mIndices[j]);
+		range.indexCount = indices.size() - range.firstIndex;
+		ranges.push_back(range);
+	}
+}
+
+TEST(ExtractionMatchesSerialOrder)
+{
+	const char* fileName = "models/demo.fbx";
+	ImportOptions options;
+	options.useCache = false;
+	options.optimizeIndices = false;
+	options.buildLods = options.buildMeshlets = options.occlusionCulling = false;
+	ImportProgress progress;
+	Model model(fileName, progress, options);
+	if(!CHECK(model.Loaded())) return;
+
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(fileName, Model::importFlags);
+	if(!CHECK(scene && scene->mRootNode)) return;
+	std::vector<Vertex> vertices;
+	std::vector<UINT32> indices;
+	std::vector<MeshRange> ranges;
+	ExtractSerially(scene, vertices, indices, ranges);
+
+	CHECK(model.Vertices().size() == vertices.size());
+	CHECK(memcmp(model.Vertices().data(), vertices.data(), min(model.Vertices().size(), vertices.size()) * sizeof(Vertex)) == 0);
+	if(!CHECK(model.meshRanges.size() == ranges.size())) return;
+	UINT wrongIndices = 0;
+	for(int i = 0; i < (int)ranges.size(); ++i)
+	{
+		const MeshRange& range = model.meshRanges[i];
+		CHECK(range.baseVertex == ranges[i].baseVertex && range.vertexCount == ranges[i].vertexCount);
+		if(!CHECK(range.indexCount == ranges[i].indexCount)) continue;
+		for(UINT k = 0; k < range.indexCount; ++k) wrongIndices += model.triangleStore.Get(i, k) != indices[ranges[i].firstIndex + k];
+	}
+	CHECK(wrongIndices == 0);
+}
+
+// A load cancelled before it starts has to unwind from the first stage, the hash of the cache key,
+// and every long stage has to give up on its own when cancelled midway.
+TEST(CancelledLoadThrows)
+{
+	ImportProgress progress;
+	progress.Cancel();
+	bool thrown = false;
+	try
+	{
+		Model model("models/demo.fbx", progress);
+	}
+	catch(const ImportCancelled&)
+	{
+		thrown = true;
+	}
+	CHECK(thrown);
+
+	std::vector<Vertex> vertices;
+	std::vector<UINT32> indices;
+	std::vector<MeshRange> ranges;
+	for(int i = 0; i < 4; ++i)
+	{
+		Vertex vertex = {};
+		vertex.position = {float(i & 1), float(i >> 1), 0};
+		vertices.push_back(vertex);
+	}
+	for(UINT32 index : {0, 1, 2, 2, 1, 3}) indices.push_back(index);
+	ranges.push_back({0, 4, 0, 6, 0, 0, 3, 0});
+
+	auto throwsCancelled = [&](auto stage) {
+		try
+		{
+			stage();
+		}
+		catch(const ImportCancelled&)
+		{
+			return true;
+		}
+		return false;
+	};
+	std::vector<CacheStats> before, after;
+	CHECK(throwsCancelled([&] { MeshOptimizer::Optimize(vertices, indices, ranges, true, before, after, &progress); }));
+	std::vector<UINT32> lodIndices;
+	std::vector<MeshLod> lods;
+	std::vector<UINT> meshLods;
+	CHECK(throwsCancelled([&] { Simplifier::BuildLods(vertices, indices, ranges, lodIndices, lods, meshLods, &progress); }));
+	std::vector<Meshlet> meshlets;
+	std::vector<UINT> meshMeshlets;
+	ClusterBounds clusterBounds;
+	CHECK(throwsCancelled([&] { MeshletBuilder::Build(vertices, indices, ranges, meshlets, meshMeshlets, clusterBounds, &progress); }));
+	BYTE data[16] = {};
+	CHECK(throwsCancelled([&] { ModelCache::Hash(data, sizeof(data), &progress); }));
+}
+
+// Every mesh of the demo model with its vertex cache figures before and after optimization.
+BENCHMARK(VertexCachePerMesh)
+{
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile("models/demo.fbx", Model::importFlags);
+	if(!CHECK(scene && scene->mRootNode)) return;
+	std::vector<Vertex> vertices;
+	std::vector<UINT32> indices;
+	std::vector<MeshRange> ranges;
+	ExtractSerially(scene, vertices, indices, ranges);
+
+	std::vector<CacheStats> before, after;
+	MeshOptimizer::Optimize(vertices, indices, ranges, true, before, after);
+	for(int i = 0; i < (int)ranges.size(); ++i)
+		if(before[i].triangles > 0)
+			printf("mesh %d: %u triangles, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+				i, before[i].triangles, before[i].Acmr(), after[i].Acmr(), before[i].Atvr(), after[i].Atvr());
+	MeshOptimizer::Spread spread = MeshOptimizer::MeshSpread(after, &CacheStats::Acmr);
+	printf("ACMR after: min %.3f, median %.3f, p90 %.3f, max %.3f\n", spread.lowest, spread.median, spread.p90, spread.highest);
+	CacheStats totalBefore, totalAfter;
+	for(int i = 0; i < (int)ranges.size(); ++i)
+	{
+		totalBefore.Add(before[i]);
+		totalAfter.Add(after[i]);
+	}
+	CHECK(totalAfter.misses <= totalBefore.misses);
+}
+
+static double PeakWorkingSetMB()
+{
+	PROCESS_MEMORY_COUNTERS counters;
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return counters.PeakWorkingSetSize / 1048576.0;
+}
+
+static double ReadWithAssimp(const std::string& path)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	Assimp::Importer importer;
+	importer.SetIOHandler(new MappedIOSystem());
+	const aiScene* scene = importer.ReadFile(path, Model::importFlags);
+	CHECK(scene && scene->mRootNode);
+	return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// The same generated files through the native readers, as Model calls them, and through Assimp.
+BENCHMARK(NativeReadersAgainstAssimp)
+{
+	struct File { const char* name; std::string data; } files[] = {
+		{"large.obj", ModelFiles::Obj(1200, true)},
+		{"large.stl", ModelFiles::BinaryStl(1000)},
+		{"large.ply", ModelFiles::BinaryPly(1000)},
+		{"large.glb", ModelFiles::Glb(1000)}};
+	for(auto& file : files)
+	{
+		std::string path = ModelFiles::Write(file.name, file.data);
+		ImportOptions options;
+		options.useCache = false;
+		options.buildLods = options.buildMeshlets = options.occlusionCulling = false;
+		auto start = std::chrono::high_resolution_clock::now();
+		ImportProgress progress;
+		Model model(path, progress, options);
+		double nativeMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		CHECK(model.Loaded());
+		double assimpMs = ReadWithAssimp(path);
+		double megabytes = file.data.size() / 1048576.0;
+		printf("%s, %.1f MB: whole native load %.1f ms, Assimp read alone %.1f ms, %.1f MB/s against %.1f MB/s\n",
+			file.name, megabytes, nativeMs, assimpMs, megabytes / nativeMs * 1000, megabytes / assimpMs * 1000);
+		ModelFiles::Remove(path);
+	}
+}
+
+// A generated OBJ saved through the native writers, as Model::saveModel does, and through the Assimp round
+// trip that saveModel falls back on for other formats.
+BENCHMARK(NativeWritersAgainstAssimp)
+{
+	std::string source = ModelFiles::Write("export.obj", ModelFiles::Obj(1200, true));
+	ImportOptions options;
+	options.useCache = false;
+	options.buildLods = options.buildMeshlets = options.occlusionCulling = false;
+	ImportProgress progress;
+	Model model(source, progress, options);
+	if(!CHECK(model.Loaded())) return;
+
+	auto megabytes = [](const std::string& path) {
+		std::error_code error;
+		return std::filesystem::file_size(path, error) / 1048576.0;
+	};
+	for(const char* name : {"exported.obj", "exported.ply", "exported.stl"})
+	{
+		std::string path = ModelFiles::Path(name);
+		auto start = std::chrono::high_resolution_clock::now();
+		model.saveModel(path);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		CHECK(megabytes(path) > 0);
+		printf("%s, native writer: %.1f MB in %.1f ms, %.1f MB/s\n", name, megabytes(path), ms, megabytes(path) / ms * 1000);
+		ModelFiles::Remove(path);
+	}
+
+	std::string path = ModelFiles::Path("exported.assimp.obj");
+	auto start = std::chrono::high_resolution_clock::now();
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(source, 0);
+	Assimp::Exporter exporter;
+	CHECK(scene && exporter.Export(scene, "obj", path) == AI_SUCCESS);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	printf("Assimp round trip to obj: %.1f MB in %.1f ms, %.1f MB/s\n", megabytes(path), ms, megabytes(path) / ms * 1000);
+	ModelFiles::Remove(path);
+	ModelFiles::Remove(source);
+}
+
+// Peak working set is per process, so these run one at a time: --bench LargeGlbNative, --bench LargeGlbAssimp,
+// then --bench LargeGlbAssimpExtraction.
+static const UINT largeGlbSize = 4000;
+
+BENCHMARK(LargeGlbNative)
+{
+	std::string path = ModelFiles::Write("peak.glb", ModelFiles::Glb(largeGlbSize));
+	double before = PeakWorkingSetMB();
+	std::vector<Vertex> vertices;
+	std::vector<UINT32> indices;
+	std::vector<MeshRange> ranges;
+	std::vector<InstanceTransform> instances;
+	std::vector<UINT> meshInstances;
+	UINT64 bytes = 0;
+	auto start = std::chrono::high_resolution_clock::now();
+	CHECK(GltfReader::Read(path, vertices, indices, ranges, instances, meshInstances, bytes, nullptr));
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	printf("native GLB reader, %.1f MB in %.1f ms, peak working set %.1f MB (%.1f MB after writing the file)\n",
+		bytes / 1048576.0, ms, PeakWorkingSetMB(), before);
+	ModelFiles::Remove(path);
+}
+
+BENCHMARK(LargeGlbAssimp)
+{
+	std::string path = ModelFiles::Write("peak.glb", ModelFiles::Glb(largeGlbSize));
+	double before = PeakWorkingSetMB();
+	double ms = ReadWithAssimp(path);
+	printf("Assimp GLB reader in %.1f ms, peak working set %.1f MB (%.1f MB after writing the file)\n", ms, PeakWorkingSetMB(), before);
+	ModelFiles::Remove(path);
+}
+
+// Read and extraction through Model, which deletes every batch of extracted meshes from the scene; set
+// against LargeGlbAssimp, the difference is what extraction adds on top of the scene.
+BENCHMARK(LargeGlbAssimpExtraction)
+{
+	std::string path = ModelFiles::Write("peak.glb", ModelFiles::Glb(largeGlbSize));
+	double before = PeakWorkingSetMB();
+	ImportOptions options;
+	options.useCache = false;
+	options.nativeReaders = false;
+	options.optimizeIndices = false;
+	options.buildLods = options.buildMeshlets = options.occlusionCulling = false;
+	auto start = std::chrono::high_resolution_clock::now();
+	ImportProgress progress;
+	Model model(path, progress, options);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	CHECK(model.Loaded());
+	printf("Assimp GLB load in %.1f ms, peak working set %.1f MB (%.1f MB after writing the file)\n", ms, PeakWorkingSetMB(), before);
+	ModelFiles::Remove(path);
+}
@@ -0,0 +1,111 @@
+#include "Test.h"
+#include "LightClusterBuilder.h"
+#include "TestScenes.h"
+#include <chrono>
+
+static const float fovY = TestScenes::fovY, aspect = 16.0f / 9, nearZ = 1, farZ = 1000000;
+
+// A camera like the viewer's default one, looking at lights spread around the origin.
+static XMMATRIX View()
+{
+	return TestScenes::View(XMVectorSet(1200, 800, -1200, 1), XMVectorSet(0, 400, 0, 1));
+}
+
+static std::vector<PointLight> RandomLights(UINT count, UINT seed)
+{
+	std::uniform_real_distribution<float> brightness(50, 500);
+	return TestScenes::Random<PointLight>(count, seed, [&](std::mt19937& random, UINT) {
+		PointLight light;
+		light.position = TestScenes::RandomPoint(random, 1500);
+		float intensity = brightness(random);
+		light.color = {intensity, intensity, intensity};
+		light.radius = LightClusterBuilder::Radius(light.color);
+		light.unused = 0;
+		return light;
+	});
+}
+
+// Same lists in the same order as the brute force over every light and cluster box.
+static bool AgreesWithBruteForce(const LightClusterBuilder& builder, const std::vector<PointLight>& lights)
+{
+	std::vector<LightCluster> reference;
+	std::vector<UINT> referenceIndices;
+	builder.BuildScalar(lights, View(), fovY, aspect, nearZ, farZ, 100, 4000, reference, referenceIndices);
+	bool agree = builder.dropped == 0 && referenceIndices.size() == builder.lightIndices.size();
+	for(UINT c = 0; agree && c < LightClusterBuilder::clusterCount; ++c)
+	{
+		agree = reference[c].count == builder.clusters[c].count;
+		for(UINT k = 0; agree && k < reference[c].count; ++k)
+			agree = referenceIndices[reference[c].offset + k] == builder.lightIndices[builder.clusters[c].offset + k];
+	}
+	return agree;
+}
+
+TEST(LightClustersAgreeWithBruteForce)
+{
+	LightClusterBuilder builder;
+	for(UINT count : {1u, 7u, 1000u, 10000u})
+	{
+		std::vector<PointLight> lights = RandomLights(count, count);
+		builder.Build(lights, View(), fovY, aspect, nearZ, farZ, 100, 4000);
+		CHECK(AgreesWithBruteForce(builder, lights));
+	}
+}
+
+// A light reaching past the far plane is listed in every cluster, one behind the camera in none.
+TEST(LightClustersHonourTheLightRadius)
+{
+	std::vector<PointLight> lights(2);
+	lights[0] = {{0, 400, 0}, farZ, {1, 1, 1}, 0};
+	lights[1] = {{2400, 1600, -2400}, 100, {1, 1, 1}, 0};
+	LightClusterBuilder builder;
+	builder.Build(lights, View(), fovY, aspect, nearZ, farZ, 100, 4000);
+	bool everywhere = true;
+	for(const LightCluster& cluster : builder.clusters)
+		everywhere = everywhere && cluster.count == 1 && builder.lightIndices[cluster.offset] == 0;
+	CHECK(everywhere);
+	CHECK(builder.lightIndices.size() == LightClusterBuilder::clusterCount);
+}
+
+// Lights past maxLights are ignored, and entries past maxLightIndices are cut off and counted.
+TEST(LightClustersStayWithinTheirBuffers)
+{
+	std::vector<PointLight> lights(LightClusterBuilder::maxLights + 100, {{0, 400, 0}, farZ, {1, 1, 1}, 0});
+	LightClusterBuilder builder;
+	builder.Build(lights, View(), fovY, aspect, nearZ, farZ, 100, 4000);
+	UINT largest = 0;
+	for(UINT i : builder.lightIndices) largest = max(largest, i);
+	CHECK(largest < LightClusterBuilder::maxLights);
+	CHECK(builder.lightIndices.size() == LightClusterBuilder::maxLightIndices);
+	CHECK(builder.dropped == LightClusterBuilder::maxLights * LightClusterBuilder::clusterCount - LightClusterBuilder::maxLightIndices);
+	const LightCluster& last = builder.clusters.back();
+	CHECK(last.offset + last.count <= LightClusterBuilder::maxLightIndices);
+}
+
+BENCHMARK(LightClustersThousandAndTenThousandLights)
+{
+	for(UINT count : {1000u, 10000u})
+	{
+		std::vector<PointLight> lights = RandomLights(count, 1);
+		LightClusterBuilder builder;
+		const int repeats = 20;
+		double ms = 0;
+		for(int r = 0; r < repeats; ++r)
+		{
+			builder.Build(lights, View(), fovY, aspect, nearZ, farZ, 100, 4000);
+			ms += builder.buildMs / repeats;
+		}
+
+		std::vector<LightCluster> reference;
+		std::vector<UINT> referenceIndices;
+		auto start = std::chrono::high_resolution_clock::now();
+		builder.BuildScalar(lights, View(), fovY, aspect, nearZ, farZ, 100, 4000, reference, referenceIndices);
+		double scalarMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		CHECK(AgreesWithBruteForce(builder, lights));
+
+		UINT busiest = 0;
+		for(auto& cluster : builder.clusters) busiest = max(busiest, cluster.count);
+		printf("light clusters for %u lights: %.3f ms, brute force %.3f ms, %u entries, %.1f lights per cluster, at most %u\n",
+			count, ms, scalarMs, (UINT)builder.lightIndices.size(), (double)builder.lightIndices.size() / LightClusterBuilder::clusterCount, busiest);
+	}
+}
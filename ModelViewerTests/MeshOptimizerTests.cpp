@@ -0,0 +1,106 @@
+#include "Test.h"
+#include "MeshOptimizer.h"
+#include <chrono>
+#include <random>
+#include <array>
+
+// Regular grid of size x size quads with its triangles shuffled, so that the vertex cache starts out cold.
+static void ShuffledGrid(UINT size, std::vector<Vertex>& vertices, std::vector<UINT32>& indices, std::vector<MeshRange>& ranges)
+{
+	for(UINT y = 0; y <= size; ++y)
+		for(UINT x = 0; x <= size; ++x)
+		{
+			Vertex vertex = {};
+			vertex.position = {(float)x, (float)y, 0};
+			vertex.normal = {0, 0, 1};
+			vertices.push_back(vertex);
+		}
+	std::vector<std::array<UINT32, 3>> triangles;
+	for(UINT y = 0; y < size; ++y)
+		for(UINT x = 0; x < size; ++x)
+		{
+			UINT32 v = y * (size + 1) + x;
+			triangles.push_back({v, v + 1, v + size + 1});
+			triangles.push_back({v + size + 1, v + 1, v + size + 2});
+		}
+	std::shuffle(triangles.begin(), triangles.end(), std::mt19937(7));
+	for(auto& triangle : triangles) indices.insert(indices.end(), triangle.begin(), triangle.end());
+	ranges.push_back({0, (UINT)vertices.size(), 0, (UINT)indices.size(), 0, 0, 3, 0});
+}
+
+// Triangles as grid coordinates, each rotated to start at its smallest corner so that winding is kept.
+static std::vector<std::array<UINT, 3>> CanonicalTriangles(const std::vector<Vertex>& vertices, const std::vector<UINT32>& indices, UINT size)
+{
+	std::vector<std::array<UINT, 3>> triangles;
+	for(size_t i = 0; i < indices.size(); i += 3)
+	{
+		std::array<UINT, 3> triangle;
+		for(int k = 0; k < 3; ++k)
+		{
+			const XMFLOAT3& p = vertices[indices[i + k]].position;
+			triangle[k] = (UINT)p.y * (size + 1) + (UINT)p.x;
+		}
+		std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+		triangles.push_back(triangle);
+	}
+	std::sort(triangles.begin(), triangles.end());
+	return triangles;
+}
+
+TEST(OptimizeSplitsLargeMeshIntoBlocks)
+{
+	const UINT size = 300;
+	std::vector<Vertex> vertices;
+	std::vector<UINT32> indices;
+	std::vector<MeshRange> ranges;
+	ShuffledGrid(size, vertices, indices, ranges);
+	CHECK(indices.size() / 3 > 2 * MeshOptimizer::blockTriangles);
+	std::vector<std::array<UINT, 3>> expected = CanonicalTriangles(vertices, indices, size);
+
+	std::vector<CacheStats> before, after;
+	MeshOptimizer::Optimize(vertices, indices, ranges, true, before, after);
+	CHECK(CanonicalTriangles(vertices, indices, size) == expected);
+	if(!CHECK(before.size() == 1 && after.size() == 1)) return;
+	CHECK(before[0].triangles == size * size * 2 && after[0].triangles == before[0].triangles);
+	CHECK(after[0].Acmr() < 0.8f && after[0].Acmr() < before[0].Acmr() / 2);
+
+	// Renumbering by first use: every index is at most one past the largest before it.
+	UINT32 next = 0;
+	bool firstUse = true;
+	for(UINT32 index : indices)
+	{
+		firstUse &= index <= next;
+		if(index == next) ++next;
+	}
+	CHECK(firstUse);
+}
+
+TEST(MeshSpreadIgnoresMeshesWithoutTriangles)
+{
+	std::vector<CacheStats> stats(12);
+	for(UINT i = 0; i < 10; ++i)
+	{
+		stats[i].triangles = 10;
+		stats[i].misses = 10 + i;
+	}
+	MeshOptimizer::Spread spread = MeshOptimizer::MeshSpread(stats, &CacheStats::Acmr);
+	CHECK(spread.lowest == 1.0f && spread.highest == 1.9f);
+	CHECK(spread.median == 1.5f && spread.p90 == 1.9f);
+}
+
+BENCHMARK(OptimizeOneLargeMesh)
+{
+	const UINT size = 1000;
+	std::vector<Vertex> vertices;
+	std::vector<UINT32> indices;
+	std::vector<MeshRange> ranges;
+	ShuffledGrid(size, vertices, indices, ranges);
+
+	std::vector<CacheStats> before, after;
+	auto start = std::chrono::high_resolution_clock::now();
+	MeshOptimizer::Optimize(vertices, indices, ranges, true, before, after);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	printf("optimized %u triangles in one mesh in %.1f ms, %.2f M triangles/s, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+		before[0].triangles, ms, before[0].triangles / ms / 1000, before[0].Acmr(), after[0].Acmr(), before[0].Atvr(), after[0].Atvr());
+	CHECK(after[0].Acmr() < before[0].Acmr());
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include <string>
+#include <fstream>
+#include <filesystem>
+
+// Model files generated for the reader tests and benchmarks: a size x size grid of quads in the xy plane
+// at z = 0.5 with normals along +z, in each of the formats the native readers cover.
+class ModelFiles
+{
+public:
+	static std::string Path(const char* name)
+	{
+		std::error_code error;
+		std::filesystem::path directory = std::filesystem::temp_directory_path(error) / "ModelViewerTests";
+		std::filesystem::create_directories(directory, error);
+		return (directory / name).string();
+	}
+
+	static std::string Write(const char* name, const std::string& data)
+	{
+		std::string path = Path(name);
+		std::ofstream(path, std::ios::binary | std::ios::trunc).write(data.data(), data.size());
+		return path;
+	}
+
+	static void Remove(const std::string& path)
+	{
+		std::error_code error;
+		std::filesystem::remove(path, error);
+	}
+
+	template<class T>
+	static void Put(std::string& data, const T& value)
+	{
+		data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	// Quads a, b, d, c counterclockwise, with vn records if normals is set.
+	static std::string Obj(UINT size, bool normals)
+	{
+		std::string data;
+		char line[128];
+		for(UINT y = 0; y <= size; ++y)
+			for(UINT x = 0; x <= size; ++x)
+			{
+				data.append(line, snprintf(line, sizeof(line), "v %g %g 0.5\n", x * 0.01, y * 0.01));
+				if(normals) data += "vn 0 0 1\n";
+			}
+		for(UINT y = 0; y < size; ++y)
+			for(UINT x = 0; x < size; ++x)
+			{
+				UINT a = y * (size + 1) + x + 1, b = a + 1, c = a + size + 1, d = c + 1;
+				if(normals) data.append(line, snprintf(line, sizeof(line), "f %u//%u %u//%u %u//%u %u//%u\n", a, a, b, b, d, d, c, c));
+				else data.append(line, snprintf(line, sizeof(line), "f %u %u %u %u\n", a, b, d, c));
+			}
+		return data;
+	}
+
+	// Two triangles per quad, every corner written out as binary STL does.
+	static std::string BinaryStl(UINT size)
+	{
+		std::string data(80, ' ');
+		Put(data, (UINT32)(size * size * 2));
+		auto corner = [&](UINT x, UINT y)
+		{
+			float position[3] = {x * 0.01f, y * 0.01f, 0.5f};
+			data.append(reinterpret_cast<const char*>(position), sizeof(position));
+		};
+		const float normal[3] = {0, 0, 1};
+		for(UINT y = 0; y < size; ++y)
+			for(UINT x = 0; x < size; ++x)
+			{
+				Put(data, normal);
+				corner(x, y);
+				corner(x + 1, y);
+				corner(x + 1, y + 1);
+				Put(data, (UINT16)0);
+				Put(data, normal);
+				corner(x, y);
+				corner(x + 1, y + 1);
+				corner(x, y + 1);
+				Put(data, (UINT16)0);
+			}
+		return data;
+	}
+
+	// Float position and normal, uchar colour, then an element the reader has to skip before the quads.
+	static std::string BinaryPly(UINT size)
+	{
+		UINT vertexCount = (size + 1) * (size + 1);
+		std::string data = "ply\r\nformat binary_little_endian 1.0\r\nelement vertex " + std::to_string(vertexCount) +
+			"\r\nproperty float x\r\nproperty float y\r\nproperty float z\r\nproperty float nx\r\nproperty float ny\r\nproperty float nz\r\n"
+			"property uchar red\r\nproperty uchar green\r\nproperty uchar blue\r\nelement junk 2\r\nproperty list uchar int stuff\r\n"
+			"element face " + std::to_string(size * size) + "\r\nproperty list uchar int vertex_indices\r\nend_header\r\n";
+		for(UINT y = 0; y <= size; ++y)
+			for(UINT x = 0; x <= size; ++x)
+			{
+				float values[6] = {x * 0.01f, y * 0.01f, 0.5f, 0, 0, 1};
+				Put(data, values);
+				BYTE color[3] = {255, (BYTE)x, 0};
+				Put(data, color);
+			}
+		for(int junk = 0; junk < 2; ++junk)
+		{
+			Put(data, (BYTE)1);
+			Put(data, (int)7);
+		}
+		for(UINT y = 0; y < size; ++y)
+			for(UINT x = 0; x < size; ++x)
+			{
+				int a = y * (size + 1) + x;
+				int quad[4] = {a, a + 1, a + (int)size + 2, a + (int)size + 1};
+				Put(data, (BYTE)4);
+				Put(data, quad);
+			}
+		return data;
+	}
+
+	// One mesh with float positions and normals and 32-bit indices in a single binary chunk.
+	static std::string Glb(UINT size)
+	{
+		UINT vertexCount = (size + 1) * (size + 1), indexCount = size * size * 6;
+		std::string binary;
+		for(UINT y = 0; y <= size; ++y)
+			for(UINT x = 0; x <= size; ++x)
+			{
+				float position[3] = {x * 0.01f, y * 0.01f, 0.5f};
+				Put(binary, position);
+			}
+		const float normal[3] = {0, 0, 1};
+		for(UINT v = 0; v < vertexCount; ++v) Put(binary, normal);
+		for(UINT y = 0; y < size; ++y)
+			for(UINT x = 0; x < size; ++x)
+			{
+				UINT32 a = y * (size + 1) + x;
+				UINT32 triangles[6] = {a, a + 1, a + size + 2, a, a + size + 2, a + size + 1};
+				Put(binary, triangles);
+			}
+
+		char json[2048];
+		snprintf(json, sizeof(json),
+			R"({"asset":{"version":"2.0"},"scene":0,"scenes":[{"nodes":[0]}],"nodes":[{"mesh":0}],)"
+			R"("meshes":[{"primitives":[{"attributes":{"POSITION":0,"NORMAL":1},"indices":2}]}],"buffers":[{"byteLength":%u}],)"
+			R"("bufferViews":[{"buffer":0,"byteOffset":0,"byteLength":%u},{"buffer":0,"byteOffset":%u,"byteLength":%u},)"
+			R"({"buffer":0,"byteOffset":%u,"byteLength":%u}],"accessors":[{"bufferView":0,"componentType":5126,"count":%u,"type":"VEC3"},)"
+			R"({"bufferView":1,"componentType":5126,"count":%u,"type":"VEC3"},{"bufferView":2,"componentType":5125,"count":%u,"type":"SCALAR"}]})",
+			(UINT)binary.size(), vertexCount * 12, vertexCount * 12, vertexCount * 12, vertexCount * 24, indexCount * 4, vertexCount, vertexCount, indexCount);
+		std::string text = json;
+		while(text.size() % 4) text += ' ';
+
+		std::string data;
+		Put(data, (UINT32)0x46546c67);
+		Put(data, (UINT32)2);
+		Put(data, (UINT32)(12 + 8 + text.size() + 8 + binary.size()));
+		Put(data, (UINT32)text.size());
+		Put(data, (UINT32)0x4e4f534a);
+		data += text;
+		Put(data, (UINT32)binary.size());
+		Put(data, (UINT32)0x004e4942);
+		data += binary;
+		return data;
+	}
+};
@@ -0,0 +1,156 @@
+#include "Test.h"
+#include "OcclusionCuller.h"
+#include "TestScenes.h"
+
+// A closed cube of subdivided faces around the origin.
+static OccluderMesh Cube(float half, int divisions)
+{
+	OccluderMesh cube;
+	for(int face = 0; face < 6; ++face)
+	{
+		int axis = face / 2;
+		float side = face % 2 ? half : -half;
+		UINT base = cube.positions.size();
+		for(int j = 0; j <= divisions; ++j)
+			for(int i = 0; i <= divisions; ++i)
+			{
+				float p[3];
+				p[axis] = side;
+				p[(axis + 1) % 3] = -half + 2 * half * i / divisions;
+				p[(axis + 2) % 3] = -half + 2 * half * j / divisions;
+				cube.positions.push_back({p[0], p[1], p[2]});
+			}
+		for(int j = 0; j < divisions; ++j)
+			for(int i = 0; i < divisions; ++i)
+			{
+				UINT a = base + j * (divisions + 1) + i, b = a + 1, c = a + divisions + 1, d = c + 1;
+				for(UINT index : {a, b, d, a, d, c}) cube.indices.push_back(index);
+			}
+	}
+	return cube;
+}
+
+static XMMATRIX FrontView()
+{
+	return TestScenes::ViewProjection(XMVectorSet(0, 0, -600, 1), XMVectorZero(), (float)OcclusionCuller::width / OcclusionCuller::height, 1, 2000);
+}
+
+// Pixel x, y and depth z straight to the buffer: x in [0, width], y in [0, height] from the top, z in [0, 1].
+static XMMATRIX PixelView()
+{
+	return XMMatrixOrthographicOffCenterLH(0, (float)OcclusionCuller::width, (float)OcclusionCuller::height, 0, 0, 1);
+}
+
+static void AddQuad(OccluderMesh& mesh, float left, float top, float right, float bottom, float z)
+{
+	UINT base = mesh.positions.size();
+	mesh.positions.insert(mesh.positions.end(), {{left, top, z}, {right, top, z}, {right, bottom, z}, {left, bottom, z}});
+	for(UINT index : {0u, 1u, 2u, 0u, 2u, 3u}) mesh.indices.push_back(base + index);
+}
+
+static Bounds Box(XMFLOAT3 low, XMFLOAT3 high)
+{
+	Bounds bounds;
+	bounds.boxMin = low;
+	bounds.boxMax = high;
+	return bounds;
+}
+
+// Random boxes around the cube: none of those in front of it and in the frustum may be hidden, and none of
+// those inside may stay visible unless they come within a pixel or so of its outline, where the pixels are
+// only partly covered.
+static UINT WrongCubeResults(UINT count, UINT seed, UINT& inFrustum, UINT& visibleCount, OcclusionCuller::Stats* total, int repeats)
+{
+	const float half = 100;
+	OccluderMesh cube = Cube(half, 24);
+	std::vector<Bounds> placed = TestScenes::RandomBoxes(count, seed, 300, 1, 10);
+	BoxBounds boxes = TestScenes::Pack(placed);
+
+	XMMATRIX viewProjection = FrontView();
+	OcclusionCuller culler;
+	std::vector<BYTE> visible, frustum;
+	for(int r = 0; r < repeats; ++r)
+	{
+		inFrustum = FrustumCuller::Cull(boxes, viewProjection, visible);
+		culler.Render(cube, viewProjection);
+		visibleCount = culler.Test(boxes, viewProjection, visible);
+		if(!total) continue;
+		total->setupMs += culler.stats.setupMs / repeats;
+		total->rasterMs += culler.stats.rasterMs / repeats;
+		total->testMs += culler.stats.testMs / repeats;
+		total->triangles = culler.stats.triangles;
+		total->binned = culler.stats.binned;
+	}
+
+	FrustumCuller::Cull(boxes, viewProjection, frustum);
+	UINT wrong = 0;
+	for(UINT i = 0; i < count; ++i)
+	{
+		const Bounds& box = placed[i];
+		const float outline = half - 10;
+		bool inside = box.boxMin.x > -outline && box.boxMax.x < outline && box.boxMin.y > -outline && box.boxMax.y < outline &&
+			box.boxMin.z > -half && box.boxMax.z < half;
+		bool inFront = box.boxMax.z < -half;
+		wrong += (inside && visible[i]) || (inFront && frustum[i] && !visible[i]);
+	}
+	return wrong;
+}
+
+// The subdivided faces share their edges, so the cube has to come out of the raster without cracks.
+TEST(OcclusionCubeHidesWhatIsInside)
+{
+	UINT inFrustum = 0, visible = 0;
+	CHECK(WrongCubeResults(2000, 1, inFrustum, visible, nullptr, 1) == 0);
+	CHECK(visible < inFrustum);
+}
+
+// A quad ending 0.7 pixel into column 100 covers that pixel's center but not the whole pixel.
+TEST(OcclusionWritesOnlyFullyCoveredPixels)
+{
+	OccluderMesh quad;
+	AddQuad(quad, 10, 10, 100.7f, 100.3f, 0.5f);
+	OcclusionCuller culler;
+	culler.Render(quad, PixelView());
+	CHECK(fabsf(culler.Depth(50, 50) - 0.5f) < 1e-6f);
+	CHECK(fabsf(culler.Depth(10, 10) - 0.5f) < 1e-6f && fabsf(culler.Depth(99, 99) - 0.5f) < 1e-6f);
+	CHECK(culler.Depth(100, 50) == 1 && culler.Depth(50, 100) == 1 && culler.Depth(9, 50) == 1);
+
+	Bounds boxes[] = {
+		Box({50, 50, 0.8f}, {51, 51, 0.9f}),            // behind the quad
+		Box({50, 50, 0.1f}, {51, 51, 0.2f}),            // in front of it
+		Box({100.8f, 50, 0.8f}, {100.95f, 51, 0.9f}),   // behind, but past the edge inside the partly covered pixels
+		Box({99.2f, 50, 0.8f}, {99.9f, 51, 0.9f})};     // behind the fully covered pixel next to them
+	BoxBounds bounds;
+	bounds.Resize(4);
+	for(UINT i = 0; i < 4; ++i) bounds.Set(i, boxes[i]);
+	std::vector<BYTE> visible(4, 1);
+	CHECK(culler.Test(bounds, PixelView(), visible) == 2);
+	CHECK(!visible[0] && visible[1] && visible[2] && !visible[3]);
+}
+
+// Two triangles tilted in depth: every written pixel holds the farthest depth of its corners, at least the
+// plane's depth anywhere in the pixel.
+TEST(OcclusionKeepsTheFarthestDepthInAPixel)
+{
+	OccluderMesh slope;
+	slope.positions = {{20, 20, 0.2f}, {120, 20, 0.7f}, {120, 80, 0.7f}, {20, 80, 0.2f}};
+	slope.indices = {0, 1, 2, 0, 2, 3};
+	OcclusionCuller culler;
+	culler.Render(slope, PixelView());
+	bool farthest = true;
+	for(int x = 20; x < 120; ++x)
+		farthest = farthest && fabsf(culler.Depth(x, 50) - (0.2f + 0.005f * (x + 1 - 20))) < 1e-5f;
+	CHECK(farthest);
+	CHECK(culler.Depth(120, 50) == 1);
+}
+
+BENCHMARK(OcclusionCullingHundredThousandBoxes)
+{
+	const UINT count = 100000;
+	UINT inFrustum = 0, visible = 0;
+	OcclusionCuller::Stats total;
+	CHECK(WrongCubeResults(count, 1, inFrustum, visible, &total, 20) == 0);
+	printf("occlusion culling of %u boxes, %u in the frustum, %u visible behind %u triangles in %u tile entries: "
+		"setup %.3f ms, raster %.3f ms, test %.3f ms\n",
+		count, inFrustum, visible, total.triangles, total.binned, total.setupMs, total.rasterMs, total.testMs);
+}
@@ -0,0 +1,70 @@
+#include "Test.h"
+#include "PackedVertex.h"
+#include <random>
+
+// Meshes far from the origin with a small extent, where the rounding of the float arithmetic is largest
+// next to the step, with vertices on the box corners and in between.
+static void RoundTripMeshes(std::vector<Vertex>& vertices, std::vector<MeshRange>& ranges, std::vector<Bounds>& meshBounds)
+{
+	std::mt19937 random(11);
+	std::uniform_real_distribution<float> unit(0, 1);
+	const float offsets[] = {0.0f, 1.0f, -37.5f, 1000.0f, -65000.0f, 3.0e6f};
+	const float extents[] = {1e-3f, 0.1f, 1.0f, 250.0f, 1e5f};
+	for(float offset : offsets)
+		for(float extent : extents)
+		{
+			MeshRange range = {};
+			range.baseVertex = vertices.size();
+			range.vertexCount = 4096;
+			range.faceSize = 3;
+			Bounds bounds;
+			for(UINT v = 0; v < range.vertexCount; ++v)
+			{
+				Vertex vertex = {};
+				float t[3];
+				for(int k = 0; k < 3; ++k) t[k] = v < 8 ? (float)(v >> k & 1) : unit(random);
+				vertex.position = {offset + t[0] * extent, offset - t[1] * extent * 0.5f, offset + t[2] * extent * 0.25f};
+				vertex.normal = {0, 0, 1};
+				vertices.push_back(vertex);
+				bounds.boxMin = {min(bounds.boxMin.x, vertex.position.x), min(bounds.boxMin.y, vertex.position.y), min(bounds.boxMin.z, vertex.position.z)};
+				bounds.boxMax = {max(bounds.boxMax.x, vertex.position.x), max(bounds.boxMax.y, vertex.position.y), max(bounds.boxMax.z, vertex.position.z)};
+			}
+			ranges.push_back(range);
+			meshBounds.push_back(bounds);
+		}
+}
+
+TEST(PackedPositionsStayWithinMaxPositionError)
+{
+	std::vector<Vertex> vertices;
+	std::vector<MeshRange> ranges;
+	std::vector<Bounds> meshBounds;
+	RoundTripMeshes(vertices, ranges, meshBounds);
+
+	std::vector<PackedVertex> packed;
+	std::vector<UINT32> colors;
+	std::vector<PackedMesh> meshes;
+	VertexPacker::Encode(vertices, ranges, meshBounds, packed, colors, meshes);
+	std::vector<Vertex> decoded;
+	VertexPacker::Decode(packed, colors, meshes, ranges, decoded);
+	if(!CHECK(decoded.size() == vertices.size())) return;
+
+	int outside = 0;
+	for(int i = 0; i < (int)ranges.size(); ++i)
+	{
+		double bound = meshes[i].MaxPositionError(), worst = 0;
+		for(UINT v = ranges[i].baseVertex; v < ranges[i].baseVertex + ranges[i].vertexCount; ++v)
+		{
+			double dx = (double)decoded[v].position.x - vertices[v].position.x;
+			double dy = (double)decoded[v].position.y - vertices[v].position.y;
+			double dz = (double)decoded[v].position.z - vertices[v].position.z;
+			worst = max(worst, sqrt(dx * dx + dy * dy + dz * dz));
+		}
+		if(worst > bound)
+		{
+			printf("mesh %d: error %g over the bound %g\n", i, worst, bound);
+			++outside;
+		}
+	}
+	CHECK(outside == 0);
+}
@@ -0,0 +1,212 @@
+#include "Test.h"
+#include "GltfReader.h"
+#include "ObjReader.h"
+#include "StlReader.h"
+#include "PlyReader.h"
+#include "ModelFiles.h"
+#include <chrono>
+#include <omp.h>
+
+// The native readers without Assimp, so these run on any platform; ImportTests compares them with Assimp.
+// --bench --threads 1 gives the single-core throughput.
+struct ReadResult
+{
+	std::vector<Vertex> vertices;
+	std::vector<UINT32> indices;
+	std::vector<MeshRange> ranges;
+	std::vector<InstanceTransform> instances;
+	std::vector<UINT> meshInstances;
+	UINT64 bytes = 0;
+	double ms = 0;
+};
+
+template<class Read>
+static bool TimeRead(ReadResult& result, Read read)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	bool ok = read();
+	result.ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	return ok;
+}
+
+static bool ReadNative(const std::string& path, ReadResult& result)
+{
+	return TimeRead(result, [&]
+	{
+		if(ObjReader::Handles(path)) return ObjReader::Read(path, result.vertices, result.indices, result.ranges, result.bytes, nullptr);
+		if(StlReader::Handles(path)) return StlReader::Read(path, result.vertices, result.indices, result.ranges, result.bytes, nullptr);
+		if(PlyReader::Handles(path)) return PlyReader::Read(path, result.vertices, result.indices, result.ranges, result.bytes, nullptr);
+		return GltfReader::Read(path, result.vertices, result.indices, result.ranges, result.instances, result.meshInstances, result.bytes, nullptr);
+	});
+}
+
+// Every reader turns the grid into one left-handed mesh: z and the normal flip, and so does the winding.
+static void CheckGrid(const ReadResult& result, UINT size)
+{
+	if(!CHECK(result.ranges.size() == 1 && result.indices.size() == (size_t)size * size * 6)) return;
+	CHECK(result.vertices.size() == (size_t)(size + 1) * (size + 1));
+	CHECK(result.indices[0] == 0 && result.indices[1] == size + 2 && result.indices[2] == 1);
+	CHECK(result.vertices[size + 2].position.x == 0.01f && result.vertices[size + 2].position.y == 0.01f);
+	CHECK(result.vertices[size + 2].position.z == -0.5f && result.vertices[size + 2].normal.z == -1);
+}
+
+static void ReportThroughput(const char* format, const ReadResult& result)
+{
+	printf("%s: %.1f MB, %u triangles in %.1f ms on %d threads, %.1f MB/s\n", format, result.bytes / 1048576.0,
+		(UINT)(result.indices.size() / 3), result.ms, omp_get_max_threads(), result.bytes / 1048576.0 / max(result.ms, 0.001) * 1000);
+}
+
+TEST(ObjReaderReadsNegativeIndicesAndColors)
+{
+	std::string path = ModelFiles::Write("quad.obj", "# quad\r\nv 0 0 0 1 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 +0\r\nvt 0 0\ng x\nf -4 -3 -2 -1\n");
+	ReadResult result;
+	if(!CHECK(ReadNative(path, result))) return;
+	CHECK(result.vertices.size() == 4 && result.indices.size() == 6 && result.ranges[0].hasColors);
+	CHECK(result.vertices[0].color.x == 1 && result.vertices[0].normal.z != 0);
+	ModelFiles::Remove(path);
+}
+
+TEST(ObjReaderLeavesUnsupportedFilesToAssimp)
+{
+	const char* files[] = {"v 0 0 0\nv 1 0 0\nl 1 2\n", "v 0 0 0\nv 1 0 0\nv 1 1 1\nf 1 2 4\n", "v 0 0 0\nv 1 0 0\nv 1 1 1\nf 1 2 x\n"};
+	for(const char* file : files)
+	{
+		std::string path = ModelFiles::Write("unsupported.obj", file);
+		ReadResult result;
+		CHECK(!ReadNative(path, result));
+		ModelFiles::Remove(path);
+	}
+}
+
+TEST(ReadersReadTheGrid)
+{
+	const UINT size = 40;
+	struct File { const char* name; std::string data; } files[] = {
+		{"grid.obj", ModelFiles::Obj(size, true)},
+		{"grid-computed-normals.obj", ModelFiles::Obj(size, false)},
+		{"grid.ply", ModelFiles::BinaryPly(size)},
+		{"grid.glb", ModelFiles::Glb(size)}};
+	for(auto& file : files)
+	{
+		std::string path = ModelFiles::Write(file.name, file.data);
+		ReadResult result;
+		if(CHECK(ReadNative(path, result))) CheckGrid(result, size);
+		ModelFiles::Remove(path);
+	}
+}
+
+// STL has no shared vertices; the weld numbers positions by first use, so the grid comes back in another order.
+TEST(StlReaderWeldsCorners)
+{
+	const UINT size = 40;
+	std::string path = ModelFiles::Write("grid.stl", ModelFiles::BinaryStl(size));
+	ReadResult result;
+	if(CHECK(ReadNative(path, result)))
+	{
+		CHECK(result.vertices.size() == (size_t)(size + 1) * (size + 1) && result.indices.size() == (size_t)size * size * 6);
+		CHECK(result.indices[0] == 0 && result.indices[1] == 1 && result.indices[2] == 2);
+	}
+	ModelFiles::Remove(path);
+
+	path = ModelFiles::Write("ascii.stl", "solid x\nendsolid x\n");
+	CHECK(!ReadNative(path, result));
+	ModelFiles::Remove(path);
+}
+
+TEST(PlyReaderReadsAsciiQuadsAndPoints)
+{
+	std::string path = ModelFiles::Write("quad.ply",
+		"ply\nformat ascii 1.0\ncomment x\nelement vertex 4\nproperty float x\nproperty float y\nproperty float z\n"
+		"property uchar red\nproperty uchar green\nproperty uchar blue\nelement face 1\nproperty list uchar int vertex_indices\n"
+		"end_header\n0 0 0 255 0 0\n1 0 0 0 0 0\n1 1 0 0 0 0\n0 1 0 0 0 0\n4 0 1 2 3\n");
+	ReadResult result;
+	if(CHECK(ReadNative(path, result))) CHECK(result.vertices.size() == 4 && result.indices.size() == 6 && result.ranges[0].hasColors && result.vertices[0].color.x == 1);
+	ModelFiles::Remove(path);
+
+	path = ModelFiles::Write("points.ply", "ply\nformat ascii 1.0\nelement vertex 2\nproperty double x\nproperty double y\nproperty double z\nend_header\n0 0 1\n1 2 3\n");
+	ReadResult points;
+	if(CHECK(ReadNative(path, points))) CHECK(points.ranges[0].faceSize == 1 && points.indices.size() == 2 && points.vertices[1].position.z == -3);
+	ModelFiles::Remove(path);
+
+	path = ModelFiles::Write("big-endian.ply", "ply\nformat binary_big_endian 1.0\nelement vertex 0\nend_header\n");
+	CHECK(!ReadNative(path, points));
+	ModelFiles::Remove(path);
+}
+
+// Every property type, out of order and interleaved with unused ones, so each column takes the typed path;
+// the ASCII file with the same records gives the expected floats.
+TEST(PlyReaderReadsMixedBinaryColumnsLikeAscii)
+{
+	const char* header = "element vertex 3\nproperty short nz\nproperty double x\nproperty uchar red\nproperty float unused\n"
+		"property int y\nproperty ushort green\nproperty char nx\nproperty float z\nproperty uint ny\nproperty float blue\nend_header\n";
+	std::string binary = std::string("ply\nformat binary_little_endian 1.0\n") + header, ascii = std::string("ply\nformat ascii 1.0\n") + header;
+	char line[256];
+	for(int v = 0; v < 3; ++v)
+	{
+		INT16 nz = (INT16)(v - 1);
+		double x = 0.1 * v + 1e-9;
+		BYTE red = (BYTE)(100 * v);
+		int y = -70000 * v;
+		UINT16 green = (UINT16)(30000 * v);
+		char nx = (char)(-v);
+		float z = 0.25f + v;
+		UINT32 ny = 4000000000u - v;
+		float blue = 0.5f * v;
+		ModelFiles::Put(binary, nz); ModelFiles::Put(binary, x); ModelFiles::Put(binary, red); ModelFiles::Put(binary, 9.0f);
+		ModelFiles::Put(binary, y); ModelFiles::Put(binary, green); ModelFiles::Put(binary, nx); ModelFiles::Put(binary, z);
+		ModelFiles::Put(binary, ny); ModelFiles::Put(binary, blue);
+		ascii.append(line, snprintf(line, sizeof(line), "%d %.17g %u 9 %d %u %d %.9g %u %.9g\n", nz, x, red, y, green, nx, z, ny, blue));
+	}
+	std::string binaryPath = ModelFiles::Write("mixed-binary.ply", binary), asciiPath = ModelFiles::Write("mixed-ascii.ply", ascii);
+	ReadResult fromBinary, fromAscii;
+	if(CHECK(ReadNative(binaryPath, fromBinary) && ReadNative(asciiPath, fromAscii)) && CHECK(fromBinary.vertices.size() == 3 && fromAscii.vertices.size() == 3))
+	{
+		CHECK(memcmp(fromBinary.vertices.data(), fromAscii.vertices.data(), 3 * sizeof(Vertex)) == 0);
+		const Vertex& last = fromBinary.vertices[2];
+		CHECK(last.position.x == (float)(0.2 + 1e-9) && last.position.y == -140000 && last.position.z == -2.25f);
+		CHECK(last.normal.x == -2 && last.normal.y == (float)(4000000000u - 2) && last.normal.z == -1);
+		CHECK(last.color.x == (float)(200 / 255.0) && last.color.y == (float)(60000 / 65535.0) && last.color.z == 1);
+	}
+	ModelFiles::Remove(binaryPath);
+	ModelFiles::Remove(asciiPath);
+}
+
+BENCHMARK(ReadLargeObj)
+{
+	const UINT size = 1200;
+	std::string path = ModelFiles::Write("large.obj", ModelFiles::Obj(size, true));
+	ReadResult result;
+	if(CHECK(ReadNative(path, result))) CheckGrid(result, size);
+	ReportThroughput("OBJ", result);
+	ModelFiles::Remove(path);
+}
+
+BENCHMARK(ReadLargeStl)
+{
+	const UINT size = 1000;
+	std::string path = ModelFiles::Write("large.stl", ModelFiles::BinaryStl(size));
+	ReadResult result;
+	CHECK(ReadNative(path, result) && result.vertices.size() == (size_t)(size + 1) * (size + 1));
+	ReportThroughput("binary STL", result);
+	ModelFiles::Remove(path);
+}
+
+BENCHMARK(ReadLargePly)
+{
+	const UINT size = 1000;
+	std::string path = ModelFiles::Write("large.ply", ModelFiles::BinaryPly(size));
+	ReadResult result;
+	if(CHECK(ReadNative(path, result))) CheckGrid(result, size);
+	ReportThroughput("binary PLY", result);
+	ModelFiles::Remove(path);
+}
+
+BENCHMARK(ReadLargeGlb)
+{
+	const UINT size = 1000;
+	std::string path = ModelFiles::Write("large.glb", ModelFiles::Glb(size));
+	ReadResult result;
+	if(CHECK(ReadNative(path, result))) CheckGrid(result, size);
+	ReportThroughput("GLB", result);
+	ModelFiles::Remove(path);
+}
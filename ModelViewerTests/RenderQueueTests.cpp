@@ -0,0 +1,109 @@
+#include "Test.h"
+#include "RenderQueue.h"
+#include "TestScenes.h"
+#include <chrono>
+
+// count packets over a few passes, pipelines and materials, with commands in the order they were added.
+static std::vector<RenderPacket> RandomPackets(unsigned int count, unsigned int seed)
+{
+	std::uniform_int_distribution<unsigned int> pass(0, 2), pso(0, 15), material(0, 1023);
+	std::uniform_real_distribution<float> depth(0, 10000);
+	return TestScenes::Random<RenderPacket>(count, seed, [&](std::mt19937& random, UINT i) {
+		unsigned int p = pass(random), s = pso(random), m = material(random);
+		return RenderPacket{RenderQueue::MakeKey(p, s, m, depth(random)), i};
+	});
+}
+
+static std::vector<RenderPacket> StableSorted(std::vector<RenderPacket> packets)
+{
+	std::stable_sort(packets.begin(), packets.end(), [](const RenderPacket& a, const RenderPacket& b) { return a.key < b.key; });
+	return packets;
+}
+
+static bool SameOrder(const std::vector<RenderPacket>& a, const std::vector<RenderPacket>& b)
+{
+	bool same = a.size() == b.size();
+	for(size_t i = 0; same && i < a.size(); ++i) same = a[i].key == b[i].key && a[i].command == b[i].command;
+	return same;
+}
+
+static void Fill(RenderQueue& queue, const std::vector<RenderPacket>& packets)
+{
+	queue.Clear();
+	for(const RenderPacket& packet : packets) queue.Add(packet.key, packet.command);
+}
+
+TEST(RenderQueueKeysOrderPassPipelineMaterialDepth)
+{
+	RenderQueue::Key key = RenderQueue::MakeKey(2, 7, 1000, 3.5f);
+	CHECK(RenderQueue::Pass(key) == 2 && RenderQueue::Pso(key) == 7 && RenderQueue::Material(key) == 1000);
+	CHECK(RenderQueue::MakeKey(0, 15, 1023, 9999) < RenderQueue::MakeKey(1, 0, 0, 0));
+	CHECK(RenderQueue::MakeKey(1, 2, 1023, 9999) < RenderQueue::MakeKey(1, 3, 0, 0));
+	CHECK(RenderQueue::MakeKey(1, 2, 3, 9999) < RenderQueue::MakeKey(1, 2, 4, 0));
+	CHECK(RenderQueue::MakeKey(1, 2, 3, 0.5f) < RenderQueue::MakeKey(1, 2, 3, 1.5f));
+	CHECK(RenderQueue::MakeKey(1, 2, 3, -4) == RenderQueue::MakeKey(1, 2, 3, 0));
+}
+
+// Equal keys keep the order they were added in, however many chunks the sort splits the packets into:
+// the counts straddle minChunk and the thread counts leave a short last chunk.
+TEST(RenderQueueSortIsStableForAnyThreadCount)
+{
+	int threads = omp_get_max_threads();
+	RenderQueue queue;
+	bool stable = true;
+	for(unsigned int count : {0u, 1u, 2u, 1000u, 16383u, 16385u, 100003u})
+	{
+		// Few distinct keys, so most packets tie with others.
+		std::vector<RenderPacket> packets = RandomPackets(count, count);
+		for(RenderPacket& packet : packets) packet.key &= ~0xFFFFFFFFull;
+		std::vector<RenderPacket> expected = StableSorted(packets);
+		for(int t : {1, 3, 8})
+		{
+			omp_set_num_threads(t);
+			Fill(queue, packets);
+			queue.Sort();
+			stable = stable && SameOrder(queue.Packets(), expected);
+		}
+	}
+	omp_set_num_threads(threads);
+	CHECK(stable);
+}
+
+TEST(RenderQueueSortMatchesStableSort)
+{
+	RenderQueue queue;
+	for(unsigned int count : {7u, 5000u, 200001u})
+	{
+		std::vector<RenderPacket> packets = RandomPackets(count, 1);
+		Fill(queue, packets);
+		queue.Sort();
+		CHECK(SameOrder(queue.Packets(), StableSorted(packets)));
+	}
+}
+
+BENCHMARK(RenderQueueSortMillionPackets)
+{
+	const unsigned int count = 1 << 20;
+	std::vector<RenderPacket> source = RandomPackets(count, 1);
+	const int repeats = 10;
+	RenderQueue queue;
+	double radixMs = 0, stdMs = 0;
+	std::vector<RenderPacket> sorted;
+	for(int r = 0; r < repeats; ++r)
+	{
+		Fill(queue, source);
+		auto start = std::chrono::high_resolution_clock::now();
+		queue.Sort();
+		radixMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / repeats;
+
+		start = std::chrono::high_resolution_clock::now();
+		sorted = StableSorted(source);
+		stdMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / repeats;
+	}
+	CHECK(SameOrder(queue.Packets(), sorted));
+
+	unsigned int changes = 0;
+	for(unsigned int i = 1; i < count; ++i) changes += RenderQueue::Pso(queue.Packets()[i].key) != RenderQueue::Pso(queue.Packets()[i - 1].key);
+	printf("render queue sort of %u packets on %d threads: radix %.3f ms, std::stable_sort %.3f ms, %u pipeline changes\n",
+		count, omp_get_max_threads(), radixMs, stdMs, changes);
+}
@@ -0,0 +1,101 @@
+#include "Test.h"
+#include "Simplifier.h"
+#include <chrono>
+#include <omp.h>
+
+// Wavy height field of size x size quads, so that every collapse has a cost.
+static void WavyGrid(UINT size, std::vector<Vertex>& vertices, std::vector<UINT32>& indices, std::vector<MeshRange>& ranges)
+{
+	for(UINT y = 0; y <= size; ++y)
+		for(UINT x = 0; x <= size; ++x)
+		{
+			Vertex vertex = {};
+			vertex.position = {(float)x, (float)y, 4 * sinf(x * 0.05f) * cosf(y * 0.07f)};
+			vertex.normal = {0, 0, 1};
+			vertex.color = {1, 1, 1};
+			vertices.push_back(vertex);
+		}
+	for(UINT y = 0; y < size; ++y)
+		for(UINT x = 0; x < size; ++x)
+		{
+			UINT32 v = y * (size + 1) + x;
+			for(UINT32 index : {v, v + 1, v + size + 1, v + size + 1, v + 1, v + size + 2}) indices.push_back(index);
+		}
+	ranges.push_back({0, (UINT)vertices.size(), 0, (UINT)indices.size(), 0, 0, 3, 0});
+}
+
+struct Lods
+{
+	std::vector<UINT32> lodIndices;
+	std::vector<MeshLod> lods;
+	std::vector<UINT> meshLods;
+};
+
+static Lods BuildWithThreads(int threads, const std::vector<Vertex>& vertices, const std::vector<UINT32>& indices, const std::vector<MeshRange>& ranges)
+{
+	int previous = omp_get_max_threads();
+	omp_set_num_threads(threads);
+	Lods result;
+	Simplifier::BuildLods(vertices, indices, ranges, result.lodIndices, result.lods, result.meshLods);
+	omp_set_num_threads(previous);
+	return result;
+}
+
+TEST(SimplifierLevelsShrinkByTheRatio)
+{
+	std::vector<Vertex> vertices;
+	std::vector<UINT32> indices;
+	std::vector<MeshRange> ranges;
+	WavyGrid(120, vertices, indices, ranges);
+	Lods result = BuildWithThreads(omp_get_max_threads(), vertices, indices, ranges);
+	if(!CHECK(result.meshLods.size() == 2 && result.meshLods[1] >= 2)) return;
+
+	UINT previous = indices.size() / 3;
+	float error = 0;
+	for(const MeshLod& lod : result.lods)
+	{
+		UINT triangles = lod.indexCount / 3;
+		CHECK(triangles <= previous * Simplifier::levelRatio * 1.1f && triangles > 0);
+		CHECK(lod.error >= error);
+		UINT outOfRange = 0;
+		for(UINT k = 0; k < lod.indexCount; ++k) outOfRange += result.lodIndices[lod.firstIndex + k] >= vertices.size();
+		CHECK(outOfRange == 0);
+		previous = triangles;
+		error = lod.error;
+	}
+}
+
+// A mesh above parallelTriangles runs its rounds over the threads; the levels have to come out the same.
+TEST(SimplifierIsIndependentOfThreadCount)
+{
+	std::vector<Vertex> vertices;
+	std::vector<UINT32> indices;
+	std::vector<MeshRange> ranges;
+	WavyGrid(200, vertices, indices, ranges);
+	CHECK(indices.size() / 3 >= Simplifier::parallelTriangles);
+
+	Lods serial = BuildWithThreads(1, vertices, indices, ranges);
+	Lods parallel = BuildWithThreads(4, vertices, indices, ranges);
+	CHECK(serial.lodIndices == parallel.lodIndices);
+	CHECK(serial.meshLods == parallel.meshLods);
+	CHECK(serial.lods.size() == parallel.lods.size() &&
+		memcmp(serial.lods.data(), parallel.lods.data(), serial.lods.size() * sizeof(MeshLod)) == 0);
+}
+
+BENCHMARK(SimplifyOneLargeMesh)
+{
+	std::vector<Vertex> vertices;
+	std::vector<UINT32> indices;
+	std::vector<MeshRange> ranges;
+	WavyGrid(1000, vertices, indices, ranges);
+
+	Lods result;
+	auto start = std::chrono::high_resolution_clock::now();
+	Simplifier::BuildLods(vertices, indices, ranges, result.lodIndices, result.lods, result.meshLods);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	printf("LODs of %u triangles in one mesh on %d threads in %.1f ms, %.2f M triangles/s:", (UINT)(indices.size() / 3),
+		omp_get_max_threads(), ms, indices.size() / 3 / ms / 1000);
+	for(const MeshLod& lod : result.lods) printf(" %u", lod.indexCount / 3);
+	printf("\n");
+	CHECK(result.lods.size() >= 3);
+}
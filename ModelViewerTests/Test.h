@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdio>
+
+// Headless cases for the CPU side of the viewer. Tests assert with CHECK and keep going after a failed
+// check; benchmarks print their timings and CHECK the results they time. Cases register themselves
+// before main runs, in the order of their translation unit.
+struct TestCase
+{
+	const char* name;
+	void (*run)();
+	bool benchmark;
+};
+
+inline std::vector<TestCase>& TestCases()
+{
+	static std::vector<TestCase> cases;
+	return cases;
+}
+
+inline int& FailedChecks()
+{
+	static int failed = 0;
+	return failed;
+}
+
+struct TestRegistration
+{
+	TestRegistration(const char* name, void (*run)(), bool benchmark)
+	{
+		TestCases().push_back({name, run, benchmark});
+	}
+};
+
+inline bool Check(bool condition, const char* expression, const char* file, int line)
+{
+	if(condition) return true;
+	printf("%s(%d): check failed: %s\n", file, line, expression);
+	++FailedChecks();
+	return false;
+}
+
+#define TEST(name) \
+	static void name(); \
+	static TestRegistration name##Registration(#name, name, false); \
+	static void name()
+
+#define BENCHMARK(name) \
+	static void name(); \
+	static TestRegistration name##Registration(#name, name, true); \
+	static void name()
+
+#define CHECK(condition) Check((condition), #condition, __FILE__, __LINE__)
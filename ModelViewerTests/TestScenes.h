@@ -0,0 +1,90 @@
+#pragma once
+
+#include "DirectX-std.h"
+#include "Bounds.h"
+#include "FrustumCuller.h"
+#include <random>
+#include <vector>
+
+// Cameras and random scenes for the culling, light and render queue tests. Every fixture draws from its own
+// seeded generator, so a failing check fails the same way on every run.
+class TestScenes
+{
+public:
+	static constexpr float fovY = 0.25f * XM_PI;
+	// Not a multiple of four or eight, so every SIMD path ends on a partial group.
+	static constexpr UINT oddCount = 1003;
+
+	static XMMATRIX View(FXMVECTOR eye, FXMVECTOR target)
+	{
+		return XMMatrixLookAtLH(eye, target, XMVectorSet(0, 1, 0, 0));
+	}
+
+	static XMMATRIX ViewProjection(FXMVECTOR eye, FXMVECTOR target, float aspect, float nearZ, float farZ)
+	{
+		return View(eye, target) * XMMatrixPerspectiveFovLH(fovY, aspect, nearZ, farZ);
+	}
+
+	// count items, item i made by make(random, i), all from one generator seeded with seed.
+	template<class T, class Make>
+	static std::vector<T> Random(UINT count, UINT seed, Make make)
+	{
+		std::mt19937 random(seed);
+		std::vector<T> items(count);
+		for(UINT i = 0; i < count; ++i) items[i] = make(random, i);
+		return items;
+	}
+
+	// A point in the cube of side 2 * extent around the origin.
+	static XMFLOAT3 RandomPoint(std::mt19937& random, float extent)
+	{
+		std::uniform_real_distribution<float> position(-extent, extent);
+		float x = position(random), y = position(random), z = position(random);
+		return {x, y, z};
+	}
+
+	static XMFLOAT3 RandomDirection(std::mt19937& random)
+	{
+		XMFLOAT3 point = RandomPoint(random, 1), direction;
+		XMStoreFloat3(&direction, XMVector3Normalize(XMLoadFloat3(&point) + XMVectorSet(0, 0, 1e-3f, 0)));
+		return direction;
+	}
+
+	// Boxes with their low corner within extent of the origin and sides of minSide to maxSide; with
+	// emptyEvery, every emptyEvery-th box is left empty.
+	static std::vector<Bounds> RandomBoxes(UINT count, UINT seed, float extent, float minSide, float maxSide, UINT emptyEvery = 0)
+	{
+		std::uniform_real_distribution<float> side(minSide, maxSide);
+		return Random<Bounds>(count, seed, [&](std::mt19937& random, UINT i) {
+			Bounds bounds;
+			if(emptyEvery && i % emptyEvery == emptyEvery - 1) return bounds;
+			bounds.boxMin = RandomPoint(random, extent);
+			float x = side(random), y = side(random), z = side(random);
+			bounds.boxMax = {bounds.boxMin.x + x, bounds.boxMin.y + y, bounds.boxMin.z + z};
+			return bounds;
+		});
+	}
+
+	static BoxBounds Pack(const std::vector<Bounds>& boxes)
+	{
+		BoxBounds packed;
+		packed.Resize(boxes.size());
+		for(UINT i = 0; i < boxes.size(); ++i) packed.Set(i, boxes[i]);
+		return packed;
+	}
+
+	// How many of count random cameras fail agree(eye, target), with the eye within eyeExtent of the origin
+	// and the target within targetExtent.
+	template<class Agree>
+	static int CameraMismatches(UINT seed, int count, float eyeExtent, float targetExtent, Agree agree)
+	{
+		std::mt19937 random(seed);
+		int mismatches = 0;
+		for(int camera = 0; camera < count; ++camera)
+		{
+			XMFLOAT3 eye = RandomPoint(random, eyeExtent), target = RandomPoint(random, targetExtent);
+			mismatches += !agree(XMLoadFloat3(&eye), XMLoadFloat3(&target));
+		}
+		return mismatches;
+	}
+};
@@ -0,0 +1,38 @@
+#include "Test.h"
+#include <omp.h>
+#include <cstdlib>
+
+// Runs every test, or every benchmark with --bench. --threads n caps OpenMP at n threads, so that
+// --bench --threads 1 gives single-core numbers. Any other argument picks the cases whose name contains it.
+// Model files are opened relative to the working directory, which should be the ModelViewer folder.
+int main(int argc, char** argv)
+{
+	bool benchmarks = false;
+	std::vector<std::string> filters;
+	for(int i = 1; i < argc; ++i)
+	{
+		std::string argument = argv[i];
+		if(argument == "--bench") benchmarks = true;
+		else if(argument == "--threads" && i + 1 < argc) omp_set_num_threads(atoi(argv[++i]));
+		else filters.push_back(argument);
+	}
+
+	int run = 0, failed = 0;
+	for(const TestCase& test : TestCases())
+	{
+		if(test.benchmark != benchmarks) continue;
+		bool selected = filters.empty();
+		for(auto& filter : filters) selected |= std::string(test.name).find(filter) != std::string::npos;
+		if(!selected) continue;
+
+		printf("[ RUN  ] %s\n", test.name);
+		int before = FailedChecks();
+		test.run();
+		bool passed = FailedChecks() == before;
+		printf("[ %s ] %s\n", passed ? " OK " : "FAIL", test.name);
+		++run;
+		failed += !passed;
+	}
+	printf("%d of %d %s passed\n", run - failed, run, benchmarks ? "benchmarks" : "tests");
+	return failed == 0 ? 0 : 1;
+}